@@ -28,6 +28,7 @@ void CommandArgsParser::defineAll() {
     define('r', "root", "Root directory, where all config files are stored", std::filesystem::absolute(root).string());
     define('x', "temp", "Temp directory, where all temporary files are stored", tempPath);
     define('s', "server", "Run in server mode");
+    define('\0', "max-clients", "Server mode maximum number of clients", 8);
     define('\0', "password", "Protect server mode protocol with password", std::string(""));
     define('\0', "autostart", "Automatically start the SDR after loading");
     define('\0', "http", "HTTP debug server port (0 to disable)", 8080);
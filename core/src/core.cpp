@@ -18,6 +18,7 @@
 #include <cstdlib>
 #include <gui/menus/display.h>
 #include <http_debug_server.h>
+#include <utils/arrays.h>
 #include <thread>
 #include <mutex>
 #include <unordered_map>
@@ -559,6 +560,7 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["fftRate"] = 20;
     defConfig["fftSize"] = 65536;
     defConfig["fftWindow"] = 2;
+    defConfig["fftPlanRigor"] = "measure";
     defConfig["frequency"] = 100000000.0;
     defConfig["fullWaterfallUpdate"] = false;
     defConfig["zoomBw"] = 1.0;
@@ -730,6 +732,12 @@ int sdrpp_main(int argc, char* argv[]) {
     defConfig["decimation"] = 1;
     defConfig["iqCorrection"] = false;
     defConfig["invertIQ"] = false;
+    defConfig["channelizer"] = false;
+    defConfig["dspThreadPool"] = false;
+    defConfig["iqHistory"] = false;
+    defConfig["iqHistorySeconds"] = 60;
+    defConfig["iqHistoryInt16"] = true;
+    defConfig["efftWorkerThread"] = false;
     defConfig["operatorCallsign"] = "";
     defConfig["operatorLocation"] = "KO80";
 
@@ -837,6 +845,13 @@ int sdrpp_main(int argc, char* argv[]) {
     // Load UI scaling
     style::uiScale = core::configManager.conf["uiScale"];
 
+    // FFT plans: reuse wisdom from earlier runs, measure new sizes in the background
+    std::string fftPlanRigor = core::configManager.conf["fftPlanRigor"];
+    dsp::arrays::FFTPlanRigor rigor = dsp::arrays::FFT_PLAN_MEASURE;
+    if (fftPlanRigor == "estimate") { rigor = dsp::arrays::FFT_PLAN_ESTIMATE; }
+    else if (fftPlanRigor == "patient") { rigor = dsp::arrays::FFT_PLAN_PATIENT; }
+    dsp::arrays::initFFTPlanCache(root + "/fftw_wisdom.dat", rigor);
+
     core::configManager.release(true);
 
     if (serverMode) { return server::main(); }
@@ -52,14 +52,21 @@ namespace dsp::bench {
             std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
             stop();
             buffer::free(randBuf);
+            outRate = (double)outSampCount * 1000.0 / (double)durationMs;
             return (double)sampCount * 1000.0 / (double)durationMs;
         }
 
+        // Samples per second that came out of the last benchmark, differs from the input rate for resamplers
+        double getOutputRate() {
+            return outRate;
+        }
+
     protected:
         void start() {
             if (running) { return; }
             running = true;
             sampCount = 0;
+            outSampCount = 0;
             wthr = std::thread(&SpeedTester::writeWorker, this);
             rthr = std::thread(&SpeedTester::readWorker, this);
         }
@@ -88,6 +95,7 @@ namespace dsp::bench {
                 int count = _out->read();
                 _out->flush();
                 if (count < 0) { return; }
+                outSampCount += count;
             }
         }
 
@@ -100,6 +108,8 @@ namespace dsp::bench {
         std::thread wthr;
         std::thread rthr;
         uint64_t sampCount;
+        uint64_t outSampCount;
+        double outRate = 0;
 
     };
 }
\ No newline at end of file
@@ -4,22 +4,55 @@
 #include <vector>
 #include <algorithm>
 #include <functional>
+#include <atomic>
+#include <time.h>
+#include <cstdlib>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
 #include "stream.h"
 #include "types.h"
 #include "core.h"
 
 namespace dsp {
+    // CPU time consumed by the calling thread, in nanoseconds
+    inline uint64_t threadCPUTimeNs() {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+        uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+        uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+        return (k + u) * 100;
+#else
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+    }
+
+    class block;
+
+    // Runs blocks cooperatively instead of each on its own thread, see executor.h
+    class BlockScheduler {
+    public:
+        virtual ~BlockScheduler() {}
+        virtual void addBlock(block* blk) = 0;
+        virtual void removeBlock(block* blk) = 0;
+    };
+
     class generic_block {
     public:
         virtual ~generic_block() {}
         virtual void start() {}
         virtual void stop() {}
         virtual int run() { return -1; }
+        virtual void setScheduler(BlockScheduler* scheduler) {}
     };
 
     class block : public generic_block {
     public:
         virtual ~block() {
+            profiler::unregisterBlock(this);
             if (!_block_init) { return; }
             stop();
             _block_init = false;
@@ -32,6 +65,7 @@ namespace dsp {
                 return;
             }
             running = true;
+            profiler::registerBlock(this, getTypeName(), inputs, outputs);
             doStart();
         }
 
@@ -43,6 +77,7 @@ namespace dsp {
             }
             doStop();
             running = false;
+            profiler::unregisterBlock(this);
         }
 
         void tempStart() {
@@ -65,21 +100,111 @@ namespace dsp {
 
         virtual int run() = 0;
 
+        // Hands the block to a scheduler instead of giving it its own thread, NULL goes back to a thread.
+        // Blocks without an input always keep their own thread.
+        void setScheduler(BlockScheduler* sched) {
+            std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+            if (sched == scheduler) { return; }
+            if (!_block_init) {
+                scheduler = sched;
+                return;
+            }
+            tempStop();
+            scheduler = sched;
+            tempStart();
+        }
+
+        // True when run() can complete without waiting on any of the streams
+        virtual bool isRunnable() {
+            bool hasInput = false;
+            for (auto& in : inputs) {
+                if (!in) { continue; }
+                hasInput = true;
+                if (!in->isReadable()) { return false; }
+            }
+            for (auto& out : outputs) {
+                if (!out->isWritable()) { return false; }
+            }
+            return hasInput;
+        }
+
+        // Adds CPU time measured by whoever runs the block
+        inline void accountRun(uint64_t ns) {
+            cpuTimeNs.fetch_add(ns, std::memory_order_relaxed);
+            runCount.fetch_add(1, std::memory_order_relaxed);
+            if (profiler::isEnabled()) { runTimeNs.fetch_add(ns, std::memory_order_relaxed); }
+        }
+
+        const std::vector<untyped_stream*>& getInputs() { return inputs; }
+        const std::vector<untyped_stream*>& getOutputs() { return outputs; }
+
+        // CPU time spent in run() in seconds, and the number of run() calls
+        double getCPUTime() { return (double)cpuTimeNs.load() / 1e9; }
+        uint64_t getRunCount() { return runCount.load(); }
+
+        // Wall time spent in run() in seconds, waits included. Only measured while dsp::profiler is enabled.
+        double getRunTime() { return (double)runTimeNs.load() / 1e9; }
+
+        bool isScheduled() { return scheduled.load() != NULL; }
+
+        void resetCPUTime() {
+            cpuTimeNs = 0;
+            runCount = 0;
+            runTimeNs = 0;
+        }
+
+        // Class name without namespaces and template arguments
+        std::string getTypeName() {
+            std::string tn = typeid(*this).name();
+#ifdef __GNUG__
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(tn.c_str(), NULL, NULL, &status);
+            if (demangled) {
+                tn = demangled;
+                std::free(demangled);
+            }
+#endif
+            tn = tn.substr(0, tn.find('<'));
+            size_t scope = tn.find_last_of(": ");
+            return (scope == std::string::npos) ? tn : tn.substr(scope + 1);
+        }
+
     protected:
         void workerLoop() {
-            std::string tn = typeid(*this).name();
-            int lastDigit = -1;
-            for(int q=0; q<tn.size(); q++) {
-                if (isdigit(tn[q])) {
-                    lastDigit = q;
-                }
+            SetThreadName("block:" + getTypeName());
+
+            // The thread only runs this block, so its CPU time is the block's. Reading the clock is a
+            // syscall, only do it every few runs.
+            uint64_t last = threadCPUTimeNs();
+            int runs = 0;
+            while (true) {
+                uint64_t runStart = profiler::begin();
+                int ret = run();
+                profiler::end(runTimeNs, runStart);
+                if (ret < 0) { break; }
+                if (++runs < CPU_TIME_SAMPLE_RUNS) { continue; }
+                uint64_t now = threadCPUTimeNs();
+                cpuTimeNs.fetch_add(now - last, std::memory_order_relaxed);
+                runCount.fetch_add(runs, std::memory_order_relaxed);
+                last = now;
+                runs = 0;
             }
-            tn = tn.substr(lastDigit+1);
-            SetThreadName("block:" + tn);
-            while (run() >= 0) {}
+            cpuTimeNs.fetch_add(threadCPUTimeNs() - last, std::memory_order_relaxed);
+            runCount.fetch_add(runs, std::memory_order_relaxed);
+        }
+
+        static constexpr int CPU_TIME_SAMPLE_RUNS = 64;
+
+        bool hasInput() {
+            return std::find_if(inputs.begin(), inputs.end(), [](untyped_stream* in) { return in != NULL; }) != inputs.end();
         }
 
         virtual void doStart() {
+            if (scheduler && hasInput()) {
+                scheduled = scheduler;
+                scheduler->addBlock(this);
+                return;
+            }
             workerThread = std::thread(&block::workerLoop, this);
         }
 
@@ -93,6 +218,12 @@ namespace dsp {
                 out->stopWriter();
             }
 
+            // Wait for the scheduler to be done with the block
+            if (scheduled) {
+                scheduled.load()->removeBlock(this);
+                scheduled = NULL;
+            }
+
             // TODO: Make sure this isn't needed, I don't know why it stops
             if (workerThread.joinable()) {
                 workerThread.join();
@@ -116,24 +247,29 @@ namespace dsp {
         //     ctrlMtx.unlock();
         // }
 
+        // The profiler keeps its own copy of the stream lists, it must not read them while they change
         void registerInput(untyped_stream* inStream) {
             if (inputs.size() == 1 && inStream) {
                 abort();
             } else {
                 inputs.push_back(inStream);
             }
+            profiler::setBlockStreams(this, inputs, outputs);
         }
 
         void unregisterInput(untyped_stream* inStream) {
             inputs.erase(std::remove(inputs.begin(), inputs.end(), inStream), inputs.end());
+            profiler::setBlockStreams(this, inputs, outputs);
         }
 
         void registerOutput(untyped_stream* outStream) {
             outputs.push_back(outStream);
+            profiler::setBlockStreams(this, inputs, outputs);
         }
 
         void unregisterOutput(untyped_stream* outStream) {
             outputs.erase(std::remove(outputs.begin(), outputs.end(), outStream), outputs.end());
+            profiler::setBlockStreams(this, inputs, outputs);
         }
 
         bool _block_init = false;
@@ -147,5 +283,11 @@ namespace dsp {
         bool tempStopped = false;
         int tempStopDepth = 0;
         std::thread workerThread;
+
+        BlockScheduler* scheduler = NULL;
+        std::atomic<BlockScheduler*> scheduled = NULL;
+        std::atomic<uint64_t> cpuTimeNs = 0;
+        std::atomic<uint64_t> runCount = 0;
+        std::atomic<uint64_t> runTimeNs = 0;
     };
 }
\ No newline at end of file
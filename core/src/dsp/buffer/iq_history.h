@@ -0,0 +1,265 @@
+#pragma once
+#include "../sink.h"
+#include "../source.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <condition_variable>
+#include <algorithm>
+#include <volk/volk.h>
+
+namespace dsp::buffer {
+    // Circular history of the last seconds of IQ. Samples are addressed by their absolute position since
+    // the last configure(), anything older than the capacity is overwritten. The storage is allocated
+    // once by configure(), run() only copies.
+    class IQHistory : public Sink<complex_t> {
+        using base_type = Sink<complex_t>;
+    public:
+        IQHistory() {}
+
+        IQHistory(stream<complex_t>* in, double sampleRate, double seconds, bool int16) { init(in, sampleRate, seconds, int16); }
+
+        void init(stream<complex_t>* in, double sampleRate, double seconds, bool int16) {
+            base_type::init(in);
+            configure(sampleRate, seconds, int16);
+        }
+
+        // Storage never grows past this, longer histories are shortened to fit
+        static constexpr uint64_t MAX_MEMORY_BYTES = 4ull << 30;
+
+        // Reallocates and clears the history. int16 storage halves the memory, samples are clipped to +-1.
+        // Returns false if the memory could not be allocated, the history then holds nothing.
+        bool configure(double sampleRate, double seconds, bool int16) {
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            bool ok = true;
+            {
+                std::lock_guard<std::mutex> lck2(bufMtx);
+                _sampleRate = sampleRate;
+                _seconds = seconds;
+                _int16 = int16;
+                uint64_t sampleBytes = int16 ? 2 * sizeof(int16_t) : sizeof(complex_t);
+                uint64_t wanted = std::max<double>(1.0, sampleRate * seconds);
+                capacity = std::min<uint64_t>(wanted, MAX_MEMORY_BYTES / sampleBytes);
+                if (capacity < wanted) {
+                    _seconds = (double)capacity / sampleRate;
+                    flog::warn("[IQHistory] {} s of history would take over {} MB, keeping {} s", seconds, (int64_t)(MAX_MEMORY_BYTES >> 20), _seconds);
+                }
+
+                // Release the old storage before allocating the new one, assign() also touches every page now
+                std::vector<complex_t>().swap(f32Buf);
+                std::vector<int16_t>().swap(i16Buf);
+                try {
+                    if (int16) {
+                        i16Buf.assign(capacity * 2, 0);
+                    }
+                    else {
+                        f32Buf.assign(capacity, complex_t{ 0.0f, 0.0f });
+                    }
+                }
+                catch (const std::bad_alloc&) {
+                    flog::error("[IQHistory] Could not allocate {} MB for {} s of history", (int64_t)((capacity * sampleBytes) >> 20), _seconds);
+                    std::vector<complex_t>().swap(f32Buf);
+                    std::vector<int16_t>().swap(i16Buf);
+                    capacity = 1;
+                    _seconds = 0.0;
+                    i16Buf.assign(2, 0);
+                    f32Buf.assign(1, complex_t{ 0.0f, 0.0f });
+                    ok = false;
+                }
+                writePos = 0;
+            }
+            dataCV.notify_all();
+            base_type::tempStart();
+            return ok;
+        }
+
+        void setSampleRate(double sampleRate) {
+            if (sampleRate == _sampleRate) { return; }
+            configure(sampleRate, _seconds, _int16);
+        }
+
+        double getSampleRate() { return _sampleRate; }
+        double getCapacitySeconds() { return _seconds; }
+        bool isInt16() { return _int16; }
+        size_t getMemoryBytes() { return _int16 ? capacity * 2 * sizeof(int16_t) : capacity * sizeof(complex_t); }
+
+        // Position of the next sample to be written, and of the oldest one still held
+        uint64_t getWritePosition() {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            return writePos;
+        }
+
+        uint64_t getOldestPosition() {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            return (writePos > capacity) ? writePos - capacity : 0;
+        }
+
+        double getAvailableSeconds() {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            return (double)std::min<uint64_t>(writePos, capacity) / _sampleRate;
+        }
+
+        // Position of the sample written the given number of seconds ago, clamped to what is held
+        uint64_t positionSecondsAgo(double seconds) {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            uint64_t back = std::min<uint64_t>(std::max<double>(seconds, 0.0) * _sampleRate, std::min<uint64_t>(writePos, capacity));
+            return writePos - back;
+        }
+
+        // Copies up to count samples starting at position. Returns how many were copied, 0 if the position
+        // was already overwritten or not written yet.
+        int read(uint64_t position, complex_t* out, int count) {
+            std::lock_guard<std::mutex> lck(bufMtx);
+            return readLocked(position, out, count);
+        }
+
+        // Like read() but waits up to timeoutMs for the position to be written
+        int waitRead(uint64_t position, complex_t* out, int count, int timeoutMs) {
+            std::unique_lock<std::mutex> lck(bufMtx);
+            dataCV.wait_for(lck, std::chrono::milliseconds(timeoutMs), [&] { return writePos > position || wakeReaders; });
+            return readLocked(position, out, count);
+        }
+
+        // Wakes up waitRead() callers, for stopping them
+        void wakeReadersNow(bool wake) {
+            {
+                std::lock_guard<std::mutex> lck(bufMtx);
+                wakeReaders = wake;
+            }
+            dataCV.notify_all();
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            {
+                std::lock_guard<std::mutex> lck(bufMtx);
+                const complex_t* in = base_type::_in->readBuf;
+                int left = count;
+                while (left) {
+                    uint64_t idx = writePos % capacity;
+                    int n = std::min<uint64_t>(left, capacity - idx);
+                    if (_int16) {
+                        volk_32f_s32f_convert_16i(&i16Buf[idx * 2], (const float*)in, 32767.0f, n * 2);
+                    }
+                    else {
+                        memcpy(&f32Buf[idx], in, n * sizeof(complex_t));
+                    }
+                    in += n;
+                    left -= n;
+                    writePos += n;
+                }
+            }
+            dataCV.notify_all();
+
+            base_type::_in->flush();
+            return count;
+        }
+
+    private:
+        int readLocked(uint64_t position, complex_t* out, int count) {
+            uint64_t oldest = (writePos > capacity) ? writePos - capacity : 0;
+            if (position < oldest || position >= writePos) { return 0; }
+            count = std::min<uint64_t>(count, writePos - position);
+
+            int left = count;
+            while (left) {
+                uint64_t idx = position % capacity;
+                int n = std::min<uint64_t>(left, capacity - idx);
+                if (_int16) {
+                    volk_16i_s32f_convert_32f((float*)out, &i16Buf[idx * 2], 32767.0f, n * 2);
+                }
+                else {
+                    memcpy(out, &f32Buf[idx], n * sizeof(complex_t));
+                }
+                out += n;
+                left -= n;
+                position += n;
+            }
+            return count;
+        }
+
+        std::mutex bufMtx;
+        std::condition_variable dataCV;
+        bool wakeReaders = false;
+
+        double _sampleRate = 1.0;
+        double _seconds = 0.0;
+        bool _int16 = false;
+        uint64_t capacity = 1;
+        uint64_t writePos = 0;
+        std::vector<complex_t> f32Buf;
+        std::vector<int16_t> i16Buf;
+    };
+
+    // Plays an IQHistory back at a fixed delay behind the live samples. The pace comes from the history
+    // being written, so the delay stays exact without a clock of its own.
+    class IQHistoryPlayer : public Source<complex_t> {
+        using base_type = Source<complex_t>;
+    public:
+        IQHistoryPlayer() {}
+
+        IQHistoryPlayer(IQHistory* history, double delaySeconds) { init(history, delaySeconds); }
+
+        void init(IQHistory* history, double delaySeconds) {
+            _history = history;
+            setDelay(delaySeconds);
+        }
+
+        // Restarts playback the given number of seconds behind live, or as far back as the history goes
+        void setDelay(double delaySeconds) {
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _delay = std::max<double>(delaySeconds, 0.0);
+            position = _history->positionSecondsAgo(_delay);
+            delaySamples = _history->getWritePosition() - position;
+            base_type::tempStart();
+        }
+
+        double getDelay() { return (double)delaySamples / _history->getSampleRate(); }
+
+        int run() {
+            // Only hand out samples that are at least the delay old
+            uint64_t writePos = _history->getWritePosition();
+            int blockSize = std::max<int>(1, std::min<int>(_history->getSampleRate() / 200.0, STREAM_BUFFER_SIZE));
+            int count = 0;
+            if (writePos >= position + delaySamples + blockSize) {
+                count = _history->read(position, base_type::out.writeBuf, blockSize);
+                if (!count) {
+                    // Overwritten under us, skip to the oldest sample still held
+                    position = _history->getOldestPosition();
+                    return 0;
+                }
+            }
+            else {
+                complex_t dummy;
+                _history->waitRead(position + delaySamples + blockSize - 1, &dummy, 0, 50);
+                return stopping ? -1 : 0;
+            }
+
+            position += count;
+            if (!base_type::out.swap(count)) { return -1; }
+            return count;
+        }
+
+    protected:
+        void doStop() override {
+            stopping = true;
+            _history->wakeReadersNow(true);
+            base_type::doStop();
+            _history->wakeReadersNow(false);
+            stopping = false;
+        }
+
+    private:
+        IQHistory* _history = NULL;
+        double _delay = 0.0;
+        uint64_t position = 0;
+        uint64_t delaySamples = 0;
+        std::atomic<bool> stopping = false;
+    };
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "buffer.h"
+
+namespace dsp::buffer {
+    // Pool of fixed size sample buffers handed out as shared pointers. A buffer goes back to the pool
+    // when its last reference is dropped, so steady state operation doesn't allocate.
+    template<class T>
+    class SharedPool : public std::enable_shared_from_this<SharedPool<T>> {
+    public:
+        SharedPool(int capacity) : _capacity(capacity) {}
+
+        ~SharedPool() {
+            for (auto& buf : freeList) { buffer::free(buf); }
+        }
+
+        std::shared_ptr<T> acquire() {
+            T* buf = NULL;
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                if (!freeList.empty()) {
+                    buf = freeList.back();
+                    freeList.pop_back();
+                }
+            }
+            if (!buf) {
+                buf = buffer::alloc<T>(_capacity);
+                allocated++;
+            }
+
+            // The deleter keeps the pool alive until every outstanding buffer is back
+            auto self = this->shared_from_this();
+            return std::shared_ptr<T>(buf, [self](T* b) { self->release(b); });
+        }
+
+        inline int getCapacity() { return _capacity; }
+        inline int getAllocatedCount() { return allocated; }
+
+    private:
+        void release(T* buf) {
+            std::lock_guard<std::mutex> lck(mtx);
+            freeList.push_back(buf);
+        }
+
+        int _capacity;
+        int allocated = 0;
+        std::mutex mtx;
+        std::vector<T*> freeList;
+    };
+}
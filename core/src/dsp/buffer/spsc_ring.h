@@ -0,0 +1,211 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <climits>
+#include <thread>
+#include <stdint.h>
+#include "buffer.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dsp::buffer {
+    // Event count: waiters read the sequence, re-check their condition, then sleep on the sequence.
+    // notify() only issues a wake syscall when someone is actually sleeping.
+    class EventCount {
+    public:
+        inline uint32_t prepareWait() {
+            waiters.fetch_add(1);
+            return seq.load();
+        }
+
+        inline void cancelWait() {
+            waiters.fetch_sub(1);
+        }
+
+        inline void wait(uint32_t key) {
+            sleeps.fetch_add(1, std::memory_order_relaxed);
+#ifdef __linux__
+            syscall(SYS_futex, (uint32_t*)&seq, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+#else
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                cv.wait(lck, [&] { return seq.load() != key; });
+            }
+#endif
+            waiters.fetch_sub(1);
+        }
+
+        inline void notify() {
+            seq.fetch_add(1);
+            if (waiters.load() == 0) { return; }
+            wakeups.fetch_add(1, std::memory_order_relaxed);
+#ifdef __linux__
+            syscall(SYS_futex, (uint32_t*)&seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+            }
+            cv.notify_all();
+#endif
+        }
+
+        // Process wide counters, for benchmarks
+        static inline std::atomic<uint64_t> wakeups = 0;
+        static inline std::atomic<uint64_t> sleeps = 0;
+
+    private:
+        std::atomic<uint32_t> seq = 0;
+        std::atomic<int> waiters = 0;
+#ifndef __linux__
+        std::mutex mtx;
+        std::condition_variable cv;
+#endif
+    };
+
+    // Lock-free single producer single consumer ring of sample buffers. The writer fills the current slot
+    // and publishes it, the reader acquires the oldest published slot and releases it when done.
+    // With depth published slots the writer can run up to depth blocks ahead of the reader.
+    template<class T>
+    class SPSCRing {
+    public:
+        // Number of condition re-checks before going to sleep
+        static constexpr int SPIN_COUNT = 64;
+
+        SPSCRing(int depth, int slotSize) {
+            slotCount = depth + 1;
+            bufs = new T*[slotCount];
+            sizes = new int[slotCount];
+            for (int i = 0; i < slotCount; i++) {
+                bufs[i] = buffer::alloc<T>(slotSize);
+                sizes[i] = 0;
+            }
+        }
+
+        ~SPSCRing() {
+            for (int i = 0; i < slotCount; i++) { buffer::free(bufs[i]); }
+            delete[] bufs;
+            delete[] sizes;
+        }
+
+        inline int getDepth() { return slotCount - 1; }
+
+        // Published slots not yet released by the reader
+        inline int getFill() { return (int)(head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed)); }
+
+        inline T* writeSlot() {
+            return bufs[head.load(std::memory_order_relaxed) % slotCount];
+        }
+
+        // Publishes the current write slot and waits for the next one to be free. False if the writer was stopped.
+        bool publish(int size) {
+            commit(size);
+            return waitWritable();
+        }
+
+        void commit(int size) {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            sizes[h % slotCount] = size;
+            head.store(h + 1, std::memory_order_seq_cst);
+            readable.notify();
+        }
+
+        bool waitWritable() {
+            return waitFor(writable, writerStop, [&] { return (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire)) < (uint64_t)slotCount; });
+        }
+
+        // Waits for a published slot. Returns its size or -1 if the reader was stopped.
+        int acquire(T*& buf) {
+            if (holding) { release(); }
+            readers.fetch_add(1);
+            bool ok = waitFor(readable, readerStop, [&] { return tail.load(std::memory_order_relaxed) < head.load(std::memory_order_acquire); });
+            readers.fetch_sub(1);
+            if (!ok) { return -1; }
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            buf = bufs[t % slotCount];
+            holding = true;
+            return sizes[t % slotCount];
+        }
+
+        void release() {
+            if (!holding) { return; }
+            holding = false;
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_seq_cst);
+            writable.notify();
+        }
+
+        inline bool isDataReady() {
+            return head.load() > tail.load() + (holding ? 1 : 0);
+        }
+
+        // True when acquire() or the next publish() would not wait
+        inline bool isReadable() {
+            return isDataReady() || readerStop.load();
+        }
+
+        inline bool isWritable() {
+            return (head.load() + 1 - tail.load()) < (uint64_t)slotCount || writerStop.load();
+        }
+
+        void stopWriter() {
+            writerStop = true;
+            writable.notify();
+        }
+
+        void clearWriteStop() {
+            writerStop = false;
+        }
+
+        void stopReader() {
+            readerStop = true;
+            readable.notify();
+            while (readers.load()) { readable.notify(); std::this_thread::yield(); }
+        }
+
+        void clearReadStop() {
+            readerStop = false;
+        }
+
+    private:
+        template<typename Func>
+        inline bool waitFor(EventCount& ev, std::atomic<bool>& stop, Func cond) {
+            for (int i = 0; i < SPIN_COUNT; i++) {
+                if (cond()) { return true; }
+                if (stop.load()) { return false; }
+            }
+            while (true) {
+                uint32_t key = ev.prepareWait();
+                if (cond()) {
+                    ev.cancelWait();
+                    return true;
+                }
+                if (stop.load()) {
+                    ev.cancelWait();
+                    return false;
+                }
+                ev.wait(key);
+            }
+        }
+
+        int slotCount;
+        T** bufs;
+        int* sizes;
+
+        // Written by the writer only
+        alignas(64) std::atomic<uint64_t> head = 0;
+        // Written by the reader only
+        alignas(64) std::atomic<uint64_t> tail = 0;
+        bool holding = false;
+
+        std::atomic<bool> writerStop = false;
+        std::atomic<bool> readerStop = false;
+        std::atomic<int> readers = 0;
+
+        EventCount readable;
+        EventCount writable;
+    };
+}
@@ -38,6 +38,7 @@ namespace dsp {
             // Add to the list
             links.push_back(block);
             states[block] = false;
+            if (scheduler) { block->setScheduler(scheduler); }
 
             // Enable if needed
             if (enabled) { enableBlock(block, [](stream<T>* out){}); }
@@ -54,6 +55,7 @@ namespace dsp {
             disableBlock(block, onOutputChange);
         
             // Remove block from the list
+            if (scheduler) { block->setScheduler(NULL); }
             states.erase(block);
             links.erase(std::find(links.begin(), links.end(), block));
         }
@@ -141,6 +143,14 @@ namespace dsp {
             }
         }
 
+        // Fuses all the blocks of the chain onto a scheduler, NULL gives each its own thread again
+        void setScheduler(BlockScheduler* sched) {
+            scheduler = sched;
+            for (auto& ln : links) {
+                ln->setScheduler(scheduler);
+            }
+        }
+
         void start() {
             if (running) { return; }
             for (auto& ln : links) {
@@ -163,12 +173,13 @@ namespace dsp {
 
     private:
         Processor<T, T>* blockBefore(Processor<T, T>* block) {
-            // TODO: This is wrong and must be fixed when I get more time
+            // Last enabled block ahead of this one
+            Processor<T, T>* before = NULL;
             for (auto& ln : links) {
-                if (ln == block) { return NULL; }
-                if (states[ln]) { return ln; }
+                if (ln == block) { break; }
+                if (states[ln]) { before = ln; }
             }
-            return NULL;
+            return before;
         }
 
         Processor<T, T>* blockAfter(Processor<T, T>* block) {
@@ -191,5 +202,6 @@ namespace dsp {
         std::vector<Processor<T, T>*> links;
         std::map<Processor<T, T>*, bool> states;
         bool running = false;
+        BlockScheduler* scheduler = NULL;
     };
 }
\ No newline at end of file
@@ -0,0 +1,255 @@
+#pragma once
+#include <vector>
+#include "../sink.h"
+#include "../taps/low_pass.h"
+#include <utils/arrays.h>
+
+namespace dsp::channel {
+    // 2x oversampled polyphase filter bank channelizer. The input band is cut into M channels spaced
+    // inSamplerate / M apart, each output at 2 * inSamplerate / M. A single FFT pass per output sample
+    // computes every channel, the block only writes out the channels that have a stream bound to them.
+    class PFBChannelizer : public Sink<complex_t> {
+        using base_type = Sink<complex_t>;
+    public:
+        // Channel spacing the channel count is chosen for, the real spacing is the closest power of two split
+        static constexpr double TARGET_CHANNEL_SPACING = 50000.0;
+        static constexpr int MIN_CHANNELS = 8;
+        static constexpr int MAX_CHANNELS = 1024;
+
+        // Fraction of the channel spacing (one sided) that is flat and alias free at the channel output
+        static constexpr double USABLE_BANDWIDTH = 0.75;
+
+        PFBChannelizer() {}
+
+        PFBChannelizer(stream<complex_t>* in, double inSamplerate) { init(in, inSamplerate); }
+
+        ~PFBChannelizer() {
+            if (!base_type::_block_init) { return; }
+            base_type::stop();
+            buffer::free(buffer);
+            buffer::free(bankTaps);
+            buffer::free(work);
+        }
+
+        void init(stream<complex_t>* in, double inSamplerate) {
+            _inSamplerate = inSamplerate;
+            buffer = NULL;
+            bankTaps = NULL;
+            work = NULL;
+            reconfigure();
+            base_type::init(in);
+        }
+
+        void setInSamplerate(double inSamplerate) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            _inSamplerate = inSamplerate;
+            reconfigure();
+            base_type::tempStart();
+        }
+
+        inline int getChannelCount() { return channelCount; }
+        inline double getChannelSpacing() { return _inSamplerate / (double)channelCount; }
+        inline double getChannelSamplerate() { return 2.0 * _inSamplerate / (double)channelCount; }
+
+        // Returns the channel index able to carry a signal of the given bandwidth at the given offset
+        // and its offset relative to that channel's center, or -1 if it doesn't fit the channel grid.
+        int findChannel(double offset, double bandwidth, double outSamplerate, double& residual) {
+            double spacing = getChannelSpacing();
+            if (outSamplerate > getChannelSamplerate()) { return -1; }
+            int k = (int)round(offset / spacing);
+            if (k < -channelCount / 2 || k > channelCount / 2) { return -1; }
+            residual = offset - (double)k * spacing;
+            if (fabs(residual) + (bandwidth / 2.0) > USABLE_BANDWIDTH * spacing) { return -1; }
+            return ((k % channelCount) + channelCount) % channelCount;
+        }
+
+        // Returns true if a signal of the given bandwidth at the given offset still fits the given channel, along
+        // with its offset relative to that channel's center. Adjacent channels overlap, so a signal may fit a
+        // channel other than the one findChannel() would pick.
+        bool fitsChannel(int channel, double offset, double bandwidth, double outSamplerate, double& residual) {
+            double spacing = getChannelSpacing();
+            if (channel < 0 || channel >= channelCount || outSamplerate > getChannelSamplerate()) { return false; }
+            int k = (int)round(offset / spacing);
+            if (k < -channelCount / 2 || k > channelCount / 2) { return false; }
+            double r = remainder(offset - (double)channel * spacing, _inSamplerate);
+            if (fabs(r) + (bandwidth / 2.0) > USABLE_BANDWIDTH * spacing) { return false; }
+            residual = r;
+            return true;
+        }
+
+        void bindChannel(int channel, stream<complex_t>* stream) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (channel < 0 || channel >= channelCount) {
+                throw std::runtime_error("[PFBChannelizer] Tried to bind a stream to an invalid channel");
+            }
+            for (auto& b : bindings) {
+                if (b.output == stream) {
+                    throw std::runtime_error("[PFBChannelizer] Tried to bind stream to that is already bound");
+                }
+            }
+
+            base_type::tempStop();
+            base_type::registerOutput(stream);
+            bindings.push_back({ channel, stream });
+            base_type::tempStart();
+        }
+
+        void unbindChannel(stream<complex_t>* stream) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            auto it = std::find_if(bindings.begin(), bindings.end(), [=](const Binding& b) { return b.output == stream; });
+            if (it == bindings.end()) {
+                throw std::runtime_error("[PFBChannelizer] Tried to unbind stream to that isn't bound");
+            }
+
+            base_type::tempStop();
+            bindings.erase(it);
+            base_type::unregisterOutput(stream);
+            base_type::tempStart();
+        }
+
+        bool hasBindings() {
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            return !bindings.empty();
+        }
+
+        void reset() {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            buffer::clear(buffer, histLen - 1);
+            bufCount = histLen - 1;
+            nextStep = histLen - 1;
+            stepParity = false;
+            base_type::tempStart();
+        }
+
+        // Channelizes count samples, writing the output of each bound channel to its stream's write buffer.
+        // Returns the number of samples written per channel.
+        int process(int count, const complex_t* in) {
+            memcpy(&buffer[bufCount], in, count * sizeof(complex_t));
+            bufCount += count;
+
+            auto fftIn = fftPlan->getInput()->data();
+            auto fftOut = fftPlan->getOutput()->data();
+            int outCount = 0;
+            for (; nextStep < bufCount; nextStep += decimation) {
+                // Polyphase partial sums, one per branch, stored in reverse branch order
+                float* acc = (float*)work;
+                memset(acc, 0, channelCount * sizeof(complex_t));
+                for (int q = 0; q < tapsPerPhase; q++) {
+                    const float* seg = (const float*)&buffer[nextStep - (q * channelCount) - (channelCount - 1)];
+                    const float* tp = &bankTaps[2 * q * channelCount];
+                    for (int i = 0; i < 2 * channelCount; i++) {
+                        acc[i] += tp[i] * seg[i];
+                    }
+                }
+                for (int p = 0; p < channelCount; p++) {
+                    fftIn[p] = work[channelCount - 1 - p];
+                }
+
+                fftPlan->execute();
+
+                // Decimating by M/2 leaves a (-1)^(k*n) residual rotation on odd channels
+                for (auto& b : bindings) {
+                    complex_t v = fftOut[b.channel];
+                    if (stepParity && (b.channel & 1)) {
+                        v = complex_t{ -v.re, -v.im };
+                    }
+                    b.output->writeBuf[outCount] = v;
+                }
+                stepParity = !stepParity;
+                outCount++;
+            }
+
+            // Keep only the history needed by the next step
+            int keepFrom = nextStep - histLen + 1;
+            memmove(buffer, &buffer[keepFrom], (bufCount - keepFrom) * sizeof(complex_t));
+            bufCount -= keepFrom;
+            nextStep -= keepFrom;
+
+            return outCount;
+        }
+
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+
+            int outCount = process(count, base_type::_in->readBuf);
+
+            base_type::_in->flush();
+            if (outCount) {
+                for (auto& b : bindings) {
+                    if (!b.output->swap(outCount)) { return -1; }
+                }
+            }
+            return outCount;
+        }
+
+    protected:
+        struct Binding {
+            int channel;
+            stream<complex_t>* output;
+        };
+
+        void reconfigure() {
+            // Pick a power of two channel count close to the target spacing
+            channelCount = MIN_CHANNELS;
+            while (channelCount < MAX_CHANNELS && _inSamplerate / (double)channelCount > TARGET_CHANNEL_SPACING) {
+                channelCount *= 2;
+            }
+            decimation = channelCount / 2;
+
+            // Prototype filter: flat up to USABLE_BANDWIDTH of the spacing, stopband at the channel output nyquist
+            double spacing = getChannelSpacing();
+            tap<float> proto = taps::lowPass(spacing * (USABLE_BANDWIDTH + 1.0) / 2.0, spacing * (1.0 - USABLE_BANDWIDTH), _inSamplerate);
+            tapsPerPhase = (proto.size + channelCount - 1) / channelCount;
+            histLen = tapsPerPhase * channelCount;
+
+            // Lay out the taps so that each row of the bank lines up with a contiguous run of input samples.
+            // Taps are duplicated for the I and Q lanes and scaled by M since the inverse FFT is normalized.
+            buffer::free(bankTaps);
+            bankTaps = buffer::alloc<float>(2 * histLen);
+            for (int q = 0; q < tapsPerPhase; q++) {
+                for (int j = 0; j < channelCount; j++) {
+                    int idx = q * channelCount + (channelCount - 1 - j);
+                    float t = (idx < proto.size) ? proto.taps[idx] * (float)channelCount : 0.0f;
+                    bankTaps[2 * (q * channelCount + j)] = t;
+                    bankTaps[2 * (q * channelCount + j) + 1] = t;
+                }
+            }
+            taps::free(proto);
+
+            buffer::free(work);
+            work = buffer::alloc<complex_t>(channelCount);
+
+            buffer::free(buffer);
+            buffer = buffer::alloc<complex_t>(STREAM_BUFFER_SIZE + histLen);
+            buffer::clear(buffer, histLen - 1);
+            bufCount = histLen - 1;
+            nextStep = histLen - 1;
+            stepParity = false;
+
+            fftPlan = arrays::allocateFFTWPlan(true, channelCount);
+        }
+
+        double _inSamplerate;
+        int channelCount;
+        int decimation;
+        int tapsPerPhase;
+        int histLen;
+
+        float* bankTaps;
+        complex_t* work;
+        complex_t* buffer;
+        int bufCount;
+        int nextStep;
+        bool stepParity;
+        arrays::Arg<arrays::FFTPlan> fftPlan;
+
+        std::vector<Binding> bindings;
+    };
+}
@@ -5,9 +5,10 @@
 #include "utils/arrays.h"
 #include "utils/strings.h"
 #include "dsp/window/blackman.h"
-#include "dsp/compression/sample_stream_compressor.h"
-#include "dsp/compression/sample_stream_decompressor.h"
+#include <volk/volk.h>
 #include <cmath>
+#include <deque>
+#include <condition_variable>
 
 
 namespace dsp::compression {
@@ -29,6 +30,13 @@ namespace dsp::compression {
 
     using namespace ::dsp::arrays;
 
+    // Lossy "EFFT" compression of the server IQ stream. Each slice goes out as its spectrum with the bins
+    // below the noise floor zeroed, the noise floor coming from the average spectrum of the last slices, so
+    // the output lags minRecents slices behind the input.
+    //
+    // Every buffer is sized in setSampleRate() and a slice runs without allocating. With the worker thread
+    // on, the FFTs of a slice run on the block thread while the filtering of the previous one runs on the
+    // worker, slices still come out in order.
     class ExperimentalFFTCompressor : public Processor<complex_t, complex_t> {
         using base_type = Processor<complex_t, complex_t>;
     public:
@@ -38,23 +46,15 @@ namespace dsp::compression {
         int fftSize = 1024;
         double lossRate = 1.0;
 
-        Arg<FFTPlan> fftPlan;
-        std::shared_ptr<std::vector<complex_t>> inArray;
-        std::vector<float> fftWindow;
-
-        std::vector<complex_t> inputBuffer;
-
         const int minRecents = 10;
-        std::vector<ComplexArray> cleanFreqDomain;
-        std::vector<FloatArray> cleanMagnitudes;
-        std::vector<FloatArray> windowedMagnitudes;
 
         float hzTick;
         int smallTick;
         int largeTick;
         int signalWidth = 300;
 
-        std::vector<int32_t> maskedFrequencies;
+        // Slices between the FFT stage and the filter stage when the worker thread is on
+        static constexpr int SLICE_QUEUE_SIZE = 3;
 
 
         ExperimentalFFTCompressor() {}
@@ -65,35 +65,48 @@ namespace dsp::compression {
             return this->sampleRate;
         }
         void setSampleRate(int sampleRate) {
-            if (sampleRate != this->sampleRate) {
-                clear();
-                this->sampleRate = sampleRate;
-                fftSize = sampleRate * sliceMsec / 1000;
-                fftSize = pow(2, floor(log2(fftSize)));
-                fftPlan = allocateFFTWPlan(false, fftSize);
-                inArray = std::make_shared<std::vector<dsp::complex_t>>(fftSize);
-
-                fftWindow.resize(fftSize);
-                for (int i = 0; i < fftSize; i++) { fftWindow[i] = blackmanWindowElement(i+5, fftSize+10); }
-
-
-                hzTick = ((float) sampleRate) / fftSize;
-                smallTick = signalWidth / hzTick;
-                largeTick = smallTick * 10;
-                sharedDataLock.lock();
-                noiseFigure.clear();
-                sharedDataLock.unlock();
-            }
+            if (sampleRate == this->sampleRate) { return; }
+            std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+            if (_block_init) { tempStop(); }
+            clear();
+            this->sampleRate = sampleRate;
+            fftSize = sampleRate * sliceMsec / 1000;
+            fftSize = pow(2, floor(log2(fftSize)));
+            fftPlan = allocateFFTWPlan(false, fftSize);
+            fftIn = fftPlan->getInput()->data();
+            fftOut = fftPlan->getOutput()->data();
+
+            fftWindow.resize(fftSize);
+            for (int i = 0; i < fftSize; i++) { fftWindow[i] = blackmanWindowElement(i+5, fftSize+10); }
+
+            hzTick = ((float) sampleRate) / fftSize;
+            smallTick = signalWidth / hzTick;
+            largeTick = smallTick * 10;
+            allocateBuffers();
+            sharedDataLock.lock();
+            noiseFigure.clear();
+            sharedDataLock.unlock();
+            if (_block_init) { tempStart(); }
         }
 
         void clear() {
             inputBuffer.clear();
+            inputPos = 0;
+            spectrumHead = spectrumCount = 0;
+            magHead = magCount = 0;
         }
 
         bool enabled = false;
 
+        // The pass-through in run() writes the output itself, so with the worker thread the block is stopped while
+        // switching. The slices the worker had not sent yet are dropped.
         void setEnabled(bool enabled) {
+            std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+            if (enabled == this->enabled) { return; }
+            bool restart = _block_init && useWorker;
+            if (restart) { tempStop(); }
             this->enabled = enabled;
+            if (restart) { tempStart(); }
         }
 
         void setMaskedFrequencies(const std::vector<int32_t> maskedFrequencies) {
@@ -106,358 +119,353 @@ namespace dsp::compression {
             return enabled;
         }
 
-        int iteration = 0;
+        void setWorkerThread(bool useWorker) {
+            std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+            if (useWorker == this->useWorker) { return; }
+            if (_block_init) { tempStop(); }
+            this->useWorker = useWorker;
+            if (_block_init) { tempStart(); }
+        }
+
+        bool getWorkerThread() {
+            return useWorker;
+        }
 
         const int noiseNPoints = 16;
         std::vector<float> noiseFigure; // mean, variance, mean, variance, mean, variance..
         std::mutex sharedDataLock;
         float prevAllowance = 0;
 
-        // returns noise floor
-        FloatArray filterSignal(FloatArray windowedMags, FloatArray clearMags, dsp::complex_t *unfiltered) {
-            //
-            auto mvar = dsp::arrays::movingVariance(windowedMags, noiseNPoints);
-            auto newAllowance = lossRate * percentile::percentile_sampling(*clone(mvar), .15);
-            auto allowance = newAllowance * 0.1 + prevAllowance * 0.9;
-            prevAllowance = allowance;
+        bool txMode = false;
+        void setTxMode(int txMode) {
+            this->txMode = txMode;
+        }
 
-            auto cma = centeredSma(windowedMags, largeTick);
+        // One slice of fftSize samples in, fftSize spectrum bins out once the history is full, synchronously.
+        // Returns the number of bins written.
+        int processSlice(const complex_t* samples, complex_t* out) {
+            analyzeSlice(samples, syncSlice);
+            return finishSlice(syncSlice, out);
+        }
 
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
 
-            for (int i = 0; i < fftSize; i++) {
-                if (mvar->at(i) > allowance) {
-                    cma->at(i) = 0;
+            if (!enabled) {
+                std::copy(_in->readBuf, _in->readBuf + count, this->out.writeBuf);
+                base_type::_in->flush();
+                if (count > 0) {
+                    if (!base_type::out.swap(count)) { return -1; }
                 }
+                return count;
             }
-            dsp::math::linearInterpolateHoles(cma->data(), cma->size());
 
-            cma = centeredSma(cma, largeTick);          // cleared noise floor.
-            auto cmax = centeredSma(cma, 5*largeTick);          // cleared noise floor.
-            auto diff = subeach(cma, cmax);
-            for (int i = 0; i < fftSize; i++) {
-                diff->at(i) = fabs(diff->at(i));
-            }
-            auto cmaxAllow = percentile::percentile_sampling(*clone(diff), .15);
-            for (int i = 0; i < fftSize; i++) {
-                if (diff->at(i)  > cmaxAllow) {
-                    cma->at(i) = 0;
-                }
-            }
-            dsp::math::linearInterpolateHoles(cma->data(), cma->size());
-            cma = centeredSma(cma, largeTick);          // cleared noise floor.
+            inputBuffer.insert(inputBuffer.end(), base_type::_in->readBuf, base_type::_in->readBuf + count);
+            base_type::_in->flush();
 
-            auto mask = npzeros(fftSize);
-            if (!txMode) {
-                // for rx mode, add good signals to mask, for tx assume no signals at all. Mask will be used to filter signal.
-                for (int i = 0; i < fftSize; i++) {
-                    if (clearMags->at(i) > cma->at(i) + allowance) {     // allowance = normal noise variance
-                        mask->at(i) = 1;
-                    }
+            while (inputBuffer.size() - inputPos >= fftSize) {
+                const complex_t* samples = &inputBuffer[inputPos];
+                if (!useWorker) {
+                    int outCount = processSlice(samples, this->out.writeBuf);
+                    if (outCount && !base_type::out.swap(outCount)) { return -1; }
                 }
-            }
-            for(int i=0; i<maskedFrequencies.size(); i+=2) {
-                int from = maskedFrequencies[i+0];
-                int to = maskedFrequencies[i+1];
-                int tickFrom = fftSize/2 + from / hzTick;
-                int tickTo = fftSize/2 + to / hzTick;
-                for (int j = tickFrom; j < tickTo; j++) {
-                    if (j >= 0 && j < fftSize) {
-                        mask->at(j) = 1;
+                else {
+                    Slice* slice = takeFreeSlice();
+                    if (!slice) { return -1; }
+                    analyzeSlice(samples, *slice);
+                    {
+                        std::lock_guard<std::mutex> lck(sliceMtx);
+                        readySlices.push_back(slice);
                     }
+                    sliceCnd.notify_all();
                 }
+                inputPos += fftSize;
             }
-            mask = centeredSma(mask, signalWidth / 8);      // add some around the signal
-            int nfiltered = 0;
-            for (int i = 0; i < fftSize; i++) {
-                if (mask->at(i) == 0) {
-                    unfiltered[i] = {0, 0};
-                    nfiltered++;
-                }
-            }
-//            flog::info("compressor: filtered {} of {}", nfiltered, fftSize);
-            return cma;
-        }
 
-        int zz = 0;
+            // One move per block for what's left of the input
+            inputBuffer.erase(inputBuffer.begin(), inputBuffer.begin() + inputPos);
+            inputPos = 0;
+            return count;
+        }
 
-        std::vector<float> estimateNoise(FloatArray noiseFloor) {
-            int nslices = 30;
-            int slice = fftSize / nslices;
-            auto rv = std::vector<float>(nslices);
-            for(int i=0; i<nslices; i++) {
-                rv[i] = 7 + noiseFloor->at(i * slice + slice/2); // 7db is due to averaging, probably
+    private:
+        // FFT stage output
+        struct Slice {
+            std::vector<complex_t> spectrum;    // centered, as swapfft() leaves it
+            std::vector<float> clearMags;       // power spectrum in dB
+            std::vector<float> windowedMags;    // same with the window applied
+            bool hasMags = false;               // none in tx mode
+        };
+
+        struct Magnitudes {
+            std::vector<float> clear;
+            std::vector<float> windowed;
+        };
+
+        void allocateBuffers() {
+            auto sizeSlice = [this](Slice& s) {
+                s.spectrum.resize(fftSize);
+                s.clearMags.resize(fftSize);
+                s.windowedMags.resize(fftSize);
+            };
+            sizeSlice(syncSlice);
+            for (auto& s : slicePool) { sizeSlice(s); }
+            spectrumHistory.resize(minRecents);
+            for (auto& h : spectrumHistory) { h.resize(fftSize); }
+            magHistory.resize(2 * minRecents + 1);
+            for (auto& h : magHistory) {
+                h.clear.resize(fftSize);
+                h.windowed.resize(fftSize);
             }
-            return rv;
+            clearAvg.resize(fftSize);
+            windowedAvg.resize(fftSize);
+            for (auto& s : scratch) { s.resize(fftSize); }
+            noiseEstimate.resize(NOISE_SLICES);
+            percentileScratch.reserve(fftSize);
         }
 
-        bool txMode = false;
-        void setTxMode(int txMode) {
-            this->txMode = txMode;
+        // Both FFTs of a slice, the spectrum centered like swapfft() does
+        void analyzeSlice(const complex_t* samples, Slice& s) {
+            int half = fftSize / 2;
+            memcpy(fftIn, samples, fftSize * sizeof(complex_t));
+            fftPlan->execute();
+            memcpy(s.spectrum.data(), fftOut + half, half * sizeof(complex_t));
+            memcpy(s.spectrum.data() + half, fftOut, half * sizeof(complex_t));
+
+            s.hasMags = !txMode;
+            if (!s.hasMags) { return; }
+            volk_32fc_s32f_power_spectrum_32f(s.clearMags.data(), (const lv_32fc_t *)s.spectrum.data(), fftSize, fftSize);
+
+            volk_32fc_32f_multiply_32fc((lv_32fc_t*)fftIn, (const lv_32fc_t*)samples, fftWindow.data(), fftSize);
+            fftPlan->execute();
+            volk_32fc_s32f_power_spectrum_32f(s.windowedMags.data(), (const lv_32fc_t *)(fftOut + half), fftSize, half);
+            volk_32fc_s32f_power_spectrum_32f(s.windowedMags.data() + half, (const lv_32fc_t *)fftOut, fftSize, half);
         }
 
-        inline int process() {
-
-            if (inputBuffer.size() < fftSize) {
+        // Adds a slice to the history, then filters and writes out the oldest one once the history is full
+        int finishSlice(const Slice& s, complex_t* out) {
+            std::copy(s.spectrum.begin(), s.spectrum.end(), spectrumHistory[(spectrumHead + spectrumCount) % minRecents].begin());
+            spectrumCount++;
+            if (s.hasMags) {
+                auto& m = magHistory[(magHead + magCount) % magHistory.size()];
+                std::copy(s.clearMags.begin(), s.clearMags.end(), m.clear.begin());
+                std::copy(s.windowedMags.begin(), s.windowedMags.end(), m.windowed.begin());
+                magCount++;
+            }
+            if (spectrumCount < minRecents) {
                 return 0;
             }
 
-            inArray->clear();
-            inArray->insert(inArray->begin(), inputBuffer.begin(), inputBuffer.begin() + fftSize);
-            inputBuffer.erase(inputBuffer.begin(), inputBuffer.begin() + fftSize);
-            auto out = fftPlan->npfftfft(inArray);
-            swapfft(out);
-            cleanFreqDomain.emplace_back(clone(out));
+            std::copy(spectrumHistory[spectrumHead].begin(), spectrumHistory[spectrumHead].end(), out);
+            averageMagnitudes();
 
-            auto spectrumOut = npzeros(fftSize);
-            volk_32fc_s32f_power_spectrum_32f(spectrumOut->data(), (const lv_32fc_t *) out->data(), fftSize, fftSize);
-            if (!txMode) {
-                cleanMagnitudes.emplace_back(spectrumOut);
-            }
-
-            // applying window to get windowed windowedSpectrum
-            volk_32fc_32f_multiply_32fc((lv_32fc_t*)inArray->data(), (lv_32fc_t*)inArray->data(), fftWindow.data(), fftSize);
-            out = fftPlan->npfftfft(inArray);
-            swapfft(out);
-            auto windowedSpectrumOut = npzeros(fftSize);
-            volk_32fc_s32f_power_spectrum_32f(windowedSpectrumOut->data(), (const lv_32fc_t *) out->data(), fftSize, fftSize);
-            if (!txMode) {
-                windowedMagnitudes.emplace_back(windowedSpectrumOut);
+            if (lossRate > 0) {
+                const float* nf = filterSignal(out); // result is filtered out
+                if (!txMode) {
+                    estimateNoise(nf); // i/q variance estimate, output is in noise figure.
+                    sharedDataLock.lock();
+                    noiseFigure.assign(noiseEstimate.begin(), noiseEstimate.end());
+                    sharedDataLock.unlock();
+                }
             }
 
-            if (cleanFreqDomain.size() < minRecents) {
-                return 0;
+            for(int i=0; i<fftSize; i++) {
+                // make amplitude logarithmic, for better for 8bit scaling
+                if (out[i].re == 0 && out[i].im == 0) { continue; }
+                auto amp = out[i].amplitude();
+                auto namp = sqrt(sqrt(amp));
+                out[i] *= (namp / amp);
             }
 
-            std::copy(cleanFreqDomain[0]->begin(), cleanFreqDomain[0]->end(), this->out.writeBuf);
-
-            auto windowedSpectrum = npzeros(fftSize);
-            for (int r = 0; r < windowedMagnitudes.size(); r++) {
-                windowedSpectrum = addeach(windowedSpectrum, windowedMagnitudes[r]);
+            spectrumHead = (spectrumHead + 1) % minRecents;
+            spectrumCount--;
+            if (magCount > minRecents * 2) {
+                magHead = (magHead + 1) % magHistory.size();
+                magCount--;
             }
-            windowedSpectrum = div(windowedSpectrum, windowedMagnitudes.size());
+            return fftSize;
+        }
 
-            auto clearSpectrum = npzeros(fftSize);
-            for (int r = 0; r < cleanMagnitudes.size(); r++) {
-                clearSpectrum = addeach(clearSpectrum, cleanMagnitudes[r]);
+        // Oldest first, the same order of additions as summing the list of arrays
+        void averageMagnitudes() {
+            std::fill(clearAvg.begin(), clearAvg.end(), 0.0f);
+            std::fill(windowedAvg.begin(), windowedAvg.end(), 0.0f);
+            for (int r = 0; r < magCount; r++) {
+                auto& m = magHistory[(magHead + r) % magHistory.size()];
+                volk_32f_x2_add_32f(clearAvg.data(), clearAvg.data(), m.clear.data(), fftSize);
+                volk_32f_x2_add_32f(windowedAvg.data(), windowedAvg.data(), m.windowed.data(), fftSize);
             }
-            clearSpectrum = div(clearSpectrum, cleanMagnitudes.size());
+            float scale = 1.0 / (float)magCount;
+            volk_32f_s32f_multiply_32f(clearAvg.data(), clearAvg.data(), scale, fftSize);
+            volk_32f_s32f_multiply_32f(windowedAvg.data(), windowedAvg.data(), scale, fftSize);
+        }
 
-            std::vector<dsp::complex_t> noise(fftSize, {0, 0});
+        // returns noise floor
+        const float* filterSignal(dsp::complex_t *unfiltered) {
+            const float* windowedMags = windowedAvg.data();
+            const float* clearMags = clearAvg.data();
+            float* mvar = scratch[0].data();
+            float* cma = scratch[1].data();
+            float* tmp = scratch[2].data();
+            float* work = scratch[3].data();
+
+            movingVariance(windowedMags, mvar, work, fftSize, noiseNPoints);
+            auto newAllowance = lossRate * percentile::percentile_sampling(mvar, fftSize, .15, percentileScratch);
+            auto allowance = newAllowance * 0.1 + prevAllowance * 0.9;
+            prevAllowance = allowance;
 
-            if (lossRate > 0) {
-                auto nf = filterSignal(windowedSpectrum, clearSpectrum, this->out.writeBuf); // result is filtered writebuf
-                if (!txMode) {
-                    auto newNoiseFigure = estimateNoise(nf); // i/q variance estimate, output is in noise figure.
-                    sharedDataLock.lock();
-                    noiseFigure = newNoiseFigure;
-                    sharedDataLock.unlock();
+            centeredSma(windowedMags, cma, fftSize, largeTick);
+            for (int i = 0; i < fftSize; i++) {
+                if (mvar[i] > allowance) {
+                    cma[i] = 0;
                 }
             }
-            auto unfiltered = this->out.writeBuf;
-            for(int i=0; i<fftSize; i++) {
-                // make amplitude logarithmic, for better for 8bit scaling
-                if (unfiltered[i].re == 0 && unfiltered[i].im == 0) {
-
-                } else {
-                    auto amp = unfiltered[i].amplitude();
-                    auto namp = sqrt(sqrt(amp));
-                    unfiltered[i] *= (namp / amp);
+            dsp::math::linearInterpolateHoles(cma, fftSize);
+
+            centeredSma(cma, tmp, fftSize, largeTick);          // cleared noise floor.
+            std::swap(cma, tmp);
+            float* cmax = work;
+            centeredSma(cma, cmax, fftSize, 5*largeTick);
+            float* diff = mvar;
+            volk_32f_x2_subtract_32f(diff, cma, cmax, fftSize);
+            for (int i = 0; i < fftSize; i++) {
+                diff[i] = fabs(diff[i]);
+            }
+            auto cmaxAllow = percentile::percentile_sampling(diff, fftSize, .15, percentileScratch);
+            for (int i = 0; i < fftSize; i++) {
+                if (diff[i] > cmaxAllow) {
+                    cma[i] = 0;
                 }
             }
+            dsp::math::linearInterpolateHoles(cma, fftSize);
+            centeredSma(cma, tmp, fftSize, largeTick);          // cleared noise floor.
+            std::swap(cma, tmp);
 
-            if (fftSize < 16000 && false) {
-                uint8_t  buf[30000];
-                dsp::complex_t tbuf[30000];
-                int cnt = SampleStreamCompressor::process(fftSize, PCM_TYPE_I8, unfiltered, buf);
-                int ocnt = SampleStreamDecompressor::process(cnt, buf, tbuf);
-                float maxdelta = 0;
-                for(int q=0; q<fftSize; q++) {
-                    auto delta = (tbuf[q] - unfiltered[q]).amplitude();
-                    if (delta > maxdelta) {
-                        maxdelta = delta;
+            float* mask = work;
+            std::fill(mask, mask + fftSize, 0.0f);
+            if (!txMode) {
+                // for rx mode, add good signals to mask, for tx assume no signals at all. Mask will be used to filter signal.
+                for (int i = 0; i < fftSize; i++) {
+                    if (clearMags[i] > cma[i] + allowance) {     // allowance = normal noise variance
+                        mask[i] = 1;
                     }
                 }
-                flog::info("ocnt = {}  maxerr={}", ocnt, maxdelta);
             }
-
-
-            // averaged windowedSpectrum ready, normalized around 0. Calculating noise floor
-
-//            auto smallSma = centeredSma(windowedSpectrum, smallTick);
-//            auto largeSma = centeredSma(windowedSpectrum, largeTick);
-//            auto mask = npzeros(fftSize);
-//            int rawNoiseCount = 0;
-//            auto sdata = windowedSpectrum->data();;
-//            auto sigmaskdata = mask->data();
-//            for(int i=1; i<fftSize-1; i++) {
-//                if (sdata[i] * sdata[i-1] < 0 && sdata[i] * sdata[i+1] < 0) {
-//                    // noikse
-//                    rawNoiseCount++;
-//                } else {
-//                    sigmaskdata[i] = 1.0;
-//                }
-//            }
-//            for(int i=0; i<fftSize-2; i++) {
-//                if (sigmaskdata[i] == 0 && sigmaskdata[i+2] == 0 && sigmaskdata[i+1] != 0) {
-//                    sigmaskdata[i+1] = 0;       // remove singular signals, which are not.
-//                    rawNoiseCount++;
-//                }
-//            }
-//
-//            int noiseCount = 0;
-//            int sliceSize = fftSize / noiseNPoints;
-//
-//            if (rawNoiseCount > 30 * noiseNPoints) {
-//                auto spectrumVars = npzeros(noiseNPoints);  // variances
-//                for (int p = 0; p < noiseNPoints; p++) {
-//                    float sum = 0;
-//                    int cnt = 0;
-//                    for (int q = 0; q < sliceSize; q++) {
-//                        if (sigmaskdata[q + p * sliceSize] == 0) {
-//                            double dbl = sdata[q + p * sliceSize];
-//                            sum += dbl * dbl;
-//                            cnt++;
-//                        }
-//                    }
-//                    if (cnt == 0) {
-//                        cnt = 1; // value will be 0
-//                    }
-//                    spectrumVars->at(p) = sum / cnt;
-//                }
-//
-//                math::linearInterpolateHoles(spectrumVars->data(), spectrumVars->size());
-//                spectrumVars->emplace_back(spectrumVars->back()); // duplicate last item.
-//                spectrumVars = centeredSma(spectrumVars, 5);
-//
-//
-//                // build noise figure.
-//
-//                auto iMean = npzeros(noiseNPoints);
-//                auto qMean = npzeros(noiseNPoints);
-//                auto iDev = npzeros(noiseNPoints);
-//                auto qDev = npzeros(noiseNPoints);
-//                char logg[10000] = {0};
-//                for (int p = 0; p < noiseNPoints; p++) {
-//                    dsp::complex_t iqSum = {0, 0};
-//                    int cnt = 0;
-//                    for (int q = 0; q < sliceSize; q++) {
-//                        int srcIndex = q + p * sliceSize;
-//                        if (smallSma->at(srcIndex) < spectrumVars->at(p) * lossRate && lossRate > 0) {
-//                            iqSum += this->out.writeBuf[srcIndex];
-//                            cnt++;
-//                        }
-//                    }
-//                    sprintf(logg + strlen(logg), "%d: cnt1=%d", p, cnt);
-//                    if (cnt == 0) {
-//                        cnt = 1;
-//                    }
-//                    dsp::complex_t mean = {iqSum.re / cnt, iqSum.im / cnt};
-//                    iMean->at(p) = mean.re;
-//                    qMean->at(p) = mean.im;
-//
-//                    dsp::complex_t iqVar = {0, 0};
-//                    cnt = 0;
-//                    for (int q = 0; q < sliceSize; q++) {
-//                        int srcIndex = q + p * sliceSize;
-//                        if (smallSma->at(srcIndex) < spectrumVars->at(p) * lossRate && lossRate > 0) {
-//                            auto dd = this->out.writeBuf[q + p * sliceSize] - mean;
-//                            iqVar += {dd.re * dd.re, dd.im * dd.im};
-//                            cnt++;
-//                        }
-//                    }
-//                    sprintf(logg + strlen(logg), " cnt2=%d iqv=%f+i*%f .", cnt, iqVar.re, iqVar.im);
-//                    if (cnt == 0) {
-//                        cnt = 1;
-//                    }
-//                    dsp::complex_t iqDev = {sqrt(iqVar.re / cnt), sqrt(iqVar.im / cnt)};
-//                    iDev->at(p) = iqDev.re;
-//                    qDev->at(p) = iqDev.im;
-//                }
-////                flog::info("comp: {}", logg);
-//                math::linearInterpolateHoles(iMean->data(), iMean->size());
-//                math::linearInterpolateHoles(qMean->data(), qMean->size());
-//                math::linearInterpolateHoles(iDev->data(), iDev->size());
-//                math::linearInterpolateHoles(qDev->data(), qDev->size());
-//                iMean = centeredSma(iMean, 5);
-//                qMean = centeredSma(qMean, 5);
-//                iDev = centeredSma(iDev, 5);
-//                qDev = centeredSma(qDev, 5);
-//
-//                if (lossRate > 0) {
-//                    sharedDataLock.lock();
-//                    noiseFigure.clear();
-//                    for (int p = 0; p < noiseNPoints; p++) {
-//                        dsp::complex_t iqMean = {iMean->at(p), qMean->at(p)};
-//                        dsp::complex_t iqDev = {iDev->at(p), qDev->at(p)};
-//                        if (isnan(iqMean.im) || isnan(iqMean.re) || isnan(iqDev.im) || isnan(iqDev.re)) {
-//                            flog::info("noise figure is nan: {} {} {} {}", iqMean.im, iqMean.re, iqDev.im, iqDev.re);
-//                        }
-//                        noiseFigure.emplace_back(iqMean);
-//                        noiseFigure.emplace_back(iqDev);
-//                    }
-//                    sharedDataLock.unlock();
-//                }
-//
-//                for(int i=0; i<fftSize; i++) {
-//                    if (smallSma->at(i) < spectrumVars->at(i / sliceSize) * lossRate && lossRate > 0) {
-//                        // remove signals below the noise level.
-//                        this->out.writeBuf[i] = {0, 0};
-//                        noiseCount++;
-//                    }
-//                }
-//
-//            }
-
-
-//            flog::info("RawNoiseCount={} NoiseCount={} ", rawNoiseCount, noiseCount);
-
-            iteration++;
-            if (iteration == -10) {
-                FILE *t = fopen("/tmp/arr.bin", "wb");
-                if (t) {
-                    for (int r = 0; r < minRecents; r++) {
-                        fwrite(cleanFreqDomain[r].get()->data(), sizeof(dsp::complex_t), fftSize, t);
-                    }
-                    fclose(t);
+            sharedDataLock.lock();
+            masked.assign(maskedFrequencies.begin(), maskedFrequencies.end());
+            sharedDataLock.unlock();
+            for(int i=0; i + 1<masked.size(); i+=2) {
+                int tickFrom = fftSize/2 + masked[i+0] / hzTick;
+                int tickTo = fftSize/2 + masked[i+1] / hzTick;
+                for (int j = std::max<int>(tickFrom, 0); j < std::min<int>(tickTo, fftSize); j++) {
+                    mask[j] = 1;
                 }
             }
-
-            cleanFreqDomain.erase(cleanFreqDomain.begin() + 0);
-            if (cleanMagnitudes.size() > minRecents * 2) {
-                cleanMagnitudes.erase(cleanMagnitudes.begin() + 0);
-                windowedMagnitudes.erase(windowedMagnitudes.begin() + 0);
+            float* spread = diff;
+            centeredSma(mask, spread, fftSize, signalWidth / 8);      // add some around the signal
+            for (int i = 0; i < fftSize; i++) {
+                if (spread[i] == 0) {
+                    unfiltered[i] = {0, 0};
+                }
             }
+            return cma;
+        }
 
-            return fftSize;
+        void estimateNoise(const float* noiseFloor) {
+            int slice = fftSize / NOISE_SLICES;
+            for(int i=0; i<NOISE_SLICES; i++) {
+                noiseEstimate[i] = 7 + noiseFloor[i * slice + slice/2]; // 7db is due to averaging, probably
+            }
         }
 
-        int run() {
-            int count = base_type::_in->read();
-            if (count < 0) { return -1; }
+        Slice* takeFreeSlice() {
+            std::unique_lock<std::mutex> lck(sliceMtx);
+            sliceCnd.wait(lck, [this] { return !freeSlices.empty() || workerStop; });
+            if (workerStop) { return NULL; }
+            Slice* slice = freeSlices.front();
+            freeSlices.pop_front();
+            return slice;
+        }
 
-            if (!enabled) {
-                std::copy(_in->readBuf, _in->readBuf + count, this->out.writeBuf);
-                base_type::_in->flush();
-                if (count > 0) {
-                    if (!base_type::out.swap(count)) { return -1; }
+        void filterWorker() {
+            SetThreadName("efft_filter");
+            while (true) {
+                Slice* slice;
+                {
+                    std::unique_lock<std::mutex> lck(sliceMtx);
+                    sliceCnd.wait(lck, [this] { return !readySlices.empty() || workerStop; });
+                    if (workerStop) { return; }
+                    slice = readySlices.front();
+                    readySlices.pop_front();
                 }
-                return count;
-            } else {
-
-                inputBuffer.insert(inputBuffer.end(), base_type::_in->readBuf, base_type::_in->readBuf + count);
-                base_type::_in->flush();
+                int outCount = finishSlice(*slice, this->out.writeBuf);
+                {
+                    std::lock_guard<std::mutex> lck(sliceMtx);
+                    freeSlices.push_back(slice);
+                }
+                sliceCnd.notify_all();
+                if (outCount && !base_type::out.swap(outCount)) { return; }
+            }
+        }
 
-                int outCount = process();
+        void doStart() override {
+            if (useWorker) {
+                workerStop = false;
+                freeSlices.clear();
+                readySlices.clear();
+                for (auto& s : slicePool) { freeSlices.push_back(&s); }
+                worker = std::thread(&ExperimentalFFTCompressor::filterWorker, this);
+            }
+            block::doStart();
+        }
 
-                // Swap if some data was generated
-                if (outCount) {
-                    if (!base_type::out.swap(outCount)) { return -1; }
-                }
-//                flog::info("experimental FFT compr: inCount={} outCount={} bufSize={}", count, outCount, (int)inputBuffer.size());
-                return outCount;
+        void doStop() override {
+            // Slices still queued are dropped, the worker may be waiting on the output
+            {
+                std::lock_guard<std::mutex> lck(sliceMtx);
+                workerStop = true;
             }
+            sliceCnd.notify_all();
+            base_type::out.stopWriter();
+            if (worker.joinable()) { worker.join(); }
+            block::doStop();
         }
 
+        static constexpr int NOISE_SLICES = 30;
 
+        Arg<FFTPlan> fftPlan;
+        complex_t* fftIn = NULL;
+        complex_t* fftOut = NULL;
+        std::vector<float> fftWindow;
+
+        std::vector<complex_t> inputBuffer;
+        size_t inputPos = 0;
+
+        // Rings, oldest at the head
+        std::vector<std::vector<complex_t>> spectrumHistory;
+        int spectrumHead = 0;
+        int spectrumCount = 0;
+        std::vector<Magnitudes> magHistory;
+        int magHead = 0;
+        int magCount = 0;
+
+        std::vector<float> clearAvg;
+        std::vector<float> windowedAvg;
+        std::vector<float> scratch[4];
+        std::vector<float> percentileScratch;
+        std::vector<float> noiseEstimate;
+        std::vector<int32_t> maskedFrequencies;
+        std::vector<int32_t> masked;
+
+        Slice syncSlice;
+        Slice slicePool[SLICE_QUEUE_SIZE];
+        bool useWorker = false;
+        std::thread worker;
+        std::mutex sliceMtx;
+        std::condition_variable sliceCnd;
+        std::deque<Slice*> freeSlices;
+        std::deque<Slice*> readySlices;
+        bool workerStop = false;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <stdint.h>
+#include <zstd.h>
+#include <zdict.h>
+
+namespace dsp::compression {
+    // Packet wise zstd stream. Every packet is flushed so it decodes as soon as it arrives, but the window
+    // carries over from packet to packet so each one compresses against the ones before it.
+    // The decoder must see every packet of a frame in order, lost packets need a reset on both sides.
+    class ZstdStreamEncoder {
+    public:
+        // Training data collected before building a dictionary, cut in samples of DICT_SAMPLE_SIZE
+        static constexpr int DICT_TRAINING_BYTES = 1024 * 1024;
+        static constexpr int DICT_SAMPLE_SIZE = 4096;
+        static constexpr int DICT_CAPACITY = 16 * 1024;
+
+        ZstdStreamEncoder(int level = 1) : level(level) {
+            cctx = ZSTD_createCCtx();
+            windowStart = std::chrono::steady_clock::now();
+        }
+
+        ~ZstdStreamEncoder() {
+            ZSTD_freeCCtx(cctx);
+        }
+
+        // The next packet starts a new frame
+        void reset() {
+            resetPending = true;
+        }
+
+        // Dictionary for the frames started from now on, empty for none
+        void setDictionary(const std::vector<uint8_t>& dict) {
+            dictionary = dict;
+            resetPending = true;
+        }
+
+        const std::vector<uint8_t>& getDictionary() {
+            return dictionary;
+        }
+
+        // Feeds a packet to the dictionary trainer. Returns true when this packet completed the training data
+        // and a dictionary could be built, it is then used from the next packet on.
+        bool train(const uint8_t* in, int count) {
+            if (trainingDone) { return false; }
+            for (int i = 0; i < count; i += DICT_SAMPLE_SIZE) {
+                int size = std::min<int>(DICT_SAMPLE_SIZE, count - i);
+                trainingData.insert(trainingData.end(), &in[i], &in[i + size]);
+                trainingSizes.push_back(size);
+            }
+            if (trainingData.size() < DICT_TRAINING_BYTES) { return false; }
+
+            trainingDone = true;
+            std::vector<uint8_t> dict(DICT_CAPACITY);
+            size_t size = ZDICT_trainFromBuffer(dict.data(), dict.size(), trainingData.data(), trainingSizes.data(), trainingSizes.size());
+            std::vector<uint8_t>().swap(trainingData);
+            std::vector<size_t>().swap(trainingSizes);
+            if (ZDICT_isError(size)) { return false; }
+            dict.resize(size);
+            setDictionary(dict);
+            return true;
+        }
+
+        void restartTraining() {
+            trainingDone = false;
+            trainingData.clear();
+            trainingSizes.clear();
+        }
+
+        // Compresses one packet into out starting at offset, growing out if needed. Returns the compressed size,
+        // or -1 on error after which the stream restarts. frameStart tells if the decoder must reset for it.
+        int compress(const uint8_t* in, int count, std::vector<uint8_t>& out, int offset, bool& frameStart) {
+            auto start = std::chrono::steady_clock::now();
+
+            frameStart = resetPending;
+            if (resetPending) {
+                ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+                ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+                if (!dictionary.empty()) { ZSTD_CCtx_loadDictionary(cctx, dictionary.data(), dictionary.size()); }
+                resetPending = false;
+            }
+
+            size_t needed = offset + ZSTD_compressBound(count);
+            if (out.size() < needed) { out.resize(needed); }
+
+            ZSTD_inBuffer inBuf = { in, (size_t)count, 0 };
+            ZSTD_outBuffer outBuf = { &out[offset], out.size() - offset, 0 };
+            size_t remaining;
+            do {
+                remaining = ZSTD_compressStream2(cctx, &outBuf, &inBuf, ZSTD_e_flush);
+                if (ZSTD_isError(remaining)) {
+                    resetPending = true;
+                    return -1;
+                }
+            } while (remaining != 0);
+
+            auto now = std::chrono::steady_clock::now();
+            windowRawBytes += count;
+            windowCompressedBytes += outBuf.pos;
+            windowCompressTime += now - start;
+            double elapsed = std::chrono::duration<double>(now - windowStart).count();
+            if (elapsed >= 1.0) {
+                ratio = windowCompressedBytes ? (float)windowRawBytes / (float)windowCompressedBytes : 0.0f;
+                compressMillisPerSecond = std::chrono::duration<float, std::milli>(windowCompressTime).count() / elapsed;
+                windowRawBytes = 0;
+                windowCompressedBytes = 0;
+                windowCompressTime = std::chrono::steady_clock::duration::zero();
+                windowStart = now;
+            }
+
+            return outBuf.pos;
+        }
+
+        // Raw over compressed bytes during the last full second
+        inline float getRatio() { return ratio; }
+
+        // Time spent compressing per second of wall time, during the last full second
+        inline float getCompressMillisPerSecond() { return compressMillisPerSecond; }
+
+    private:
+        ZSTD_CCtx* cctx;
+        int level;
+        bool resetPending = true;
+        std::vector<uint8_t> dictionary;
+
+        bool trainingDone = false;
+        std::vector<uint8_t> trainingData;
+        std::vector<size_t> trainingSizes;
+
+        std::chrono::steady_clock::time_point windowStart;
+        uint64_t windowRawBytes = 0;
+        uint64_t windowCompressedBytes = 0;
+        std::chrono::steady_clock::duration windowCompressTime = std::chrono::steady_clock::duration::zero();
+        float ratio = 0.0f;
+        float compressMillisPerSecond = 0.0f;
+    };
+
+    class ZstdStreamDecoder {
+    public:
+        ZstdStreamDecoder() {
+            dctx = ZSTD_createDCtx();
+        }
+
+        ~ZstdStreamDecoder() {
+            ZSTD_freeDCtx(dctx);
+        }
+
+        // Dictionary for the frames started from now on, empty for none
+        void setDictionary(const uint8_t* data, int size) {
+            dictionary.assign(data, data + size);
+        }
+
+        // Decodes one packet into out. Returns the decoded size, or -1 on error or while waiting for the
+        // start of a frame after an error.
+        int decompress(const uint8_t* in, int count, uint8_t* out, int capacity, bool frameStart) {
+            if (frameStart) {
+                ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+                if (!dictionary.empty()) { ZSTD_DCtx_loadDictionary(dctx, dictionary.data(), dictionary.size()); }
+                synced = true;
+            }
+            if (!synced) { return -1; }
+
+            ZSTD_inBuffer inBuf = { in, (size_t)count, 0 };
+            ZSTD_outBuffer outBuf = { out, (size_t)capacity, 0 };
+            while (true) {
+                size_t ret = ZSTD_decompressStream(dctx, &outBuf, &inBuf);
+                if (ZSTD_isError(ret) || outBuf.pos == outBuf.size) {
+                    // Corrupt or bigger than a packet can be, nothing is usable until the next frame
+                    synced = false;
+                    return -1;
+                }
+                if (inBuf.pos == inBuf.size) { break; }
+            }
+            return outBuf.pos;
+        }
+
+    private:
+        ZSTD_DCtx* dctx;
+        std::vector<uint8_t> dictionary;
+        bool synced = false;
+    };
+}
@@ -9,46 +9,10 @@
 #include <ctm.h>
 #include <iomanip>
 #include <sstream>
+#include <volk/volk.h>
 
 namespace dsp::detector {
 
-    // Normalize magnitudes by subtracting a moving average
-    static std::vector<float> normalizeMagnitudes(const ArrayView<float>& magnitudes) {
-        const int WINDOW = 300;
-        const int n = magnitudes.size();
-        std::vector<float> normalized(n, 0.0f);
-        
-        if (n == 0) {
-            return normalized;
-        }
-        
-        // Compute moving average for each point
-        for (int i = 0; i < n; i++) {
-            // Define window boundaries, ensuring they stay within array bounds
-            int start_idx = std::max<int>(0, i - WINDOW/2);
-            int end_idx = std::min<int>(n-1, i + WINDOW/2);
-            
-            if (start_idx > end_idx) {
-                continue;  // Skip if window is invalid
-            }
-                
-            // Compute the mean of the window
-            float window_sum = 0.0f;
-            int count = 0;
-            for (int j = start_idx; j <= end_idx; j++) {
-                window_sum += magnitudes[j];
-                count++;
-            }
-            
-            float window_mean = (count > 0) ? window_sum / count : 0.0f;
-                
-            // Subtract the local mean from the current value
-            normalized[i] = magnitudes[i] - window_mean;
-        }
-        
-        return normalized;
-    }
-
     // Helper for percentile calculation
     static float percentileFast(std::vector<float> arr, float p) {
         size_t n = arr.size();
@@ -71,196 +35,20 @@ namespace dsp::detector {
         return data.at(n/2);
     }
 
-    // Find the dominant harmonic intervals in a spectrum
-    static std::pair<std::vector<int>, std::vector<float>> findDominantHarmonicIntervals(
-        const ArrayView<float>& spectrum,
-        int epsilon,
-        int min_interval,
-        int max_interval
-    ) {
-        int N = spectrum.size();
-        if (N == 0) {
-            return std::make_pair(std::vector<int>(), std::vector<float>());
-        }
-
-        // Validate input parameters
-        if (min_interval <= 0 || max_interval < min_interval || max_interval >= N) {
-            flog::error("Invalid interval range: min={}, max={}, N={}", min_interval, max_interval, N);
-            return std::make_pair(std::vector<int>(), std::vector<float>());
-        }
-
-        if (epsilon <= 0) {
-            flog::error("Epsilon must be positive: epsilon={}", epsilon);
-            return std::make_pair(std::vector<int>(), std::vector<float>());
-        }
-
-        // Create range of intervals
-        std::vector<int> intervals;
-        intervals.reserve(max_interval - min_interval + 1);
-        for (int d = min_interval; d <= max_interval; d++) {
-            intervals.push_back(d);
-        }
-
-        int num_intervals = intervals.size();
-        if (num_intervals == 0) {
-            return std::make_pair(std::vector<int>(), std::vector<float>());
-        }
-
-        // Raw responses matrix: intervals x spectrum
-        std::vector<std::vector<float>> raw_responses(num_intervals, std::vector<float>(N, 0.0f));
-
-        // 1. Compute lag products
-        for (int k = 0; k < num_intervals; k++) {
-            int d = intervals[k];
-            int valid_len = N - d;
-
-            if (valid_len > 0) {
-                for (int i = 0; i < valid_len; i++) {
-                    raw_responses[k][i] = std::max<float>(0.0f, spectrum[i]) * std::max<float>(0.0f, spectrum[i + d]);
-                }
-            }
-        }
-
-        // 2. Use raw responses directly for further processing without smoothing
-        const std::vector<std::vector<float>>& smoothed_responses = raw_responses;
-
-        // 3. Find dominant interval and confidence for each position
-        std::vector<int> dominant_intervals(N, 0);
-        std::vector<float> confidence_scores(N, 0.0f);
-
-        for (int i = 0; i < N; i++) {
-            float max_val = -std::numeric_limits<float>::infinity();
-            int max_k = 0;
-
-            for (int k = 0; k < num_intervals; k++) {
-                if (smoothed_responses[k][i] > max_val) {
-                    max_val = smoothed_responses[k][i];
-                    max_k = k;
-                }
-            }
-
-            if (max_k < static_cast<int>(intervals.size())) {
-                dominant_intervals[i] = intervals[max_k];
-                confidence_scores[i] = max_val;
-            }
-        }
-
-        return std::make_pair(dominant_intervals, confidence_scores);
-    }
-
-    // Get line candidates from a frequency slice
-    static std::shared_ptr<std::vector<float>> getLineCandidates(const ArrayView<float>& first_slice_db) {
-        // Guard against empty input
-        if (first_slice_db.size() == 0) {
-            return std::make_shared<std::vector<float>>();
-        }
-        
-        // Initialize return value with -20 for all elements
-        auto retval = std::make_shared<std::vector<float>>(first_slice_db.size(), -20.0f);
-        
-        // Normalize the magnitudes
-        std::vector<float> normalized_slice = normalizeMagnitudes(first_slice_db);
-
-        // Find dominant harmonic intervals
-        auto result = findDominantHarmonicIntervals(
-            ArrayView<float>(normalized_slice), 250, 8, 35);
-
-        const std::vector<int>& freq = result.first;
-        const std::vector<float>& score = result.second;
-
-        // Early return if frequencies couldn't be determined
-        if (freq.empty() || freq.size() < 100) {
-            flog::info("Not enough frequency data for line candidate detection");
-            return retval;
-        }
-
-        // Scan through the data in sections
-        for (size_t p = 0; p + 100 <= freq.size(); p += 50) {
-            size_t vl1 = p;
-            size_t vl2 = p + 100;
-
-            if (vl2 > normalized_slice.size()) {
-                vl2 = normalized_slice.size();
-            }
-
-            if (vl2 <= vl1) {
-                continue;
-            }
-
-            // Extract view of data for this section
-            ArrayView<float> subdata(&normalized_slice[vl1], vl2 - vl1);
-
-            // Extract frequency for this section
-            std::vector<int> freqSection(freq.begin() + vl1, freq.begin() + vl2);
-
-            if (freqSection.empty()) {
-                continue;
-            }
-
-            int domfreq_int = median_destructive(freqSection);
-
-            // Guard against invalid dominant frequency
-            if (domfreq_int <= 0) {
-                continue;
-            }
-
-            // Initialize offset score
-            std::vector<float> offset_score(domfreq_int, 0.0f);
-
-            // Accumulate signals at each phase offset
-            for (size_t x = 0; x < subdata.size(); x++) {
-                // Ensure modulo calculation is correct and in bounds
-                int offset = static_cast<int>((x + offset_score.size() - 1) % offset_score.size());
-                if (offset >= 0 && offset < static_cast<int>(offset_score.size())) {
-                    offset_score[offset] += subdata[x];
-                }
-            }
-
-            // Find phase with maximum score
-            auto max_it = std::max_element(offset_score.begin(), offset_score.end());
-            if (max_it == offset_score.end()) {
-                continue;
-            }
-
-            int phase = std::distance(offset_score.begin(), max_it);
-
-            // Collect in-phase samples
-            std::vector<float> inphase;
-            std::vector<size_t> inphaseix;
-
-            for (int ix = phase; ix < static_cast<int>(subdata.size()); ix += domfreq_int) {
-                if (ix >= 0 && ix < static_cast<int>(subdata.size())) {
-                    inphase.push_back(subdata[ix]);
-                    inphaseix.push_back(vl1 + ix);
-                }
-            }
-
-            // Find maximum in-phase value
-            if (!inphase.empty()) {
-                auto max_inphase_it = std::max_element(inphase.begin(), inphase.end());
-                int maxi = std::distance(inphase.begin(), max_inphase_it);
-
-                // Mark peaks before maximum
-                for (int x = maxi - 4; x < maxi; x++) {
-                    if (x >= 0 && x < static_cast<int>(inphase.size())) {
-                        size_t ix = inphaseix[x];
-                        if (ix < normalized_slice.size() && ix < retval->size()) {
-                            (*retval)[ix] = -normalized_slice[ix];
-                        }
-                    }
-                }
-            }
-        }
-
-        return retval;
-    }
-
-
     SignalDetector::SignalDetector() {
         flog::info("Signal detector.");
     }
 
     SignalDetector::~SignalDetector() {
+        if (workerThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lck(rowMtx);
+                stopWorker = true;
+            }
+            rowCV.notify_all();
+            workerThread.join();
+        }
+
         if (!base_type::_block_init) { return; }
         base_type::stop();
 
@@ -269,12 +57,17 @@ namespace dsp::detector {
             fftWindowBuf = nullptr;
         }
 
-        fftInArray.reset();
+        fftMagArray.reset();
         fftPlan.reset();
     }
 
     void SignalDetector::init(stream<complex_t> *in) {
         base_type::init(in);
+        if (!workerThread.joinable()) {
+            detectPool = std::make_unique<WorkerPool>(std::clamp<int>((int)std::thread::hardware_concurrency() / 2, 1, 4));
+            stopWorker = false;
+            workerThread = std::thread(&SignalDetector::worker, this);
+        }
     }
 
     void SignalDetector::setSampleRate(double sampleRate) {
@@ -301,7 +94,14 @@ namespace dsp::detector {
 
     void SignalDetector::clear() {
         bufferPos = 0;
-        framesSinceLastDetect = 0;
+
+        // Rows of the old spectrum are not detected anymore, the history restarts with the next one
+        std::lock_guard<std::mutex> lck(rowMtx);
+        while (!readyRows.empty()) {
+            freeRows.push_back(readyRows.front());
+            readyRows.pop_front();
+        }
+        resetHistory = true;
     }
 
     void SignalDetector::updateFFTSize() {
@@ -312,6 +112,10 @@ namespace dsp::detector {
         // Calculate FFT size as samplerate/10
         int newFFTSize = sampleRate * TIME_SLICE;
 
+        // The detection stage must not be in the middle of a row while the buffers change
+        std::lock_guard<std::mutex> dlck(detectMtx);
+        std::lock_guard<std::mutex> lck(rowMtx);
+
         fftSize = newFFTSize;
         flog::info("Signal detector FFT size set to {0}", fftSize);
 
@@ -328,14 +132,21 @@ namespace dsp::detector {
         // Allocate window buffer
         fftWindowBuf = new float[fftSize];
 
-        // Allocate new input array
-        fftInArray = std::make_shared<std::vector<complex_t> >(fftSize);
+        // Allocate new magnitude array
+        fftMagArray = std::make_shared<std::vector<float> >(fftSize);
 
         // Create FFT plan (forward transform)
         fftPlan = dsp::arrays::allocateFFTWPlan(false, fftSize);
 
         // Generate window function
         generateWindow();
+
+        // Row hand-off between the stages
+        rowPool.assign(ROW_QUEUE_SIZE, std::vector<float>(fftSize));
+        freeRows.clear();
+        readyRows.clear();
+        for (int i = 0; i < ROW_QUEUE_SIZE; i++) { freeRows.push_back(i); }
+        resetHistory = true;
     }
 
     void SignalDetector::generateWindow() {
@@ -363,121 +174,297 @@ namespace dsp::detector {
             return count;
         }
 
-        // Process samples and perform FFT when buffer is full
-        for (int i = 0; i < count; i++) {
-            // Store sample in buffer
-            if (bufferPos < fftSize) {
-                buffer[bufferPos++] = base_type::_in->readBuf[i];
-            }
-
-            // When buffer is full, perform FFT
+        // Collect samples and capture a row when the buffer is full
+        int done = 0;
+        while (done < count) {
+            int n = std::min<int>(count - done, fftSize - bufferPos);
+            memcpy(&buffer[bufferPos], &base_type::_in->readBuf[done], n * sizeof(complex_t));
+            bufferPos += n;
+            done += n;
             if (bufferPos >= fftSize) {
-                // Apply window function
-                auto &inVec = *fftInArray;
-                for (int j = 0; j < fftSize; j++) {
-                    inVec.at(j).re = buffer.at(j).re * fftWindowBuf[j];
-                    inVec.at(j).im = buffer.at(j).im * fftWindowBuf[j];
-                }
-
-                // Execute FFT
-                dsp::arrays::npfftfft(fftInArray, fftPlan);
-                
-                // Swap FFT output so that 0 frequency is at the center
-                dsp::arrays::swapfft(fftPlan->getOutput());
-
-                // Compute magnitude spectrum
-                auto mag = dsp::arrays::npabsolute(fftPlan->getOutput());
-
-                // Convert magnitude to logarithmic scale (dB)
-                for (int j = 0; j < fftSize; j++) {
-                    // Add small value (1e-10) to avoid log of zero, multiply by 20 to convert to dB
-                    mag->at(j) = 20.0f * log10f(mag->at(j) + 1e-10f);
-                }
-
-                addSingleFFTRow(*mag);
+                captureRow();
                 bufferPos = 0;
             }
-            // Pass through the original data unchanged
-            base_type::out.writeBuf[i] = base_type::_in->readBuf[i];
         }
 
+        // Pass through the original data unchanged
+        memcpy(base_type::out.writeBuf, base_type::_in->readBuf, count * sizeof(complex_t));
+
         base_type::_in->flush();
         if (!base_type::out.swap(count)) { return -1; }
         return count;
     }
 
-    void SignalDetector::aggregateAndDetect() {
-        if (suppressedCarrierCandidates.empty()) {
+    void SignalDetector::captureRow() {
+        int row = -1;
+        {
+            std::lock_guard<std::mutex> lck(rowMtx);
+            if (!freeRows.empty()) {
+                row = freeRows.front();
+                freeRows.pop_front();
+            }
+        }
+        if (row < 0) {
+            // Detection is behind, don't even spend the FFT on this row
+            droppedRows++;
             return;
         }
 
-        // Get dimensions
-        size_t freq_bins = suppressedCarrierCandidates[0]->size();
-        size_t time_bins = suppressedCarrierCandidates.size();
+        // Apply window function straight into the plan input
+        volk_32fc_32f_multiply_32fc((lv_32fc_t*)fftPlan->getInput()->data(), (lv_32fc_t*)buffer.data(), fftWindowBuf, fftSize);
 
-        if (freq_bins == 0 || time_bins == 0) {
-            return;
+        // Execute FFT
+        fftPlan->execute();
+
+        // Swap FFT output so that 0 frequency is at the center
+        dsp::arrays::swapfft(fftPlan->getOutput());
+
+        // Compute magnitude spectrum
+        auto& mag = fftMagArray;
+        dsp::arrays::npabsolute(fftPlan->getOutput(), mag);
+
+        // Convert magnitude to logarithmic scale (dB)
+        float* out = rowPool[row].data();
+        for (int j = 0; j < fftSize; j++) {
+            // Add small value (1e-10) to avoid log of zero, multiply by 20 to convert to dB
+            out[j] = 20.0f * log10f(mag->at(j) + 1e-10f);
         }
 
-        // Create a 2D array for chosen candidates (in linearized form)
-        // Compute mean across time dimension (vertical mean of all candidates)
-        std::vector<float> sigs(freq_bins, 0.0f);
-        for (size_t f = 0; f < freq_bins; f++) {
-            float sum = 0.0f;
-            int count = 0;
-            for (size_t t = 0; t < time_bins; t++) {
-                const auto& candidates = suppressedCarrierCandidates[t];
-                if (candidates && f < candidates->size()) {
-                    sum += candidates->at(f);
-                    count++;
-                }
-            }
-            sigs[f] = (count > 0) ? sum / count : 0.0f;
+        {
+            std::lock_guard<std::mutex> lck(rowMtx);
+            readyRows.push_back(row);
         }
+        capturedRows++;
+        rowCV.notify_one();
+    }
 
-        // Apply simple moving average with centered kernel of size 3
-        sigs_smoothed.resize(sigs.size());
-        for (size_t i = 0; i < sigs.size(); i++) {
-            if (i == 0) {
-                // Edge case: first element
-                sigs_smoothed[i] = (sigs[i] + sigs[i+1]) / 2.0f;
+    void SignalDetector::worker() {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lck(rowMtx);
+                rowCV.wait(lck, [this] { return stopWorker || !readyRows.empty(); });
+                if (stopWorker) { return; }
             }
-            else if (i == sigs.size() - 1) {
-                // Edge case: last element
-                sigs_smoothed[i] = (sigs[i-1] + sigs[i]) / 2.0f;
+
+            std::lock_guard<std::mutex> dlck(detectMtx);
+            int row;
+            {
+                std::lock_guard<std::mutex> lck(rowMtx);
+                if (readyRows.empty()) { continue; }
+                row = readyRows.front();
+                readyRows.pop_front();
+                processingRow = true;
             }
-            else {
-                // Standard case: centered kernel
-                sigs_smoothed[i] = (sigs[i-1] + sigs[i] + sigs[i+1]) / 3.0f;
+
+            processRow(rowPool[row].data());
+
+            {
+                std::lock_guard<std::mutex> lck(rowMtx);
+                freeRows.push_back(row);
+                processingRow = false;
             }
+            idleCV.notify_all();
         }
+    }
 
+    void SignalDetector::flush() {
+        std::unique_lock<std::mutex> lck(rowMtx);
+        idleCV.wait(lck, [this] { return readyRows.empty() && !processingRow; });
+    }
 
+    bool SignalDetector::getSmoothed(std::vector<float>& out, uint64_t& version) {
+        std::lock_guard<std::mutex> lck(resultMtx);
+        if (version == resultVersion) { return false; }
+        out = sigs_smoothed;
+        version = resultVersion;
+        return true;
     }
 
-    void SignalDetector::addSingleFFTRow(const ArrayView<float> &rowView) {
-        auto candidates = getLineCandidates(rowView);
+    // Subtracts from each bin the mean of the bins within 150 of it, using a prefix sum so each bin costs the same
+    void SignalDetector::normalizeMagnitudes(const float* magnitudes, int n) {
+        const int WINDOW = 300;
+        normalized.resize(n);
+        normPrefix.resize(n + 1);
+        normPrefix[0] = 0.0;
+        for (int i = 0; i < n; i++) {
+            normPrefix[i + 1] = normPrefix[i] + magnitudes[i];
+        }
+        for (int i = 0; i < n; i++) {
+            int start_idx = std::max<int>(0, i - WINDOW/2);
+            int end_idx = std::min<int>(n-1, i + WINDOW/2);
+            float window_mean = (float)((normPrefix[end_idx + 1] - normPrefix[start_idx]) / (end_idx - start_idx + 1));
+            normalized[i] = magnitudes[i] - window_mean;
+        }
+    }
 
-        if (candidates && candidates->size() == rowView.size()) {
-            suppressedCarrierCandidates.push_back(candidates);
+    // For each bin, the spacing within [minInterval, maxInterval] whose lag product with the positive part of
+    // the normalized spectrum is the largest. Bins are split between the detection pool threads.
+    void SignalDetector::findDominantHarmonicIntervals(int minInterval, int maxInterval) {
+        int N = normalized.size();
+        positive.resize(N);
+        confidence.resize(N);
+        dominant.resize(N);
+        for (int i = 0; i < N; i++) {
+            positive[i] = std::max<float>(0.0f, normalized[i]);
+        }
 
-            // Keep a fixed history length
-            while (suppressedCarrierCandidates.size() > N_FFT_ROWS) {
-                suppressedCarrierCandidates.erase(suppressedCarrierCandidates.begin());
+        detectPool->parallelFor(N, [&](int begin, int end) {
+            const float* pos = positive.data();
+            float* conf = confidence.data();
+            int* dom = dominant.data();
+            std::fill(&conf[begin], &conf[end], -std::numeric_limits<float>::infinity());
+            for (int d = minInterval; d <= maxInterval; d++) {
+                // Lags running past the end of the spectrum respond 0
+                int validEnd = std::max<int>(begin, std::min<int>(end, N - d));
+                for (int i = begin; i < validEnd; i++) {
+                    float v = pos[i] * pos[i + d];
+                    bool better = v > conf[i];
+                    conf[i] = better ? v : conf[i];
+                    dom[i] = better ? d : dom[i];
+                }
+                for (int i = validEnd; i < end; i++) {
+                    bool better = 0.0f > conf[i];
+                    conf[i] = better ? 0.0f : conf[i];
+                    dom[i] = better ? d : dom[i];
+                }
             }
+        });
+    }
 
-            // Increment counter for frames since last detection
-            framesSinceLastDetect++;
-
-            // Only detect when we have enough data AND detection interval has passed
-            if (suppressedCarrierCandidates.size() > MIN_DETECT_FFT_ROWS && 
-                framesSinceLastDetect >= DETECT_INTERVAL_FRAMES) {
-                long long l1 = currentTimeMillis();
-                aggregateAndDetect();
-                long long l2 = currentTimeMillis();
-                flog::info("aggregateAndDetect, took {}", (int64_t)(l2-l1));
-                framesSinceLastDetect = 0; // Reset counter after detection
+    // Get line candidates from a frequency slice
+    void SignalDetector::findLineCandidates(const float* first_slice_db, float* retval) {
+        int n = fftSize;
+        std::fill(retval, retval + n, -20.0f);
+        if (n == 0) {
+            return;
+        }
+
+        // Normalize the magnitudes
+        normalizeMagnitudes(first_slice_db, n);
+
+        // Early return if frequencies couldn't be determined
+        if (n < 100) {
+            flog::info("Not enough frequency data for line candidate detection");
+            return;
+        }
+
+        // Find dominant harmonic intervals
+        findDominantHarmonicIntervals(8, 35);
+
+        // Scan through the data in sections
+        for (size_t p = 0; p + 100 <= (size_t)n; p += 50) {
+            size_t vl1 = p;
+            size_t vl2 = p + 100;
+
+            // View of data for this section
+            ArrayView<float> subdata(&normalized[vl1], vl2 - vl1);
+
+            // Dominant frequency of this section
+            freqSection.assign(dominant.begin() + vl1, dominant.begin() + vl2);
+            int domfreq_int = median_destructive(freqSection);
+
+            // Guard against invalid dominant frequency
+            if (domfreq_int <= 0) {
+                continue;
+            }
+
+            // Accumulate signals at each phase offset
+            offsetScore.assign(domfreq_int, 0.0f);
+            for (size_t x = 0; x < subdata.size(); x++) {
+                int offset = static_cast<int>((x + offsetScore.size() - 1) % offsetScore.size());
+                offsetScore[offset] += subdata[x];
+            }
+
+            // Find phase with maximum score
+            int phase = std::distance(offsetScore.begin(), std::max_element(offsetScore.begin(), offsetScore.end()));
+
+            // Collect in-phase samples
+            inphase.clear();
+            inphaseIx.clear();
+            for (int ix = phase; ix < static_cast<int>(subdata.size()); ix += domfreq_int) {
+                inphase.push_back(subdata[ix]);
+                inphaseIx.push_back(vl1 + ix);
+            }
+
+            // Find maximum in-phase value
+            if (!inphase.empty()) {
+                int maxi = std::distance(inphase.begin(), std::max_element(inphase.begin(), inphase.end()));
+
+                // Mark peaks before maximum
+                for (int x = std::max<int>(0, maxi - 4); x < maxi; x++) {
+                    size_t ix = inphaseIx[x];
+                    retval[ix] = -normalized[ix];
+                }
             }
         }
     }
+
+    void SignalDetector::processRow(const float* row) {
+        if (resetHistory.exchange(false) || history.size() != N_FFT_ROWS || (int)runningSum.size() != fftSize) {
+            history.assign(N_FFT_ROWS, std::vector<float>(fftSize, 0.0f));
+            runningSum.assign(fftSize, 0.0f);
+            historyRows = 0;
+            historyPos = 0;
+            framesSinceLastDetect = 0;
+        }
+
+        // The oldest row leaves the sums as the new one takes its place
+        float* slot = history[historyPos].data();
+        if (historyRows == N_FFT_ROWS) {
+            volk_32f_x2_subtract_32f(runningSum.data(), runningSum.data(), slot, fftSize);
+        }
+        findLineCandidates(row, slot);
+        volk_32f_x2_add_32f(runningSum.data(), runningSum.data(), slot, fftSize);
+        historyPos = (historyPos + 1) % N_FFT_ROWS;
+        if (historyRows < N_FFT_ROWS) { historyRows++; }
+
+        // Float sums drift a little with every add and subtract, start again from the rows once per turn
+        if (historyPos == 0) { resumHistory(); }
+
+        // Increment counter for frames since last detection
+        framesSinceLastDetect++;
+
+        // Only detect when we have enough data AND detection interval has passed
+        if (historyRows > MIN_DETECT_FFT_ROWS && framesSinceLastDetect >= DETECT_INTERVAL_FRAMES) {
+            auto start = std::chrono::steady_clock::now();
+            aggregateAndDetect();
+            lastDetectMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            framesSinceLastDetect = 0; // Reset counter after detection
+        }
+    }
+
+    void SignalDetector::resumHistory() {
+        std::fill(runningSum.begin(), runningSum.end(), 0.0f);
+        for (int t = 0; t < historyRows; t++) {
+            volk_32f_x2_add_32f(runningSum.data(), runningSum.data(), history[t].data(), fftSize);
+        }
+    }
+
+    void SignalDetector::aggregateAndDetect() {
+        size_t freq_bins = runningSum.size();
+        if (freq_bins < 2 || historyRows == 0) {
+            return;
+        }
+
+        // Mean across time is the running sum over the rows held
+        sigs.resize(freq_bins);
+        volk_32f_s32f_multiply_32f(sigs.data(), runningSum.data(), 1.0f / historyRows, freq_bins);
+
+        // Apply simple moving average with centered kernel of size 3
+        auto& sm = smoothedScratch;
+        sm.resize(freq_bins);
+        size_t inner = freq_bins - 2;
+        if (inner) {
+            volk_32f_x2_add_32f(&sm[1], &sigs[0], &sigs[1], inner);
+            volk_32f_x2_add_32f(&sm[1], &sm[1], &sigs[2], inner);
+            volk_32f_s32f_multiply_32f(&sm[1], &sm[1], 1.0f / 3.0f, inner);
+        }
+        sm[0] = (sigs[0] + sigs[1]) / 2.0f;
+        sm[freq_bins - 1] = (sigs[freq_bins - 2] + sigs[freq_bins - 1]) / 2.0f;
+
+        // Publish, the old output becomes the next scratch
+        std::lock_guard<std::mutex> lck(resultMtx);
+        sigs_smoothed.swap(sm);
+        resultVersion++;
+    }
 }
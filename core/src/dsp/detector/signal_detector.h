@@ -1,7 +1,14 @@
 #pragma once
 #include "../processor.h"
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
 #include <utils/arrays.h>
+#include <utils/worker_pool.h>
 #include <sstream>
 #include <type_traits>
 #include <stdexcept>
@@ -77,11 +84,12 @@ namespace dsp::detector {
     };
 
 
+    // Finds suppressed carrier candidates over the last seconds of spectrum. run() only captures windowed FFT
+    // rows on the DSP path, a worker thread does the detection on them and keeps running sums over the history,
+    // so the front end is never held up by it. Rows are dropped when the detection stage falls behind.
     class SignalDetector : public Processor<complex_t, complex_t> {
         using base_type = Processor<complex_t, complex_t>;
     public:
-        std::vector<float> sigs_smoothed; // Smoothed signal vector for detection
-
         SignalDetector();
         ~SignalDetector();
 
@@ -92,6 +100,17 @@ namespace dsp::detector {
 
         int run();
 
+        // Latest smoothed detector output, copied into out only when it changed since version. Returns true
+        // when it did. Safe from any thread.
+        bool getSmoothed(std::vector<float>& out, uint64_t& version);
+
+        // Waits for the detection stage to go through every row captured so far
+        void flush();
+
+        uint64_t getCapturedRows() { return capturedRows; }
+        uint64_t getDroppedRows() { return droppedRows; }
+        double getLastDetectMillis() { return lastDetectMillis; }
+
     public:
         // Enable/disable the detector
         void setEnabled(bool enabled) { this->enabled = enabled; }
@@ -104,6 +123,7 @@ namespace dsp::detector {
         static constexpr int MIN_DETECT_FFT_ROWS = (int)(1 / TIME_SLICE * 2); // 2 seconds
         static constexpr int FREQ_WINDOW_SIZE = 50; // Window size for frequency bins in candidate selection
         static constexpr int DETECT_INTERVAL_FRAMES = (int)(1 / TIME_SLICE); // Once per second
+        static constexpr int ROW_QUEUE_SIZE = 4; // Captured rows waiting for the detection stage
 
         bool enabled = true; // Whether the detector is enabled
 
@@ -113,18 +133,64 @@ namespace dsp::detector {
         int fftSize = 0;
         int bufferPos = 0;
 
+        // Capture stage, on the DSP thread
         std::vector<complex_t> buffer;
         float* fftWindowBuf = nullptr;
-        dsp::arrays::ComplexArray fftInArray;
+        dsp::arrays::FloatArray fftMagArray;
         dsp::arrays::Arg<dsp::arrays::FFTPlan> fftPlan;
 
-        std::vector<std::shared_ptr<std::vector<float>>> suppressedCarrierCandidates;
+        // Rows in dB handed from the capture to the detection stage
+        std::vector<std::vector<float>> rowPool;
+        std::deque<int> freeRows;
+        std::deque<int> readyRows;
+        bool processingRow = false;
+        std::mutex rowMtx;
+        std::condition_variable rowCV;
+        std::condition_variable idleCV;
+        std::atomic<uint64_t> capturedRows = 0;
+        std::atomic<uint64_t> droppedRows = 0;
+
+        // Detection stage, on the worker thread. detectMtx is held while a row is processed.
+        std::thread workerThread;
+        bool stopWorker = false;
+        std::mutex detectMtx;
+        std::unique_ptr<WorkerPool> detectPool;
+        std::atomic<bool> resetHistory = true;
+        std::vector<std::vector<float>> history;    // candidate rows, circular
+        std::vector<float> runningSum;              // sum of history over time, per bin
+        int historyRows = 0;
+        int historyPos = 0;
         int framesSinceLastDetect = 0; // Counter for frames since last detection
+        std::atomic<double> lastDetectMillis = 0.0;
+
+        // Detection scratch, reused for every row
+        std::vector<double> normPrefix;
+        std::vector<float> normalized;
+        std::vector<float> positive;
+        std::vector<float> confidence;
+        std::vector<int> dominant;
+        std::vector<int> freqSection;
+        std::vector<float> offsetScore;
+        std::vector<float> inphase;
+        std::vector<size_t> inphaseIx;
+        std::vector<float> sigs;
+        std::vector<float> smoothedScratch;
+
+        // Published output
+        std::mutex resultMtx;
+        std::vector<float> sigs_smoothed;
+        uint64_t resultVersion = 0;
 
         void updateFFTSize();
         void generateWindow();
+        void captureRow();
+        void worker();
+        void processRow(const float* row);
+        void findLineCandidates(const float* row, float* out);
+        void normalizeMagnitudes(const float* magnitudes, int n);
+        void findDominantHarmonicIntervals(int minInterval, int maxInterval);
+        void resumHistory();
         void aggregateAndDetect();
-        void addSingleFFTRow(const ArrayView<float> &rowView);
         void clear();
     };
 }
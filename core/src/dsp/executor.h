@@ -0,0 +1,289 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include "block.h"
+
+namespace dsp {
+    class ExecGroup;
+
+    // Fixed pool of worker threads running groups of fused blocks. Each worker keeps its own queue and
+    // steals from the others when it runs dry, so a group usually stays on the worker that woke it.
+    class Executor {
+    public:
+        Executor(int workerCount = 0) {
+            if (workerCount <= 0) { workerCount = std::max<int>(std::thread::hardware_concurrency(), 1); }
+            queues.resize(workerCount);
+            for (int i = 0; i < workerCount; i++) {
+                workers.emplace_back(&Executor::workerLoop, this, i);
+            }
+        }
+
+        ~Executor() {
+            {
+                std::lock_guard<std::mutex> lck(sleepMtx);
+                stopWorkers = true;
+            }
+            sleepCV.notify_all();
+            for (auto& w : workers) {
+                if (w.joinable()) { w.join(); }
+            }
+        }
+
+        // Pool shared by every fused chain, sized to the core count. Never destroyed so that global
+        // blocks can still be stopped during static destruction.
+        static Executor& getDefault() {
+            static Executor* executor = new Executor();
+            return *executor;
+        }
+
+        void submit(ExecGroup* group) {
+            // Keep the group on the current worker when woken from inside the pool
+            int id = (currentExecutor == this) ? currentWorkerId : (int)(nextQueue++ % queues.size());
+            {
+                std::lock_guard<std::mutex> lck(queues[id].mtx);
+                queues[id].tasks.push_back(group);
+            }
+            {
+                std::lock_guard<std::mutex> lck(sleepMtx);
+                queued++;
+            }
+            sleepCV.notify_one();
+        }
+
+        inline int getWorkerCount() { return workers.size(); }
+        inline uint64_t getStealCount() { return steals.load(); }
+
+    private:
+        struct WorkQueue {
+            std::mutex mtx;
+            std::deque<ExecGroup*> tasks;
+        };
+
+        ExecGroup* take(int id) {
+            // Newest from our own queue first, it is most likely still in cache
+            {
+                std::lock_guard<std::mutex> lck(queues[id].mtx);
+                if (!queues[id].tasks.empty()) {
+                    ExecGroup* group = queues[id].tasks.back();
+                    queues[id].tasks.pop_back();
+                    queued--;
+                    return group;
+                }
+            }
+
+            // Steal the oldest from someone else
+            int count = queues.size();
+            for (int i = 1; i < count; i++) {
+                WorkQueue& victim = queues[(id + i) % count];
+                std::lock_guard<std::mutex> lck(victim.mtx);
+                if (!victim.tasks.empty()) {
+                    ExecGroup* group = victim.tasks.front();
+                    victim.tasks.pop_front();
+                    queued--;
+                    steals++;
+                    return group;
+                }
+            }
+            return NULL;
+        }
+
+        void workerLoop(int id);
+
+        std::vector<std::thread> workers;
+        std::deque<WorkQueue> queues;
+        std::atomic<uint64_t> nextQueue = 0;
+        std::atomic<uint64_t> steals = 0;
+
+        // Tasks in the queues, at most. Raised under sleepMtx after the task is queued, lowered when it is taken.
+        std::mutex sleepMtx;
+        std::condition_variable sleepCV;
+        std::atomic<int> queued = 0;
+        bool stopWorkers = false;
+
+        static inline thread_local Executor* currentExecutor = NULL;
+        static inline thread_local int currentWorkerId = 0;
+    };
+
+    // Set of blocks fused into a single task. A pass runs every block whose streams are ready, in the order
+    // they were added, so a chain added front to back moves a buffer through all its blocks in one pass.
+    // Blocks must not wait on anything but their registered streams and must swap each output at most once
+    // per run(), which holds for everything built on the Processor and Sink run macros. A run() may stop or
+    // start blocks, those of its own group included. The group must outlive the blocks scheduled on it.
+    class ExecGroup : public BlockScheduler, public StreamListener {
+    public:
+        ExecGroup(Executor* executor = NULL) {
+            this->executor = executor ? executor : &Executor::getDefault();
+        }
+
+        // The last pass may still be finishing, or queued again, after the last block was removed
+        ~ExecGroup() {
+            std::unique_lock<std::mutex> lck(stateMtx);
+            idleCV.wait(lck, [this] { return state == IDLE; });
+        }
+
+        void addBlock(block* blk) {
+            std::lock_guard<std::mutex> lck(execMtx);
+            blocks.push_back({ blk, std::make_shared<std::atomic<bool>>(true) });
+            for (auto& in : blk->getInputs()) {
+                if (in) { in->readerListener = this; }
+            }
+            for (auto& out : blk->getOutputs()) { out->writerListener = this; }
+            streamChanged();
+        }
+
+        void removeBlock(block* blk) {
+            std::unique_lock<std::mutex> lck(execMtx);
+            auto it = std::find_if(blocks.begin(), blocks.end(), [blk](const Entry& e) { return e.blk == blk; });
+            if (it == blocks.end()) { return; }
+            for (auto& in : blk->getInputs()) {
+                StreamListener* self = this;
+                if (in) { in->readerListener.compare_exchange_strong(self, nullptr); }
+            }
+            for (auto& out : blk->getOutputs()) {
+                StreamListener* self = this;
+                out->writerListener.compare_exchange_strong(self, nullptr);
+            }
+            it->alive->store(false);
+            blocks.erase(it);
+
+            // A pass in progress is not done with the block until it ends, the block's streams are already stopped
+            // so it can't be stuck. From inside the pass there is nothing to wait for, a removed block is not run
+            // again.
+            if (passesDone < passesStarted && passThread != std::this_thread::get_id()) {
+                uint64_t pass = passesStarted;
+                passCV.wait(lck, [&] { return passesDone >= pass; });
+            }
+        }
+
+        void streamChanged() {
+            std::lock_guard<std::mutex> lck(stateMtx);
+            if (state == IDLE) {
+                state = QUEUED;
+                executor->submit(this);
+            }
+            else {
+                pending = true;
+            }
+        }
+
+        // Runs every ready block until none can make progress or the budget is used up
+        void execute() {
+            {
+                std::lock_guard<std::mutex> lck(stateMtx);
+                state = RUNNING;
+                pending = false;
+            }
+
+            {
+                std::lock_guard<std::mutex> lck(execMtx);
+                passBlocks.clear();
+                for (auto& e : blocks) {
+                    if (*e.alive) { passBlocks.push_back(e); }
+                }
+                passesStarted++;
+                passThread = std::this_thread::get_id();
+            }
+
+            // The blocks run without execMtx held, so a run() can stop blocks of this group
+            bool progress = false;
+            // Time between two runs, readiness checks included, goes to the block that ran
+            uint64_t last = threadCPUTimeNs();
+            for (auto& e : passBlocks) {
+                block* blk = e.blk;
+                for (int i = 0; i < MAX_RUNS_PER_PASS && *e.alive && blk->isRunnable(); i++) {
+                    int ret = blk->run();
+                    uint64_t now = threadCPUTimeNs();
+                    blk->accountRun(now - last);
+                    last = now;
+
+                    // A failed run means the block is being stopped, leave it alone until removed
+                    if (ret < 0) {
+                        e.alive->store(false);
+                        break;
+                    }
+                    progress = true;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lck(execMtx);
+                passesDone = passesStarted;
+                passThread = std::thread::id();
+            }
+            passCV.notify_all();
+
+            // Go idle only if nothing happened since the pass started, otherwise go again
+            std::lock_guard<std::mutex> lck(stateMtx);
+            if (progress || pending) {
+                state = QUEUED;
+                pending = false;
+                executor->submit(this);
+            }
+            else {
+                state = IDLE;
+                idleCV.notify_all();
+            }
+        }
+
+        int getBlockCount() {
+            std::lock_guard<std::mutex> lck(execMtx);
+            return blocks.size();
+        }
+
+    private:
+        // Bounds how long one group keeps a worker before yielding to the others
+        static constexpr int MAX_RUNS_PER_PASS = 16;
+
+        enum State {
+            IDLE,
+            QUEUED,
+            RUNNING
+        };
+
+        // alive goes false once the block failed a run or was removed, it may have been removed by the pass
+        // itself. The pass snapshot shares the flag so that it can check it without looking the block up.
+        struct Entry {
+            block* blk;
+            std::shared_ptr<std::atomic<bool>> alive;
+        };
+
+        Executor* executor;
+
+        std::mutex execMtx;
+        std::vector<Entry> blocks;
+
+        // Blocks of the pass in progress, only touched by the thread running it
+        std::vector<Entry> passBlocks;
+        uint64_t passesStarted = 0;
+        uint64_t passesDone = 0;
+        std::thread::id passThread;
+        std::condition_variable passCV;
+
+        std::mutex stateMtx;
+        std::condition_variable idleCV;
+        State state = IDLE;
+        bool pending = false;
+    };
+
+    inline void Executor::workerLoop(int id) {
+        SetThreadName("dsp_worker:" + std::to_string(id));
+        currentExecutor = this;
+        currentWorkerId = id;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lck(sleepMtx);
+                sleepCV.wait(lck, [this] { return queued > 0 || stopWorkers; });
+                if (stopWorkers) { return; }
+            }
+
+            // Another worker may have taken the task first, then there is nothing left to do but sleep again
+            ExecGroup* group = take(id);
+            if (group) { group->execute(); }
+        }
+    }
+}
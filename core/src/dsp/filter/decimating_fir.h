@@ -12,6 +12,8 @@ namespace dsp::filter {
 
         void init(stream<D>* in, tap<T>& taps, int decimation) {
             _decimation = decimation;
+            // Only every n-th output is computed, fast convolution would do more work than the direct form
+            base_type::fastConvAllowed = false;
             base_type::init(in, taps);
         }
 
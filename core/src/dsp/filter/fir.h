@@ -2,6 +2,10 @@
 #include "../processor.h"
 #include "../taps/tap.h"
 #include <utils/flog.h>
+#include <utils/arrays.h>
+
+// Tap count from which FIR switches to overlap-save fast convolution
+#define FIR_FAST_CONV_THRESHOLD 128
 
 namespace dsp::filter {
     template <class D, class T>
@@ -16,10 +20,12 @@ namespace dsp::filter {
             if (!base_type::_block_init) { return; }
             base_type::stop();
             buffer::free(buffer);
+            buffer::free(fftTaps);
         }
 
         virtual void init(stream<D>* in, tap<T>& taps) {
             _taps = taps;
+            updateFastConv();
 
             // Allocate and clear buffer
             buffer = buffer::alloc<D>(STREAM_BUFFER_SIZE + 64000);
@@ -37,6 +43,7 @@ namespace dsp::filter {
 
             int oldTC = _taps.size;
             _taps = taps;
+            updateFastConv();
 
             // Update start of buffer
             bufStart = &buffer[_taps.size - 1];
@@ -61,24 +68,27 @@ namespace dsp::filter {
             base_type::tempStart();
         }
 
+        // Tap count from which fast convolution is used, INT_MAX to always use direct convolution
+        void setFastConvThreshold(int threshold) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            base_type::tempStop();
+            fastConvThreshold = threshold;
+            updateFastConv();
+            base_type::tempStart();
+        }
+
+        bool isFastConv() { return fastConv; }
+
         inline int process(int count, const D* in, D* out) {
             // Copy data to work buffer
             memcpy(bufStart, in, count * sizeof(D));
 
-            // Do convolution
-            for (int i = 0; i < count; i++) {
-                if constexpr (std::is_same_v<D, float> && std::is_same_v<T, float>) {
-                    volk_32f_x2_dot_prod_32f(&out[i], &buffer[i], _taps.taps, _taps.size);
-                } else if constexpr ((std::is_same_v<D, complex_t>) && std::is_same_v<T, float>) {
-                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&out[i], (lv_32fc_t*)&buffer[i], _taps.taps, _taps.size);
-                } else  if constexpr ((std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>) && (std::is_same_v<T, complex_t>)) {
-                    volk_32fc_x2_dot_prod_32fc((lv_32fc_t*)&out[i], (lv_32fc_t*)&buffer[i], (lv_32fc_t*)_taps.taps, _taps.size);
-                } else if constexpr (std::is_same_v<D, stereo_t> && std::is_same_v<T, float_t>) {
-                  volk_32f_x2_dot_prod_32f(&out[i].l, &buffer[i].l, _taps.taps, _taps.size);
-                  volk_32f_x2_dot_prod_32f(&out[i].r, &buffer[i].r, _taps.taps, _taps.size);
-                } else {
-                  static_assert((D)0, "type error"); // compile-time error
-                }
+            if (fastConv) {
+                fastConvolve(count, out);
+            }
+            else {
+                directConvolve(count, out);
             }
 
             // Move unused data
@@ -103,8 +113,105 @@ namespace dsp::filter {
         }
 
     protected:
+        // Overlap-save works on complex data, real and stereo samples are carried in the complex lanes
+        static constexpr bool FAST_CONV_SUPPORTED = (std::is_same_v<T, float> && (std::is_same_v<D, float> || std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>)) ||
+                                                    (std::is_same_v<T, complex_t> && std::is_same_v<D, complex_t>);
+
+        inline void directConvolve(int count, D* out) {
+            for (int i = 0; i < count; i++) {
+                if constexpr (std::is_same_v<D, float> && std::is_same_v<T, float>) {
+                    volk_32f_x2_dot_prod_32f(&out[i], &buffer[i], _taps.taps, _taps.size);
+                } else if constexpr ((std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>) && std::is_same_v<T, float>) {
+                    volk_32fc_32f_dot_prod_32fc((lv_32fc_t*)&out[i], (lv_32fc_t*)&buffer[i], _taps.taps, _taps.size);
+                } else  if constexpr ((std::is_same_v<D, complex_t> || std::is_same_v<D, stereo_t>) && (std::is_same_v<T, complex_t>)) {
+                    volk_32fc_x2_dot_prod_32fc((lv_32fc_t*)&out[i], (lv_32fc_t*)&buffer[i], (lv_32fc_t*)_taps.taps, _taps.size);
+                } else {
+                  static_assert((D)0, "type error"); // compile-time error
+                }
+            }
+        }
+
+        // Overlap-save over the work buffer. Each FFT block of fftSize samples yields blockLen outputs,
+        // the last block is zero padded. Output matches directConvolve() sample for sample.
+        inline void fastConvolve(int count, D* out) {
+            if constexpr (FAST_CONV_SUPPORTED) {
+                complex_t* fwdIn = fwdPlan->getInput()->data();
+                complex_t* fwdOut = fwdPlan->getOutput()->data();
+                complex_t* bwdIn = bwdPlan->getInput()->data();
+                complex_t* bwdOut = bwdPlan->getOutput()->data();
+                int histLen = _taps.size - 1;
+                int avail = count + histLen;
+
+                for (int i = 0; i < count; i += blockLen) {
+                    int outCount = std::min<int>(blockLen, count - i);
+                    int inCount = std::min<int>(fftSize, avail - i);
+
+                    if constexpr (std::is_same_v<D, float>) {
+                        for (int j = 0; j < inCount; j++) { fwdIn[j] = complex_t{ buffer[i + j], 0.0f }; }
+                    }
+                    else {
+                        memcpy(fwdIn, &buffer[i], inCount * sizeof(complex_t));
+                    }
+                    if (inCount < fftSize) { buffer::clear(fwdIn, fftSize - inCount, inCount); }
+
+                    fwdPlan->execute();
+                    volk_32fc_x2_multiply_32fc((lv_32fc_t*)bwdIn, (lv_32fc_t*)fwdOut, (lv_32fc_t*)fftTaps, fftSize);
+                    bwdPlan->execute();
+
+                    if constexpr (std::is_same_v<D, float>) {
+                        for (int j = 0; j < outCount; j++) { out[i + j] = bwdOut[histLen + j].re; }
+                    }
+                    else {
+                        memcpy(&out[i], &bwdOut[histLen], outCount * sizeof(complex_t));
+                    }
+                }
+            }
+        }
+
+        void updateFastConv() {
+            fastConv = FAST_CONV_SUPPORTED && fastConvAllowed && (int)_taps.size >= fastConvThreshold;
+            buffer::free(fftTaps);
+            fftTaps = NULL;
+            fwdPlan = NULL;
+            bwdPlan = NULL;
+            if (!fastConv) { return; }
+
+            // About 3/4 of every FFT block produces output
+            fftSize = 1;
+            while (fftSize < _taps.size) { fftSize <<= 1; }
+            fftSize <<= 2;
+            blockLen = fftSize - (_taps.size - 1);
+
+            fwdPlan = arrays::allocateFFTWPlan(false, fftSize);
+            bwdPlan = arrays::allocateFFTWPlan(true, fftSize);
+
+            // Spectrum of the reversed taps since the direct form correlates the taps with the input
+            complex_t* fwdIn = fwdPlan->getInput()->data();
+            buffer::clear(fwdIn, fftSize);
+            for (int i = 0; i < _taps.size; i++) {
+                if constexpr (std::is_same_v<T, float>) {
+                    fwdIn[i] = complex_t{ _taps.taps[_taps.size - 1 - i], 0.0f };
+                }
+                else if constexpr (std::is_same_v<T, complex_t>) {
+                    fwdIn[i] = _taps.taps[_taps.size - 1 - i];
+                }
+            }
+            fwdPlan->execute();
+            fftTaps = buffer::alloc<complex_t>(fftSize);
+            memcpy(fftTaps, fwdPlan->getOutput()->data(), fftSize * sizeof(complex_t));
+        }
+
         tap<T> _taps;
         D* buffer;
         D* bufStart;
+
+        bool fastConvAllowed = true;
+        int fastConvThreshold = FIR_FAST_CONV_THRESHOLD;
+        bool fastConv = false;
+        int fftSize = 0;
+        int blockLen = 0;
+        complex_t* fftTaps = NULL;
+        arrays::Arg<arrays::FFTPlan> fwdPlan;
+        arrays::Arg<arrays::FFTPlan> bwdPlan;
     };
 }
\ No newline at end of file
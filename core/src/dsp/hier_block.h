@@ -32,6 +32,16 @@ namespace dsp {
             running = false;
         }
 
+        // Fuses every sub-block onto a scheduler, NULL gives each its own thread again
+        virtual void setScheduler(BlockScheduler* sched) {
+            assert(_block_init);
+            std::lock_guard<std::recursive_mutex> lck(ctrlMtx);
+            scheduler = sched;
+            for (auto& block : blocks) {
+                block->setScheduler(scheduler);
+            }
+        }
+
         void tempStart() {
             assert(_block_init);
             if (!tempStopDepth || --tempStopDepth) { return; }
@@ -71,13 +81,16 @@ namespace dsp {
     protected:
         void registerBlock(generic_block* block) {
             blocks.push_back(block);
+            if (scheduler) { block->setScheduler(scheduler); }
         }
 
         void unregisterBlock(generic_block* block) {
+            if (scheduler) { block->setScheduler(NULL); }
             blocks.erase(std::remove(blocks.begin(), blocks.end(), block), blocks.end());
         }
 
         bool _block_init = false;
         std::recursive_mutex ctrlMtx;
+        BlockScheduler* scheduler = NULL;
     };
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "profiler.h"
+#include "block.h"
+#include <json.hpp>
+#include <mutex>
+#include <map>
+#include <set>
+#include <stdio.h>
+
+namespace dsp::profiler {
+    std::atomic<bool> enabled = false;
+
+    struct BlockEntry {
+        std::string type;
+        std::vector<untyped_stream*> inputs;
+        std::vector<untyped_stream*> outputs;
+    };
+
+    struct Registry {
+        std::mutex mtx;
+        std::map<block*, BlockEntry> blocks;
+        std::set<untyped_stream*> streams;
+        uint64_t startNs = 0;
+        uint64_t stopNs = 0;
+    };
+
+    // Created on first use and never destroyed, streams and blocks with static lifetime register on either side
+    static Registry& registry() {
+        static Registry* reg = new Registry();
+        return *reg;
+    }
+
+    static std::string idString(const void* id) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%p", id);
+        return buf;
+    }
+
+    // Caller holds the registry lock
+    static void resetLocked(Registry& reg) {
+        for (auto& [blk, entry] : reg.blocks) { blk->resetCPUTime(); }
+        for (auto& s : reg.streams) { s->resetCounters(); }
+        reg.startNs = nowNs();
+        reg.stopNs = reg.startNs;
+    }
+
+    void setEnabled(bool enable) {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        if (enable == enabled.load()) { return; }
+        if (enable) { resetLocked(reg); }
+        else { reg.stopNs = nowNs(); }
+        enabled = enable;
+    }
+
+    void reset() {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        resetLocked(reg);
+    }
+
+    void registerBlock(block* blk, const std::string& type, const std::vector<untyped_stream*>& inputs, const std::vector<untyped_stream*>& outputs) {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        reg.blocks[blk] = { type, inputs, outputs };
+    }
+
+    void unregisterBlock(block* blk) {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        reg.blocks.erase(blk);
+    }
+
+    void setBlockStreams(block* blk, const std::vector<untyped_stream*>& inputs, const std::vector<untyped_stream*>& outputs) {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        auto it = reg.blocks.find(blk);
+        if (it == reg.blocks.end()) { return; }
+        it->second.inputs = inputs;
+        it->second.outputs = outputs;
+    }
+
+    void registerStream(untyped_stream* stream) {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        reg.streams.insert(stream);
+    }
+
+    void unregisterStream(untyped_stream* stream) {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        reg.streams.erase(stream);
+    }
+
+    Snapshot getSnapshot() {
+        auto& reg = registry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        Snapshot snap;
+        snap.enabled = enabled.load();
+        snap.elapsed = (double)((snap.enabled ? nowNs() : reg.stopNs) - reg.startNs) / 1e9;
+
+        // Streams are listed when a started block uses them. A block may still point to a deleted one, only
+        // registered streams are touched. The block's own lists belong to its control thread, the copies kept
+        // here are used instead.
+        std::set<untyped_stream*> used;
+        for (auto& [blk, entry] : reg.blocks) {
+            BlockStats bs = {};
+            bs.id = blk;
+            bs.type = entry.type;
+            bs.scheduled = blk->isScheduled();
+            bs.runs = blk->getRunCount();
+            bs.cpuTime = blk->getCPUTime();
+            bs.runTime = blk->getRunTime();
+            for (auto& in : entry.inputs) {
+                if (!in || !reg.streams.count(in)) { continue; }
+                bs.inputs.push_back(in);
+                bs.samplesIn += in->samplesRead.load();
+                bs.readWait += (double)in->readWaitNs.load() / 1e9;
+                used.insert(in);
+            }
+            for (auto& out : entry.outputs) {
+                if (!out || !reg.streams.count(out)) { continue; }
+                bs.outputs.push_back(out);
+                bs.samplesOut += out->samplesWritten.load();
+                bs.writeWait += (double)out->writeWaitNs.load() / 1e9;
+                used.insert(out);
+            }
+            snap.blocks.push_back(std::move(bs));
+        }
+
+        for (auto& s : used) {
+            StreamStats ss;
+            ss.id = s;
+            ss.name = s->getName();
+            ss.blocksWritten = s->blocksWritten.load();
+            ss.samplesWritten = s->samplesWritten.load();
+            ss.samplesRead = s->samplesRead.load();
+            ss.readWait = (double)s->readWaitNs.load() / 1e9;
+            ss.writeWait = (double)s->writeWaitNs.load() / 1e9;
+            ss.fill = s->getFill();
+            ss.capacity = s->getCapacity();
+            snap.streams.push_back(std::move(ss));
+        }
+        return snap;
+    }
+
+    std::string toJson(const Snapshot& snap) {
+        nlohmann::json j;
+        j["enabled"] = snap.enabled;
+        j["elapsed"] = snap.elapsed;
+        j["blocks"] = nlohmann::json::array();
+        for (auto& b : snap.blocks) {
+            nlohmann::json jb;
+            jb["id"] = idString(b.id);
+            jb["type"] = b.type;
+            jb["scheduled"] = b.scheduled;
+            jb["runs"] = b.runs;
+            jb["cpu_time"] = b.cpuTime;
+            jb["run_time"] = b.runTime;
+            jb["read_wait"] = b.readWait;
+            jb["write_wait"] = b.writeWait;
+            jb["samples_in"] = b.samplesIn;
+            jb["samples_out"] = b.samplesOut;
+            jb["inputs"] = nlohmann::json::array();
+            for (auto& in : b.inputs) { jb["inputs"].push_back(idString(in)); }
+            jb["outputs"] = nlohmann::json::array();
+            for (auto& out : b.outputs) { jb["outputs"].push_back(idString(out)); }
+            j["blocks"].push_back(jb);
+        }
+        j["streams"] = nlohmann::json::array();
+        for (auto& s : snap.streams) {
+            nlohmann::json js;
+            js["id"] = idString(s.id);
+            js["name"] = s.name;
+            js["blocks_written"] = s.blocksWritten;
+            js["samples_written"] = s.samplesWritten;
+            js["samples_read"] = s.samplesRead;
+            js["read_wait"] = s.readWait;
+            js["write_wait"] = s.writeWait;
+            js["fill"] = s.fill;
+            js["capacity"] = s.capacity;
+            j["streams"].push_back(js);
+        }
+        // Stream names are whatever the owner set, do not let a stray byte fail the whole snapshot
+        return j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+    }
+}
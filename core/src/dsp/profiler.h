@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sdrpp_export.h>
+
+namespace dsp {
+    class block;
+    class untyped_stream;
+}
+
+// Pipeline profiler: every started block and every stream is known here. While enabled, streams count
+// samples and the time their reader and writer spend waiting, and threaded blocks time their run() calls.
+// While disabled the hot paths only test the flag.
+namespace dsp::profiler {
+    SDRPP_EXPORT std::atomic<bool> enabled;
+
+    inline bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    inline uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Start of a timed section, 0 when profiling is off
+    inline uint64_t begin() { return isEnabled() ? nowNs() : 0; }
+
+    // Adds the time since begin() to total, if it was timed
+    inline void end(std::atomic<uint64_t>& total, uint64_t start) {
+        if (start) { total.fetch_add(nowNs() - start, std::memory_order_relaxed); }
+    }
+
+    struct StreamStats {
+        const void* id;
+        std::string name;
+        uint64_t blocksWritten;
+        uint64_t samplesWritten;
+        uint64_t samplesRead;
+        double readWait;    // seconds
+        double writeWait;   // seconds
+        int fill;           // blocks published and not yet flushed by the reader
+        int capacity;
+    };
+
+    struct BlockStats {
+        const void* id;
+        std::string type;
+        bool scheduled;
+        uint64_t runs;
+        double cpuTime;     // seconds, sampled every few runs on block threads
+        double runTime;     // seconds of wall time in run(), waits included
+        double readWait;    // seconds waited in read() of the inputs
+        double writeWait;   // seconds waited in swap() of the outputs
+        uint64_t samplesIn;
+        uint64_t samplesOut;
+        std::vector<const void*> inputs;
+        std::vector<const void*> outputs;
+    };
+
+    struct Snapshot {
+        bool enabled;
+        double elapsed;     // seconds since profiling was enabled or reset
+        std::vector<BlockStats> blocks;
+        std::vector<StreamStats> streams;
+    };
+
+    SDRPP_EXPORT void setEnabled(bool enable);
+
+    // Zeroes the counters of every block and stream
+    SDRPP_EXPORT void reset();
+
+    SDRPP_EXPORT Snapshot getSnapshot();
+    SDRPP_EXPORT std::string toJson(const Snapshot& snap);
+
+    SDRPP_EXPORT void registerBlock(block* blk, const std::string& type, const std::vector<untyped_stream*>& inputs, const std::vector<untyped_stream*>& outputs);
+    SDRPP_EXPORT void unregisterBlock(block* blk);
+
+    // Called by a block when its streams change, ignored unless the block is registered
+    SDRPP_EXPORT void setBlockStreams(block* blk, const std::vector<untyped_stream*>& inputs, const std::vector<untyped_stream*>& outputs);
+    SDRPP_EXPORT void registerStream(untyped_stream* stream);
+    SDRPP_EXPORT void unregisterStream(untyped_stream* stream);
+}
@@ -1,5 +1,7 @@
 #pragma once
+#include <map>
 #include "../sink.h"
+#include "../buffer/shared_pool.h"
 
 namespace dsp::routing {
     template <class T>
@@ -11,19 +13,26 @@ namespace dsp::routing {
 
         Splitter(stream<T>* in) { base_type::init(in); }
 
-        void bindStream(stream<T>* stream) {
+        void bindStream(stream<T>* stream, FanoutPolicy policy = FanoutPolicy::BLOCK, int queueDepth = 1) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            
+
             // Check that the stream isn't already bound
             if (std::find(streams.begin(), streams.end(), stream) != streams.end()) {
                 throw std::runtime_error("[Splitter] Tried to bind stream to that is already bound");
             }
+            if (sharedFanout && stream->isRing()) {
+                throw std::runtime_error("[Splitter] Tried to bind a ring stream with shared fan-out");
+            }
 
             // Add to the list
             base_type::tempStop();
             base_type::registerOutput(stream);
             streams.push_back(stream);
+            auto& branch = branches[stream];
+            branch.policy = policy;
+            branch.queueDepth = std::max<int>(queueDepth, 1);
+            branch.dropped = 0;
             base_type::tempStart();
         }
 
@@ -34,7 +43,7 @@ namespace dsp::routing {
         void unbindStream(stream<T>* stream) {
             assert(base_type::_block_init);
             std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
-            
+
             // Check that the stream is bound
             auto sit = std::find(streams.begin(), streams.end(), stream);
             if (sit == streams.end()) {
@@ -44,10 +53,60 @@ namespace dsp::routing {
             // Add to the list
             base_type::tempStop();
             streams.erase(sit);
+            branches.erase(stream);
+            stream->clearShared();
             base_type::unregisterOutput(stream);
             base_type::tempStart();
         }
 
+        // Shared fan-out: the input is copied once into a pooled buffer and every bound stream gets a
+        // reference to it instead of its own copy, blocks reading the branches must not write to their input.
+        // Only in this mode are the branch policies applied.
+        void setSharedFanout(bool enabled) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            if (enabled && std::any_of(streams.begin(), streams.end(), [](stream<T>* s) { return s->isRing(); })) {
+                throw std::runtime_error("[Splitter] Tried to enable shared fan-out with a ring stream bound");
+            }
+            base_type::tempStop();
+            sharedFanout = enabled;
+            if (sharedFanout && !pool) {
+                pool = std::make_shared<buffer::SharedPool<T>>(STREAM_BUFFER_SIZE);
+            }
+            base_type::tempStart();
+        }
+
+        void setPolicy(stream<T>* stream, FanoutPolicy policy, int queueDepth = 1) {
+            assert(base_type::_block_init);
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            auto it = branches.find(stream);
+            if (it == branches.end()) {
+                throw std::runtime_error("[Splitter] Tried to set the policy of a stream that isn't bound");
+            }
+            base_type::tempStop();
+            it->second.policy = policy;
+            it->second.queueDepth = std::max<int>(queueDepth, 1);
+            base_type::tempStart();
+        }
+
+        // Number of blocks a branch lost to its drop policy since it was bound
+        uint64_t getDroppedBlocks(stream<T>* stream) {
+            std::lock_guard<std::recursive_mutex> lck(base_type::ctrlMtx);
+            auto it = branches.find(stream);
+            return (it != branches.end()) ? it->second.dropped.load() : 0;
+        }
+
+        // A BLOCK branch with a full queue would make run() wait in pushShared(), which on an executor holds
+        // up the worker
+        bool isRunnable() override {
+            if (!base_type::isRunnable()) { return false; }
+            if (!sharedFanout) { return true; }
+            for (auto& [stream, branch] : branches) {
+                if (!stream->isSharedWritable(branch.policy, branch.queueDepth)) { return false; }
+            }
+            return true;
+        }
+
         std::function<void(T*, int)> hook;
 
         void setHook(const std::function<void(T*, int)> &_hook) {
@@ -71,6 +130,10 @@ namespace dsp::routing {
 
             workedCount += count;
 
+            if (sharedFanout) {
+                return runShared(count);
+            }
+
             for (const auto& stream : streams) {
                 memcpy(stream->writeBuf, base_type::_in->readBuf, count * sizeof(T));
 //                flog::info("Splitter {} flushing to {}", origin, stream->origin);
@@ -92,7 +155,37 @@ namespace dsp::routing {
         }
 
     protected:
+        struct Branch {
+            FanoutPolicy policy = FanoutPolicy::BLOCK;
+            int queueDepth = 1;
+            std::atomic<uint64_t> dropped = 0;
+        };
+
+        int runShared(int count) {
+            // One copy for all branches, the input can be released right away
+            std::shared_ptr<T> block = pool->acquire();
+            memcpy(block.get(), base_type::_in->readBuf, count * sizeof(T));
+
+            if (hook) {
+                hook(base_type::_in->readBuf, count);
+            }
+
+            base_type::_in->flush();
+
+            for (const auto& stream : streams) {
+                auto& branch = branches[stream];
+                if (!stream->pushShared(block, count, branch.policy, branch.queueDepth, branch.dropped)) {
+                    return -1;
+                }
+            }
+
+            return count;
+        }
+
         std::vector<stream<T>*> streams;
+        std::map<stream<T>*, Branch> branches;
+        bool sharedFanout = false;
+        std::shared_ptr<buffer::SharedPool<T>> pool;
 
     };
-}
\ No newline at end of file
+}
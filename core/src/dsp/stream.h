@@ -1,14 +1,19 @@
 #pragma once
 #include <string.h>
+#include <assert.h>
 #include <mutex>
 #include <atomic>
 #include <functional>
+#include <memory>
+#include <deque>
 #include <utils/flog.h>
 #include <condition_variable>
 //#include <volk/volk.h>
 #include <utils/usleep.h>
 
 #include "buffer/buffer.h"
+#include "buffer/spsc_ring.h"
+#include "profiler.h"
 
 // 1MSample buffer
 #define STREAM_BUFFER_SIZE 1000000
@@ -16,6 +21,13 @@
 extern void logDebugMessage(const char *msg);
 
 namespace dsp {
+    // Told when one side of a stream may be able to make progress, used by the block executor
+    class StreamListener {
+    public:
+        virtual ~StreamListener() {}
+        virtual void streamChanged() = 0;
+    };
+
     class untyped_stream {
     public:
         virtual ~untyped_stream() {}
@@ -26,11 +38,68 @@ namespace dsp {
         virtual void clearWriteStop() {}
         virtual void stopReader() {}
         virtual void clearReadStop() {}
+
+        // True when read() or swap() would return without waiting
+        virtual bool isReadable() { return true; }
+        virtual bool isWritable() { return true; }
+
+        virtual const char* getName() { return ""; }
+
+        // Blocks published and not yet flushed by the reader, and how many the stream can hold
+        virtual int getFill() { return 0; }
+        virtual int getCapacity() { return 1; }
+
+        // Profiling counters, only updated while dsp::profiler is enabled
+        std::atomic<uint64_t> blocksWritten = 0;
+        std::atomic<uint64_t> samplesWritten = 0;
+        std::atomic<uint64_t> samplesRead = 0;
+        std::atomic<uint64_t> readWaitNs = 0;
+        std::atomic<uint64_t> writeWaitNs = 0;
+
+        void resetCounters() {
+            blocksWritten = 0;
+            samplesWritten = 0;
+            samplesRead = 0;
+            readWaitNs = 0;
+            writeWaitNs = 0;
+        }
+
+        // Notified when data was published or the reader stopped, and when data was consumed or the writer stopped
+        std::atomic<StreamListener*> readerListener = nullptr;
+        std::atomic<StreamListener*> writerListener = nullptr;
+
+    protected:
+        inline void countWritten(int size) {
+            if (!profiler::isEnabled()) { return; }
+            blocksWritten.fetch_add(1, std::memory_order_relaxed);
+            samplesWritten.fetch_add(size, std::memory_order_relaxed);
+        }
+
+        inline void countRead(int size) {
+            if (size > 0 && profiler::isEnabled()) { samplesRead.fetch_add(size, std::memory_order_relaxed); }
+        }
+
+        inline void notifyReaderListener() {
+            StreamListener* l = readerListener.load();
+            if (l) { l->streamChanged(); }
+        }
+
+        inline void notifyWriterListener() {
+            StreamListener* l = writerListener.load();
+            if (l) { l->streamChanged(); }
+        }
     };
 
 
 
 
+    // What a shared fan-out does when a reader still has queueDepth blocks pending
+    enum class FanoutPolicy {
+        BLOCK,          // wait for the reader, back-pressures the writer
+        DROP_OLDEST,    // replace the oldest pending block
+        DROP_NEWEST     // discard the incoming block
+    };
+
     template <class T>
     class stream : public untyped_stream {
     public:
@@ -48,6 +117,7 @@ namespace dsp {
             snprintf((char*)originBuf, sizeof(originBuf), "stream %d", sc);
             this->origin = &originBuf[0];
             initBuffers();
+            profiler::registerStream(this);
         }
         stream(const char *origin) : stream() {
             this->origin = origin;
@@ -67,6 +137,7 @@ namespace dsp {
         }
 
         virtual ~stream() {
+            profiler::unregisterStream(this);
             free();
         }
 
@@ -82,14 +153,55 @@ namespace dsp {
             //buffer::register_buffer_dbg(readBuf0, origin ? origin: "stream without origin, sbs");
             readBuf = readBuf0;
             writeBuf = writeBuf0;
+            if (ring) { setRingDepth(ring->getDepth(), samples); }
+        }
+
+        // Switches the stream to a lock-free ring of depth blocks of up to slotSize samples, 0 restores the
+        // double buffer. Only one writer and one reader may use a ring stream, which rules out binding it to a
+        // splitter with shared fan-out. Must not be called while in use.
+        void setRingDepth(int depth, int slotSize = STREAM_BUFFER_SIZE) {
+            if (depth > 0) {
+                ring = std::make_unique<buffer::SPSCRing<T>>(depth, slotSize);
+                writeBuf = ring->writeSlot();
+                readBuf = writeBuf;
+            }
+            else {
+                ring.reset();
+                readBuf = readBuf0;
+                writeBuf = writeBuf0;
+            }
+        }
+
+        inline bool isRing() { return (bool)ring; }
 
+        const char* getName() { return origin; }
+
+        int getFill() {
+            if (ring) { return ring->getFill(); }
+            std::lock_guard<std::mutex> lck(rdyMtx);
+            return (dataReady ? 1 : 0) + (int)sharedQueue.size();
         }
 
+        int getCapacity() { return ring ? ring->getDepth() : 1; }
+
         virtual inline bool swap(int size) {
+            if (ring) {
+                ring->commit(size);
+                countWritten(size);
+                notifyReaderListener();
+                uint64_t waitStart = profiler::begin();
+                bool writable = ring->waitWritable();
+                profiler::end(writeWaitNs, waitStart);
+                if (!writable) { return false; }
+                writeBuf = ring->writeSlot();
+                return true;
+            }
             {
                 // Wait to either swap or stop
                 std::unique_lock<std::mutex> lck(swapMtx);
+                uint64_t waitStart = profiler::begin();
                 swapCV.wait(lck, [this] { return (canSwap || writerStop); });
+                profiler::end(writeWaitNs, waitStart);
 
                 // If writer was stopped, abandon operation
                 if (writerStop) { return false; }
@@ -101,6 +213,7 @@ namespace dsp {
                 readBuf = temp;
                 canSwap = false;
             }
+            countWritten(size);
 
             // Notify reader that some data is ready
             {
@@ -108,68 +221,180 @@ namespace dsp {
                 dataReady = true;
             }
             rdyCV.notify_all();
+            notifyReaderListener();
 
             return true;
         }
 
+        // Hands a reference counted block to the reader without copying it into this stream. Every branch of the
+        // fan-out reads the same memory, so a reader of a shared block must not modify readBuf in place.
+        // Returns false if the writer was stopped, dropped is incremented when the policy discarded a block.
+        virtual bool pushShared(const std::shared_ptr<T>& block, int size, FanoutPolicy policy, int queueDepth, std::atomic<uint64_t>& dropped) {
+            // The ring reader never looks at the shared queue
+            assert(!ring);
+            {
+                std::unique_lock<std::mutex> lck(rdyMtx);
+                if ((int)sharedQueue.size() >= queueDepth) {
+                    if (policy == FanoutPolicy::DROP_NEWEST) {
+                        dropped++;
+                        return true;
+                    }
+                    else if (policy == FanoutPolicy::DROP_OLDEST) {
+                        sharedQueue.pop_front();
+                        dropped++;
+                    }
+                    else {
+                        uint64_t waitStart = profiler::begin();
+                        sharedCV.wait(lck, [&] { return ((int)sharedQueue.size() < queueDepth || writerStop); });
+                        profiler::end(writeWaitNs, waitStart);
+                        if (writerStop) { return false; }
+                    }
+                }
+                sharedQueue.emplace_back(block, size);
+            }
+            countWritten(size);
+            rdyCV.notify_all();
+            notifyReaderListener();
+            return true;
+        }
+
+        // True when pushShared() with this policy would return without waiting
+        bool isSharedWritable(FanoutPolicy policy, int queueDepth) {
+            if (policy != FanoutPolicy::BLOCK) { return true; }
+            std::lock_guard<std::mutex> lck(rdyMtx);
+            return (int)sharedQueue.size() < queueDepth || writerStop;
+        }
+
+        // Drops all shared blocks not yet handed to the reader
+        void clearShared() {
+            std::lock_guard<std::mutex> lck(rdyMtx);
+            sharedQueue.clear();
+        }
+
         virtual inline int read() {
             // Wait for data to be ready or to be stopped
             if (!readBuf0 || !writeBuf) {
                 return -1;
             }
+            if (ring) {
+                T* buf;
+                uint64_t waitStart = profiler::begin();
+                int rv = ring->acquire(buf);
+                profiler::end(readWaitNs, waitStart);
+                if (rv >= 0) { readBuf = buf; }
+                countRead(rv);
+                return rv;
+            }
             std::unique_lock<std::mutex> lck(rdyMtx);
             nReaders++;
-            rdyCV.wait(lck, [this] { return (dataReady || readerStop); });
+            uint64_t waitStart = profiler::begin();
+            rdyCV.wait(lck, [this] { return (dataReady || !sharedQueue.empty() || readerStop); });
+            profiler::end(readWaitNs, waitStart);
 
             auto rv = readerStop ? -1 : dataSize;
+            bool queueFreed = false;
+            if (!readerStop && !dataReady) {
+                // Point the reader to the shared block until it flushes
+                sharedCurrent = sharedQueue.front().first;
+                rv = sharedQueue.front().second;
+                sharedQueue.pop_front();
+                ownReadBuf = readBuf;
+                readBuf = sharedCurrent.get();
+                sharedCV.notify_all();
+                queueFreed = true;
+            }
             if (debugTraffic) {
                 flog::info("reading stream {}: return {} samples", origin, rv);
             }
+            countRead(rv);
             nReaders--;
+            lck.unlock();
+
+            // A pooled writer waiting for room in the queue can go on
+            if (queueFreed) { notifyWriterListener(); }
             return (rv);
         }
 
         virtual inline bool isDataReady() {
+            if (ring) { return ring->isDataReady(); }
             {
                 std::lock_guard<std::mutex> lck(rdyMtx);
-                return dataReady;
+                return dataReady || !sharedQueue.empty();
             }
         }
 
+        virtual bool isReadable() {
+            if (ring) { return ring->isReadable(); }
+            std::lock_guard<std::mutex> lck(rdyMtx);
+            return dataReady || !sharedQueue.empty() || readerStop;
+        }
+
+        virtual bool isWritable() {
+            if (ring) { return ring->isWritable(); }
+            std::lock_guard<std::mutex> lck(swapMtx);
+            return canSwap || writerStop;
+        }
+
         virtual inline void flush() {
-            // Clear data ready
+            if (ring) {
+                ring->release();
+                notifyWriterListener();
+                return;
+            }
+
+            // Release a shared block, the writer never waits on the double buffer in that case
+            bool shared = false;
             {
                 std::lock_guard<std::mutex> lck(rdyMtx);
-                dataReady = false;
+                if (sharedCurrent) {
+                    readBuf = ownReadBuf;
+                    sharedCurrent.reset();
+                    shared = true;
+                }
+                else {
+                    // Clear data ready
+                    dataReady = false;
+                }
             }
 
             // Notify writer that buffers can be swapped
-            {
-                std::lock_guard<std::mutex> lck(swapMtx);
-                canSwap = true;
+            if (!shared) {
+                {
+                    std::lock_guard<std::mutex> lck(swapMtx);
+                    canSwap = true;
+                }
+                swapCV.notify_all();
             }
-
-            swapCV.notify_all();
+            notifyWriterListener();
         }
 
         virtual void stopWriter() {
+            if (ring) { ring->stopWriter(); }
             {
                 std::lock_guard<std::mutex> lck(swapMtx);
                 writerStop = true;
             }
             swapCV.notify_all();
+            {
+                std::lock_guard<std::mutex> lck(rdyMtx);
+            }
+            sharedCV.notify_all();
+            notifyWriterListener();
         }
 
         virtual void clearWriteStop() {
+            if (ring) { ring->clearWriteStop(); }
             writerStop = false;
         }
 
         virtual void stopReader() {
+            if (ring) { ring->stopReader(); }
             {
                 std::lock_guard<std::mutex> lck(rdyMtx);
                 readerStop = true;
             }
             rdyCV.notify_all();
+            notifyReaderListener();
             while (true) {
                 {
                     std::unique_lock<std::mutex> lck(rdyMtx);
@@ -182,6 +407,7 @@ namespace dsp {
         }
 
         virtual void clearReadStop() {
+            if (ring) { ring->clearReadStop(); }
             readerStop = false;
         }
 
@@ -215,6 +441,14 @@ namespace dsp {
         bool writerStop = false;
 
         int dataSize = 0;
+
+        std::unique_ptr<buffer::SPSCRing<T>> ring;
+
+        // Shared fan-out, guarded by rdyMtx
+        std::condition_variable sharedCV;
+        std::deque<std::pair<std::shared_ptr<T>, int>> sharedQueue;
+        std::shared_ptr<T> sharedCurrent;
+        T* ownReadBuf = NULL;
     };
 
     template <class T>
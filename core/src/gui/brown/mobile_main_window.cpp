@@ -1257,6 +1257,7 @@ struct QSOAudioRecorder {
         w.setFormat(wav::FORMAT_WAV);
         w.setSampleType(wav::SAMP_TYPE_FLOAT32);
         w.setSamplerate(trxAudioSampleRate);
+        w.setBlocking(true);
         if (!w.open(where)) {
             ImGui::InsertNotification({ImGuiToastType_Error, 5000, ("Write err: " + std::string(strerror(errno))).c_str()});
             return;
@@ -2766,6 +2767,7 @@ void MobileMainWindowPrivate::recordCallCQPopup() {
                         w.setFormat(wav::FORMAT_WAV);
                         w.setSampleType(wav::SAMP_TYPE_FLOAT32);
                         w.setSamplerate(trxAudioSampleRate);
+                        w.setBlocking(true);
                         if (!w.open(fname)) {
                             ImGui::InsertNotification({ImGuiToastType_Error, 5000, ("Write err: " + std::string(strerror(errno))).c_str()});
                             return;
@@ -0,0 +1,254 @@
+#ifndef IMGUI_DEFINE_MATH_OPERATORS
+#define IMGUI_DEFINE_MATH_OPERATORS
+#endif
+#include <gui/dialogs/pipeline_profiler.h>
+#include <imgui.h>
+#include <imgui_internal.h>
+#include <gui/style.h>
+#include <dsp/profiler.h>
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+
+namespace pipeline_profiler {
+    // Rates are averaged between two snapshots this many seconds apart
+    const double REFRESH_INTERVAL = 0.5;
+
+    // Share of wall time from which a block busy, or a writer blocked on a stream, is a hot spot
+    const float WARM_SHARE = 0.5f;
+    const float HOT_SHARE = 0.8f;
+
+    struct BlockRates {
+        float load = 0;         // time in run() minus time waiting on streams
+        float readWait = 0;
+        float writeWait = 0;
+        float runsPerSec = 0;
+        float samplesInPerSec = 0;
+        float samplesOutPerSec = 0;
+    };
+
+    dsp::profiler::Snapshot current;
+    std::map<const void*, BlockRates> blockRates;
+    std::map<const void*, float> streamWriteWait;
+    double lastRefresh = -REFRESH_INTERVAL;
+
+    void refresh() {
+        dsp::profiler::Snapshot previous = std::move(current);
+        current = dsp::profiler::getSnapshot();
+
+        // After a reset, or for a block not seen before, the counters start from zero
+        bool fromZero = current.elapsed < previous.elapsed;
+        std::map<const void*, const dsp::profiler::BlockStats*> blocksBefore;
+        std::map<const void*, const dsp::profiler::StreamStats*> streamsBefore;
+        if (!fromZero) {
+            for (auto& b : previous.blocks) { blocksBefore[b.id] = &b; }
+            for (auto& s : previous.streams) { streamsBefore[s.id] = &s; }
+        }
+
+        blockRates.clear();
+        for (auto& b : current.blocks) {
+            auto it = blocksBefore.find(b.id);
+            const dsp::profiler::BlockStats* p = (it != blocksBefore.end()) ? it->second : NULL;
+            double span = current.elapsed - (p ? previous.elapsed : 0);
+            if (span <= 0) { continue; }
+            BlockRates r;
+            r.readWait = (b.readWait - (p ? p->readWait : 0)) / span;
+            r.writeWait = (b.writeWait - (p ? p->writeWait : 0)) / span;
+            r.load = std::clamp<float>((b.runTime - (p ? p->runTime : 0)) / span - r.readWait - r.writeWait, 0.0f, 1.0f);
+            r.runsPerSec = (b.runs - (p ? p->runs : 0)) / span;
+            r.samplesInPerSec = (b.samplesIn - (p ? p->samplesIn : 0)) / span;
+            r.samplesOutPerSec = (b.samplesOut - (p ? p->samplesOut : 0)) / span;
+            blockRates[b.id] = r;
+        }
+
+        streamWriteWait.clear();
+        for (auto& s : current.streams) {
+            auto it = streamsBefore.find(s.id);
+            const dsp::profiler::StreamStats* p = (it != streamsBefore.end()) ? it->second : NULL;
+            double span = current.elapsed - (p ? previous.elapsed : 0);
+            if (span <= 0) { continue; }
+            streamWriteWait[s.id] = (s.writeWait - (p ? p->writeWait : 0)) / span;
+        }
+    }
+
+    ImU32 shareColor(float share, ImU32 cold) {
+        if (share >= HOT_SHARE) { return IM_COL32(200, 50, 40, 255); }
+        if (share >= WARM_SHARE) { return IM_COL32(210, 130, 30, 255); }
+        return cold;
+    }
+
+    std::string formatRate(float perSec) {
+        char buf[32];
+        if (perSec >= 1e6f) { snprintf(buf, sizeof(buf), "%.2f M/s", perSec / 1e6f); }
+        else if (perSec >= 1e3f) { snprintf(buf, sizeof(buf), "%.1f k/s", perSec / 1e3f); }
+        else { snprintf(buf, sizeof(buf), "%.0f /s", perSec); }
+        return buf;
+    }
+
+    // Blocks in columns by how many blocks feed them, streams as curves from writer to reader
+    void drawGraph() {
+        std::map<const void*, const dsp::profiler::BlockStats*> writers;
+        std::map<const void*, const dsp::profiler::StreamStats*> streams;
+        for (auto& b : current.blocks) {
+            for (auto& out : b.outputs) { writers[out] = &b; }
+        }
+        for (auto& s : current.streams) { streams[s.id] = &s; }
+
+        // Longest chain of blocks in front of each one, bounded in case the graph loops
+        std::map<const void*, int> column;
+        int blockCount = current.blocks.size();
+        for (int pass = 0; pass < blockCount; pass++) {
+            bool changed = false;
+            for (auto& b : current.blocks) {
+                for (auto& in : b.inputs) {
+                    auto w = writers.find(in);
+                    if (w == writers.end()) { continue; }
+                    int c = column[w->second->id] + 1;
+                    if (c > column[b.id] && c < blockCount) {
+                        column[b.id] = c;
+                        changed = true;
+                    }
+                }
+            }
+            if (!changed) { break; }
+        }
+
+        const ImVec2 nodeSize = ImVec2(160.0f, 44.0f) * style::uiScale;
+        const ImVec2 gap = ImVec2(60.0f, 12.0f) * style::uiScale;
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        std::map<int, int> rows;
+        std::map<const void*, ImVec2> pos;
+        ImVec2 extent = ImVec2(0, 0);
+        for (auto& b : current.blocks) {
+            int c = column[b.id];
+            int r = rows[c]++;
+            pos[b.id] = origin + ImVec2(c * (nodeSize.x + gap.x), r * (nodeSize.y + gap.y));
+            extent = ImMax(extent, pos[b.id] - origin + nodeSize);
+        }
+
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+        for (auto& b : current.blocks) {
+            for (auto& in : b.inputs) {
+                auto w = writers.find(in);
+                if (w == writers.end()) { continue; }
+                ImVec2 from = pos[w->second->id] + ImVec2(nodeSize.x, nodeSize.y * 0.5f);
+                ImVec2 to = pos[b.id] + ImVec2(0, nodeSize.y * 0.5f);
+                ImVec2 bend = ImVec2(gap.x * 0.5f, 0);
+                ImU32 color = shareColor(streamWriteWait[in], IM_COL32(140, 140, 140, 255));
+                drawList->AddBezierCubic(from, from + bend, to - bend, to, color, 2.0f * style::uiScale);
+                auto s = streams.find(in);
+                if (s != streams.end()) {
+                    char fill[32];
+                    snprintf(fill, sizeof(fill), "%d/%d", s->second->fill, s->second->capacity);
+                    drawList->AddText((from + to) * 0.5f - ImVec2(0, ImGui::GetTextLineHeight()), color, fill);
+                }
+            }
+        }
+
+        for (auto& b : current.blocks) {
+            const BlockRates& r = blockRates[b.id];
+            ImVec2 min = pos[b.id];
+            ImVec2 max = min + nodeSize;
+            drawList->AddRectFilled(min, max, shareColor(r.load, IM_COL32(45, 80, 55, 255)), 4.0f * style::uiScale);
+            drawList->AddRect(min, max, IM_COL32(200, 200, 200, 255), 4.0f * style::uiScale);
+            char load[32];
+            snprintf(load, sizeof(load), "%.0f%%%s", r.load * 100.0f, b.scheduled ? " (pool)" : "");
+            ImVec2 pad = ImGui::GetStyle().FramePadding;
+            drawList->PushClipRect(min, max, true);
+            drawList->AddText(min + pad, IM_COL32(255, 255, 255, 255), b.type.c_str());
+            drawList->AddText(min + pad + ImVec2(0, ImGui::GetTextLineHeight()), IM_COL32(255, 255, 255, 255), load);
+            drawList->PopClipRect();
+
+            ImGui::SetCursorScreenPos(min);
+            ImGui::PushID(b.id);
+            ImGui::InvisibleButton("##block", nodeSize);
+            ImGui::PopID();
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("%s\nBusy %.1f%%, waiting %.1f%% to read, %.1f%% to write\n%s runs, in %s, out %s samples",
+                                  b.type.c_str(), r.load * 100.0f, r.readWait * 100.0f, r.writeWait * 100.0f,
+                                  formatRate(r.runsPerSec).c_str(), formatRate(r.samplesInPerSec).c_str(), formatRate(r.samplesOutPerSec).c_str());
+            }
+        }
+
+        ImGui::SetCursorScreenPos(origin);
+        ImGui::Dummy(extent);
+    }
+
+    void drawTable() {
+        std::vector<const dsp::profiler::BlockStats*> sorted;
+        for (auto& b : current.blocks) { sorted.push_back(&b); }
+        std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return blockRates[a->id].load > blockRates[b->id].load; });
+
+        if (!ImGui::BeginTable("Pipeline Profiler Table", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY)) { return; }
+        ImGui::TableSetupColumn("Block");
+        ImGui::TableSetupColumn("Busy");
+        ImGui::TableSetupColumn("Read wait");
+        ImGui::TableSetupColumn("Write wait");
+        ImGui::TableSetupColumn("Runs");
+        ImGui::TableSetupColumn("Samples in");
+        ImGui::TableSetupColumn("Samples out");
+        ImGui::TableSetupScrollFreeze(1, 1);
+        ImGui::TableHeadersRow();
+        for (auto b : sorted) {
+            const BlockRates& r = blockRates[b->id];
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::TextUnformatted(b->type.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::PushStyleColor(ImGuiCol_Text, shareColor(r.load, ImGui::GetColorU32(ImGuiCol_Text)));
+            ImGui::Text("%.1f%%", r.load * 100.0f);
+            ImGui::PopStyleColor();
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.1f%%", r.readWait * 100.0f);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.1f%%", r.writeWait * 100.0f);
+            ImGui::TableSetColumnIndex(4);
+            ImGui::TextUnformatted(formatRate(r.runsPerSec).c_str());
+            ImGui::TableSetColumnIndex(5);
+            ImGui::TextUnformatted(formatRate(r.samplesInPerSec).c_str());
+            ImGui::TableSetColumnIndex(6);
+            ImGui::TextUnformatted(formatRate(r.samplesOutPerSec).c_str());
+        }
+        ImGui::EndTable();
+    }
+
+    void draw(bool* open) {
+        ImGui::SetNextWindowSize(ImVec2(900, 600) * style::uiScale, ImGuiCond_FirstUseEver);
+        if (!ImGui::Begin("Pipeline Profiler", open)) {
+            ImGui::End();
+            return;
+        }
+
+        bool enabled = dsp::profiler::isEnabled();
+        if (ImGui::Checkbox("Profile##pipeline_profiler_enabled", &enabled)) {
+            dsp::profiler::setEnabled(enabled);
+            lastRefresh = -REFRESH_INTERVAL;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Reset##pipeline_profiler_reset")) {
+            dsp::profiler::reset();
+            lastRefresh = -REFRESH_INTERVAL;
+        }
+        ImGui::SameLine();
+        ImGui::Text("%d blocks, %.1f s profiled", (int)current.blocks.size(), current.elapsed);
+
+        // Keeps the last rates on screen while paused
+        double now = ImGui::GetTime();
+        if (now - lastRefresh >= REFRESH_INTERVAL && (enabled || current.blocks.empty())) {
+            refresh();
+            lastRefresh = now;
+        }
+
+        if (!enabled) {
+            ImGui::TextUnformatted("Profiling is off, blocks and streams only count while it is on.");
+        }
+
+        float graphHeight = ImGui::GetContentRegionAvail().y * 0.6f;
+        ImGui::BeginChild("##pipeline_profiler_graph", ImVec2(0, graphHeight), true, ImGuiWindowFlags_HorizontalScrollbar);
+        drawGraph();
+        ImGui::EndChild();
+
+        drawTable();
+        ImGui::End();
+    }
+}
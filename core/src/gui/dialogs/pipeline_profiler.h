@@ -0,0 +1,6 @@
+#pragma once
+
+namespace pipeline_profiler {
+    // Window with the live block graph of dsp::profiler, open is cleared when the user closes it
+    void draw(bool* open);
+}
@@ -25,6 +25,7 @@
 #include <gui/menus/module_manager.h>
 #include <gui/menus/theme.h>
 #include <gui/dialogs/credits.h>
+#include <gui/dialogs/pipeline_profiler.h>
 #include <cstring>
 #include <filesystem>
 #include <signal_path/source.h>
@@ -522,8 +523,15 @@ void MainWindow::displayVariousWindows() {
         lockWaterfallControls = true;
         ShowLogWindow();
     }
+    if (profilerWindow) {
+        lockWaterfallControls = true;
+        pipeline_profiler::draw(&profilerWindow);
+    }
     if (sigpath::iqFrontEnd.detectorPreprocessor.isEnabled()) {
-        auto& toPlot = sigpath::iqFrontEnd.detectorPreprocessor.sigs_smoothed;
+        // Only copied when the detector published a new result
+        static std::vector<float> toPlot;
+        static uint64_t toPlotVersion = 0;
+        sigpath::iqFrontEnd.detectorPreprocessor.getSmoothed(toPlot, toPlotVersion);
         if (!toPlot.empty()) {
             ImGui::SetNextWindowSize(ImVec2(1800, 300), ImGuiCond_FirstUseEver);
             if (ImGui::Begin("Signal Detector Output")) {
@@ -1251,6 +1259,7 @@ void MainWindow::drawDebugMenu() {
         ImGui::Text("Source name: %s", sourceName.c_str());
         ImGui::Checkbox("Show demo window", &demoWindow);
         ImGui::Checkbox("Show log", &logWindow);
+        ImGui::Checkbox("Show pipeline profiler", &profilerWindow);
         ImGui::Text("ImGui version: %s", ImGui::GetVersion());
 
         // ImGui::Checkbox("Bypass buffering", &sigpath::iqFrontEnd.inputBuffer.bypass);
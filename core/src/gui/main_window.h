@@ -55,6 +55,7 @@ public:
     bool hasBottomWindow(std::string name);
 
     bool logWindow = false;
+    bool profilerWindow = false;
     bool showMenu = true;
 
     // Mic stream handling
@@ -9,6 +9,7 @@
 #include <signal_path/signal_path.h>
 #include <gui/style.h>
 #include <utils/optionlist.h>
+#include <utils/arrays.h>
 #include <algorithm>
 
 namespace displaymenu {
@@ -382,14 +383,40 @@ namespace displaymenu {
         {
             ImGui::SameLine();
             static auto lastFFTReportTime = currentTimeMillis();
-            static long long lastFFTReport = 0;
+            static uint64_t lastFFTTotalNs = 0;
+            static double lastFFTReport = 0;
+            static std::vector<dsp::arrays::FFTStats> lastFFTStats;
+            static std::vector<dsp::arrays::FFTStats> fftStatsRate;
             auto ctm = currentTimeMillis();
             if (ctm - lastFFTReportTime > 1000) {
                 lastFFTReportTime += 1000;
-                lastFFTReport = fftCumulativeTime;
-                fftCumulativeTime = 0;
+                uint64_t totalNs = dsp::arrays::getFFTTotalTimeNs();
+                lastFFTReport = (double)(totalNs - lastFFTTotalNs) / 1e6;
+                lastFFTTotalNs = totalNs;
+
+                // Per size activity over the last second
+                auto stats = dsp::arrays::getFFTStats();
+                fftStatsRate.clear();
+                for (auto& st : stats) {
+                    dsp::arrays::FFTStats delta = st;
+                    for (auto& prev : lastFFTStats) {
+                        if (prev.size != st.size || prev.backward != st.backward) { continue; }
+                        delta.count -= prev.count;
+                        delta.totalNs -= prev.totalNs;
+                    }
+                    if (delta.count) { fftStatsRate.push_back(delta); }
+                }
+                lastFFTStats = stats;
+            }
+            ImGui::Text("%.1f ms/s", lastFFTReport);
+            if (ImGui::IsItemHovered() && !fftStatsRate.empty()) {
+                ImGui::BeginTooltip();
+                for (auto& st : fftStatsRate) {
+                    ImGui::Text("%d %s (%s): %d/s, %.1f us each", st.size, st.backward ? "inverse" : "forward",
+                                st.measured ? "measured" : "estimated", (int)st.count, (double)st.totalNs / (double)st.count / 1e3);
+                }
+                ImGui::EndTooltip();
             }
-            ImGui::Text("%lld ms/s", lastFFTReport);
         }
 
         ImGui::LeftLabel("FFT Window");
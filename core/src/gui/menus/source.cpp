@@ -21,6 +21,11 @@ namespace sourcemenu {
 
     bool iqCorrection = false;
     bool invertIQ = false;
+    bool channelizer = false;
+    bool dspThreadPool = false;
+    bool iqHistory = false;
+    int iqHistorySeconds = 60;
+    bool iqHistoryInt16 = true;
     utils::LatLng operatorLatLng = utils::LatLng::invalid();
     char operatorCallsignRaw[30];
     utils::CTY::Callsign callsignFound;
@@ -192,6 +197,11 @@ namespace sourcemenu {
         std::string selectedOffset = core::configManager.conf["selectedOffset"];
         iqCorrection = core::configManager.conf["iqCorrection"];
         invertIQ = core::configManager.conf["invertIQ"];
+        channelizer = core::configManager.conf["channelizer"];
+        dspThreadPool = core::configManager.conf["dspThreadPool"];
+        iqHistory = core::configManager.conf["iqHistory"];
+        iqHistorySeconds = std::clamp<int>(core::configManager.conf["iqHistorySeconds"], 1, 3600);
+        iqHistoryInt16 = core::configManager.conf["iqHistoryInt16"];
 
         std::string opcs = core::configManager.conf["operatorCallsign"];
         std::copy(opcs.begin(), opcs.end(), operatorCallsignRaw);
@@ -229,6 +239,9 @@ namespace sourcemenu {
         sigpath::iqFrontEnd.setDCBlocking(iqCorrection);
         sigpath::iqFrontEnd.setInvertIQ(invertIQ);
         sigpath::iqFrontEnd.setDecimation(decimations.value(decimId));
+        sigpath::iqFrontEnd.setChannelizerEnabled(channelizer);
+        sigpath::iqFrontEnd.setThreadPoolEnabled(dspThreadPool);
+        if (!sigpath::iqFrontEnd.setHistory(iqHistory, iqHistorySeconds, iqHistoryInt16)) { iqHistory = false; }
         selectOffsetByName(selectedOffset);
 
         // Register handlers
@@ -354,6 +367,51 @@ namespace sourcemenu {
             core::configManager.release(true);
         }
 
+        if (ImGui::Checkbox("Shared channelizer##_sdrpp_channelizer", &channelizer)) {
+            sigpath::iqFrontEnd.setChannelizerEnabled(channelizer);
+            core::configManager.acquire();
+            core::configManager.conf["channelizer"] = channelizer;
+            core::configManager.release(true);
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Narrowband VFOs share one filter bank pass (%d VFOs channelized)", sigpath::iqFrontEnd.getChannelizedVFOCount());
+        }
+
+        if (ImGui::Checkbox("DSP thread pool##_sdrpp_dsp_pool", &dspThreadPool)) {
+            sigpath::iqFrontEnd.setThreadPoolEnabled(dspThreadPool);
+            core::configManager.acquire();
+            core::configManager.conf["dspThreadPool"] = dspThreadPool;
+            core::configManager.release(true);
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Run pre-processing and VFOs on %d shared worker threads instead of one thread per block", (int)std::thread::hardware_concurrency());
+        }
+
+        // Time-shift history, settings apply when the checkbox or a value changes
+        bool historyChanged = ImGui::Checkbox("IQ history##_sdrpp_iq_history", &iqHistory);
+        if (ImGui::IsItemHovered()) {
+            auto history = sigpath::iqFrontEnd.getHistory();
+            ImGui::SetTooltip("Keep the last seconds of IQ in memory to save or replay them (%d MB)", history ? (int)(history->getMemoryBytes() >> 20) : 0);
+        }
+        if (iqHistory) {
+            ImGui::LeftLabel("History seconds");
+            ImGui::FillWidth();
+            if (ImGui::InputInt("##_sdrpp_iq_history_seconds", &iqHistorySeconds, 10, 60, ImGuiInputTextFlags_EnterReturnsTrue)) {
+                iqHistorySeconds = std::clamp<int>(iqHistorySeconds, 1, 3600);
+                historyChanged = true;
+            }
+            historyChanged |= ImGui::Checkbox("Store as int16##_sdrpp_iq_history_int16", &iqHistoryInt16);
+        }
+        if (historyChanged) {
+            // Unchecked again when the memory could not be allocated
+            if (!sigpath::iqFrontEnd.setHistory(iqHistory, iqHistorySeconds, iqHistoryInt16)) { iqHistory = false; }
+            core::configManager.acquire();
+            core::configManager.conf["iqHistory"] = iqHistory;
+            core::configManager.conf["iqHistorySeconds"] = iqHistorySeconds;
+            core::configManager.conf["iqHistoryInt16"] = iqHistoryInt16;
+            core::configManager.release(true);
+        }
+
 
         ImGui::LeftLabel("Offset mode");
         ImGui::SetNextItemWidth(itemWidth - ImGui::GetCursorPosX() - 2.0f * (lineHeight + 1.5f * spacing));
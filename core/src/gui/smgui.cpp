@@ -392,6 +392,118 @@ namespace SmGui {
         return size;
     }
 
+    bool DrawList::sameItem(const DrawListElem& a, const DrawListElem& b) {
+        if (a.type != b.type) { return false; }
+        if (a.type == DRAW_LIST_ELEM_TYPE_DRAW_STEP) { return a.step == b.step && a.forceSync == b.forceSync; }
+        else if (a.type == DRAW_LIST_ELEM_TYPE_BOOL) { return a.b == b.b; }
+        else if (a.type == DRAW_LIST_ELEM_TYPE_INT) { return a.i == b.i; }
+        else if (a.type == DRAW_LIST_ELEM_TYPE_FLOAT) { return memcmp(&a.f, &b.f, sizeof(float)) == 0; }
+        else if (a.type == DRAW_LIST_ELEM_TYPE_STRING) { return a.str == b.str; }
+        return false;
+    }
+
+    int DrawList::storeFull(uint32_t seq, std::vector<uint8_t>& out) {
+        int size = getSize();
+        out.resize(sizeof(DeltaHeader) + size);
+        DeltaHeader* hdr = (DeltaHeader*)out.data();
+        hdr->version = DELTA_VERSION;
+        hdr->flags = DELTA_FLAG_FULL;
+        hdr->baseSeq = 0;
+        hdr->seq = seq;
+        hdr->elemCount = elements.size();
+        hdr->changeCount = elements.size();
+        if (store(&out[sizeof(DeltaHeader)], size) < 0) { return -1; }
+        return out.size();
+    }
+
+    int DrawList::storeDelta(DrawList& base, uint32_t baseSeq, uint32_t seq, std::vector<uint8_t>& out) {
+        // Size it first, most of the time only a value or two changed
+        int fullSize = getSize();
+        int deltaSize = 0;
+        int changes = 0;
+        for (int i = 0; i < elements.size(); i++) {
+            if (i < base.elements.size() && sameItem(elements[i], base.elements[i])) { continue; }
+            deltaSize += sizeof(uint32_t) + getItemSize(elements[i]);
+            changes++;
+        }
+        if (deltaSize >= fullSize) { return storeFull(seq, out); }
+
+        out.resize(sizeof(DeltaHeader) + deltaSize);
+        DeltaHeader* hdr = (DeltaHeader*)out.data();
+        hdr->version = DELTA_VERSION;
+        hdr->flags = 0;
+        hdr->baseSeq = baseSeq;
+        hdr->seq = seq;
+        hdr->elemCount = elements.size();
+        hdr->changeCount = changes;
+
+        int pos = sizeof(DeltaHeader);
+        for (int i = 0; i < elements.size(); i++) {
+            if (i < base.elements.size() && sameItem(elements[i], base.elements[i])) { continue; }
+            *(uint32_t*)&out[pos] = i;
+            pos += sizeof(uint32_t);
+            int count = storeItem(elements[i], &out[pos], out.size() - pos);
+            if (count < 0) { return -1; }
+            pos += count;
+        }
+        return pos;
+    }
+
+    int DrawList::loadDelta(void* data, int len, uint32_t& seq) {
+        if (len < sizeof(DeltaHeader)) { return -1; }
+        DeltaHeader hdr = *(DeltaHeader*)data;
+        uint8_t* buf = (uint8_t*)data + sizeof(DeltaHeader);
+        len -= sizeof(DeltaHeader);
+        if (hdr.version != DELTA_VERSION) { return -1; }
+
+        if (hdr.flags & DELTA_FLAG_FULL) {
+            if (load(buf, len) < 0 || elements.size() != hdr.elemCount) { return -1; }
+            seq = hdr.seq;
+            return sizeof(DeltaHeader) + len;
+        }
+        if (hdr.baseSeq != seq) { return -2; }
+
+        // Each change is at least an index and a type byte, don't size anything from a count the packet can't hold
+        if (hdr.changeCount > len / (sizeof(uint32_t) + 1)) { return -1; }
+
+        // Parse everything before touching the list, a bad packet leaves it as it was
+        std::vector<std::pair<uint32_t, DrawListElem>> changes(hdr.changeCount);
+        int i = 0;
+        for (auto& [index, elem] : changes) {
+            if (len < sizeof(uint32_t) + 1) { return -1; }
+            index = *(uint32_t*)&buf[i];
+            i += sizeof(uint32_t);
+            len -= sizeof(uint32_t);
+            if (index >= hdr.elemCount) { return -1; }
+            int count = loadItem(elem, &buf[i], len);
+            if (count < 0) { return -1; }
+            i += count;
+            len -= count;
+        }
+
+        // Anything past the old end has to be in the delta
+        int oldCount = elements.size();
+        int appended = 0;
+        for (auto& c : changes) {
+            if (c.first >= oldCount) { appended++; }
+        }
+        if (hdr.elemCount > oldCount && appended != hdr.elemCount - oldCount) { return -1; }
+
+        elements.resize(hdr.elemCount);
+        for (auto& [index, elem] : changes) {
+            elements[index] = std::move(elem);
+        }
+
+        std::string step;
+        if (!validate(step)) {
+            flog::error("Drawlist delta validation failed: {}", step);
+            elements.clear();
+            return -1;
+        }
+        seq = hdr.seq;
+        return sizeof(DeltaHeader) + i;
+    }
+
     bool DrawList::checkTypes(int firstId, int n, ...) {
         va_list args;
         va_start(args, n);
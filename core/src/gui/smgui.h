@@ -61,6 +61,20 @@ namespace SmGui {
         std::string str;
     };
 
+    // Remote UI update, little endian like the rest of the protocol. With DELTA_FLAG_FULL a whole list
+    // follows the header, otherwise changeCount times { uint32 index, item } to apply to the list of
+    // sequence baseSeq, resized to elemCount first.
+    struct DeltaHeader {
+        uint16_t version;
+        uint16_t flags;
+        uint32_t baseSeq;
+        uint32_t seq;
+        uint32_t elemCount;
+        uint32_t changeCount;
+    };
+    static const int DELTA_VERSION = 1;
+    static const int DELTA_FLAG_FULL = 0x0001;
+
     enum FormatString {
         FMT_STR_NONE,
         FMT_STR_INT_DEFAULT,
@@ -106,6 +120,13 @@ namespace SmGui {
         bool checkTypes(int firstId, int n, ...);
         bool validate(std::string &step);
 
+        // Remote UI deltas, see DeltaHeader. storeDelta() falls back to a full list when that is not larger.
+        // loadDelta() returns -2 when the delta is not based on seq, the caller then asks for a full list.
+        static bool sameItem(const DrawListElem& a, const DrawListElem& b);
+        int storeFull(uint32_t seq, std::vector<uint8_t>& out);
+        int storeDelta(DrawList& base, uint32_t baseSeq, uint32_t seq, std::vector<uint8_t>& out);
+        int loadDelta(void* data, int len, uint32_t& seq);
+
         std::vector<DrawListElem> elements;
     };
 
@@ -0,0 +1,124 @@
+#include <gui/widgets/fft_pyramid.h>
+#include <algorithm>
+#include <math.h>
+#include <utils/flog.h>
+
+void doZoom(int offset, int width, int inSize, int outSize, float* in, float* out) {
+    // NOTE: REMOVE THAT SHIT, IT'S JUST A HACKY FIX
+    if (width > 524288) {
+        width = 524288;
+    }
+    if (offset < 0) {
+        flog::warn("Offset is negative: {}", offset);
+        offset = 0;
+    }
+
+    float factor = (float)width / (float)outSize;
+
+    int sFactor = (int)ceilf(factor);
+    float id = offset;
+    float maxVal, maxVal1, maxVal2, maxVal3, maxVal4, maxVal5, maxVal6, maxVal7, maxVal8, maxVal9, maxVal10, maxVal11, maxVal12, maxVal13, maxVal14, maxVal15;
+    int sId;
+    for (int i = 0; i < outSize; i++) {
+        maxVal = -INFINITY;
+        maxVal1 = -INFINITY;
+        maxVal2 = -INFINITY;
+        maxVal3 = -INFINITY;
+        maxVal4 = -INFINITY;
+        maxVal5 = -INFINITY;
+        maxVal6 = -INFINITY;
+        maxVal7 = -INFINITY;
+        // more than 8 is not worth it
+        sId = (int)id;
+        int uFactor = (sId + sFactor > inSize) ? inSize - sId : sFactor;
+
+        constexpr int N = 8;
+        auto uFactorN = (((int)uFactor) / N) * N;
+        int j;
+        for (j = 0; j < uFactorN; j += N) {
+            maxVal = std::max<float>(maxVal, in[sId + j]);
+            maxVal1 = std::max<float>(maxVal1, in[sId + j + 1]);
+            maxVal2 = std::max<float>(maxVal2, in[sId + j + 2]);
+            maxVal3 = std::max<float>(maxVal3, in[sId + j + 3]);
+            maxVal4 = std::max<float>(maxVal4, in[sId + j + 4]);
+            maxVal5 = std::max<float>(maxVal5, in[sId + j + 5]);
+            maxVal6 = std::max<float>(maxVal6, in[sId + j + 6]);
+            maxVal7 = std::max<float>(maxVal7, in[sId + j + 7]);
+        }
+        maxVal = std::max<float>(maxVal, maxVal1);
+        maxVal = std::max<float>(maxVal, maxVal2);
+        maxVal = std::max<float>(maxVal, maxVal3);
+        maxVal = std::max<float>(maxVal, maxVal4);
+        maxVal = std::max<float>(maxVal, maxVal5);
+        maxVal = std::max<float>(maxVal, maxVal6);
+        maxVal = std::max<float>(maxVal, maxVal7);
+        for (; j < uFactor; j++) {
+            maxVal = std::max<float>(maxVal, in[sId + j]);
+        }
+
+        out[i] = maxVal;
+        id += factor;
+    }
+}
+
+void FFTPyramid::init(int rawSize) {
+    this->rawSize = rawSize;
+    levelOffsets.clear();
+    levelSizes.clear();
+    rowSize = 0;
+    for (int size = rawSize / 2; size >= MIN_LEVEL_SIZE; size /= 2) {
+        levelOffsets.push_back(rowSize);
+        levelSizes.push_back(size);
+        rowSize += size;
+    }
+}
+
+// Each level keeps the max of bin pairs of the one below, an odd last bin is left out
+void FFTPyramid::buildRow(const float* raw, float* row) {
+    const float* in = raw;
+    for (int l = 0; l < levelSizes.size(); l++) {
+        float* out = &row[levelOffsets[l]];
+        int size = levelSizes[l];
+        for (int i = 0; i < size; i++) {
+            out[i] = std::max<float>(in[2 * i], in[2 * i + 1]);
+        }
+        in = out;
+    }
+}
+
+// Climbs the levels from both ends of the range, taking the odd bin at each end on the way up
+float FFTPyramid::rangeMax(const float* raw, const float* row, int begin, int end) {
+    float maxVal = -INFINITY;
+    const float* level = raw;
+    int l = 0;
+    while (begin < end) {
+        if (l == levelSizes.size()) {
+            for (int i = begin; i < end; i++) { maxVal = std::max<float>(maxVal, level[i]); }
+            break;
+        }
+        if (begin & 1) { maxVal = std::max<float>(maxVal, level[begin++]); }
+        if (end & 1) { maxVal = std::max<float>(maxVal, level[--end]); }
+        begin >>= 1;
+        end >>= 1;
+        level = &row[levelOffsets[l++]];
+    }
+    return maxVal;
+}
+
+void FFTPyramid::zoomRow(const float* raw, const float* row, int offset, int width, int outSize, float* out) {
+    // Same pixel to bin mapping as doZoom(), which is faster as long as a pixel only covers a few bins
+    width = std::min<int>(width, 524288);
+    offset = std::max<int>(offset, 0);
+    float factor = (float)width / (float)outSize;
+    int sFactor = (int)ceilf(factor);
+    if (sFactor <= DIRECT_ZOOM_MAX_BINS || levelSizes.empty()) {
+        doZoom(offset, width, rawSize, outSize, (float*)raw, out);
+        return;
+    }
+    float id = offset;
+    for (int i = 0; i < outSize; i++) {
+        int begin = (int)id;
+        out[i] = rangeMax(raw, row, begin, std::min<int>(begin + sFactor, rawSize));
+        id += factor;
+    }
+}
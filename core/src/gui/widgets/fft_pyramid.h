@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+
+// Zooms width bins of in starting at offset to outSize pixels, each pixel being the max of the bins it covers
+void doZoom(int offset, int width, int inSize, int outSize, float* in, float* out);
+
+// Max pyramid over FFT rows. Level l of a row holds the max of each aligned run of 2^l raw bins, so the max of
+// any range of bins only takes a few reads from the levels. Zooming a row gives the same pixels as doZoom() on
+// the raw bins for a fraction of the reads. The rows themselves are stored by the caller.
+class FFTPyramid {
+public:
+    // Levels smaller than this aren't worth keeping
+    static const int MIN_LEVEL_SIZE = 64;
+
+    // Up to this many bins per pixel, reading every bin is faster than walking the levels
+    static const int DIRECT_ZOOM_MAX_BINS = 32;
+
+    void init(int rawSize);
+
+    inline int getRowSize() { return rowSize; }
+
+    // Fills row (getRowSize() floats) from rawSize raw bins
+    void buildRow(const float* raw, float* row);
+
+    // Same as doZoom(offset, width, rawSize, outSize, raw, out), using the row built from raw
+    void zoomRow(const float* raw, const float* row, int offset, int width, int outSize, float* out);
+
+private:
+    float rangeMax(const float* raw, const float* row, int begin, int end);
+
+    int rawSize = 0;
+    int rowSize = 0;
+    std::vector<int> levelOffsets;
+    std::vector<int> levelSizes;
+};
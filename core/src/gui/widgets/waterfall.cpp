@@ -14,6 +14,8 @@
 #include <gui/style.h>
 #include <ctm.h>
 #include "utils/strings.h"
+#include <utils/worker_pool.h>
+#include <gui/widgets/fft_pyramid.h>
 #include <gui/menus/display.h>
 
 #define MEASURE_LOCK_GUARD(mtx)                                       \
@@ -95,65 +97,12 @@ inline void printAndScale(double freq, char* buf) {
     }
 }
 
-inline void doZoom(int offset, int width, int inSize, int outSize, float* in, float* out) {
-    // NOTE: REMOVE THAT SHIT, IT'S JUST A HACKY FIX
-    if (width > 524288) {
-        width = 524288;
-    }
-    if (offset < 0) {
-        flog::warn("Offset is negative: {}", offset);
-        offset = 0;
-    }
-
-    float factor = (float)width / (float)outSize;
-
-    int sFactor = (int)ceilf(factor);
-    float id = offset;
-    float maxVal, maxVal1, maxVal2, maxVal3, maxVal4, maxVal5, maxVal6, maxVal7, maxVal8, maxVal9, maxVal10, maxVal11, maxVal12, maxVal13, maxVal14, maxVal15;
-    int sId;
-    for (int i = 0; i < outSize; i++) {
-        maxVal = -INFINITY;
-        maxVal1 = -INFINITY;
-        maxVal2 = -INFINITY;
-        maxVal3 = -INFINITY;
-        maxVal4 = -INFINITY;
-        maxVal5 = -INFINITY;
-        maxVal6 = -INFINITY;
-        maxVal7 = -INFINITY;
-        // more than 8 is not worth it
-        sId = (int)id;
-        int uFactor = (sId + sFactor > inSize) ? inSize - sId : sFactor;
-
-        constexpr int N = 8;
-        auto uFactorN = (((int)uFactor) / N) * N;
-        int j;
-        for (j = 0; j < uFactorN; j += N) {
-            maxVal = std::max<float>(maxVal, in[sId + j]);
-            maxVal1 = std::max<float>(maxVal1, in[sId + j + 1]);
-            maxVal2 = std::max<float>(maxVal2, in[sId + j + 2]);
-            maxVal3 = std::max<float>(maxVal3, in[sId + j + 3]);
-            maxVal4 = std::max<float>(maxVal4, in[sId + j + 4]);
-            maxVal5 = std::max<float>(maxVal5, in[sId + j + 5]);
-            maxVal6 = std::max<float>(maxVal6, in[sId + j + 6]);
-            maxVal7 = std::max<float>(maxVal7, in[sId + j + 7]);
-        }
-        maxVal = std::max<float>(maxVal, maxVal1);
-        maxVal = std::max<float>(maxVal, maxVal2);
-        maxVal = std::max<float>(maxVal, maxVal3);
-        maxVal = std::max<float>(maxVal, maxVal4);
-        maxVal = std::max<float>(maxVal, maxVal5);
-        maxVal = std::max<float>(maxVal, maxVal6);
-        maxVal = std::max<float>(maxVal, maxVal7);
-        for (; j < uFactor; j++) {
-            maxVal = std::max<float>(maxVal, in[sId + j]);
-        }
-
-        out[i] = maxVal;
-        id += factor;
-    }
+// Shared by all waterfalls, full redraws are split across it
+static WorkerPool& redrawPool() {
+    static WorkerPool* pool = new WorkerPool(std::clamp<int>((int)std::thread::hardware_concurrency() - 1, 1, 7));
+    return *pool;
 }
 
-
 namespace ImGui {
 
     WaterFall::WaterFall() {
@@ -762,6 +711,26 @@ namespace ImGui {
         return std::clamp<int>(((frequency / (wholeBandwidth / 2.0)) * (double)(rawFFTSize / 2)) + (rawFFTSize / 2), 0, rawFFTSize);
     }
 
+    void WaterFall::allocFFTPyramid() {
+        fftPyramidLayout.init(rawFFTSize);
+        int rows = std::max<int>(1, waterfallHeight);
+        int rowSize = fftPyramidLayout.getRowSize();
+        fftPyramid = (float*)realloc(fftPyramid, std::max<int>(1, rows * rowSize) * sizeof(float));
+        memset(fftPyramid, 0, rows * rowSize * sizeof(float));
+    }
+
+    void WaterFall::buildFFTPyramidRow(int line) {
+        fftPyramidLayout.buildRow(&rawFFTs[line * rawFFTSize], &fftPyramid[line * fftPyramidLayout.getRowSize()]);
+    }
+
+    /**
+     * zooms a stored row to dataWidth pixels using its pyramid, same output as doZoom on the raw row.
+     * offset and width are in raw bins.
+     */
+    void WaterFall::zoomFFTRow(int line, int offset, int width, float* out) {
+        fftPyramidLayout.zoomRow(&rawFFTs[line * rawFFTSize], &fftPyramid[line * fftPyramidLayout.getRowSize()], offset, width, dataWidth, out);
+    }
+
     /**
      * from raw fft to the waterfallDB, using palette. Also, invalidates opengl textures.
      * */
@@ -801,44 +770,26 @@ namespace ImGui {
 
 
             if (count != 0) {
-                int NTHREADS = 4;
-
                 int wfi = waterfallFbIndex;
-                int blockSize = count / NTHREADS;
-                std::vector<std::shared_ptr<std::thread>> threads;
-                threads.reserve(NTHREADS);
-
-                for (int b = 0; b < NTHREADS; b++) {
-                    int ii = b * blockSize;
-                    auto cnt = blockSize;
-                    if (b == NTHREADS - 1) {
-                        cnt = count - ii;
-                    }
-
-
-                    threads.emplace_back(std::make_shared<std::thread>([=]() {
-                        std::vector<float> tempdata(dataWidth);
-                        auto td = tempdata.data();
-                        auto waterfallFbIndexLocal = wfi % totalNumberOfPixels;
-                        for (int i = ii; i < ii + cnt; i++) {
-                            doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, &rawFFTs[((i + currentFFTLine) % waterfallHeight) * rawFFTSize], td);
-                            for (int j = 0; j < dataWidth; j++) {
-                                auto pixel = (std::clamp<float>(td[j], waterfallMin, waterfallMax) - waterfallMin) / dataRange;
-                                if (waterfallFbIndexLocal >= totalNumberOfPixels) {
-                                    flog::info("failure, waterfallFbIndex: {}, totalNumberOfPixels: {}, dataWidth: {}, waterfallHeight: {}", waterfallFbIndexLocal, totalNumberOfPixels, dataWidth, waterfallHeight);
-                                    abort();
-                                }
-                                waterfallFb[waterfallFbIndexLocal++] = waterfallPallet[(int)(pixel * (WATERFALL_RESOLUTION - 1))];
+                redrawPool().parallelFor(count, [&](int begin, int end) {
+                    static thread_local std::vector<float> tempdata;
+                    tempdata.resize(dataWidth);
+                    auto td = tempdata.data();
+                    int waterfallFbIndexLocal = (int)((wfi + (long long)begin * dataWidth) % totalNumberOfPixels);
+                    for (int i = begin; i < end; i++) {
+                        zoomFFTRow((i + currentFFTLine) % waterfallHeight, drawDataStart, drawDataSize, td);
+                        for (int j = 0; j < dataWidth; j++) {
+                            auto pixel = (std::clamp<float>(td[j], waterfallMin, waterfallMax) - waterfallMin) / dataRange;
+                            if (waterfallFbIndexLocal >= totalNumberOfPixels) {
+                                flog::info("failure, waterfallFbIndex: {}, totalNumberOfPixels: {}, dataWidth: {}, waterfallHeight: {}", waterfallFbIndexLocal, totalNumberOfPixels, dataWidth, waterfallHeight);
+                                abort();
                             }
-                            waterfallFbIndexLocal %= totalNumberOfPixels;
+                            waterfallFb[waterfallFbIndexLocal++] = waterfallPallet[(int)(pixel * (WATERFALL_RESOLUTION - 1))];
                         }
-                    }));
-                    wfi = (wfi + cnt * dataWidth) % totalNumberOfPixels;
-                }
-                for (int b = 0; b < NTHREADS; b++) {
-                    threads[b]->join();
-                }
-                waterfallFbIndex = wfi % totalNumberOfPixels; // for continuing
+                        waterfallFbIndexLocal %= totalNumberOfPixels;
+                    }
+                });
+                waterfallFbIndex = (int)((wfi + (long long)count * dataWidth) % totalNumberOfPixels); // for continuing
             }
 
 
@@ -1037,12 +988,11 @@ namespace ImGui {
             if (rawFFTs != NULL) {
                 if (currentFFTLine != 0) {
                     // flog::info("onresize: currentFFTLine={} rawFFTSize={}", currentFFTLine, rawFFTSize);
-                    float* tempWF = new float[currentFFTLine * rawFFTSize];
-                    int moveCount = lastWaterfallHeight - currentFFTLine;
-                    memcpy(tempWF, rawFFTs, currentFFTLine * rawFFTSize * sizeof(float));
-                    memmove(rawFFTs, &rawFFTs[currentFFTLine * rawFFTSize], moveCount * rawFFTSize * sizeof(float));
-                    memcpy(&rawFFTs[moveCount * rawFFTSize], tempWF, currentFFTLine * rawFFTSize * sizeof(float));
-                    delete[] tempWF;
+                    // Newest line first, the pyramid rows follow the raw ones
+                    std::rotate(rawFFTs, &rawFFTs[currentFFTLine * rawFFTSize], &rawFFTs[lastWaterfallHeight * rawFFTSize]);
+                    if (fftPyramid != NULL) {
+                        std::rotate(fftPyramid, &fftPyramid[currentFFTLine * fftPyramidLayout.getRowSize()], &fftPyramid[lastWaterfallHeight * fftPyramidLayout.getRowSize()]);
+                    }
                 }
                 currentFFTLine = 0;
                 rawFFTs = (float*)realloc(rawFFTs, waterfallHeight * rawFFTSize * sizeof(float));
@@ -1050,6 +1000,12 @@ namespace ImGui {
             else {
                 rawFFTs = (float*)malloc(waterfallHeight * rawFFTSize * sizeof(float));
             }
+            if (fftPyramid != NULL) {
+                fftPyramid = (float*)realloc(fftPyramid, std::max<int>(1, waterfallHeight * fftPyramidLayout.getRowSize()) * sizeof(float));
+            }
+            else {
+                allocFFTPyramid();
+            }
             // ==============
         }
 
@@ -1210,7 +1166,8 @@ namespace ImGui {
         int drawDataStart = (((double)rawFFTSize / 2.0) * (offsetRatio + 1)) - (drawDataSize / 2);
 
         if (waterfallVisible) {
-            doZoom(drawDataStart, drawDataSize, rawFFTSize, dataWidth, &rawFFTs[currentFFTLine * rawFFTSize], latestFFT);
+            buildFFTPyramidRow(currentFFTLine);
+            zoomFFTRow(currentFFTLine, drawDataStart, drawDataSize, latestFFT);
 
             waterfallHeadSectionHeight++;
             if (waterfallHeadSectionHeight > waterfallMaxSectionHeight) {
@@ -1271,6 +1228,7 @@ namespace ImGui {
                 latestFFTHold[i] = std::max<float>(latestFFT[i], latestFFTHold[i] - fftHoldSpeed);
             }
         }
+        fftFrameCount++;
 
         buf_mtx.unlock();
     }
@@ -1512,6 +1470,7 @@ namespace ImGui {
         }
         fftLines = 0;
         memset(rawFFTs, 0, rawFFTSize * waterfallHeight * sizeof(float));
+        allocFFTPyramid();
         updateWaterfallFb();
     }
 
@@ -1760,6 +1719,9 @@ namespace ImGui {
         size_t length = waterfallHeight * rawFFTSize * sizeof(float);
         flog::info("rawFFTS: {}, length {}", (void*)rawFFTs, (int)length);
         memset(rawFFTs, 0, length);
+        if (fftPyramid) {
+            memset(fftPyramid, 0, waterfallHeight * fftPyramidLayout.getRowSize() * sizeof(float));
+        }
         updateWaterfallFb();
     }
 
@@ -1801,6 +1763,9 @@ namespace ImGui {
         if (rawFFTs) {
             free(rawFFTs);
         }
+        if (fftPyramid) {
+            free(fftPyramid);
+        }
         if (latestFFT != NULL) {
             delete[] latestFFT;
         }
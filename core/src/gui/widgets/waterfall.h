@@ -2,7 +2,9 @@
 #include <core.h>
 #include <vector>
 #include <mutex>
+#include <atomic>
 #include <gui/widgets/bandplan.h>
+#include <gui/widgets/fft_pyramid.h>
 #include <imgui/imgui.h>
 #include <imgui/imgui_internal.h>
 #include <utils/event.h>
@@ -161,6 +163,9 @@ namespace ImGui {
         float* acquireLatestFFT(int& width);
         void releaseLatestFFT();
 
+        // Frames pushed so far, for readers of acquireLatestFFT() that handle each frame once
+        uint64_t getFFTFrameCount() { return fftFrameCount; }
+
         bool centerFreqMoved = false;
         bool vfoFreqChanged = false;
         bool bandplanEnabled = false;
@@ -256,6 +261,9 @@ namespace ImGui {
         void onPositionChange();
         void onResize();
         void updateWaterfallTexture();
+        void allocFFTPyramid();
+        void buildFFTPyramidRow(int line);
+        void zoomFFTRow(int line, int offset, int width, float* out);
 
         enum {
             TEXTURE_SPECIFY_REQUIRED,
@@ -323,8 +331,12 @@ namespace ImGui {
         //std::vector<std::vector<float>> rawFFTs;
         int rawFFTSize;
         float* rawFFTs = NULL;
+        // Max pyramid of every rawFFTs row, redraws zoom from it instead of reading every raw bin in view
+        float* fftPyramid = NULL;
+        FFTPyramid fftPyramidLayout;
         float* latestFFT = NULL;
         float* latestFFTHold = NULL;
+        std::atomic<uint64_t> fftFrameCount = 0;
         float* smoothingBuf = NULL;
         int currentFFTLine = 0;
         int fftLines = 0;
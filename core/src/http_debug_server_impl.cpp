@@ -15,6 +15,7 @@
 #include <cstdarg>
 #include <core.h>
 #include <signal_path/signal_path.h>
+#include <dsp/profiler.h>
 
 #ifdef __cplusplus
 #include "imgui.h"
@@ -387,7 +388,8 @@ namespace httpdebug {
 
 // Implement createResponseForRequest here
 struct Response* createResponseForRequest(const struct Request* request, struct Connection* connection) {
-    if (strcmp(request->path, "/log") != 0) {
+    // Polled endpoints stay out of the log
+    if (strcmp(request->path, "/log") != 0 && strcmp(request->path, "/profile") != 0) {
         std::string reqLine = std::string(request->method) + " " + request->pathDecoded;
         if (request->body.length > 0 && request->body.contents) {
             reqLine += " body=";
@@ -794,17 +796,18 @@ struct Response* createResponseForRequest(const struct Request* request, struct
 #endif
 
     if (strcmp(request->path, "/log") == 0) {
-        if (!flog::isMemoryLogEnabled()) {
-            return responseAllocJSON("{\"error\":\"memory log buffer disabled\"}");
-        }
+        // From the in-memory ring of flog: what came since the last call, or since the seq given
+        static std::atomic<uint64_t> logCursor{ 0 };
+        char* sinceParam = strdupDecodeGETParam("since=", request, "");
+        uint64_t since = *sinceParam ? strtoull(sinceParam, NULL, 10) : logCursor.load();
+        free(sinceParam);
+        std::vector<flog::LogRec> records;
+        uint64_t next = flog::getRecent(since, records, 5000);
+        logCursor = next;
         std::string content;
-        {
-            std::lock_guard<std::mutex> lock(flog::outMtx);
-            for (const auto& rec : flog::logRecords) {
-                content += rec.message;
-                content += '\n';
-            }
-            flog::logRecords.clear();
+        for (const auto& rec : records) {
+            content += rec.message;
+            content += '\n';
         }
 
         std::string escaped;
@@ -830,7 +833,19 @@ struct Response* createResponseForRequest(const struct Request* request, struct
                     break;
             }
         }
-        std::string json = std::string("{\"log\": \"") + escaped + "\"}";
+        std::string json = std::string("{\"log\": \"") + escaped + "\", \"next\": " + std::to_string(next) + ", \"dropped\": " + std::to_string(flog::getDroppedCount()) + "}";
+        return responseAllocJSON(json.c_str());
+    }
+
+    if (strcmp(request->path, "/profile") == 0) {
+        // Pipeline profiler: /profile?enable=1 starts counting from zero, ?reset=1 zeroes, ?enable=0 stops
+        char* enableParam = strdupDecodeGETParam("enable=", request, "");
+        char* resetParam = strdupDecodeGETParam("reset=", request, "");
+        if (*enableParam) { dsp::profiler::setEnabled(atoi(enableParam) != 0); }
+        if (atoi(resetParam)) { dsp::profiler::reset(); }
+        free(enableParam);
+        free(resetParam);
+        std::string json = dsp::profiler::toJson(dsp::profiler::getSnapshot());
         return responseAllocJSON(json.c_str());
     }
 
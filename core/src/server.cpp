@@ -4,6 +4,9 @@
 #include <version.h>
 #include <config.h>
 #include <filesystem>
+#include <deque>
+#include <atomic>
+#include <memory>
 #include <dsp/types.h>
 #include <utils/wav.h>
 #include <signal_path/signal_path.h>
@@ -13,6 +16,9 @@
 #include <dsp/buffer/prebuffer.h>
 #include <dsp/buffer/packer.h>
 #include "dsp/compression/experimental_fft_compressor.h"
+#include "dsp/compression/zstd_stream.h"
+#include "dsp/channel/frequency_xlator.h"
+#include "dsp/routing/splitter.h"
 #include "dsp/sink/handler_sink.h"
 #include "dsp/loop/agc.h"
 #include "dsp/multirate/rational_resampler.h"
@@ -27,88 +33,352 @@
 #include "utils/pbkdf2_sha256.h"
 
 namespace server {
+    static const int CLIENT_CAPS_BASEDATA_METADATA = 0x0001;        // wants frequency and samplerate along with each IQ batch (otherwise, network latency decouples freq request from baseband)
+    static const int CLIENT_CAPS_FFT_WANTED = 0x0002;        // not yet done
+
+    // Baseband frames a client can have waiting to be sent before the oldest one is dropped
+    static const int CLIENT_MAX_QUEUED_FRAMES = 8;
+    // IQ blocks buffered in front of each client's DSP chain before the splitter drops the oldest
+    static const int CLIENT_INPUT_QUEUE_DEPTH = 4;
+
+    // All clients share one capture, the splitter hands each of them a reference to the same block
     dsp::stream<dsp::complex_t> dummyInput("server::dummyInput");
-    dsp::multirate::RationalResampler<dsp::complex_t> forcedResampler;
-    dsp::compression::ExperimentalFFTCompressor fftCompressor;
-    dsp::compression::SampleStreamCompressor comp;
-    dsp::sink::Handler<uint8_t> hnd;
-    net::Conn client;
-    uint8_t* rbuf = NULL;
-    uint8_t* sbuf = NULL;
-    uint8_t* bbuf = NULL;
-
-    PacketHeader* r_pkt_hdr = NULL;
-    uint8_t* r_pkt_data = NULL;
-    CommandHeader* r_cmd_hdr = NULL;
-    uint8_t* r_cmd_data = NULL;
-
-    PacketHeader* s_pkt_hdr = NULL;
-    uint8_t* s_pkt_data = NULL;
-    CommandHeader* s_cmd_hdr = NULL;
-    uint8_t* s_cmd_data = NULL;
-
-    PacketHeader* bb_pkt_hdr = NULL;
-    uint8_t* bb_pkt_data = NULL;
+    dsp::routing::Splitter<dsp::complex_t> split;
 
     SmGui::DrawListElem dummyElem;
 
-    ZSTD_CCtx* cctx;
-
     net::Listener listener;
 
     OptionList<std::string, std::string> sourceList;
     int sourceId = 0;
-    bool running = false;
-    bool compression = false;
+    bool sourceRunning = false;
     double sampleRate = 1000000.0;
-    int forcedSampleRate = 0;
+    int maxClients = 1;
 
-    std::vector<int8_t> authSigningKey;
-    std::string challenge;
+    // The source, its menu and its tuning are shared by every client, last one to touch them wins
+    std::recursive_mutex sourceMtx;
 
-    static const int CLIENT_CAPS_BASEDATA_METADATA = 0x0001;        // wants frequency and samplerate along with each IQ batch (otherwise, network latency decouples freq request from baseband)
-    static const int CLIENT_CAPS_FFT_WANTED = 0x0002;        // not yet done
+    std::vector<int8_t> authSigningKey;
 
-    StartCommandArguments startCommandArguments;
     double lastTunedFrequency = 0;
     double lastCallbackFrequency = -1;
-    double lastSampleRate = 0;
 
+    std::mutex txMtx;
     bool transmitDataRunning = false;
     bool txPressed = false;
+    int txPrebufferMsec = 0;
     dsp::stream<dsp::complex_t> transmitDataStream;
     dsp::multirate::RationalResampler<dsp::complex_t> txStreamUpsampler;
     dsp::buffer::Prebuffer<dsp::complex_t> transmitPrebufferer;
     dsp::buffer::Packer<dsp::complex_t> transmitPacker;
 
-    int main() {
-        flog::info("=====| SERVER MODE |=====");
-#ifdef __linux__
-        signal(SIGPIPE, SIG_IGN);
-#endif
+    struct OutPacket {
+        std::vector<uint8_t> buf;   // only ever grows, pooled packets stop allocating once warmed up
+        int size = 0;
+        bool droppable = false;
+        bool zstdStream = false;    // payload is StreamMetadata and raw samples, the sender compresses it
+
+        inline PacketHeader* header() { return (PacketHeader*)buf.data(); }
+        inline uint8_t* data() { return &buf[sizeof(PacketHeader)]; }
+        inline CommandHeader* command() { return (CommandHeader*)data(); }
+        inline uint8_t* commandData() { return &buf[sizeof(PacketHeader) + sizeof(CommandHeader)]; }
+
+        // Shrinks the packet to len bytes of payload after it was filled
+        inline void setDataSize(int len) {
+            size = sizeof(PacketHeader) + len;
+            header()->size = size;
+        }
+    };
+    typedef std::unique_ptr<OutPacket> OutPacketPtr;
+
+    // One connected client. It gets its own DSP chain fed from the shared splitter, its own compression
+    // settings and a send queue drained by its own thread, so a slow link only ever holds up itself.
+    class ClientSession {
+    public:
+        ClientSession(net::Conn conn, int id) : conn(std::move(conn)), id(id), input("server::clientInput") {
+            peer = this->conn->getPeerName();
+            rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
+            cctx = ZSTD_createCCtx();
+            frameCountReport = currentTimeMillis();
+
+            ddc.init(&input, 0, sampleRate);
+            forcedResampler.init(&ddc.out, sampleRate, sampleRate);
+            fftCompressor.init(&forcedResampler.out);
+            fftCompressor.setEnabled(true);
+            core::configManager.acquire();
+            fftCompressor.setWorkerThread(core::configManager.conf["efftWorkerThread"]);
+            core::configManager.release();
+            comp.init(&fftCompressor.out, dsp::compression::PCM_TYPE_I16);
+            hnd.init(&comp.out, _testServerHandler, this);
+            updateResampler();
 
+            senderThread = std::thread(&ClientSession::senderWorker, this);
+        }
 
-        std::string password = (std::string)core::args["password"];
-        if (password != "") {
-            HMAC_SHA256_CTX pbkdf_hmac;
-            authSigningKey.resize(256 / 8);
-            flog::info("Computing auth signing key..");
-            pbkdf2_sha256(&pbkdf_hmac, (uint8_t *)password.data(), password.length(), (uint8_t*)passwordSalt.data(), passwordSalt.length(), 20000, (uint8_t*)authSigningKey.data(), authSigningKey.size());
+        ~ClientSession() {
+            close();
+            stopStream();
+            ZSTD_freeCCtx(cctx);
+            delete[] rbuf;
+        }
+
+        void startStream() {
+            if (running) { return; }
+            ddc.start();
+            forcedResampler.start();
+            fftCompressor.start();
+            comp.start();
+            hnd.start();
+            split.bindStream(&input, dsp::FanoutPolicy::DROP_OLDEST, CLIENT_INPUT_QUEUE_DEPTH);
+            running = true;
+        }
+
+        void stopStream() {
+            if (!running) { return; }
+            running = false;
+            split.unbindStream(&input);
+            ddc.stop();
+            forcedResampler.stop();
+            fftCompressor.stop();
+            comp.stop();
+            hnd.stop();
+        }
+
+        // Closes the connection and waits for its threads, must not be called from any of them
+        void close() {
+            dead = true;
+            conn->close();
+            {
+                std::lock_guard<std::mutex> lck(queueMtx);
+                stopSender = true;
+            }
+            queueCnd.notify_all();
+            if (senderThread.joinable()) { senderThread.join(); }
+        }
+
+        double getOutputSampleRate() {
+            return forcedSampleRate != 0 ? forcedSampleRate : sampleRate;
+        }
+
+        void updateResampler() {
+            double outRate = getOutputSampleRate();
+            ddc.setOffset(-ddcOffset, sampleRate);
+            forcedResampler.setRates(sampleRate, outRate);
+            fftCompressor.setSampleRate(outRate);
         }
 
-            // Init DSP
-        forcedResampler.init(&dummyInput, 1000000, 48000);
-        fftCompressor.init(&forcedResampler.out);
-        fftCompressor.setEnabled(true);
-        comp.init(&fftCompressor.out, dsp::compression::PCM_TYPE_I8);
-        hnd.init(&comp.out, _testServerHandler, NULL);
-        rbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        sbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        bbuf = new uint8_t[SERVER_MAX_PACKET_SIZE];
-        comp.start();
-        hnd.start();
-        fftCompressor.start();
-        forcedResampler.start();
+        // Takes a pooled packet with room for len bytes of payload
+        OutPacketPtr newPacket(PacketType type, int len, bool droppable = false) {
+            OutPacketPtr pkt;
+            {
+                std::lock_guard<std::mutex> lck(queueMtx);
+                if (!freePackets.empty()) {
+                    pkt = std::move(freePackets.back());
+                    freePackets.pop_back();
+                }
+            }
+            if (!pkt) { pkt = std::make_unique<OutPacket>(); }
+            int size = sizeof(PacketHeader) + len;
+            if (pkt->buf.size() < (size_t)size) { pkt->buf.resize(size); }
+            pkt->droppable = droppable;
+            pkt->zstdStream = false;
+            pkt->header()->type = type;
+            pkt->setDataSize(len);
+            return pkt;
+        }
+
+        OutPacketPtr newCommand(PacketType type, Command cmd, int len, bool droppable = false) {
+            auto pkt = newPacket(type, sizeof(CommandHeader) + len, droppable);
+            pkt->command()->cmd = cmd;
+            return pkt;
+        }
+
+        // Queues a packet for the sender thread. Droppable packets beyond the queue limit push out the
+        // oldest droppable one, everything else is always delivered in order.
+        void send(OutPacketPtr pkt) {
+            {
+                std::lock_guard<std::mutex> lck(queueMtx);
+                if (pkt->droppable) {
+                    if (queuedFrames >= CLIENT_MAX_QUEUED_FRAMES) {
+                        auto it = std::find_if(queue.begin(), queue.end(), [](const OutPacketPtr& p) { return p->droppable; });
+                        freePackets.push_back(std::move(*it));
+                        queue.erase(it);
+                        queuedFrames--;
+                        droppedFrames++;
+                    }
+                    queuedFrames++;
+                }
+                queue.push_back(std::move(pkt));
+            }
+            queueCnd.notify_one();
+        }
+
+        net::Conn conn;
+        int id;
+        std::string peer;
+        uint8_t* rbuf = NULL;
+        ZSTD_CCtx* cctx = NULL;
+
+        dsp::stream<dsp::complex_t> input;
+        dsp::channel::FrequencyXlator ddc;
+        dsp::multirate::RationalResampler<dsp::complex_t> forcedResampler;
+        dsp::compression::ExperimentalFFTCompressor fftCompressor;
+        dsp::compression::SampleStreamCompressor comp;
+        dsp::sink::Handler<uint8_t> hnd;
+
+        std::atomic<bool> running = false;
+        std::atomic<bool> dead = false;
+        int compression = BASEBAND_COMPRESSION_NONE;
+        dsp::compression::PCMType pcmType = dsp::compression::PCM_TYPE_I16;
+        std::atomic<bool> streamSettingsChanged = false;
+        int forcedSampleRate = 0;
+        double ddcOffset = 0;
+        double lastSampleRate = 0;
+        StartCommandArguments startCommandArguments = {};
+        std::string challenge;
+
+        int frameCount = 0;
+        long long frameCountReport = 0;
+        std::atomic<uint64_t> sentFrames = 0;
+        std::atomic<uint64_t> droppedFrames = 0;
+
+        // Remote UI as the client last got it, under sourceMtx. uiDeltaVersion stays 0 for clients that
+        // only understand full lists.
+        int uiDeltaVersion = 0;
+        SmGui::DrawList lastUI;
+        uint32_t uiSeq = 0;
+        std::vector<uint8_t> uiBuf;
+        uint64_t uiFullBytes = 0;
+        uint64_t uiSentBytes = 0;
+
+    private:
+        void senderWorker() {
+            while (true) {
+                OutPacketPtr pkt;
+                {
+                    std::unique_lock<std::mutex> lck(queueMtx);
+                    queueCnd.wait(lck, [this] { return !queue.empty() || stopSender; });
+                    if (stopSender) { return; }
+                    pkt = std::move(queue.front());
+                    queue.pop_front();
+                    if (pkt->droppable) { queuedFrames--; }
+                }
+
+                bool ok = true;
+                if (pkt->zstdStream) {
+                    int size = compressStreamPacket(pkt.get());
+                    if (size > 0) { ok = conn->write(size, streamBuf.data()); }
+                }
+                else {
+                    ok = conn->write(pkt->size, pkt->buf.data());
+                }
+                if (ok && pkt->droppable) { sentFrames++; }
+
+                {
+                    std::lock_guard<std::mutex> lck(queueMtx);
+                    freePackets.push_back(std::move(pkt));
+                }
+
+                // Cleaned up by reapClients(), the connection can't be closed from here
+                if (!ok) {
+                    dead = true;
+                    return;
+                }
+            }
+        }
+
+        // Streaming compression runs here rather than in the DSP chain, and only on frames that made it
+        // through the queue, so a dropped frame never leaves a hole in the stream history.
+        int compressStreamPacket(OutPacket* pkt) {
+            if (streamSettingsChanged.exchange(false)) {
+                if (!streamEncoder.getDictionary().empty()) { writeCommand(COMMAND_SET_ZSTD_DICTIONARY, NULL, 0); }
+                streamEncoder.setDictionary({});
+                streamEncoder.restartTraining();
+            }
+
+            int headerSize = sizeof(PacketHeader) + sizeof(StreamMetadata);
+            const uint8_t* raw = &pkt->buf[headerSize];
+            int rawSize = pkt->size - headerSize;
+
+            // The dictionary goes out ahead of the first frame that uses it
+            if (compression == BASEBAND_COMPRESSION_ZSTD_STREAM_DICT && pcmType != dsp::compression::PCM_TYPE_F32 && streamEncoder.train(raw, rawSize)) {
+                auto& dict = streamEncoder.getDictionary();
+                flog::info("Client {0}: trained a {1} byte zstd dictionary", id, (int)dict.size());
+                writeCommand(COMMAND_SET_ZSTD_DICTIONARY, dict.data(), dict.size());
+            }
+
+            bool frameStart;
+            int size = streamEncoder.compress(raw, rawSize, streamBuf, headerSize, frameStart);
+            if (size < 0) {
+                flog::error("Client {0}: zstd stream compression failed, restarting the stream", id);
+                return -1;
+            }
+
+            memcpy(streamBuf.data(), pkt->buf.data(), headerSize);
+            PacketHeader* hdr = (PacketHeader*)streamBuf.data();
+            hdr->size = headerSize + size;
+            StreamMetadata* sm = (StreamMetadata*)&streamBuf[sizeof(PacketHeader)];
+            sm->compressionRatio = streamEncoder.getRatio();
+            sm->compressMillisPerSecond = streamEncoder.getCompressMillisPerSecond();
+            sm->streamFlags = frameStart ? STREAM_FLAG_FRAME_START : 0;
+            return hdr->size;
+        }
+
+        // Writes a command right away, for the sender thread to keep it in order with the stream
+        void writeCommand(Command cmd, const void* data, int len) {
+            std::vector<uint8_t> buf(sizeof(PacketHeader) + sizeof(CommandHeader) + len);
+            PacketHeader* hdr = (PacketHeader*)buf.data();
+            CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+            hdr->type = PACKET_TYPE_COMMAND;
+            hdr->size = buf.size();
+            chdr->cmd = cmd;
+            if (len) { memcpy(&buf[sizeof(PacketHeader) + sizeof(CommandHeader)], data, len); }
+            conn->write(buf.size(), buf.data());
+        }
+
+        dsp::compression::ZstdStreamEncoder streamEncoder;
+        std::vector<uint8_t> streamBuf;
+
+        std::thread senderThread;
+        std::mutex queueMtx;
+        std::condition_variable queueCnd;
+        std::deque<OutPacketPtr> queue;
+        std::vector<OutPacketPtr> freePackets;
+        int queuedFrames = 0;
+        bool stopSender = false;
+    };
+    typedef std::shared_ptr<ClientSession> Session;
+
+    std::mutex sessionsMtx;
+    std::vector<Session> sessions;
+    int nextClientId = 1;
+
+    std::vector<Session> snapshotSessions() {
+        std::lock_guard<std::mutex> lck(sessionsMtx);
+        return sessions;
+    }
+
+    // Runs the source while at least one client is streaming
+    void updateSourceState() {
+        std::lock_guard<std::recursive_mutex> lck(sourceMtx);
+        bool anyRunning = false;
+        for (auto& s : snapshotSessions()) {
+            if (s->running && !s->dead) { anyRunning = true; }
+        }
+        if (anyRunning && !sourceRunning) {
+            sigpath::sourceManager.start();
+            sourceRunning = true;
+        }
+        else if (!anyRunning && sourceRunning) {
+            sigpath::sourceManager.stop();
+            sourceRunning = false;
+        }
+    }
+
+    void init() {
+        split.init(&dummyInput);
+        split.setSharedFanout(true);
+        split.start();
 
         if (true) {
             txStreamUpsampler.init(&transmitDataStream, TX_WIRE_SAMPLERATE, 48000);
@@ -121,23 +391,70 @@ namespace server {
         transmitPrebufferer.start();
         transmitPacker.init(&transmitPrebufferer.out, 2048);
         transmitPacker.start();
+    }
+
+    void listen(std::string host, int port, int maxClients) {
+        server::maxClients = std::max<int>(maxClients, 1);
+        listener = net::listen(host, port);
+        listener->acceptAsync(_clientHandler, NULL);
+    }
+
+    // Removes clients whose connection failed or was closed, from any thread but their own
+    void reapClients() {
+        std::vector<Session> gone;
+        {
+            std::lock_guard<std::mutex> lck(sessionsMtx);
+            for (auto it = sessions.begin(); it != sessions.end();) {
+                if ((*it)->dead || !(*it)->conn->isOpen()) {
+                    gone.push_back(*it);
+                    it = sessions.erase(it);
+                }
+                else {
+                    it++;
+                }
+            }
+        }
+        if (gone.empty()) { return; }
+
+        for (auto& s : gone) {
+            s->close();
+            s->stopStream();
+            flog::info("Client {0} ({1}) is gone, {2} frames sent, {3} dropped", s->id, s->peer, (uint64_t)s->sentFrames, (uint64_t)s->droppedFrames);
+        }
+        updateSourceState();
+    }
+
+    void shutdown() {
+        if (listener) { listener->close(); }
+        for (auto& s : snapshotSessions()) { s->dead = true; }
+        reapClients();
+    }
+
+    std::vector<ClientStats> getClientStats() {
+        std::vector<ClientStats> stats;
+        for (auto& s : snapshotSessions()) {
+            stats.push_back({ s->id, s->peer, s->running, s->sentFrames, s->droppedFrames, split.getDroppedBlocks(&s->input) });
+        }
+        return stats;
+    }
 
-        // Initialize headers
-        r_pkt_hdr = (PacketHeader*)rbuf;
-        r_pkt_data = &rbuf[sizeof(PacketHeader)];
-        r_cmd_hdr = (CommandHeader*)r_pkt_data;
-        r_cmd_data = &rbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
+    int main() {
+        flog::info("=====| SERVER MODE |=====");
+#ifdef __linux__
+        signal(SIGPIPE, SIG_IGN);
+#endif
 
-        s_pkt_hdr = (PacketHeader*)sbuf;
-        s_pkt_data = &sbuf[sizeof(PacketHeader)];
-        s_cmd_hdr = (CommandHeader*)s_pkt_data;
-        s_cmd_data = &sbuf[sizeof(PacketHeader) + sizeof(CommandHeader)];
 
-        bb_pkt_hdr = (PacketHeader*)bbuf;
-        bb_pkt_data = &bbuf[sizeof(PacketHeader)];
+        std::string password = (std::string)core::args["password"];
+        if (password != "") {
+            HMAC_SHA256_CTX pbkdf_hmac;
+            authSigningKey.resize(256 / 8);
+            flog::info("Computing auth signing key..");
+            pbkdf2_sha256(&pbkdf_hmac, (uint8_t *)password.data(), password.length(), (uint8_t*)passwordSalt.data(), passwordSalt.length(), 20000, (uint8_t*)authSigningKey.data(), authSigningKey.size());
+        }
 
-        // Initialize compressor
-        cctx = ZSTD_createCCtx();
+        // Init DSP
+        init();
 
         // Load config
         core::configManager.acquire();
@@ -235,11 +552,13 @@ namespace server {
         // TODO: Use command line option
         std::string host = (std::string)core::args["addr"];
         int port = (int)core::args["port"];
-        listener = net::listen(host, port);
-        listener->acceptAsync(_clientHandler, NULL);
+        listen(host, port, (int)core::args["max-clients"]);
 
-        flog::info("Ready, listening on {0}:{1}", host, port);
-        while(1) { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+        flog::info("Ready, listening on {0}:{1} for up to {2} clients", host, port, maxClients);
+        while(1) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            reapClients();
+        }
 
         return 0;
     }
@@ -256,73 +575,82 @@ namespace server {
         return rv.dump();
     }
 
-    void maybeSendTransmitterState() {
+    void maybeSendTransmitterState(ClientSession* client) {
         if (sigpath::transmitter) {
             auto state = transmitterStatusToString(sigpath::transmitter);
-            strcpy((char*)s_cmd_data, state.c_str());
-            sendCommand(COMMAND_SET_TRANSMITTER_SUPPORTED, state.length()+1);
+            sendCommand(client, COMMAND_SET_TRANSMITTER_SUPPORTED, state.c_str(), state.length()+1);
         } else {
-            sendCommand(COMMAND_SET_TRANSMITTER_NOT_SUPPORTED, 0);
+            sendCommand(client, COMMAND_SET_TRANSMITTER_NOT_SUPPORTED, NULL, 0);
         }
     }
 
-    void maybeSendChallenge() {
+    void maybeSendChallenge(ClientSession* client) {
         if (authSigningKey.size() > 0) {
-            challenge = std::to_string(currentTimeMillis());
-            challenge.resize(256 / 8, ' ');
-            memcpy(s_cmd_data, challenge.c_str(), challenge.size());
-            sendCommand(COMMAND_SECURE_CHALLENGE, challenge.size());
+            client->challenge = std::to_string(currentTimeMillis());
+            client->challenge.resize(256 / 8, ' ');
+            sendCommand(client, COMMAND_SECURE_CHALLENGE, client->challenge.c_str(), client->challenge.size());
         }
     }
 
+    void sendDisconnect(net::Conn& conn) {
+        uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader)];
+        PacketHeader *tmp_phdr = (PacketHeader *) buf;
+        CommandHeader *tmp_chdr = (CommandHeader *) &buf[sizeof(PacketHeader)];
+        tmp_phdr->size = sizeof(PacketHeader) + sizeof(CommandHeader);
+        tmp_phdr->type = PACKET_TYPE_COMMAND;
+        tmp_chdr->cmd = COMMAND_DISCONNECT;
+        conn->write(tmp_phdr->size, buf);
+    }
+
+    bool hasFreeSlot() {
+        std::lock_guard<std::mutex> lck(sessionsMtx);
+        return (int)sessions.size() < maxClients;
+    }
+
     void _clientHandler(net::Conn conn, void* ctx) {
-        // Reject if someone else is already connected
-        if (client && client->isOpen()) {
-            if (running) {
-                flog::info("REJECTED Connection from {0}, another client is already connected.", conn->getPeerName());
-
-                // Issue a disconnect command to the client
-                uint8_t buf[sizeof(PacketHeader) + sizeof(CommandHeader)];
-                PacketHeader *tmp_phdr = (PacketHeader *) buf;
-                CommandHeader *tmp_chdr = (CommandHeader *) &buf[sizeof(PacketHeader)];
-                tmp_phdr->size = sizeof(PacketHeader) + sizeof(CommandHeader);
-                tmp_phdr->type = PACKET_TYPE_COMMAND;
-                tmp_chdr->cmd = COMMAND_DISCONNECT;
-                conn->write(tmp_phdr->size, buf);
-
-                // TODO: Find something cleaner
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-                conn->close();
-
-                // Start another async accept
-                listener->acceptAsync(_clientHandler, NULL);
-                return;
-            } else {
-                // idle existing client is sent away.
-                client->close();
-                client.reset();
+        // Free the slots of clients that went away since the last check
+        reapClients();
+
+        // When full, an idle client is sent away to make room
+        if (!hasFreeSlot()) {
+            for (auto& s : snapshotSessions()) {
+                if (s->running) { continue; }
+                flog::info("Sending away idle client {0} ({1})", s->id, s->peer);
+                sendDisconnect(s->conn);
+                s->dead = true;
+                break;
             }
+            reapClients();
         }
 
-        flog::info("Connection from {0}", conn->getPeerName());
-        client = std::move(conn);
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
+        if (!hasFreeSlot()) {
+            flog::info("REJECTED Connection from {0}, already serving {1} clients.", conn->getPeerName(), maxClients);
 
-        // Perform settings reset
-        sigpath::sourceManager.stop();
-        comp.setPCMType(dsp::compression::PCM_TYPE_I16);
-        compression = false;
+            // Issue a disconnect command to the client
+            sendDisconnect(conn);
 
-        sendSampleRate(forcedSampleRate != 0 ? forcedSampleRate: sampleRate);
+            // TODO: Find something cleaner
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
-        if (authSigningKey.size() > 0) {
-            maybeSendChallenge();
+            conn->close();
+
+            // Start another async accept
+            listener->acceptAsync(_clientHandler, NULL);
+            return;
+        }
+
+        auto client = std::make_shared<ClientSession>(std::move(conn), nextClientId++);
+        flog::info("Connection from {0}, client {1}", client->peer, client->id);
+        {
+            std::lock_guard<std::mutex> lck(sessionsMtx);
+            sessions.push_back(client);
         }
-        maybeSendTransmitterState();
 
+        sendSampleRate(client.get());
+        maybeSendChallenge(client.get());
+        maybeSendTransmitterState(client.get());
 
-        // TODO: Wait otherwise someone else could connect
+        client->conn->readAsync(sizeof(PacketHeader), client->rbuf, _packetHandler, client.get());
 
         listener->acceptAsync(_clientHandler, NULL);
     }
@@ -331,14 +659,16 @@ namespace server {
         auto rv = json({});
         rv["transmitStatus"] = (bool)sigpath::transmitter->getTXStatus();;
         auto str = rv.dump();
-        strcpy((char*)s_cmd_data, str.c_str());
-        sendCommand(COMMAND_TRANSMIT_ACTION, str.length()+1); // including zero, for conv.
+        broadcastCommand(COMMAND_TRANSMIT_ACTION, str.c_str(), str.length()+1); // including zero, for conv.
     }
 
 
     int lastSentTXStatus = 0;
+    // Called with txMtx held
     void setTxStatus(bool transmitFlag) {
-        fftCompressor.setTxMode(transmitFlag);
+        for (auto& s : snapshotSessions()) {
+            s->fftCompressor.setTxMode(transmitFlag);
+        }
         sigpath::transmitter->setTransmitStatus(transmitFlag);
         int currentTXStatus = sigpath::transmitter->getTXStatus();
         if (currentTXStatus != lastSentTXStatus) {
@@ -350,14 +680,22 @@ namespace server {
     wav::ComplexDumper txDump(48000, "/tmp/svr_txaudio_in.raw");
 
     void _packetHandler(int count, uint8_t* buf, void* ctx) {
+        ClientSession* client = (ClientSession*)ctx;
         PacketHeader* hdr = (PacketHeader*)buf;
 
-        // Read the rest of the data (TODO: CHECK SIZE OR SHIT WILL BE FUCKED + ADD TIMEOUT)
+        // A bogus size would overrun the receive buffer, drop the client instead
+        if (hdr->size < sizeof(PacketHeader) || hdr->size > SERVER_MAX_PACKET_SIZE) {
+            flog::error("Client {0} sent a packet of invalid size {1}, disconnecting", client->id, (uint32_t)hdr->size);
+            client->dead = true;
+            return;
+        }
+
+        // Read the rest of the data (TODO: ADD TIMEOUT)
         int len = 0;
         int read = 0;
         int goal = hdr->size - sizeof(PacketHeader);
         while (len < goal) {
-            read = client->read(goal - len, &buf[sizeof(PacketHeader) + len]);
+            read = client->conn->read(goal - len, &buf[sizeof(PacketHeader) + len]);
             if (read < 0) { return; };
             len += read;
         }
@@ -365,15 +703,17 @@ namespace server {
         // Parse and process
         if (hdr->type == PACKET_TYPE_TRANSMIT_DATA && sigpath::transmitter) {
             int nSamples = (hdr->size - sizeof(PacketHeader) - sizeof(float)) / (2*sizeof(int16_t));
+            std::lock_guard<std::mutex> lck(txMtx);
             if (nSamples) {
                 if (!transmitDataRunning) {
                     txDump.clear();
                     transmitDataRunning = true;
+                    txPrebufferMsec = client->startCommandArguments.txPrebufferMsec;
                     transmitPacker.out.clearReadStop();
                     transmitPrebufferer.setSampleRate(48000);
                     transmitPrebufferer.clear();
                     transmitPacker.clear();
-                    transmitPrebufferer.setPrebufferMsec(startCommandArguments.txPrebufferMsec);
+                    transmitPrebufferer.setPrebufferMsec(txPrebufferMsec);
                     sigpath::transmitter->setTransmitStream(&transmitPacker.out);
                 }
                 float *fptr = (float *)(buf + sizeof(PacketHeader));
@@ -386,7 +726,7 @@ namespace server {
                 //txDump.dump(buf + sizeof(PacketHeader), nSamples);
 //                flog::info("received samples for tx data: {}", (int)nSamples);
                 transmitDataStream.swap(nSamples);
-                if (txPressed && sigpath::transmitter->getTXStatus() == 0 && (transmitPrebufferer.bufferReached || startCommandArguments.txPrebufferMsec == 0)) {
+                if (txPressed && sigpath::transmitter->getTXStatus() == 0 && (transmitPrebufferer.bufferReached || txPrebufferMsec == 0)) {
                     flog::info("sigpath::transmitter->setTransmitStatus(true): buffer reached: {} {}",
                                (int) transmitPrebufferer.buffer.size(), (int) transmitPrebufferer.getNeededBufferSize());
                     setTxStatus(true);
@@ -400,102 +740,105 @@ namespace server {
                 }
 
             }
-            maybeSendTransmitterState();
+            maybeSendTransmitterState(client);
         } else if (hdr->type == PACKET_TYPE_COMMAND && hdr->size >= sizeof(PacketHeader) + sizeof(CommandHeader)) {
             CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
-            commandHandler((Command)chdr->cmd, &buf[sizeof(PacketHeader) + sizeof(CommandHeader)], hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+            commandHandler(client, (Command)chdr->cmd, &buf[sizeof(PacketHeader) + sizeof(CommandHeader)], hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
         }
         else {
-            sendError(ERROR_INVALID_PACKET);
+            sendError(client, ERROR_INVALID_PACKET);
         }
 
         // Start another async read
-        client->readAsync(sizeof(PacketHeader), rbuf, _packetHandler, NULL);
+        client->conn->readAsync(sizeof(PacketHeader), client->rbuf, _packetHandler, client);
+    }
+
+    void checkTransmitDone() {
+        // in main loop, stop TX when buffer has finished or when tx depressed+nobuffer
+        if (!sigpath::transmitter) { return; }
+
+        // Every client's chain comes through here, whoever holds the lock does the check
+        std::unique_lock<std::mutex> lck(txMtx, std::try_to_lock);
+        if (!lck.owns_lock()) { return; }
+        if (!txPressed && sigpath::transmitter->getTXStatus() == 1 && (!transmitPrebufferer.bufferReached || txPrebufferMsec == 0)) {
+            flog::info("sigpath::transmitter->setTransmitStatus(false): buffer empty, stop transmitting.");
+            transmitPacker.out.stopReader();
+            setTxStatus(false);
+        }
     }
 
-    int frameCount = 0;
-    long long frameCountReport = currentTimeMillis();
+    void fillMetadata(ClientSession* client, StreamMetadata* sm, bool fftCompressed) {
+        sm->version = 2;
+        sm->size = sizeof(StreamMetadata);
+        sm->frequency = (lastCallbackFrequency != -1 ? lastCallbackFrequency : lastTunedFrequency) + client->ddcOffset; // for any driver, supporting callback frequency or not.
+        sm->sampleRate = client->lastSampleRate;
+        sm->fftCompressed = fftCompressed;
+        sm->compressionRatio = 0;
+        sm->compressMillisPerSecond = 0;
+        sm->streamFlags = 0;
+    }
 
     void _testServerHandler(uint8_t* data, int count, void* ctx) {
-        frameCount++;
-        long ct = currentTimeMillis();
-        if (ct > frameCountReport + 1000) {
-            flog::info("frame count from hardware: {}", frameCount);
-            frameCount = 0;
-            frameCountReport = ct;
-        }
-        // in main loop, stop TX when buffer has finished or when tx depressed+nobuffer
-        if (sigpath::transmitter) {
-            if (!txPressed && sigpath::transmitter->getTXStatus() == 1 && (!transmitPrebufferer.bufferReached || startCommandArguments.txPrebufferMsec == 0)) {
-                flog::info("sigpath::transmitter->setTransmitStatus(false): buffer empty, stop transmitting.");
-                transmitPacker.out.stopReader();
-                setTxStatus(false);
-            }
+        ClientSession* client = (ClientSession*)ctx;
+        client->frameCount++;
+        long long ct = currentTimeMillis();
+        if (ct > client->frameCountReport + 1000) {
+            flog::info("frame count for client {}: {}, {} dropped so far", client->id, client->frameCount, (uint64_t)client->droppedFrames);
+            client->frameCount = 0;
+            client->frameCountReport = ct;
         }
+        checkTransmitDone();
 
         // Compress data if needed and fill out header fields
-        if ((startCommandArguments.clientCapsRequested & CLIENT_CAPS_BASEDATA_METADATA)) {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND_WITH_METADATA;
-            StreamMetadata *sm = (StreamMetadata*)&bbuf[sizeof(PacketHeader)];
-            sm->version = 1;
-            sm->size = sizeof(StreamMetadata);
-            sm->frequency = lastCallbackFrequency != -1 ? lastCallbackFrequency : lastTunedFrequency; // for any driver, supporting callback frequency or not.
-            sm->sampleRate = lastSampleRate;
-            sm->fftCompressed = fftCompressor.isEnabled();
-            auto dataOffset = sizeof(PacketHeader) + sizeof(StreamMetadata);
-            if (sm->fftCompressed) {
-                count = ZSTD_compressCCtx(cctx, &bbuf[dataOffset], SERVER_MAX_PACKET_SIZE-dataOffset, data, count, 1);
+        bool fftCompressed = client->fftCompressor.isEnabled();
+        bool zstdStream = !fftCompressed && client->compression >= BASEBAND_COMPRESSION_ZSTD_STREAM;
+        int maxCount = (fftCompressed || client->compression == BASEBAND_COMPRESSION_LEGACY) ? ZSTD_compressBound(count) : count;
+        auto pkt = client->newPacket(PACKET_TYPE_BASEBAND, sizeof(StreamMetadata) + maxCount, true);
+        uint8_t* out = pkt->data();
+        if (zstdStream) {
+            // Compressed by the sender thread, see compressStreamPacket()
+            pkt->header()->type = PACKET_TYPE_BASEBAND_ZSTD_STREAM;
+            fillMetadata(client, (StreamMetadata*)out, false);
+            memcpy(&out[sizeof(StreamMetadata)], data, count);
+            pkt->setDataSize(sizeof(StreamMetadata) + count);
+            pkt->zstdStream = true;
+        } else if ((client->startCommandArguments.clientCapsRequested & CLIENT_CAPS_BASEDATA_METADATA)) {
+            pkt->header()->type = PACKET_TYPE_BASEBAND_WITH_METADATA;
+            fillMetadata(client, (StreamMetadata*)out, fftCompressed);
+            if (fftCompressed) {
+                count = ZSTD_compressCCtx(client->cctx, &out[sizeof(StreamMetadata)], maxCount, data, count, 1);
             } else {
-                memcpy(&bbuf[dataOffset], data, count);
+                memcpy(&out[sizeof(StreamMetadata)], data, count);
             }
-            bb_pkt_hdr->size = dataOffset + count;
-        } else if (fftCompressor.isEnabled()) {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND_EXPERIMENTAL_FFT;
-            auto dataOffset = sizeof(PacketHeader);
-            count = ZSTD_compressCCtx(cctx, &bbuf[dataOffset], SERVER_MAX_PACKET_SIZE-dataOffset, data, count, 1);
-            bb_pkt_hdr->size = sizeof(PacketHeader) + count;
-        } else if (compression) {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND_COMPRESSED;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + (uint32_t)ZSTD_compressCCtx(cctx, &bbuf[sizeof(PacketHeader)], SERVER_MAX_PACKET_SIZE-sizeof(PacketHeader), data, count, 1);
+            pkt->setDataSize(sizeof(StreamMetadata) + count);
+        } else if (fftCompressed) {
+            pkt->header()->type = PACKET_TYPE_BASEBAND_EXPERIMENTAL_FFT;
+            pkt->setDataSize(ZSTD_compressCCtx(client->cctx, out, maxCount, data, count, 1));
+        } else if (client->compression == BASEBAND_COMPRESSION_LEGACY) {
+            pkt->header()->type = PACKET_TYPE_BASEBAND_COMPRESSED;
+            pkt->setDataSize(ZSTD_compressCCtx(client->cctx, out, maxCount, data, count, 1));
         } else {
-            bb_pkt_hdr->type = PACKET_TYPE_BASEBAND;
-            bb_pkt_hdr->size = sizeof(PacketHeader) + count;
-            memcpy(&bbuf[sizeof(PacketHeader)], data, count);
-        }
-
-        // Write to network
-        if (client) {
-            if (client->isOpen()) {
-                client->write(bb_pkt_hdr->size, bbuf);
-                if (fftCompressor.isEnabled() && frameCount % 20 == 1 && (sigpath::transmitter == nullptr || sigpath::transmitter->getTXStatus() == 0)) {
-                    fftCompressor.sharedDataLock.lock();
-                    auto nbytes = fftCompressor.noiseFigure.size() * sizeof(fftCompressor.noiseFigure[0]);
-                    memcpy(s_cmd_data, fftCompressor.noiseFigure.data(), nbytes);
-                    fftCompressor.sharedDataLock.unlock();
-                    sendCommand(COMMAND_EFFT_NOISE_FIGURE, nbytes);
-                }
-            } else {
-                sigpath::sourceManager.stop();
-                running = false;
-                client.reset();
-                flog::error("Client is gone, stopping SDR.");
-            }
+            memcpy(out, data, count);
+            pkt->setDataSize(count);
         }
-    }
 
-    void updateResampler() {
-        if (forcedSampleRate == 0) {
-            forcedResampler.setRates(sampleRate, sampleRate);
-            fftCompressor.setSampleRate(sampleRate);
-        } else {
-            forcedResampler.setRates(sampleRate, forcedSampleRate);
-            fftCompressor.setSampleRate(forcedSampleRate);
+        // Hand over to the client's sender thread, a slow client drops frames instead of blocking here
+        client->send(std::move(pkt));
+
+        if (fftCompressed && client->frameCount % 20 == 1 && (sigpath::transmitter == nullptr || sigpath::transmitter->getTXStatus() == 0)) {
+            client->fftCompressor.sharedDataLock.lock();
+            auto& noiseFigure = client->fftCompressor.noiseFigure;
+            int nbytes = noiseFigure.size() * sizeof(noiseFigure[0]);
+            auto nf = client->newCommand(PACKET_TYPE_COMMAND, COMMAND_EFFT_NOISE_FIGURE, nbytes, true);
+            memcpy(nf->commandData(), noiseFigure.data(), nbytes);
+            client->fftCompressor.sharedDataLock.unlock();
+            client->send(std::move(nf));
         }
     }
 
     void setInput(dsp::stream<dsp::complex_t>* stream) {
         lastCallbackFrequency = -1;
-        forcedResampler.setInput(stream);
+        split.setInput(stream);
     }
 
     void setInputCenterFrequencyCallback(int centerFrequency) {
@@ -505,43 +848,49 @@ namespace server {
         lastCallbackFrequency = centerFrequency;
     }
 
-    void commandHandler(Command cmd, uint8_t* data, int len) {
+    void commandHandler(ClientSession* client, Command cmd, uint8_t* data, int len) {
         if (cmd == COMMAND_GET_UI) {
-            sendUI(COMMAND_GET_UI, "", dummyElem);
+            // Newer clients ask for deltas, a GET_UI from them also means they lost track and want a full list
+            if (len >= 4) {
+                std::lock_guard<std::recursive_mutex> lck(sourceMtx);
+                client->uiDeltaVersion = std::min<int>(*(int32_t*)data, SmGui::DELTA_VERSION);
+            }
+            sendUI(client, COMMAND_GET_UI, "", dummyElem);
         }
         else if (cmd == COMMAND_UI_ACTION && len >= 3) {
             // Check if sending back data is needed
             int i = 0;
             bool sendback = data[i++];
             len--;
-            
+
             // Load id
             SmGui::DrawListElem diffId;
             int count = SmGui::DrawList::loadItem(diffId, &data[i], len);
-            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
-            if (diffId.type != SmGui::DRAW_LIST_ELEM_TYPE_STRING) { sendError(ERROR_INVALID_ARGUMENT); return; } 
+            if (count < 0) { sendError(client, ERROR_INVALID_ARGUMENT); return; }
+            if (diffId.type != SmGui::DRAW_LIST_ELEM_TYPE_STRING) { sendError(client, ERROR_INVALID_ARGUMENT); return; }
             i += count;
             len -= count;
 
             // Load value
             SmGui::DrawListElem diffValue;
             count = SmGui::DrawList::loadItem(diffValue, &data[i], len);
-            if (count < 0) { sendError(ERROR_INVALID_ARGUMENT); return; }
+            if (count < 0) { sendError(client, ERROR_INVALID_ARGUMENT); return; }
             i += count;
             len -= count;
 
             // Render and send back
             if (sendback) {
-                sendUI(COMMAND_UI_ACTION, diffId.str, diffValue);
+                sendUI(client, COMMAND_UI_ACTION, diffId.str, diffValue);
             }
             else {
+                std::lock_guard<std::recursive_mutex> lck(sourceMtx);
                 renderUI(NULL, diffId.str, diffValue);
             }
         }
         else if (cmd == COMMAND_SET_EFFT_LOSS_RATE) {
             if (len == 8) {
                 double *pdata = (double*)data;
-                fftCompressor.lossRate = pdata[0];
+                client->fftCompressor.lossRate = pdata[0];
             }
         }
         else if (cmd == COMMAND_START) {
@@ -551,71 +900,83 @@ namespace server {
                 if (magic != SDRPP_BROWN_MAGIC) {      // brown
                     // do nothing
                 } else {
-                    memset(&startCommandArguments, 0, sizeof startCommandArguments);
-                    memcpy(&startCommandArguments, pdata, len);
+                    memset(&client->startCommandArguments, 0, sizeof client->startCommandArguments);
+                    memcpy(&client->startCommandArguments, pdata, std::min<int>(len, sizeof client->startCommandArguments));
                 }
             }
             bool startAllowed = true;
             if (!authSigningKey.empty()) {
-                if (challenge.size() == 0) {
+                if (client->challenge.size() == 0) {
                     flog::info("ASSERTION FAILED: challenge not produced");
                 }
                 HMAC_SHA256_CTX ctx;
                 hmac_sha256_init(&ctx, (uint8_t *)authSigningKey.data(), authSigningKey.size());
-                hmac_sha256_update(&ctx, (uint8_t *)challenge.data(), challenge.size());
+                hmac_sha256_update(&ctx, (uint8_t *)client->challenge.data(), client->challenge.size());
                 uint8_t hmac[256 / 8];
                 hmac_sha256_final(&ctx, hmac);
-                if (memcmp(hmac, startCommandArguments.signedChallenge, sizeof hmac)) {
+                if (memcmp(hmac, client->startCommandArguments.signedChallenge, sizeof hmac)) {
                     // different?
                     startAllowed = false;
-                    maybeSendChallenge();    // send new challenge. Password incorrect.
+                    maybeSendChallenge(client);    // send new challenge. Password incorrect.
                 }
             }
             if (startAllowed) {
-                sigpath::sourceManager.start();
-                running = true;
-                maybeSendTransmitterState();
+                client->streamSettingsChanged = true;   // the client's decoder starts fresh
+                client->startStream();
+                updateSourceState();
+                maybeSendTransmitterState(client);
             }
         }
         else if (cmd == COMMAND_SET_SAMPLERATE) {
-            forcedSampleRate = *(int32_t *)data;
-            updateResampler();
-            sendSampleRate(forcedSampleRate != 0 ? forcedSampleRate: sampleRate);
+            client->forcedSampleRate = *(int32_t *)data;
+            client->updateResampler();
+            sendSampleRate(client);
+        }
+        else if (cmd == COMMAND_SET_DDC_OFFSET && len == 8) {
+            double offset = *(double*)data;
+            if (fabs(offset) > sampleRate / 2.0) { sendError(client, ERROR_INVALID_ARGUMENT); return; }
+            client->ddcOffset = offset;
+            client->updateResampler();
         }
         else if (cmd == COMMAND_STOP) {
-            sigpath::sourceManager.stop();
-            running = false;
-            maybeSendTransmitterState();
-            maybeSendChallenge();
+            client->stopStream();
+            updateSourceState();
+            maybeSendTransmitterState(client);
+            maybeSendChallenge(client);
         }
         else if (cmd == COMMAND_SET_FREQUENCY && len == 8) {
+            std::lock_guard<std::recursive_mutex> lck(sourceMtx);
             lastTunedFrequency = *(double*)data;
-            flog::info("Setting device to frequency: {}", (double)lastTunedFrequency);
+            flog::info("Client {} setting device to frequency: {}", client->id, (double)lastTunedFrequency);
             sigpath::sourceManager.tune(*(double*)data);
-            sendCommandAck(COMMAND_SET_FREQUENCY, 0);
+            sendCommandAck(client, COMMAND_SET_FREQUENCY, NULL, 0);
         }
         else if (cmd == COMMAND_SET_SAMPLE_TYPE && len == 1) {
             dsp::compression::PCMType type = (dsp::compression::PCMType)*(uint8_t*)data;
-            comp.setPCMType(type);
+            client->comp.setPCMType(type);
+            client->pcmType = type;
+            client->streamSettingsChanged = true;
         }
         else if (cmd == COMMAND_SET_COMPRESSION && len == 1) {
-            compression = *(uint8_t*)data;
+            client->compression = *(uint8_t*)data;
+            client->streamSettingsChanged = true;
         }
         else if (cmd == COMMAND_SET_FFTZSTD_COMPRESSION && len == 1) {
-            fftCompressor.setEnabled(*(uint8_t*)data);
+            client->fftCompressor.setEnabled(*(uint8_t*)data);
         }
         else if (cmd == COMMAND_SET_EFFT_MASKED_FREQUENCIES) {
             std::vector<int32_t> freqs(len / sizeof(int32_t));
-            memcpy(freqs.data(), data, len);
-            fftCompressor.setMaskedFrequencies(freqs);
+            memcpy(freqs.data(), data, freqs.size() * sizeof(int32_t));
+            client->fftCompressor.setMaskedFrequencies(freqs);
         }
         else if (cmd == COMMAND_TRANSMIT_ACTION && sigpath::transmitter != nullptr) {
-            std::string str = std::string((char*)r_cmd_data, r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+            std::string str = std::string((char*)data, len);
+            std::lock_guard<std::mutex> lck(txMtx);
             try {
                 auto j = json::parse(str);
                 if (j.contains("transmitStatus")) {
                     txPressed = j["transmitStatus"];
-                    flog::info("client transmit status requested: {}", txPressed);
+                    flog::info("client {} transmit status requested: {}", client->id, txPressed);
                 }
                 if (j.contains("transmitSoftwareGain")) {
                     sigpath::transmitter->setTransmitSoftwareGain(j["transmitSoftwareGain"]);
@@ -637,12 +998,12 @@ namespace server {
         }
         else {
             flog::error("Invalid Command: {0} (len = {1})", (int)cmd, len);
-            sendError(ERROR_INVALID_COMMAND);
+            sendError(client, ERROR_INVALID_COMMAND);
         }
     }
 
     void drawMenu() {
-        if (running) { SmGui::BeginDisabled(); }
+        if (sourceRunning) { SmGui::BeginDisabled(); }
         SmGui::FillWidth();
         SmGui::ForceSync();
         if (SmGui::Combo("##sdrpp_server_src_sel", &sourceId, sourceList.txt)) {
@@ -651,12 +1012,13 @@ namespace server {
             core::configManager.conf["source"] = sourceList.key(sourceId);
             core::configManager.release(true);
         }
-        if (running) { SmGui::EndDisabled(); }
+        if (sourceRunning) { SmGui::EndDisabled(); }
 
         sigpath::sourceManager.showSelectedMenu();
     }
 
 
+    // Called with sourceMtx held, SmGui keeps its state in globals
     void renderUI(SmGui::DrawList* dl, std::string diffId, SmGui::DrawListElem diffValue) {
         // If we're recording and there's an action, render once with the action and record without
 
@@ -677,65 +1039,111 @@ namespace server {
         }
     }
 
-    void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue) {
+    void sendUI(ClientSession* client, Command originCmd, std::string diffId, SmGui::DrawListElem diffValue) {
         // Render UI
+        std::lock_guard<std::recursive_mutex> lck(sourceMtx);
         SmGui::DrawList dl;
         renderUI(&dl, diffId, diffValue);
 
-        // Create response
-        int size = dl.getSize();
-        dl.store(s_cmd_data, size);
-
         // Send to network
         //sendCommandAck(originCmd, size);
-        sendCommand(COMMAND_GET_UI, size);
+        sendUIList(client, dl, originCmd == COMMAND_GET_UI);
     }
 
     void sendUnsolicitedUI() {
+        std::lock_guard<std::recursive_mutex> lck(sourceMtx);
         SmGui::DrawList dl;
         renderUI(&dl, "", dummyElem);
-        int size = dl.getSize();
-        dl.store(s_cmd_data, size);
-        sendCommand(COMMAND_GET_UI, size);
+        for (auto& s : snapshotSessions()) {
+            sendUIList(s.get(), dl, false);
+        }
     }
 
-    void sendError(Error err) {
-        PacketHeader* hdr = (PacketHeader*)sbuf;
-        s_pkt_data[0] = err;
-        sendPacket(PACKET_TYPE_ERROR, 1);
+    // Called with sourceMtx held. Clients that asked for deltas only get the elements that changed since
+    // the list they have, and nothing when none did. Packets go out in order, so the sequence numbers
+    // only ever go out of step when the client drops a delta, it then asks for a full list.
+    void sendUIList(ClientSession* client, SmGui::DrawList& dl, bool full) {
+        int fullSize = dl.getSize();
+        client->uiFullBytes += fullSize;
+        if (client->uiDeltaVersion <= 0) {
+            auto pkt = client->newCommand(PACKET_TYPE_COMMAND, COMMAND_GET_UI, fullSize);
+            dl.store(pkt->commandData(), fullSize);
+            client->send(std::move(pkt));
+            client->uiSentBytes += fullSize;
+            return;
+        }
+
+        uint32_t seq = client->uiSeq + 1;
+        int size;
+        if (full || client->uiSeq == 0) {
+            size = dl.storeFull(seq, client->uiBuf);
+        }
+        else {
+            size = dl.storeDelta(client->lastUI, client->uiSeq, seq, client->uiBuf);
+            // Nothing changed and nothing was cut off the end, the client already has this list
+            auto hdr = (SmGui::DeltaHeader*)client->uiBuf.data();
+            if (size > 0 && hdr->changeCount == 0 && dl.elements.size() == client->lastUI.elements.size()) { return; }
+        }
+        if (size < 0) {
+            flog::error("Client {0}: could not serialize the UI", client->id);
+            return;
+        }
+
+        sendCommand(client, COMMAND_GET_UI_DELTA, client->uiBuf.data(), size);
+        client->lastUI = dl;
+        client->uiSeq = seq;
+        client->uiSentBytes += size;
+        flog::debug("Client {0}: UI {1} bytes instead of {2}, {3} of {4} bytes sent so far", client->id, size, fullSize,
+                    (int64_t)client->uiSentBytes, (int64_t)client->uiFullBytes);
     }
 
-    void sendSampleRate(double sampleRate) {
-        *(double*)s_cmd_data = sampleRate;
-        sendCommand(COMMAND_SET_SAMPLERATE, sizeof(double));
-        lastSampleRate = sampleRate;
+    void sendError(ClientSession* client, Error err) {
+        uint8_t code = err;
+        sendPacket(client, PACKET_TYPE_ERROR, &code, 1);
+    }
+
+    void sendSampleRate(ClientSession* client) {
+        double rate = client->getOutputSampleRate();
+        client->lastSampleRate = rate;
+        sendCommand(client, COMMAND_SET_SAMPLERATE, &rate, sizeof(double));
     }
 
     void sendCenterFrequency(double freq) {
-        *(double*)s_cmd_data = freq;
-        sendCommand(COMMAND_SET_FREQUENCY, sizeof(double));
+        for (auto& s : snapshotSessions()) {
+            double clientFreq = freq + s->ddcOffset;
+            sendCommand(s.get(), COMMAND_SET_FREQUENCY, &clientFreq, sizeof(double));
+        }
     }
 
     void setInputSampleRate(double samplerate) {
         sampleRate = samplerate;
-        updateResampler();
-        if (!client || !client->isOpen()) { return; }
-        sendSampleRate(forcedSampleRate != 0 ? forcedSampleRate: sampleRate);
+        for (auto& s : snapshotSessions()) {
+            s->updateResampler();
+            sendSampleRate(s.get());
+        }
+    }
+
+    void sendPacket(ClientSession* client, PacketType type, const void* data, int len) {
+        auto pkt = client->newPacket(type, len);
+        if (len) { memcpy(pkt->data(), data, len); }
+        client->send(std::move(pkt));
     }
 
-    void sendPacket(PacketType type, int len) {
-        s_pkt_hdr->type = type;
-        s_pkt_hdr->size = sizeof(PacketHeader) + len;
-        client->write(s_pkt_hdr->size, sbuf);
+    void sendCommand(ClientSession* client, Command cmd, const void* data, int len) {
+        auto pkt = client->newCommand(PACKET_TYPE_COMMAND, cmd, len);
+        if (len) { memcpy(pkt->commandData(), data, len); }
+        client->send(std::move(pkt));
     }
 
-    void sendCommand(Command cmd, int len) {
-        s_cmd_hdr->cmd = cmd;
-        sendPacket(PACKET_TYPE_COMMAND, sizeof(CommandHeader) + len);
+    void sendCommandAck(ClientSession* client, Command cmd, const void* data, int len) {
+        auto pkt = client->newCommand(PACKET_TYPE_COMMAND_ACK, cmd, len);
+        if (len) { memcpy(pkt->commandData(), data, len); }
+        client->send(std::move(pkt));
     }
 
-    void sendCommandAck(Command cmd, int len) {
-        s_cmd_hdr->cmd = cmd;
-        sendPacket(PACKET_TYPE_COMMAND_ACK, sizeof(CommandHeader) + len);
+    void broadcastCommand(Command cmd, const void* data, int len) {
+        for (auto& s : snapshotSessions()) {
+            sendCommand(s.get(), cmd, data, len);
+        }
     }
 }
@@ -5,28 +5,48 @@
 #include <server_protocol.h>
 
 namespace server {
+    class ClientSession;
+
+    struct ClientStats {
+        int id;
+        std::string peer;
+        bool running;
+        uint64_t sentFrames;
+        uint64_t droppedFrames;     // dropped from the send queue of a slow client
+        uint64_t droppedBlocks;     // IQ blocks the client's DSP chain fell behind on
+    };
+
     void setInput(dsp::stream<dsp::complex_t>* stream);
     int main();
 
+    // Shared DSP and the listener, split out of main() so they can run without the source modules
+    void init();
+    void listen(std::string host, int port, int maxClients);
+    void reapClients();
+    void shutdown();
+    std::vector<ClientStats> getClientStats();
+
     void _clientHandler(net::Conn conn, void* ctx);
     void _packetHandler(int count, uint8_t* buf, void* ctx);
     void _testServerHandler(uint8_t* data, int count, void* ctx);
 
     void drawMenu();
 
-    void commandHandler(Command cmd, uint8_t* data, int len);
+    void commandHandler(ClientSession* client, Command cmd, uint8_t* data, int len);
     void renderUI(SmGui::DrawList* dl, std::string diffId, SmGui::DrawListElem diffValue);
-    void sendUI(Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
+    void sendUI(ClientSession* client, Command originCmd, std::string diffId, SmGui::DrawListElem diffValue);
     void sendUnsolicitedUI();
-    void sendError(Error err);
-    void sendSampleRate(double sampleRate);
+    void sendUIList(ClientSession* client, SmGui::DrawList& dl, bool full);
+    void sendError(ClientSession* client, Error err);
+    void sendSampleRate(ClientSession* client);
     void sendCenterFrequency(double centerFreq);
     void setInputSampleRate(double samplerate);
     void setInputCenterFrequencyCallback(int centerFrequency); // realtime callback from drivers.
 
-    void sendPacket(PacketType type, int len);
-    void sendCommand(Command cmd, int len);
-    void sendCommandAck(Command cmd, int len);
+    void sendPacket(ClientSession* client, PacketType type, const void* data, int len);
+    void sendCommand(ClientSession* client, Command cmd, const void* data, int len);
+    void sendCommandAck(ClientSession* client, Command cmd, const void* data, int len);
+    void broadcastCommand(Command cmd, const void* data, int len);
 
 
 }
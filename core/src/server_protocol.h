@@ -26,6 +26,7 @@ namespace server {
         PACKET_TYPE_TRANSMIT_PROGRESS,     // various indicators of transmitter. 0x38
         PACKET_TYPE_TRANSMIT_DATA,  // 0x39
         PACKET_TYPE_BASEBAND_EXPERIMENTAL_FFT,  // 0x3a
+        PACKET_TYPE_BASEBAND_ZSTD_STREAM,       // StreamMetadata, then one flushed packet of a zstd stream. 0x3b
     };
 
     enum Command {
@@ -44,6 +45,9 @@ namespace server {
         COMMAND_SET_FFTZSTD_COMPRESSION,
         COMMAND_SET_EFFT_LOSS_RATE,
         COMMAND_SET_EFFT_MASKED_FREQUENCIES,        // set the current vfo so efft does not blank it.
+        COMMAND_SET_DDC_OFFSET,                     // double Hz from the center, server shifts it to baseband before resampling. 0x3b
+        COMMAND_SET_ZSTD_DICTIONARY,                // server -> client, dictionary for the next zstd stream frames, empty for none. 0x3c
+        COMMAND_GET_UI_DELTA,                       // server -> client, SmGui::DeltaHeader and the changed elements, for clients that sent COMMAND_GET_UI with an int32 delta version. 0x3d
 
         // Server to client, AND client to server. Client sets desired sample rate or 0. Server responds the actual.
         COMMAND_SET_SAMPLERATE = 0x80,
@@ -55,6 +59,17 @@ namespace server {
         COMMAND_DISCONNECT
     };
 
+    // Payload of COMMAND_SET_COMPRESSION
+    enum BasebandCompression {
+        BASEBAND_COMPRESSION_NONE,
+        BASEBAND_COMPRESSION_LEGACY,            // one zstd frame per packet
+        BASEBAND_COMPRESSION_ZSTD_STREAM,       // zstd stream across packets
+        BASEBAND_COMPRESSION_ZSTD_STREAM_DICT   // same, with a dictionary trained on the first packets (I8/I16 samples)
+    };
+
+    // StreamMetadata::streamFlags
+    static const int STREAM_FLAG_FRAME_START = 0x0001;     // zstd stream starts a new frame, decoder resets before this packet
+
     enum Error {
         ERROR_NONE = 0x00,
         ERROR_INVALID_PACKET,
@@ -76,6 +91,11 @@ namespace server {
         double frequency;
 
         int64_t fftCompressed;
+
+        // version 2
+        float compressionRatio;             // raw / compressed bytes over the last second, 0 if unknown
+        float compressMillisPerSecond;      // server time spent compressing per second
+        int32_t streamFlags;                // STREAM_FLAG_*
     };
 
     // generic data packet, to ensure protocol evolution, for non-performance cases.
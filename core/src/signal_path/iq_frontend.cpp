@@ -45,6 +45,9 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
 
     split.init(preproc.out);
 
+    channelizer.init(&chanIn, effectiveSr);
+    chanIn.origin = "iq_frontend.chan_in";
+
     // TODO: Do something to avoid basically repeating this code twice
     int skip;
     genReshapeParams(effectiveSr, _fftSize, _fftRate, skip, _nzFFTSize);
@@ -76,9 +79,15 @@ void IQFrontEnd::init(dsp::stream<dsp::complex_t>* in, double sampleRate, bool b
     // Clear the rest of the FFT input buffer
     dsp::buffer::clear(fftPlan->getInput()->data(), _fftSize - _nzFFTSize, _nzFFTSize);
 
-    split.bindStream(&fftIn);
+    // Branches share one copy of each block, a lagging waterfall drops blocks instead of stalling the VFOs
+    split.setSharedFanout(true);
+    split.bindStream(&fftIn, dsp::FanoutPolicy::DROP_OLDEST, 2);
     split.origin = "iqfrontent.split";
 
+    // History storage is only allocated once enabled
+    history.init(&historyIn, effectiveSr, 0.0, false);
+    historyIn.origin = "iq_frontend.history_in";
+
     _init = true;
 }
 
@@ -88,6 +97,11 @@ void IQFrontEnd::setInput(dsp::stream<dsp::complex_t>* in) {
 }
 
 void IQFrontEnd::setSampleRate(double sampleRate) {
+    // Time shifted VFOs can't follow a rate change of the history, put them back on live samples
+    while (!vfoPlayers.empty()) {
+        setVFOTimeShift(vfoPlayers.begin()->first, 0.0);
+    }
+
     // Temp stop the necessary blocks
     dcBlock.tempStop();
     for (auto& [name, vfo] : vfos) {
@@ -100,12 +114,13 @@ void IQFrontEnd::setSampleRate(double sampleRate) {
     onEffectiveSampleRateChange.emit(effectiveSr);
     dcBlock.setRate(genDCBlockRate(effectiveSr));
     detectorPreprocessor.setSampleRate(effectiveSr);
+    channelizer.setInSamplerate(effectiveSr);
+    if (historyEnabled) { history.setSampleRate(effectiveSr); }
     for (auto& [name, vfo] : vfos) {
-        vfo->setInSamplerate(effectiveSr);
+        routeVFO(name, true);
     }
 
 
-
     // Reconfigure the FFT
     updateFFTPath();
 
@@ -148,14 +163,18 @@ void IQFrontEnd::setInvertIQ(bool enabled) {
     preproc.setBlockEnabled(&conjugate, enabled, [=](dsp::stream<dsp::complex_t>* out){ split.setInput(out); });
 }
 
-void IQFrontEnd::bindIQStream(dsp::stream<dsp::complex_t>* stream) {
-    split.bindStream(stream);
+void IQFrontEnd::bindIQStream(dsp::stream<dsp::complex_t>* stream, dsp::FanoutPolicy policy, int queueDepth) {
+    split.bindStream(stream, policy, queueDepth);
 }
 
 void IQFrontEnd::unbindIQStream(dsp::stream<dsp::complex_t>* stream) {
     split.unbindStream(stream);
 }
 
+uint64_t IQFrontEnd::getIQStreamDroppedBlocks(dsp::stream<dsp::complex_t>* stream) {
+    return split.getDroppedBlocks(stream);
+}
+
 dsp::channel::RxVFO* IQFrontEnd::addVFO(std::string name, double sampleRate, double bandwidth, double offset) {
     // Make sure no other VFO with that name already exists
     if (vfos.find(name) != vfos.end()) {
@@ -170,8 +189,14 @@ dsp::channel::RxVFO* IQFrontEnd::addVFO(std::string name, double sampleRate, dou
     // Register them
     vfoStreams[name] = vfoIn;
     vfos[name] = vfo;
+    vfoParams[name] = { offset, bandwidth, sampleRate, -1 };
+    vfoGroups[name] = std::make_unique<dsp::ExecGroup>();
+    if (threadPoolEnabled) { vfo->setScheduler(vfoGroups[name].get()); }
     bindIQStream(vfoIn);
 
+    // Move it to the channelizer if it fits the channel grid
+    if (channelizerEnabled) { routeVFO(name); }
+
     // Start VFO
     vfo->start();
 
@@ -192,13 +217,236 @@ void IQFrontEnd::removeVFO(std::string name) {
     // Stop the VFO
     vfo->stop();
 
-    unbindIQStream(vfoIn);
+    // A time shifted VFO isn't bound anywhere, only its player has to go
+    auto pit = vfoPlayers.find(name);
+    if (pit != vfoPlayers.end()) {
+        pit->second->stop();
+        vfoPlayers.erase(pit);
+    }
+    else if (vfoParams[name].channel >= 0) {
+        channelizer.unbindChannel(vfoIn);
+    }
+    else {
+        unbindIQStream(vfoIn);
+    }
     vfoStreams.erase(name);
     vfos.erase(name);
+    vfoParams.erase(name);
+    updateChannelizerBinding();
 
     // Delete the VFO and its input stream
     delete vfo;
     delete vfoIn;
+    vfoGroups.erase(name);
+}
+
+void IQFrontEnd::setVFOOffset(std::string name, double offset) {
+    auto it = vfoParams.find(name);
+    if (it == vfoParams.end()) {
+        flog::error("[IQFrontEnd] Tried to tune a VFO that doesn't exist.");
+        return;
+    }
+    it->second.offset = offset;
+    routeVFO(name);
+}
+
+void IQFrontEnd::setVFOBandwidth(std::string name, double bandwidth) {
+    auto it = vfoParams.find(name);
+    if (it == vfoParams.end()) {
+        flog::error("[IQFrontEnd] Tried to change the bandwidth of a VFO that doesn't exist.");
+        return;
+    }
+    it->second.bandwidth = bandwidth;
+    vfos[name]->setBandwidth(bandwidth);
+    routeVFO(name);
+}
+
+void IQFrontEnd::setVFOOutSamplerate(std::string name, double sampleRate, double bandwidth) {
+    auto it = vfoParams.find(name);
+    if (it == vfoParams.end()) {
+        flog::error("[IQFrontEnd] Tried to change the samplerate of a VFO that doesn't exist.");
+        return;
+    }
+    it->second.outSamplerate = sampleRate;
+    it->second.bandwidth = bandwidth;
+    vfos[name]->setOutSamplerate(sampleRate, bandwidth);
+    routeVFO(name);
+}
+
+void IQFrontEnd::setChannelizerEnabled(bool enabled) {
+    if (channelizerEnabled == enabled) { return; }
+    channelizerEnabled = enabled;
+    for (auto& [name, vfo] : vfos) {
+        routeVFO(name);
+    }
+}
+
+void IQFrontEnd::setThreadPoolEnabled(bool enabled) {
+    if (threadPoolEnabled == enabled) { return; }
+    threadPoolEnabled = enabled;
+    preproc.setScheduler(enabled ? &preprocGroup : NULL);
+    for (auto& [name, vfo] : vfos) {
+        vfo->setScheduler(enabled ? vfoGroups[name].get() : NULL);
+    }
+}
+
+int IQFrontEnd::getChannelizedVFOCount() {
+    int count = 0;
+    for (auto& [name, params] : vfoParams) {
+        if (params.channel >= 0) { count++; }
+    }
+    return count;
+}
+
+bool IQFrontEnd::setHistory(bool enabled, double seconds, bool int16) {
+    // Stop the replays first, they read from the storage about to be replaced
+    while (!vfoPlayers.empty()) {
+        setVFOTimeShift(vfoPlayers.begin()->first, 0.0);
+    }
+
+    if (historyEnabled) {
+        split.unbindStream(&historyIn);
+        history.stop();
+    }
+    historyEnabled = enabled && seconds > 0.0;
+
+    // Frees the storage when disabled
+    if (!history.configure(effectiveSr, historyEnabled ? seconds : 0.0, int16)) {
+        historyEnabled = false;
+        return false;
+    }
+    if (!historyEnabled) { return true; }
+
+    // A stalled history drops blocks rather than holding up the VFOs
+    split.bindStream(&historyIn, dsp::FanoutPolicy::DROP_OLDEST, 8);
+    if (_init) { history.start(); }
+    flog::info("[IQFrontEnd] Keeping {} s of IQ history ({} MB)", history.getCapacitySeconds(), (int64_t)(history.getMemoryBytes() >> 20));
+    return true;
+}
+
+void IQFrontEnd::setVFOTimeShift(std::string name, double delaySeconds) {
+    auto vit = vfos.find(name);
+    if (vit == vfos.end()) {
+        flog::error("[IQFrontEnd] Tried to time shift a VFO that doesn't exist.");
+        return;
+    }
+    dsp::channel::RxVFO* vfo = vit->second;
+    dsp::stream<dsp::complex_t>* vfoIn = vfoStreams[name];
+    VFOParams& params = vfoParams[name];
+    auto pit = vfoPlayers.find(name);
+
+    // Back to live
+    if (delaySeconds <= 0.0 || !historyEnabled) {
+        if (pit == vfoPlayers.end()) { return; }
+        vfo->tempStop();
+        pit->second->stop();
+        vfoPlayers.erase(pit);
+        vfo->setInput(vfoIn);
+        bindIQStream(vfoIn);
+        params.channel = -1;
+        vfo->tempStart();
+        routeVFO(name, true);
+        return;
+    }
+
+    // Already shifted, only move the delay
+    if (pit != vfoPlayers.end()) {
+        pit->second->setDelay(delaySeconds);
+        vfo->reset();
+        return;
+    }
+
+    // Unbind from the live samples and play from the history at the full rate
+    vfo->tempStop();
+    if (params.channel >= 0) {
+        channelizer.unbindChannel(vfoIn);
+    }
+    else {
+        unbindIQStream(vfoIn);
+    }
+    params.channel = -1;
+    updateChannelizerBinding();
+
+    auto player = std::make_unique<dsp::buffer::IQHistoryPlayer>(&history, delaySeconds);
+    player->out.origin = "iq_frontend.history_player";
+    vfo->setInput(&player->out);
+    vfo->setInSamplerate(effectiveSr);
+    vfo->setOffset(params.offset);
+    vfo->reset();
+    player->start();
+    vfoPlayers[name] = std::move(player);
+    vfo->tempStart();
+}
+
+double IQFrontEnd::getVFOTimeShift(std::string name) {
+    auto pit = vfoPlayers.find(name);
+    return (pit != vfoPlayers.end()) ? pit->second->getDelay() : 0.0;
+}
+
+void IQFrontEnd::routeVFO(std::string name, bool force) {
+    VFOParams& params = vfoParams[name];
+    dsp::channel::RxVFO* vfo = vfos[name];
+    dsp::stream<dsp::complex_t>* vfoIn = vfoStreams[name];
+
+    // Time shifted VFOs stay on their player, only retune
+    if (vfoPlayers.find(name) != vfoPlayers.end()) {
+        vfo->setOffset(params.offset);
+        return;
+    }
+
+    // Find out where the VFO should be fed from. A VFO keeps its current channel for as long as it fits in it,
+    // so that tuning back and forth across a channel boundary doesn't move it (and drop audio) every time.
+    double residual = params.offset;
+    int channel = -1;
+    if (channelizerEnabled && !force && channelizer.fitsChannel(params.channel, params.offset, params.bandwidth, params.outSamplerate, residual)) {
+        channel = params.channel;
+    }
+    else if (channelizerEnabled) {
+        channel = channelizer.findChannel(params.offset, params.bandwidth, params.outSamplerate, residual);
+    }
+
+    // Same source, only retune
+    if (channel == params.channel && !force) {
+        vfo->setOffset(residual);
+        return;
+    }
+
+    // Move the VFO input to its new source
+    vfo->tempStop();
+    if (params.channel >= 0) {
+        channelizer.unbindChannel(vfoIn);
+    }
+    else {
+        unbindIQStream(vfoIn);
+    }
+    if (channel >= 0) {
+        channelizer.bindChannel(channel, vfoIn);
+    }
+    else {
+        bindIQStream(vfoIn);
+    }
+    params.channel = channel;
+
+    vfo->setInSamplerate((channel >= 0) ? channelizer.getChannelSamplerate() : effectiveSr);
+    vfo->setOffset(residual);
+    vfo->reset();
+    vfo->tempStart();
+
+    updateChannelizerBinding();
+}
+
+void IQFrontEnd::updateChannelizerBinding() {
+    // Only pay for the channelizer when at least one VFO uses it
+    bool needed = channelizer.hasBindings();
+    if (needed == channelizerBound) { return; }
+    if (needed) {
+        channelizer.reset();
+        split.bindStream(&chanIn);
+    }
+    else {
+        split.unbindStream(&chanIn);
+    }
+    channelizerBound = needed;
 }
 
 void IQFrontEnd::setFFTSize(int size) {
@@ -230,6 +478,15 @@ void IQFrontEnd::start() {
     // Start IQ splitter
     split.start();
 
+    // Start channelizer
+    channelizer.start();
+
+    // Start the history and its replays
+    if (historyEnabled) { history.start(); }
+    for (auto& [name, player] : vfoPlayers) {
+        player->start();
+    }
+
     // Start all VFOs
     for (auto& [name, vfo] : vfos) {
         vfo->start();
@@ -250,6 +507,15 @@ void IQFrontEnd::stop() {
     // Stop IQ splitter
     split.stop();
 
+    // Stop channelizer
+    channelizer.stop();
+
+    // Stop the history and its replays
+    for (auto& [name, player] : vfoPlayers) {
+        player->stop();
+    }
+    history.stop();
+
     // Stop all VFOs
     for (auto& [name, vfo] : vfos) {
         vfo->stop();
@@ -271,7 +537,7 @@ void IQFrontEnd::handler(dsp::complex_t* data, int count, void* ctx) {
     volk_32fc_32f_multiply_32fc((lv_32fc_t*)_this->fftPlan->getInput()->data(), (lv_32fc_t*)data, _this->fftWindowBuf, _this->_nzFFTSize);
 
     // Execute FFT
-    dsp::arrays::npfftfft(_this->fftPlan->getInput(), _this->fftPlan);
+    _this->fftPlan->execute();
 //    fftwf_execute(_this->fftwPlanImplFFTW);
 
     // Aquire buffer
@@ -4,12 +4,15 @@
 #include "../dsp/multirate/power_decimator.h"
 #include "../dsp/correction/dc_blocker.h"
 #include "../dsp/chain.h"
+#include "../dsp/executor.h"
 #include "../dsp/routing/splitter.h"
 #include "../dsp/channel/rx_vfo.h"
+#include "../dsp/channel/pfb_channelizer.h"
 #include "../dsp/sink/handler_sink.h"
 #include "../dsp/processor.h"
 #include "../dsp/math/conjugate.h"
 #include "../dsp/detector/signal_detector.h"
+#include "../dsp/buffer/iq_history.h"
 #include <fftw3.h>
 #include "utils/event.h"
 #include "utils/arrays.h"
@@ -41,11 +44,36 @@ public:
     void removePreprocessor(dsp::Processor<dsp::complex_t, dsp::complex_t>* processor);
     void togglePreprocessor(dsp::Processor<dsp::complex_t, dsp::complex_t>* processor, bool enabled);
 
-    void bindIQStream(dsp::stream<dsp::complex_t>* stream);
+    void bindIQStream(dsp::stream<dsp::complex_t>* stream, dsp::FanoutPolicy policy = dsp::FanoutPolicy::BLOCK, int queueDepth = 1);
     void unbindIQStream(dsp::stream<dsp::complex_t>* stream);
+    uint64_t getIQStreamDroppedBlocks(dsp::stream<dsp::complex_t>* stream);
+    uint64_t getFFTDroppedBlocks() { return getIQStreamDroppedBlocks(&fftIn); }
 
     dsp::channel::RxVFO* addVFO(std::string name, double sampleRate, double bandwidth, double offset);
     void removeVFO(std::string name);
+    void setVFOOffset(std::string name, double offset);
+    void setVFOBandwidth(std::string name, double bandwidth);
+    void setVFOOutSamplerate(std::string name, double sampleRate, double bandwidth);
+
+    // Feed VFOs that fit the channel grid from a shared polyphase channelizer instead of the full rate IQ
+    void setChannelizerEnabled(bool enabled);
+    inline bool getChannelizerEnabled() { return channelizerEnabled; }
+    int getChannelizedVFOCount();
+
+    // Keep the last seconds of pre-processed IQ in memory, for saving or replaying what already went by
+    // Returns false when the history was asked for but could not be allocated, it is left disabled
+    bool setHistory(bool enabled, double seconds, bool int16);
+    inline bool getHistoryEnabled() { return historyEnabled; }
+    dsp::buffer::IQHistory* getHistory() { return historyEnabled ? &history : NULL; }
+    uint64_t getHistoryDroppedBlocks() { return historyEnabled ? getIQStreamDroppedBlocks(&historyIn) : 0; }
+
+    // Feed a VFO from the history, delaySeconds behind live. 0 puts it back on the live samples.
+    void setVFOTimeShift(std::string name, double delaySeconds);
+    double getVFOTimeShift(std::string name);
+
+    // Run the pre-processing chain and the VFOs on the shared DSP worker pool instead of a thread per block
+    void setThreadPoolEnabled(bool enabled);
+    inline bool getThreadPoolEnabled() { return threadPoolEnabled; }
 
     void setFFTSize(int size);
     void setFFTRate(double rate);
@@ -91,6 +119,11 @@ protected:
         skip = fftInterval - nzSampCount;
     }
 
+    // Thread pool scheduling, declared first so they outlive the blocks running on them
+    dsp::ExecGroup preprocGroup;
+    std::map<std::string, std::unique_ptr<dsp::ExecGroup>> vfoGroups;
+    bool threadPoolEnabled = false;
+
     // Input buffer
     dsp::buffer::SampleFrameBuffer<dsp::complex_t> inBuf;
 
@@ -108,9 +141,31 @@ protected:
     dsp::buffer::Reshaper<dsp::complex_t> reshape;
     dsp::sink::Handler<dsp::complex_t> fftSink;
 
+    // Channelizer
+    dsp::stream<dsp::complex_t> chanIn;
+    dsp::channel::PFBChannelizer channelizer;
+    bool channelizerEnabled = false;
+    bool channelizerBound = false;
+
     // VFOs
+    struct VFOParams {
+        double offset;
+        double bandwidth;
+        double outSamplerate;
+        int channel; // -1 when fed directly from the splitter
+    };
+    void routeVFO(std::string name, bool force = false);
+    void updateChannelizerBinding();
+
     std::map<std::string, dsp::stream<dsp::complex_t>*> vfoStreams;
     std::map<std::string, dsp::channel::RxVFO*> vfos;
+    std::map<std::string, VFOParams> vfoParams;
+
+    // IQ history and the VFOs playing from it
+    dsp::stream<dsp::complex_t> historyIn;
+    dsp::buffer::IQHistory history;
+    bool historyEnabled = false;
+    std::map<std::string, std::unique_ptr<dsp::buffer::IQHistoryPlayer>> vfoPlayers;
 
     // Parameters
     double _sampleRate;
@@ -1,6 +1,14 @@
 
 #include <utils/arrays.h>
 #include <fftw3.h>
+#include <map>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <utils/flog.h>
+#include <fstream>
 
 #ifdef __APPLE__
 #include <Accelerate/Accelerate.h>
@@ -10,7 +18,6 @@
 
 #include <ctm.h>
 
-long long fftCumulativeTime = 0;
 bool enableAcceleratedFFT = false;
 
 namespace dsp {
@@ -471,13 +478,9 @@ namespace dsp {
 
     namespace arrays {
 
-        FloatArray centeredSma(FloatArray in, int winsize) {
-            int limit = in->size();
-            auto rv = npzeros(limit);
+        void centeredSma(const float* indata, float* outdata, int limit, int winsize) {
             float total = 0;
             int win2 = winsize / 2;
-            auto indata = in->data();
-            auto outdata = rv->data();
             for(int i=0; i<winsize; i++) {
                 total += indata[i];
             }
@@ -491,36 +494,290 @@ namespace dsp {
             for(int i=limit - win2; i<limit; i++) {
                 outdata[i] = outdata[limit-win2-1];
             }
+        }
+
+        void movingVariance(const float* inData, float* out, float* meanData, int limit, int winsize) {
+            centeredSma(inData, meanData, limit, winsize);
+            for(int i=0; i<limit; i++) {
+                meanData[i] = (inData[i] - meanData[i]) * (inData[i] - meanData[i]);
+            }
+            centeredSma(meanData, out, limit, winsize);
+        }
+
+        FloatArray centeredSma(FloatArray in, int winsize) {
+            int limit = in->size();
+            auto rv = npzeros(limit);
+            centeredSma(in->data(), rv->data(), limit, winsize);
             return rv;
         }
 
         FloatArray movingVariance(FloatArray in, int winsize) {
-            auto mean = centeredSma(in, winsize);
-            auto squaredDistances = npzeros(mean->size());
-            auto meanData = mean->data();
-            auto squaredDistancesData = squaredDistances->data();
-            auto inData = in->data();
-            for(int i=0; i<mean->size(); i++) {
-                squaredDistancesData[i] = (inData[i] - meanData[i]) * (inData[i] - meanData[i]);
+            auto mean = npzeros(in->size());
+            auto rv = npzeros(in->size());
+            movingVariance(in->data(), rv->data(), mean->data(), in->size(), winsize);
+            return rv;
+        }
+
+        // Execution time of all plans of one size and direction
+        struct FFTTiming {
+            std::atomic<uint64_t> count = 0;
+            std::atomic<uint64_t> totalNs = 0;
+            std::atomic<bool> measured = false;
+
+            inline void add(uint64_t ns) {
+                count.fetch_add(1, std::memory_order_relaxed);
+                totalNs.fetch_add(ns, std::memory_order_relaxed);
+            }
+        };
+
+        // Owns one FFTW plan. The last owner to let go hands it to the planner thread for destruction.
+        struct FFTWPlanHandle {
+            fftwf_plan plan;
+            FFTWPlanHandle(fftwf_plan plan) : plan(plan) {}
+            ~FFTWPlanHandle();
+        };
+
+        // FFTW plan shared by every FFTPlan of the same size and direction. The plan is only executed through
+        // fftwf_execute_dft() on the caller's arrays, so it can be replaced by a better one at any time. Users
+        // pick up the new plan when the generation changes and drop the old one, which is destroyed after the
+        // last of them moved on.
+        struct CachedFFTWPlan {
+            int size;
+            bool backward;
+            int alignment;
+            std::shared_ptr<FFTTiming> timing;
+            std::atomic<uint64_t> generation = 0;
+
+            std::shared_ptr<FFTWPlanHandle> current() {
+                std::lock_guard<std::mutex> lck(planMtx);
+                return plan;
+            }
+
+            void replace(const std::shared_ptr<FFTWPlanHandle>& newPlan) {
+                std::lock_guard<std::mutex> lck(planMtx);
+                plan = newPlan;
+                generation++;
+            }
+
+        private:
+            std::mutex planMtx;
+            std::shared_ptr<FFTWPlanHandle> plan;
+        };
+
+        class FFTWPlanCache {
+        public:
+            static FFTWPlanCache& get() {
+                // Never destroyed, the background planner may still be running at exit
+                static FFTWPlanCache* cache = new FFTWPlanCache();
+                return *cache;
+            }
+
+            void init(const std::string& path, FFTPlanRigor r) {
+                std::lock_guard<std::mutex> lck(plannerMtx);
+                wisdomPath = path;
+                rigor = r;
+                if (!wisdomPath.empty() && fftwf_import_wisdom_from_filename(wisdomPath.c_str())) {
+                    flog::info("Loaded FFTW wisdom from {}", wisdomPath);
+                }
+            }
+
+            std::shared_ptr<CachedFFTWPlan> getPlan(int size, bool backward) {
+                std::lock_guard<std::mutex> lck(cacheMtx);
+                auto& entry = plans[{ size, backward }];
+                if (entry) { return entry; }
+
+                entry = std::make_shared<CachedFFTWPlan>();
+                entry->size = size;
+                entry->backward = backward;
+                entry->timing = getTiming(size, backward);
+                {
+                    std::lock_guard<std::mutex> plck(plannerMtx);
+                    fftwf_complex* in = (fftwf_complex*)fftwf_malloc(size * sizeof(fftwf_complex));
+                    fftwf_complex* out = (fftwf_complex*)fftwf_malloc(size * sizeof(fftwf_complex));
+                    entry->alignment = fftwf_alignment_of((float*)in);
+
+                    // Wisdom from an earlier run gives a measured plan without measuring anything
+                    fftwf_plan p = NULL;
+                    if (rigor != FFT_PLAN_ESTIMATE) {
+                        p = fftwf_plan_dft_1d(size, in, out, backward ? FFTW_BACKWARD : FFTW_FORWARD, rigorFlags() | FFTW_WISDOM_ONLY);
+                    }
+                    if (p) {
+                        entry->timing->measured = true;
+                    }
+                    else {
+                        p = fftwf_plan_dft_1d(size, in, out, backward ? FFTW_BACKWARD : FFTW_FORWARD, FFTW_ESTIMATE);
+                    }
+                    entry->replace(std::make_shared<FFTWPlanHandle>(p));
+                    fftwf_free(in);
+                    fftwf_free(out);
+                }
+
+                if (!entry->timing->measured && rigor != FFT_PLAN_ESTIMATE) {
+                    queueMeasure(entry);
+                }
+                return entry;
+            }
+
+            std::shared_ptr<FFTTiming> getTiming(int size, bool backward) {
+                std::lock_guard<std::mutex> lck(timingMtx);
+                auto& timing = timings[{ size, backward }];
+                if (!timing) { timing = std::make_shared<FFTTiming>(); }
+                return timing;
+            }
+
+            std::vector<FFTStats> getStats() {
+                std::vector<FFTStats> stats;
+                std::lock_guard<std::mutex> lck(timingMtx);
+                for (auto& [key, timing] : timings) {
+                    FFTStats st;
+                    st.size = key.first;
+                    st.backward = key.second;
+                    st.measured = timing->measured;
+                    st.count = timing->count;
+                    st.totalNs = timing->totalNs;
+                    stats.push_back(st);
+                }
+                return stats;
+            }
+
+            // Plans no longer used by anyone, destroyed by the planner thread
+            void retirePlan(fftwf_plan p) {
+                std::lock_guard<std::mutex> lck(measureMtx);
+                retired.push_back(p);
+                measureCV.notify_one();
+            }
+
+            std::mutex plannerMtx;
+
+        private:
+            // Bounds how long measuring one plan takes. The measure holds the planner lock, anyone creating or
+            // destroying a plan meanwhile waits for it.
+            static constexpr double MEASURE_TIME_LIMIT = 0.25;
+
+            unsigned int rigorFlags() {
+                return (rigor == FFT_PLAN_PATIENT) ? FFTW_PATIENT : FFTW_MEASURE;
             }
-            return centeredSma(squaredDistances, winsize);
+
+            void queueMeasure(const std::shared_ptr<CachedFFTWPlan>& entry) {
+                std::lock_guard<std::mutex> lck(measureMtx);
+                measureQueue.push_back(entry);
+                if (!measureThreadStarted) {
+                    measureThreadStarted = true;
+                    std::thread(&FFTWPlanCache::measureWorker, this).detach();
+                }
+                measureCV.notify_one();
+            }
+
+            void measureWorker() {
+                SetThreadName("fftw_planner");
+                while (true) {
+                    std::shared_ptr<CachedFFTWPlan> entry;
+                    std::vector<fftwf_plan> unused;
+                    {
+                        std::unique_lock<std::mutex> lck(measureMtx);
+                        measureCV.wait(lck, [this] { return !measureQueue.empty() || !retired.empty(); });
+                        unused.swap(retired);
+                        if (!measureQueue.empty()) {
+                            entry = measureQueue.front();
+                            measureQueue.pop_front();
+                        }
+                    }
+                    if (!unused.empty()) {
+                        std::lock_guard<std::mutex> lck(plannerMtx);
+                        for (auto p : unused) { fftwf_destroy_plan(p); }
+                    }
+                    if (!entry) { continue; }
+
+                    auto start = std::chrono::steady_clock::now();
+                    fftwf_plan p;
+                    std::string allWisdom;
+                    {
+                        std::lock_guard<std::mutex> lck(plannerMtx);
+                        fftwf_complex* in = (fftwf_complex*)fftwf_malloc(entry->size * sizeof(fftwf_complex));
+                        fftwf_complex* out = (fftwf_complex*)fftwf_malloc(entry->size * sizeof(fftwf_complex));
+                        bool aligned = (fftwf_alignment_of((float*)in) == entry->alignment);
+                        fftwf_set_timelimit(MEASURE_TIME_LIMIT);
+                        p = fftwf_plan_dft_1d(entry->size, in, out, entry->backward ? FFTW_BACKWARD : FFTW_FORWARD, rigorFlags());
+                        fftwf_set_timelimit(FFTW_NO_TIMELIMIT);
+                        fftwf_free(in);
+                        fftwf_free(out);
+                        if (p && !wisdomPath.empty()) {
+                            char* str = fftwf_export_wisdom_to_string();
+                            if (str) {
+                                allWisdom = str;
+                                free(str);
+                            }
+                        }
+                        // The wisdom is still worth keeping, the plan can't run on the users' arrays
+                        if (p && !aligned) {
+                            fftwf_destroy_plan(p);
+                            p = NULL;
+                        }
+                    }
+                    if (!allWisdom.empty()) {
+                        std::ofstream file(wisdomPath, std::ios::binary | std::ios::trunc);
+                        file << allWisdom;
+                    }
+                    if (!p) { continue; }
+
+                    entry->replace(std::make_shared<FFTWPlanHandle>(p));
+                    entry->timing->measured = true;
+                    flog::info("Measured FFTW plan for {} point {} FFT in {} ms", entry->size, entry->backward ? "backward" : "forward",
+                               std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+                }
+            }
+
+            std::string wisdomPath;
+            FFTPlanRigor rigor = FFT_PLAN_ESTIMATE;
+
+            std::mutex cacheMtx;
+            std::map<std::pair<int, bool>, std::shared_ptr<CachedFFTWPlan>> plans;
+
+            std::mutex timingMtx;
+            std::map<std::pair<int, bool>, std::shared_ptr<FFTTiming>> timings;
+
+            std::mutex measureMtx;
+            std::condition_variable measureCV;
+            std::deque<std::shared_ptr<CachedFFTWPlan>> measureQueue;
+            std::vector<fftwf_plan> retired;
+            bool measureThreadStarted = false;
+        };
+
+        FFTWPlanHandle::~FFTWPlanHandle() {
+            if (plan) { FFTWPlanCache::get().retirePlan(plan); }
+        }
+
+        // Loads an FFT input, truncating or zero padding to the plan size without a temporary array
+        static void loadPadded(const ComplexArray& from, const ComplexArray& to) {
+            size_t limit = std::min<size_t>(from->size(), to->size());
+            std::copy(from->begin(), from->begin() + limit, to->begin());
+            std::fill(to->begin() + limit, to->end(), dsp::complex_t{ 0.0f, 0.0f });
         }
 
         struct fftwPlanImplFFTW : public FFTPlan {
             int nbuckets;
             bool reverse;
-            fftwf_plan_s* p;
+            std::shared_ptr<CachedFFTWPlan> cached;
+            std::shared_ptr<FFTWPlanHandle> plan;
+            uint64_t generation = 0;
+            fftwf_plan ownPlan = NULL;
             ComplexArray input;
             ComplexArray output;
 
             fftwPlanImplFFTW(bool backward, int buckets) : FFTPlan() {
-                auto plan = this;
-                plan->nbuckets = buckets;
-                plan->reverse = backward;
-                plan->input = npzeros_c(buckets);
-                plan->output = npzeros_c(buckets);
-                auto p = fftwf_plan_dft_1d(buckets, (fftwf_complex*)plan->input->data(), (fftwf_complex*)plan->output->data(), backward ? FFTW_BACKWARD : FFTW_FORWARD, FFTW_ESTIMATE);
-                plan->p = p;
+                nbuckets = buckets;
+                reverse = backward;
+                input = std::make_shared<std::vector<dsp::complex_t>>(buckets, dsp::complex_t{ 0.0f, 0.0f });
+                output = std::make_shared<std::vector<dsp::complex_t>>(buckets, dsp::complex_t{ 0.0f, 0.0f });
+                cached = FFTWPlanCache::get().getPlan(buckets, backward);
+                generation = cached->generation;
+                plan = cached->current();
+
+                // The shared plan can only run on arrays aligned like the ones it was planned with
+                if (fftwf_alignment_of((float*)input->data()) != cached->alignment || fftwf_alignment_of((float*)output->data()) != cached->alignment) {
+                    std::lock_guard<std::mutex> lck(fftwPlannerMutex());
+                    ownPlan = fftwf_plan_dft_1d(buckets, (fftwf_complex*)input->data(), (fftwf_complex*)output->data(), backward ? FFTW_BACKWARD : FFTW_FORWARD, FFTW_ESTIMATE);
+                }
             }
 
             ComplexArray getInput() override {
@@ -531,22 +788,38 @@ namespace dsp {
             }
 
             ComplexArray npfftfft(const ComplexArray& in) override {
-                auto in0 = resize(in, nbuckets);
-                std::copy(in0->begin(), in0->end(), input->begin());
-//                auto out0 = npzeros_c(nbuckets);
-                fftwf_execute(p);
-//                std::copy(output->begin(), output->end(), out0->begin());
-//                this->output->resize(nbuckets);
+                if (in != input) {
+                    loadPadded(in, input);
+                }
+                execute();
+                return this->output;
+            }
+
+            void execute() override {
+                auto start = std::chrono::steady_clock::now();
+                if (ownPlan) {
+                    fftwf_execute(ownPlan);
+                }
+                else {
+                    // Moves to a measured plan once it is there
+                    uint64_t gen = cached->generation.load(std::memory_order_acquire);
+                    if (gen != generation) {
+                        generation = gen;
+                        plan = cached->current();
+                    }
+                    fftwf_execute_dft(plan->plan, (fftwf_complex*)input->data(), (fftwf_complex*)output->data());
+                }
                 if (reverse) {
                     div_(this->output, nbuckets);
-                } else {
-                    //return out0;
                 }
-                return this->output;
+                cached->timing->add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
             }
 
             virtual ~fftwPlanImplFFTW() {
-                fftwf_destroy_plan(p);
+                if (ownPlan) {
+                    std::lock_guard<std::mutex> lck(fftwPlannerMutex());
+                    fftwf_destroy_plan(ownPlan);
+                }
             }
         };
 
@@ -559,11 +832,14 @@ namespace dsp {
             std::shared_ptr<std::vector<dsp::complex_t>> output;
             FFTSetup fftSetup;
 
+            std::shared_ptr<FFTTiming> timing;
+
             vDSPPlanImpl(bool backward, int buckets) : FFTPlan() {
                 nbuckets = buckets;
                 reverse = backward;
-                input = npzeros_c(buckets);
-                output = npzeros_c(buckets);
+                timing = FFTWPlanCache::get().getTiming(buckets, backward);
+                input = std::make_shared<std::vector<dsp::complex_t>>(buckets, dsp::complex_t{ 0.0f, 0.0f });
+                output = std::make_shared<std::vector<dsp::complex_t>>(buckets, dsp::complex_t{ 0.0f, 0.0f });
 
                 // Prepare the FFT Setup object
                 fftSetup = vDSP_create_fftsetup((int)log2(nbuckets), FFT_RADIX2);
@@ -582,9 +858,18 @@ namespace dsp {
             }
 
             ComplexArray npfftfft(const ComplexArray& in) override {
-                // Resize and copy input data to tempSplitComplex
-                auto in0 = resize(in, nbuckets);
-                auto in0P = in0->data();
+                if (in != input) {
+                    loadPadded(in, input);
+                }
+                execute();
+                return this->output;
+            }
+
+            void execute() override {
+                auto start = std::chrono::steady_clock::now();
+
+                // Copy input data to tempSplitComplex
+                auto in0P = input->data();
                 for (int i = 0; i < nbuckets; ++i) {
                     tempSplitComplex.realp[i] = in0P[i].re;
                     tempSplitComplex.imagp[i] = in0P[i].im;
@@ -609,10 +894,8 @@ namespace dsp {
 
                 if (reverse) {
                     div_(output, nbuckets);
-                } else {
-                    //return out0;
                 }
-                return this->output;
+                timing->add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
             }
 
             virtual ~vDSPPlanImpl() {
@@ -725,9 +1008,72 @@ namespace dsp {
             std::cout << dumpArr(ptr, len) << std::endl;
         }
 
+        static std::atomic<uint64_t> arrayAllocations = 0;
+        static thread_local ArrayArena* currentArena = NULL;
+
+        // Takes an array only the arena still references, growing one if none is big enough. The scan resumes
+        // where the last one stopped since arrays mostly come back in the order they were handed out.
+        template <class T>
+        static std::shared_ptr<std::vector<T>> takeFromPool(ArrayArena::Pool<T>& pool, size_t size) {
+            size_t count = pool.arrays.size();
+            std::shared_ptr<std::vector<T>>* small = NULL;
+            for (size_t i = 0; i < count; i++) {
+                size_t index = (pool.next + i) % count;
+                auto& arr = pool.arrays[index];
+                if (arr.use_count() != 1) { continue; }
+                if (arr->capacity() >= size) {
+                    pool.next = index + 1;
+                    arr->resize(size);
+                    return arr;
+                }
+                if (!small) { small = &arr; }
+            }
+            arrayAllocations++;
+            if (small) {
+                (*small)->resize(size);
+                return *small;
+            }
+            pool.arrays.push_back(std::make_shared<std::vector<T>>(size));
+            return pool.arrays.back();
+        }
+
+        FloatArray ArrayArena::floats(size_t size) {
+            return takeFromPool(floatPool, size);
+        }
+
+        ComplexArray ArrayArena::complexes(size_t size) {
+            return takeFromPool(complexPool, size);
+        }
+
+        ArenaScope::ArenaScope(ArrayArena& arena) {
+            prev = currentArena;
+            currentArena = &arena;
+        }
+
+        ArenaScope::~ArenaScope() {
+            currentArena = prev;
+        }
+
+        uint64_t getArrayAllocationCount() {
+            return arrayAllocations.load();
+        }
+
+        // Result arrays of the helpers, their contents are not initialized when they come from an arena
+        static FloatArray allocFloats(size_t size) {
+            if (currentArena) { return currentArena->floats(size); }
+            arrayAllocations++;
+            return std::make_shared<std::vector<float>>(size);
+        }
+
+        static ComplexArray allocComplex(size_t size) {
+            if (currentArena) { return currentArena->complexes(size); }
+            arrayAllocations++;
+            return std::make_shared<std::vector<dsp::complex_t>>(size);
+        }
+
         // hanning window
         FloatArray nphanning(int len) {
-            auto retval = std::make_shared<std::vector<float>>(len);
+            auto retval = allocFloats(len);
             for (int i = 0; i < len; i++) {
                 retval->at(i) = (0.5 - 0.5 * cos(2.0 * M_PI * i / (len - 1)));
             }
@@ -745,15 +1091,18 @@ namespace dsp {
 
         // multiply by scalar
         FloatArray mul(const FloatArray& v, float e) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->resize(v->size());
+            auto retval = allocFloats(v->size());
             volk_32f_s32f_multiply_32f(retval->data(), v->data(), e, v->size());
             return retval;
         }
 
+        void mul_(const FloatArray& v, float e) {
+            volk_32f_s32f_multiply_32f(v->data(), v->data(), e, v->size());
+        }
+
         // add scalar to all items
         FloatArray add(const FloatArray& v, float e) {
-            auto retval = std::make_shared<std::vector<float>>(v->size(), 0);
+            auto retval = allocFloats(v->size());
             int limit = (int)v->size();
             auto* src = v->data();
             auto* dst = retval->data();
@@ -763,26 +1112,28 @@ namespace dsp {
             return retval;
         }
 
+        void add_(const FloatArray& v, float e) {
+            int limit = (int)v->size();
+            auto* dst = v->data();
+            for (int i=0; i<limit; i++) {
+                dst[i] += e;
+            }
+        }
+
         // add two arrays
         FloatArray addeach(const FloatArray& v, const FloatArray& w) {
-            auto retval = std::make_shared<std::vector<float>>();
-            if (false) {
-                retval->reserve(v->size());
-                for (int q = 0; q < v->size(); q++) {
-                    retval->emplace_back(v->at(q) + w->at(q));
-                }
-            }
-            else {
-                retval->resize(v->size());
-                volk_32f_x2_add_32f(retval->data(), v->data(), w->data(), v->size());
-            }
+            auto retval = allocFloats(v->size());
+            volk_32f_x2_add_32f(retval->data(), v->data(), w->data(), v->size());
             return retval;
         }
 
+        void addeach_(const FloatArray& v, const FloatArray& w) {
+            volk_32f_x2_add_32f(v->data(), v->data(), w->data(), v->size());
+        }
+
         // subtract two arrays
         FloatArray subeach(const FloatArray& v, const FloatArray& w) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->resize(v->size());
+            auto retval = allocFloats(v->size());
             volk_32f_x2_subtract_32f(retval->data(), v->data(), w->data(), v->size());
             return retval;
         }
@@ -790,14 +1141,12 @@ namespace dsp {
 
         // add two arrays
         ComplexArray addeach(const ComplexArray& v, const ComplexArray& w) {
-            auto retval = std::make_shared<std::vector<dsp::complex_t>>();
+            auto retval = allocComplex(v->size());
 #ifndef VOLK_VERSION
-            retval->reserve(v->size());
             for (int q = 0; q < v->size(); q++) {
-                retval->emplace_back(v->at(q) + w->at(q));
+                (*retval)[q] = v->at(q) + w->at(q);
             }
 #else
-            retval->resize(v->size());
             volk_32fc_x2_add_32fc((lv_32fc_t*)retval->data(), (lv_32fc_t*)v->data(), (lv_32fc_t*)w->data(), v->size());
 #endif
             return retval;
@@ -805,16 +1154,18 @@ namespace dsp {
 
         // multiply two arrays
         FloatArray muleach(const FloatArray& v, const FloatArray& w) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->resize(v->size());
+            auto retval = allocFloats(v->size());
             volk_32f_x2_multiply_32f(retval->data(), v->data(), w->data(), v->size());
             return retval;
         }
 
+        void muleach_(const FloatArray& v, const FloatArray& w) {
+            volk_32f_x2_multiply_32f(v->data(), v->data(), w->data(), v->size());
+        }
+
         // multiply two arrays
         ComplexArray muleach(const FloatArray& v, const ComplexArray& w) {
-            auto retval = std::make_shared<std::vector<dsp::complex_t>>();
-            retval->resize(v->size());
+            auto retval = allocComplex(v->size());
             auto rD = retval->data();
             auto wD = w->data();
             auto vD = v->data();
@@ -825,20 +1176,15 @@ namespace dsp {
         }
 
         FloatArray diveach(const FloatArray& v, const FloatArray& w) {
-            auto retval = std::make_shared<std::vector<float>>();
-            if (false) {
-                retval->reserve(v->size());
-                for (int q = 0; q < v->size(); q++) {
-                    retval->emplace_back(v->at(q) / w->at(q));
-                }
-            }
-            else {
-                retval->resize(v->size());
-                volk_32f_x2_divide_32f(retval->data(), v->data(), w->data(), v->size());
-            }
+            auto retval = allocFloats(v->size());
+            volk_32f_x2_divide_32f(retval->data(), v->data(), w->data(), v->size());
             return retval;
         }
 
+        void diveach_(const FloatArray& v, const FloatArray& w) {
+            volk_32f_x2_divide_32f(v->data(), v->data(), w->data(), v->size());
+        }
+
         bool npall(const FloatArray& v) {
             int countZeros = 0;
             //            int firstZero = -1;
@@ -860,56 +1206,32 @@ namespace dsp {
         }
 
         FloatArray div(const FloatArray& v, float e) {
-            auto retval = std::make_shared<std::vector<float>>();
-            if (false) {
-                retval->reserve(v->size());
-                for (auto d : *v) {
-                    retval->emplace_back(d / e);
-                }
-            }
-            else {
-                retval->resize(v->size());
-                volk_32f_s32f_multiply_32f(retval->data(), v->data(), 1.0 / e, v->size());
-            }
+            auto retval = allocFloats(v->size());
+            volk_32f_s32f_multiply_32f(retval->data(), v->data(), 1.0 / e, v->size());
             return retval;
         }
 
         FloatArray npminimum(const FloatArray& v, const FloatArray& w) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->reserve(v->size());
-            //            int ix = 0;
+            auto retval = allocFloats(v->size());
             for (int q = 0; q < retval->size(); q++) {
-                if (v->at(q) < w->at(q)) {
-                    retval->emplace_back(v->at(q));
-                }
-                else {
-                    retval->emplace_back(w->at(q));
-                }
+                (*retval)[q] = std::min<float>(v->at(q), w->at(q));
             }
             return retval;
         }
 
         FloatArray npminimum(const FloatArray& v, float lim) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->reserve(v->size());
-            //            int ix = 0;
-            for (auto d : *v) {
-                if (d < lim) {
-                    retval->emplace_back(d);
-                }
-                else {
-                    retval->emplace_back(lim);
-                }
-                //                ix++;
-                //                if (ix == 1000000) {
-                //                    std::cout << "XX";
-                //                }
+            auto retval = allocFloats(v->size());
+            auto rvD = retval->data();
+            auto vD = v->data();
+            for (int q = 0; q < retval->size(); q++) {
+                rvD[q] = (vD[q] < lim) ? vD[q] : lim;
             }
             return retval;
         }
 
         FloatArray npminimum_(const FloatArray& v, float lim) {
-            auto retval = std::make_shared<std::vector<float>>(v->data(), v->data() + v->size());
+            auto retval = allocFloats(v->size());
+            std::copy(v->begin(), v->end(), retval->begin());
             auto rvD = retval->data();
             for (int q = 0; q < retval->size(); q++) {
                 if (rvD[q] > lim) {
@@ -921,17 +1243,8 @@ namespace dsp {
 
 
         ComplexArray div(const ComplexArray& v, float val) {
-            auto retval = std::make_shared<std::vector<dsp::complex_t>>();
-            if (false) {
-                retval->reserve(v->size());
-                for (auto d : *v) {
-                    retval->emplace_back(d / val);
-                }
-            }
-            else {
-                retval->resize(v->size());
-                volk_32fc_s32fc_multiply_32fc((lv_32fc_t*)retval->data(), (lv_32fc_t*)v->data(), lv_32fc_t(1.0f / val, 0.0f), v->size());
-            }
+            auto retval = allocComplex(v->size());
+            volk_32fc_s32fc_multiply_32fc((lv_32fc_t*)retval->data(), (lv_32fc_t*)v->data(), lv_32fc_t(1.0f / val, 0.0f), v->size());
             return retval;
         }
 
@@ -962,7 +1275,8 @@ namespace dsp {
         }
 
         FloatArray npmaximum(const FloatArray& v, float lim) {
-            auto retval = std::make_shared<std::vector<float>>(v->data(), v->data() + v->size());
+            auto retval = allocFloats(v->size());
+            std::copy(v->begin(), v->end(), retval->begin());
             auto rvD = retval->data();
             for (int q = 0; q < retval->size(); q++) {
                 if (rvD[q] < lim) {
@@ -987,16 +1301,14 @@ namespace dsp {
             if (end == -1) {
                 end = v->size();
             }
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->reserve(end - begin);
-            for (int i = begin; i < end; i++) {
-                retval->emplace_back(v->at(i));
-            }
+            auto retval = allocFloats(end - begin);
+            std::copy(v->begin() + begin, v->begin() + end, retval->begin());
             return retval;
         }
 
         ComplexArray nparange(const Arg<std::vector<dsp::complex_t>>& v, int begin, int end) {
-            auto retval = std::make_shared<std::vector<dsp::complex_t>>(v->begin() + begin, v->begin() + end);
+            auto retval = allocComplex(end - begin);
+            std::copy(v->begin() + begin, v->begin() + end, retval->begin());
             return retval;
         }
 
@@ -1015,59 +1327,51 @@ namespace dsp {
         }
 
         FloatArray neg(const FloatArray& v) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->reserve(v->size());
-            for (auto d : *v) {
-                retval->emplace_back(-d);
+            auto retval = allocFloats(v->size());
+            for (int q = 0; q < v->size(); q++) {
+                (*retval)[q] = -(*v)[q];
             }
             return retval;
         }
 
         FloatArray npexp(const FloatArray& v) {
-            auto retval = std::make_shared<std::vector<float>>();
-            if (false) {
-                retval->reserve(v->size());
-                for (auto d : *v) {
-                    retval->emplace_back(::exp(d));
-                }
-            }
-            else {
-                retval->resize(v->size());
-                volk_32f_expfast_32f(retval->data(), v->data(), v->size());
-            }
+            auto retval = allocFloats(v->size());
+            volk_32f_expfast_32f(retval->data(), v->data(), v->size());
             return retval;
         }
 
+        void npexp_(const FloatArray& v) {
+            volk_32f_expfast_32f(v->data(), v->data(), v->size());
+        }
+
         FloatArray npsqrt(const FloatArray& v) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->reserve(v->size());
-            for (auto d : *v) {
-                retval->emplace_back(sqrt(d));
+            auto retval = allocFloats(v->size());
+            for (int q = 0; q < v->size(); q++) {
+                (*retval)[q] = sqrt((*v)[q]);
             }
             return retval;
         }
 
         FloatArray nplog(const FloatArray& v) {
-            auto retval = std::make_shared<std::vector<float>>();
-            for (auto d : *v) {
-                retval->emplace_back(log(d));
+            auto retval = allocFloats(v->size());
+            for (int q = 0; q < v->size(); q++) {
+                (*retval)[q] = log((*v)[q]);
             }
             return retval;
         }
 
         ComplexArray tocomplex(const FloatArray& v) {
-            auto retval = std::make_shared<std::vector<dsp::complex_t>>();
-            retval->reserve(v->size());
-            for (auto d : *v) {
-                retval->emplace_back(dsp::complex_t{ d, 0.0f });
+            auto retval = allocComplex(v->size());
+            for (int q = 0; q < v->size(); q++) {
+                (*retval)[q] = dsp::complex_t{ (*v)[q], 0.0f };
             }
             return retval;
         }
 
         // only even window sizes
         FloatArray npmavg(const FloatArray& v, int windowSize) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->reserve(v->size());
+            auto retval = allocFloats(v->size());
+            retval->clear();
             float sum = 0;
             float count = 0;
             auto ws2 = windowSize / 2;
@@ -1092,16 +1396,16 @@ namespace dsp {
         }
 
         FloatArray npreal(const ComplexArray& v) {
-            auto retval = std::make_shared<std::vector<float>>();
-            retval->reserve(v->size());
-            for (auto d : *v) {
-                retval->emplace_back(d.re);
+            auto retval = allocFloats(v->size());
+            for (int q = 0; q < v->size(); q++) {
+                (*retval)[q] = (*v)[q].re;
             }
             return retval;
         }
 
         FloatArray npzeros(int size) {
-            auto retval = std::make_shared<std::vector<float>>(size, 0.0);
+            auto retval = allocFloats(size);
+            std::fill(retval->begin(), retval->end(), 0.0f);
             return retval;
         }
 
@@ -1117,7 +1421,7 @@ namespace dsp {
         }
 
         FloatArray linspace(float start, float stop, int num) {
-            auto array = std::make_shared<std::vector<float>>(num);
+            auto array = allocFloats(num);
             float step = (stop - start) / (num - 1);
             for (int i = 0; i < num; i++) {
                 (*array)[i] = start + i * step;
@@ -1134,7 +1438,8 @@ namespace dsp {
         }
 
         ComplexArray npzeros_c(int size) {
-            auto retval = std::make_shared<std::vector<dsp::complex_t>>(size, dsp::complex_t{ 0.0f, 0.0f });
+            auto retval = allocComplex(size);
+            std::fill(retval->begin(), retval->end(), dsp::complex_t{ 0.0f, 0.0f });
             return retval;
         }
 
@@ -1142,7 +1447,7 @@ namespace dsp {
             if (in->size() == nsize) {
                 return in;
             }
-            auto retval = std::make_shared<std::vector<dsp::complex_t>>(nsize, dsp::complex_t{ 0, 0 });
+            auto retval = npzeros_c(nsize);
             auto limit = in->size();
             if (nsize < in->size()) {
                 limit = nsize;
@@ -1152,7 +1457,7 @@ namespace dsp {
         }
 
         FloatArray scipyspecialexpn(const FloatArray& in) {
-            auto retval = std::make_shared<std::vector<float>>(in->size());
+            auto retval = allocFloats(in->size());
             auto rvD = retval->data();
             auto inD = in->data();
             for (auto q = 0; q < in->size(); q++) {
@@ -1162,7 +1467,7 @@ namespace dsp {
         }
 
         FloatArray maximum(const FloatArray& in, float value) {
-            auto retval = std::make_shared<std::vector<float>>(in->size());
+            auto retval = allocFloats(in->size());
             auto rvD = retval->data();
             auto inD = in->data();
             for (auto q = 0; q < in->size(); q++) {
@@ -1172,28 +1477,28 @@ namespace dsp {
         }
 
         FloatArray clone(const FloatArray& in) {
-            return std::make_shared<std::vector<float>>(*in);
+            auto retval = allocFloats(in->size());
+            std::copy(in->begin(), in->end(), retval->begin());
+            return retval;
         }
 
         ComplexArray clone(const ComplexArray& in) {
-            return std::make_shared<std::vector<dsp::complex_t>>(*in);
+            auto retval = allocComplex(in->size());
+            std::copy(in->begin(), in->end(), retval->begin());
+            return retval;
         }
 
         FloatArray npabsolute(const ComplexArray& in) {
-            auto retval = std::make_shared<std::vector<float>>();
-            if (false) {
-                retval->reserve(in->size());
-                for (auto& v : *in) {
-                    retval->emplace_back(v.amplitude());
-                }
-            }
-            else {
-                retval->resize(in->size());
-                volk_32fc_magnitude_32f(retval->data(), (const lv_32fc_t*)in->data(), in->size());
-            }
+            auto retval = allocFloats(in->size());
+            volk_32fc_magnitude_32f(retval->data(), (const lv_32fc_t*)in->data(), in->size());
             return retval;
         }
 
+        void npabsolute(const ComplexArray& in, const FloatArray& out) {
+            out->resize(in->size());
+            volk_32fc_magnitude_32f(out->data(), (const lv_32fc_t*)in->data(), in->size());
+        }
+
 
         Arg<FFTPlan> allocateFFTWPlan(bool backward, int buckets) {
             FFTPlan *plan;
@@ -1210,9 +1515,25 @@ namespace dsp {
         }
 
         void npfftfft(const ComplexArray& in, const Arg<FFTPlan>& plan) {
-            auto ctm = currentTimeMillis();
             plan->npfftfft(in);
-            fftCumulativeTime += currentTimeMillis() - ctm;
+        }
+
+        void initFFTPlanCache(const std::string& wisdomPath, FFTPlanRigor rigor) {
+            FFTWPlanCache::get().init(wisdomPath, rigor);
+        }
+
+        std::mutex& fftwPlannerMutex() {
+            return FFTWPlanCache::get().plannerMtx;
+        }
+
+        std::vector<FFTStats> getFFTStats() {
+            return FFTWPlanCache::get().getStats();
+        }
+
+        uint64_t getFFTTotalTimeNs() {
+            uint64_t total = 0;
+            for (auto& st : getFFTStats()) { total += st.totalNs; }
+            return total;
         }
 
         std::string ftos(float x) {
@@ -1,6 +1,9 @@
 #pragma once
 #include <memory>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #ifdef WIN32
 #define _USE_MATH_DEFINES
@@ -11,7 +14,6 @@
 
 #define FL_M_PI 3.1415926535f
 
-extern long long fftCumulativeTime;
 extern bool enableAcceleratedFFT;
 
 namespace dsp {
@@ -36,6 +38,36 @@ namespace dsp {
         typedef std::shared_ptr<std::vector<float>> FloatArray;
         typedef std::shared_ptr<std::vector<dsp::complex_t>> ComplexArray;
 
+        // Recycles the result arrays of the helpers below. While an ArenaScope is active on a thread, helpers
+        // take their results from its arena, and an array is handed out again once nothing but the arena holds it.
+        class ArrayArena {
+        public:
+            FloatArray floats(size_t size);
+            ComplexArray complexes(size_t size);
+
+            template <class T>
+            struct Pool {
+                std::vector<std::shared_ptr<std::vector<T>>> arrays;
+                size_t next = 0;
+            };
+
+        private:
+            Pool<float> floatPool;
+            Pool<dsp::complex_t> complexPool;
+        };
+
+        class ArenaScope {
+        public:
+            ArenaScope(ArrayArena& arena);
+            ~ArenaScope();
+
+        private:
+            ArrayArena* prev;
+        };
+
+        // Heap allocations made for helper results since startup, arena growth included
+        uint64_t getArrayAllocationCount();
+
         std::string dumpArr(const float *x, int limit);
         std::string dumpArr(const ComplexArray& x);
         std::string dumpArr(const FloatArray &x);
@@ -56,11 +88,14 @@ namespace dsp {
 
         // multiply by scalar
         FloatArray mul(const FloatArray& v, float e);
+        void mul_(const FloatArray& v, float e);
         // add scalar to all items
         FloatArray add(const FloatArray& v, float e);
+        void add_(const FloatArray& v, float e);
 
         // add two arrays
         FloatArray addeach(const FloatArray& v, const FloatArray& w);
+        void addeach_(const FloatArray& v, const FloatArray& w);
 
         // subtract two array
         FloatArray subeach(const FloatArray& v, const FloatArray& w);
@@ -69,9 +104,11 @@ namespace dsp {
 
         // multiply two arrays
         FloatArray muleach(const FloatArray& v, const FloatArray& w);
+        void muleach_(const FloatArray& v, const FloatArray& w);
         // multiply two arrays
         ComplexArray muleach(const FloatArray& v, const ComplexArray& w);
         FloatArray diveach(const FloatArray& v, const FloatArray& w);
+        void diveach_(const FloatArray& v, const FloatArray& w);
 
         bool npall(const FloatArray& v);
         FloatArray div(const FloatArray& v, float e);
@@ -92,6 +129,7 @@ namespace dsp {
         void nparangeset(const ComplexArray& v, int begin, const ComplexArray& part);
         FloatArray neg(const FloatArray& v);
         FloatArray npexp(const FloatArray& v);
+        void npexp_(const FloatArray& v);
         FloatArray npsqrt(const FloatArray& v);
         FloatArray nplog(const FloatArray& v);
         ComplexArray tocomplex(const FloatArray& v);
@@ -110,21 +148,53 @@ namespace dsp {
         FloatArray clone(const FloatArray& in);
         ComplexArray clone(const ComplexArray & in);
         FloatArray npabsolute(const ComplexArray& in);
+        void npabsolute(const ComplexArray& in, const FloatArray& out);
         FloatArray centeredSma(FloatArray in, int winsize);
         FloatArray movingVariance(FloatArray in, int winsize);
+        // Same into caller buffers of limit items, out must not be in. scratch holds the moving mean.
+        void centeredSma(const float* in, float* out, int limit, int winsize);
+        void movingVariance(const float* in, float* out, float* scratch, int limit, int winsize);
 
 
         struct FFTPlan {
             virtual ComplexArray getInput() = 0;
             virtual ComplexArray getOutput() = 0;
             virtual ComplexArray npfftfft(const ComplexArray& in) = 0;
+            // Transforms getInput() into getOutput() in place, no copies and no allocations
+            virtual void execute() = 0;
             virtual ~FFTPlan() {
 
             }
         };
 
+        // FFTW plans are shared process wide per (size, direction). A new size gets an estimated plan right
+        // away and a measured one is built in the background, wisdom makes the measured plan instant next time.
         Arg<FFTPlan> allocateFFTWPlan(bool backward, int buckets);
 
+        enum FFTPlanRigor {
+            FFT_PLAN_ESTIMATE,
+            FFT_PLAN_MEASURE,
+            FFT_PLAN_PATIENT
+        };
+
+        // Loads the wisdom file and sets how hard background planning tries. Without it only estimated plans are used.
+        void initFFTPlanCache(const std::string& wisdomPath, FFTPlanRigor rigor);
+
+        // The FFTW planner isn't thread safe, anything creating or destroying FFTW plans must hold this
+        std::mutex& fftwPlannerMutex();
+
+        struct FFTStats {
+            int size;
+            bool backward;
+            bool measured;      // running on a measured plan rather than an estimated one
+            uint64_t count;
+            uint64_t totalNs;
+        };
+
+        // Execution time per plan size since startup
+        std::vector<FFTStats> getFFTStats();
+        uint64_t getFFTTotalTimeNs();
+
         void npfftfft(const ComplexArray& in, const Arg<FFTPlan>& plan);
         std::string ftos(float x);
         std::string sampleArr(const FloatArray& x);
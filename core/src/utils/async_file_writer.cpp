@@ -0,0 +1,301 @@
+#include "async_file_writer.h"
+#include <utils/flog.h>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <stdlib.h>
+#endif
+
+#ifdef _WIN32
+#define ALIGNED_ALLOC(size) _aligned_malloc(size, AsyncFileWriter::ALIGNMENT)
+#define ALIGNED_FREE(ptr) _aligned_free(ptr)
+#else
+static void* alignedAlloc(size_t size) {
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, AsyncFileWriter::ALIGNMENT, size)) { return NULL; }
+    return ptr;
+}
+#define ALIGNED_ALLOC(size) alignedAlloc(size)
+#define ALIGNED_FREE(ptr) free(ptr)
+#endif
+
+AsyncFileWriter::~AsyncFileWriter() {
+    close();
+}
+
+void AsyncFileWriter::setBuffering(size_t blockSize, int blockCount) {
+    this->blockSize = std::max<size_t>(ALIGNMENT, (blockSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+    this->blockCount = std::max<int>(2, blockCount);
+}
+
+void AsyncFileWriter::setDirectIO(bool enabled) {
+    directIO = enabled;
+}
+
+bool AsyncFileWriter::open(std::string path) {
+    if (isOpen()) { close(); }
+    this->path = path;
+
+    // Open the file twice, the second handle takes the unaligned header patches
+#ifdef _WIN32
+    fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+    if (fd < 0) { return false; }
+    patchFd = _open(path.c_str(), _O_WRONLY | _O_BINARY);
+    direct = false;
+#else
+    fd = -1;
+    direct = false;
+#ifdef O_DIRECT
+    if (directIO) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        direct = (fd >= 0);
+        if (!direct) { flog::warn("[AsyncFileWriter] O_DIRECT not supported for {}, using buffered writes", path); }
+    }
+#endif
+    if (fd < 0) { fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644); }
+    if (fd < 0) { return false; }
+    patchFd = ::open(path.c_str(), O_WRONLY);
+#endif
+    if (patchFd < 0) {
+        close();
+        return false;
+    }
+
+    // Allocate the whole pool up front, nothing is allocated while writing
+    for (int i = 0; i < blockCount; i++) {
+        uint8_t* block = (uint8_t*)ALIGNED_ALLOC(blockSize);
+        if (!block) {
+            flog::error("[AsyncFileWriter] Could not allocate a {} byte block", (uint64_t)blockSize);
+            close();
+            return false;
+        }
+        // Touch every page now rather than on the DSP thread during the first seconds of writing
+        memset(block, 0, blockSize);
+        blocks.push_back(block);
+        freeList.push_back(block);
+    }
+    current = { freeList.back(), 0 };
+    freeList.pop_back();
+
+    // Reset stats
+    fileOffset = 0;
+    writing = 0;
+    size = 0;
+    overruns = 0;
+    droppedBytes = 0;
+    peakQueued = 0;
+    maxWriteMillis = 0.0;
+    error = false;
+
+    stopWorker = false;
+    workerThread = std::thread(&AsyncFileWriter::worker, this);
+    return true;
+}
+
+bool AsyncFileWriter::isOpen() {
+    return fd >= 0;
+}
+
+void AsyncFileWriter::close() {
+    if (!isOpen()) {
+        freeBlocks();
+        return;
+    }
+
+    // Hand the partial block to the worker and let it drain the queue
+    if (workerThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            if (current.data && current.used) {
+                queue.push_back(current);
+                current = { NULL, 0 };
+            }
+            stopWorker = true;
+        }
+        queueCV.notify_all();
+        workerThread.join();
+    }
+
+    // The last block was padded to the alignment, cut the file back to what was written
+    if (direct && !error) {
+#ifndef _WIN32
+        if (ftruncate(patchFd, size) < 0) {
+            flog::error("[AsyncFileWriter] Could not truncate {}", path);
+            error = true;
+        }
+#endif
+    }
+
+#ifdef _WIN32
+    if (patchFd >= 0) { _close(patchFd); }
+    _close(fd);
+#else
+    if (patchFd >= 0) { ::close(patchFd); }
+    ::close(fd);
+#endif
+    fd = -1;
+    patchFd = -1;
+    freeBlocks();
+}
+
+bool AsyncFileWriter::write(const void* data, size_t len) {
+    return write(data, len, blocking);
+}
+
+bool AsyncFileWriter::writeAll(const void* data, size_t len) {
+    return write(data, len, true);
+}
+
+bool AsyncFileWriter::write(const void* data, size_t len, bool wait) {
+    const uint8_t* in = (const uint8_t*)data;
+    std::unique_lock<std::mutex> lck(mtx);
+    if (!isOpen()) { return false; }
+
+    // Waiting: copy whatever fits and wait for the worker to free more, however large the write
+    if (wait) {
+        while (len) {
+            freeCV.wait(lck, [&] { return getRoom() || error; });
+            if (error) {
+                overruns++;
+                droppedBytes += len;
+                return false;
+            }
+            size_t n = std::min<size_t>(len, getRoom());
+            append(in, n);
+            in += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // Never cut the data, drop all of it if the pool can't take it
+    if (len > getRoom()) {
+        overruns++;
+        droppedBytes += len;
+        return false;
+    }
+    append(in, len);
+    return true;
+}
+
+size_t AsyncFileWriter::getRoom() {
+    return (current.data ? blockSize - current.used : 0) + freeList.size() * blockSize;
+}
+
+void AsyncFileWriter::append(const uint8_t* in, size_t len) {
+    while (len) {
+        // The next block is only taken when there is data for it, the pool may be empty until then
+        if (!current.data) {
+            current = { freeList.back(), 0 };
+            freeList.pop_back();
+        }
+        size_t n = std::min<size_t>(len, blockSize - current.used);
+        memcpy(&current.data[current.used], in, n);
+        current.used += n;
+        in += n;
+        len -= n;
+        size += n;
+        if (current.used < blockSize) { break; }
+
+        // Block full, queue it
+        queue.push_back(current);
+        int queued = queue.size() + writing;
+        if (queued > peakQueued) { peakQueued = queued; }
+        current = { NULL, 0 };
+        queueCV.notify_one();
+    }
+}
+
+bool AsyncFileWriter::patch(uint64_t offset, const void* data, size_t len) {
+    if (!isOpen()) { return false; }
+    if (offset + len > size) { return false; }
+
+    std::unique_lock<std::mutex> lck(mtx);
+
+    // The part still in the block being filled is patched in memory
+    const uint8_t* in = (const uint8_t*)data;
+    uint64_t currentStart = size - current.used;
+    if (current.data && offset + len > currentStart) {
+        size_t skip = (offset < currentStart) ? (currentStart - offset) : 0;
+        memcpy(&current.data[offset + skip - currentStart], &in[skip], len - skip);
+        len = skip;
+    }
+    if (!len) { return true; }
+
+    // The rest was already handed to the worker, wait for it to be on disk and patch the file
+    freeCV.wait(lck, [=] { return queue.empty() && !writing; });
+    return writeRaw(patchFd, offset, in, len);
+}
+
+int AsyncFileWriter::getQueuedBlocks() {
+    std::lock_guard<std::mutex> lck(mtx);
+    return queue.size() + writing;
+}
+
+void AsyncFileWriter::worker() {
+    while (true) {
+        Block block;
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            queueCV.wait(lck, [=] { return !queue.empty() || stopWorker; });
+            if (queue.empty()) { return; }
+            block = queue.front();
+            queue.pop_front();
+            writing++;
+        }
+
+        // O_DIRECT only takes whole aligned blocks, the tail gets padded and truncated on close
+        size_t len = block.used;
+        if (direct && (len % ALIGNMENT)) {
+            size_t padded = (len + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+            memset(&block.data[len], 0, padded - len);
+            len = padded;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (!error && !writeRaw(fd, fileOffset, block.data, len)) {
+            flog::error("[AsyncFileWriter] Write to {} failed at offset {}", path, fileOffset);
+            error = true;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (ms > maxWriteMillis) { maxWriteMillis = ms; }
+        fileOffset += block.used;
+
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            freeList.push_back(block.data);
+            writing--;
+        }
+        freeCV.notify_all();
+    }
+}
+
+bool AsyncFileWriter::writeRaw(int fd, uint64_t offset, const uint8_t* data, size_t len) {
+    while (len) {
+#ifdef _WIN32
+        if (_lseeki64(fd, offset, SEEK_SET) < 0) { return false; }
+        int ret = _write(fd, data, (unsigned int)std::min<size_t>(len, 1 << 30));
+#else
+        ssize_t ret = pwrite(fd, data, len, offset);
+#endif
+        if (ret <= 0) { return false; }
+        data += ret;
+        offset += ret;
+        len -= ret;
+    }
+    return true;
+}
+
+void AsyncFileWriter::freeBlocks() {
+    for (auto& block : blocks) { ALIGNED_FREE(block); }
+    blocks.clear();
+    freeList.clear();
+    queue.clear();
+    current = { NULL, 0 };
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <stdint.h>
+
+// Write-behind file writer. Data is copied into a fixed pool of large aligned blocks and a dedicated thread
+// writes full blocks to disk, so the caller never waits on the disk. When every block is waiting to be
+// written the data is dropped and counted as an overrun instead of blocking the caller.
+class AsyncFileWriter {
+public:
+    // Block sizes and file offsets are multiples of this, as required by O_DIRECT
+    static constexpr size_t ALIGNMENT = 4096;
+
+    AsyncFileWriter() {}
+    ~AsyncFileWriter();
+
+    // Pool used by the next open(). blockSize is rounded up to ALIGNMENT.
+    void setBuffering(size_t blockSize, int blockCount);
+
+    // Direct I/O bypasses the page cache for the bulk writes, only used where the OS supports it
+    void setDirectIO(bool enabled);
+
+    // Wait for the disk instead of dropping when the pool is full, for writers that aren't real time.
+    // Writes larger than the pool are then copied in as the disk frees blocks.
+    void setBlocking(bool enabled) { blocking = enabled; }
+
+    bool open(std::string path);
+    bool isOpen();
+
+    // Writes the remaining data, truncates the file to its real length and closes it
+    void close();
+
+    // Queues len bytes at the end of the file. All or nothing: returns false and counts an overrun
+    // when the pool can't hold all of it, so records written by the caller are never cut.
+    bool write(const void* data, size_t len);
+
+    // Like write() in blocking mode whatever the setting, for data the file can't do without
+    bool writeAll(const void* data, size_t len);
+
+    // Overwrites already queued bytes, for headers. Waits for everything queued so far to be on disk.
+    bool patch(uint64_t offset, const void* data, size_t len);
+
+    // Bytes accepted by write(), whether on disk yet or not
+    uint64_t getSize() { return size; }
+
+    uint64_t getOverruns() { return overruns; }
+    uint64_t getDroppedBytes() { return droppedBytes; }
+
+    // Blocks waiting for the disk, now and at most since open()
+    int getQueuedBlocks();
+    int getPeakQueuedBlocks() { return peakQueued; }
+    int getBlockCount() { return blockCount; }
+
+    // Longest single block write since open(), a measure of the disk hiccups the pool had to absorb
+    double getMaxWriteMillis() { return maxWriteMillis; }
+
+    // Set when the disk refused a write, the file is incomplete from that point
+    bool hasError() { return error; }
+
+private:
+    struct Block {
+        uint8_t* data;
+        size_t used;
+    };
+
+    bool write(const void* data, size_t len, bool wait);
+    size_t getRoom();
+    void append(const uint8_t* in, size_t len);
+    void worker();
+    bool writeRaw(int fd, uint64_t offset, const uint8_t* data, size_t len);
+    void freeBlocks();
+
+    size_t blockSize = 4 * 1024 * 1024;
+    int blockCount = 8;
+    bool directIO = false;
+    bool blocking = false;
+
+    std::string path;
+    int fd = -1;            // bulk writes, O_DIRECT when enabled
+    int patchFd = -1;       // buffered, for unaligned header patches
+    bool direct = false;    // O_DIRECT actually in use
+
+    std::vector<uint8_t*> blocks;
+    std::vector<uint8_t*> freeList;
+    std::deque<Block> queue;
+    Block current = { NULL, 0 };
+    uint64_t fileOffset = 0;    // where the worker writes the next block
+    int writing = 0;            // blocks taken off the queue but not written yet
+
+    std::mutex mtx;
+    std::condition_variable queueCV;
+    std::condition_variable freeCV;
+    std::thread workerThread;
+    bool stopWorker = false;
+
+    std::atomic<uint64_t> size = 0;
+    std::atomic<uint64_t> overruns = 0;
+    std::atomic<uint64_t> droppedBytes = 0;
+    std::atomic<int> peakQueued = 0;
+    std::atomic<double> maxWriteMillis = 0.0;
+    std::atomic<bool> error = false;
+};
@@ -3,6 +3,7 @@
 #include <core.h>
 #include "cty.h"
 #include <fstream>
+#include <algorithm>
 #include <utils/strings.h>
 
 namespace utils {
@@ -207,7 +208,20 @@ namespace utils {
         file.close();
     }
 
-    CTY::Callsign CTY::findCallsign(const std::string& callsign) const {
+    // A matching prefix takes over if it is at least as long as the best one so far, the DXCC name also
+    // follows later shorter matches unless they come from a regional sub-entity
+    static void applyPrefixMatch(CTY::Callsign& rv, const CTY::Callsign& prefix, const CTY::DXCC& dxcc1) {
+        if (prefix.value.length() >= rv.value.length()) {
+            rv = prefix;
+            rv.ll = dxcc1.ll;
+            rv.continent = dxcc1.continent;
+        }
+        if (rv.dxccname.empty() || !isSomeWeirdName(dxcc1.name)) {
+            rv.dxccname = dxcc1.name;
+        }
+    }
+
+    CTY::Callsign CTY::findCallsignScan(const std::string& callsign) const {
         bool found = false;
         CTY::Callsign rv;
         for(auto & dxcc1 : dxcc) {
@@ -230,16 +244,107 @@ namespace utils {
             for(auto &prefix: dxcc1.prefixes) {
                 if (!prefix.exact) {
                     if (callsign.find(prefix.value) == 0)  {    // last one is more important
-                        if (prefix.value.length() >= rv.value.length()) {
-                            rv = prefix;
-                            rv.ll = dxcc1.ll;
-                            rv.continent = dxcc1.continent;
-                        }
-                        if (rv.dxccname.empty() || !isSomeWeirdName(dxcc1.name)) {
-                            rv.dxccname = dxcc1.name;
-                        }
+                        applyPrefixMatch(rv, prefix, dxcc1);
+                    }
+                }
+            }
+        }
+        return rv;
+    }
+
+    void CTY::buildIndex() {
+        trie.clear();
+        trie.emplace_back();
+        exactCalls.clear();
+        int order = 0;
+        for (int d = 0; d < dxcc.size(); d++) {
+            for (int p = 0; p < dxcc[d].prefixes.size(); p++) {
+                PrefixRef ref = { order++, d, p };
+                auto& value = dxcc[d].prefixes[p].value;
+                if (dxcc[d].prefixes[p].exact) {
+                    exactCalls[value] = ref;    // last one wins, as in the scan
+                    continue;
+                }
+                int node = 0;
+                for (char c : value) {
+                    auto& children = trie[node].children;
+                    auto it = std::find_if(children.begin(), children.end(), [c](const std::pair<char, int>& ch) { return ch.first == c; });
+                    if (it != children.end()) {
+                        node = it->second;
+                        continue;
                     }
+                    int next = trie.size();
+                    children.emplace_back(c, next);
+                    trie.emplace_back();
+                    node = next;
                 }
+                trie[node].prefixes.push_back(ref);
+            }
+        }
+        indexed = true;
+
+        std::lock_guard<std::mutex> lck(cacheMtx);
+        cache.clear();
+        cacheIndex.clear();
+    }
+
+    CTY::Callsign CTY::makeResult(const PrefixRef& ref) const {
+        auto& dxcc1 = dxcc[ref.dxcc];
+        CTY::Callsign rv = dxcc1.prefixes[ref.prefix];
+        rv.ll = dxcc1.ll;
+        rv.continent = dxcc1.continent;
+        rv.dxccname = dxcc1.name;
+        return rv;
+    }
+
+    CTY::Callsign CTY::findCallsignIndexed(const std::string& callsign) const {
+        auto exact = exactCalls.find(callsign);
+        if (exact != exactCalls.end()) {
+            return makeResult(exact->second);
+        }
+
+        // Every prefix of the callsign is one node on the way down, replay their matches in scan order
+        std::vector<PrefixRef> matches;
+        int node = 0;
+        for (char c : callsign) {
+            auto& children = trie[node].children;
+            auto it = std::find_if(children.begin(), children.end(), [c](const std::pair<char, int>& ch) { return ch.first == c; });
+            if (it == children.end()) { break; }
+            node = it->second;
+            matches.insert(matches.end(), trie[node].prefixes.begin(), trie[node].prefixes.end());
+        }
+        std::sort(matches.begin(), matches.end(), [](const PrefixRef& a, const PrefixRef& b) { return a.order < b.order; });
+
+        CTY::Callsign rv;
+        for (auto& m : matches) {
+            applyPrefixMatch(rv, dxcc[m.dxcc].prefixes[m.prefix], dxcc[m.dxcc]);
+        }
+        return rv;
+    }
+
+    CTY::Callsign CTY::findCallsign(const std::string& callsign) const {
+        if (!indexed) {
+            return findCallsignScan(callsign);
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(cacheMtx);
+            auto it = cacheIndex.find(callsign);
+            if (it != cacheIndex.end()) {
+                cache.splice(cache.begin(), cache, it->second);
+                return it->second->second;
+            }
+        }
+
+        CTY::Callsign rv = findCallsignIndexed(callsign);
+
+        std::lock_guard<std::mutex> lck(cacheMtx);
+        if (cacheIndex.find(callsign) == cacheIndex.end()) {
+            cache.emplace_front(callsign, rv);
+            cacheIndex[callsign] = cache.begin();
+            if (cache.size() > LOOKUP_CACHE_SIZE) {
+                cacheIndex.erase(cache.back().first);
+                cache.pop_back();
             }
         }
         return rv;
@@ -257,7 +362,7 @@ namespace utils {
         loadCTY((resDir + "/cty/SA_cty.dat").c_str(), ", SA", globalCty);
         loadCTY((resDir + "/cty/VK_cty.dat").c_str(), ", VK", globalCty);
         loadCTY((resDir + "/cty/cty_rus.dat").c_str(), ", RUS", globalCty);
-
+        globalCty.buildIndex();
     }
 
 
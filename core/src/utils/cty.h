@@ -2,6 +2,9 @@
 
 #include <string>
 #include <vector>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <module.h>
 
 namespace utils {
@@ -29,7 +32,7 @@ namespace utils {
 
         struct Callsign {
             bool exact = false;
-            LatLng ll;
+            LatLng ll = LatLng::invalid();
             std::string continent;
             std::string value;
             std::string dxccname;
@@ -46,7 +49,40 @@ namespace utils {
 
         std::vector<DXCC> dxcc;
 
+        // Compiles dxcc into the lookup index, again after every change to dxcc
+        void buildIndex();
+
+        // Uses the index once built, otherwise scans every prefix. Recent lookups are cached.
         Callsign findCallsign(const std::string& callsign) const;
+
+        // Reference lookup going through every prefix, gives the same result as the index
+        Callsign findCallsignScan(const std::string& callsign) const;
+
+        static const size_t LOOKUP_CACHE_SIZE = 4096;
+
+    private:
+        struct PrefixRef {
+            int order;      // position in the scan, later ones win
+            int dxcc;
+            int prefix;
+        };
+
+        struct TrieNode {
+            std::vector<std::pair<char, int>> children;
+            std::vector<PrefixRef> prefixes;    // the non-exact prefixes ending here, in scan order
+        };
+
+        Callsign findCallsignIndexed(const std::string& callsign) const;
+        Callsign makeResult(const PrefixRef& ref) const;
+
+        bool indexed = false;
+        std::vector<TrieNode> trie;
+        std::unordered_map<std::string, PrefixRef> exactCalls;
+
+        // Most recent lookup first
+        mutable std::mutex cacheMtx;
+        mutable std::list<std::pair<std::string, Callsign>> cache;
+        mutable std::unordered_map<std::string, std::list<std::pair<std::string, Callsign>>::iterator> cacheIndex;
     };
 
     SDRPP_EXPORT LatLng gridToLatLng(std::string locatorString);
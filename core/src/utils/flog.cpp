@@ -1,8 +1,17 @@
 #include "flog.h"
 #include <mutex>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
 #include <string.h>
 #include <inttypes.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -28,6 +37,7 @@ namespace flog {
 #else
         false;
 #endif
+    static bool consoleToStderr = false;
 
     void setMemoryLogEnabled(bool enabled) {
         std::lock_guard<std::mutex> lck(outMtx);
@@ -42,6 +52,11 @@ namespace flog {
         return memoryLogEnabled;
     }
 
+    void setConsoleToStderr(bool enabled) {
+        std::lock_guard<std::mutex> lck(outMtx);
+        consoleToStderr = enabled;
+    }
+
     const char* TYPE_STR[_TYPE_COUNT] = {
         "DEBUG",
         "INFO",
@@ -161,27 +176,17 @@ namespace flog {
         return out;
     }
 
-    void __log__(Type type, const char* fmt, const std::vector<std::string>& args) {
-        std::string out = formatString(fmt, args);
-        
+    // Console and adhoc file output of one entry, outMtx held
+    static void writeEntry(const LogRec& rec, FILE* adhocFile) {
         // Get output stream depending on type
-        FILE* outStream = (type == TYPE_ERROR) ? stderr : stdout;
-
-        // Get time
-        auto now = std::chrono::system_clock::now();
-        auto nowt = std::chrono::system_clock::to_time_t(now);
-        long long msec = std::chrono::time_point_cast<std::chrono::milliseconds>(now).time_since_epoch().count();
-
-        // Write to output
-        {
-            std::lock_guard<std::mutex> lck(outMtx);
-            auto nowc = std::localtime(&nowt); // This is now threadsafe
+        FILE* outStream = (rec.typ == TYPE_ERROR || consoleToStderr) ? stderr : stdout;
+        time_t nowt = rec.ts / 1000;
+        auto nowc = std::localtime(&nowt); // Only ever called with outMtx held
 #if defined(_WIN32)
-            // Get output handle and return if invalid
-            int wOutStream = (type == TYPE_ERROR) ? STD_ERROR_HANDLE  : STD_OUTPUT_HANDLE;
-            HANDLE conHndl = GetStdHandle(wOutStream);
-            if (!conHndl || conHndl == INVALID_HANDLE_VALUE) { return; }
-
+        // Get output handle and skip the console if invalid
+        int wOutStream = (rec.typ == TYPE_ERROR || consoleToStderr) ? STD_ERROR_HANDLE  : STD_OUTPUT_HANDLE;
+        HANDLE conHndl = GetStdHandle(wOutStream);
+        if (conHndl && conHndl != INVALID_HANDLE_VALUE) {
             static CONSOLE_SCREEN_BUFFER_INFO console_info { 0 };
             static WORD bg = 0;
             if (console_info.wAttributes == 0) {
@@ -189,53 +194,470 @@ namespace flog {
                 bg = (console_info.wAttributes & ~7);
             }
 
-
             // Print beginning of log line
             SetConsoleTextAttribute(conHndl, bg | COLOR_WHITE);
-            fprintf(outStream, "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [", nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, 0);
+            fprintf(outStream, "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [", nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, (int)(rec.ts % 1000));
 
-            // Switch color to the log color, print log type and 
-            SetConsoleTextAttribute(conHndl, bg | TYPE_COLORS[type]);
-            fputs(TYPE_STR[type], outStream);
-            
+            // Switch color to the log color, print log type and
+            SetConsoleTextAttribute(conHndl, bg | TYPE_COLORS[rec.typ]);
+            fputs(TYPE_STR[rec.typ], outStream);
 
             // Switch back to default color and print rest of log string
             SetConsoleTextAttribute(conHndl, bg | COLOR_WHITE);
-            fprintf(outStream, "] %s\n", out.c_str());
-            fflush(outStream);
+            fprintf(outStream, "] %s\n", rec.message.c_str());
+        }
 #elif defined(__ANDROID__)
-            // Print format string
-            __android_log_print(ANDROID_LOG_WARN, FLOG_ANDROID_TAG, "%s\n", out.c_str());
-//            __android_log_print(TYPE_PRIORITIES[type], FLOG_ANDROID_TAG, COLOR_WHITE "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s%s" COLOR_WHITE "] %s\n",
-//                    nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, 0, TYPE_COLORS[type], TYPE_STR[type], out.c_str());
+        // Print format string
+        __android_log_print(ANDROID_LOG_WARN, FLOG_ANDROID_TAG, "%s\n", rec.message.c_str());
 #else
-            // Print format string
-            fprintf(outStream, COLOR_WHITE "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s%s" COLOR_WHITE "] %s\n",
-                    nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, (int)(msec % 1000), TYPE_COLORS[type], TYPE_STR[type], out.c_str());
-            fflush(outStream);
+        // Print format string
+        fprintf(outStream, COLOR_WHITE "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s%s" COLOR_WHITE "] %s\n",
+                nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, (int)(rec.ts % 1000), TYPE_COLORS[rec.typ], TYPE_STR[rec.typ], rec.message.c_str());
 #endif
+        if (adhocFile) {
+            fprintf(adhocFile, "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s" "] %s\n",
+                nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, (int)(rec.ts % 1000), TYPE_STR[rec.typ], rec.message.c_str());
+        }
+    }
+
+    static FILE* openAdhocFile() {
+        if (performAdhocFileLogging == -1) {
+            FILE *f = fopen(adhocLogFileName,"rt");
+            if (f) {
+                fclose(f);
+                performAdhocFileLogging = 1;
+            }
+            else {
+                performAdhocFileLogging = 0;
+            }
+        }
+        return (performAdhocFileLogging == 1) ? fopen(adhocLogFileName,"at") : NULL;
+    }
+
+    // Recent entries for the debug server, packed back to back in a fixed buffer, the oldest overwritten
+    class LogRing {
+    public:
+        void push(const LogRec& rec) {
+            std::lock_guard<std::mutex> lck(mtx);
+            Header hdr;
+            hdr.length = std::min<size_t>(rec.message.size(), MAX_MESSAGE);
+            hdr.size = (sizeof(Header) + hdr.length + 7) & ~7;
+            hdr.ts = rec.ts;
+            hdr.seq = rec.seq;
+            hdr.type = rec.typ;
+            while (used + hdr.size > RING_SIZE) {
+                Header old;
+                copyOut(head, &old, sizeof(old));
+                head = (head + old.size) % RING_SIZE;
+                used -= old.size;
+            }
+            copyIn(tail, &hdr, sizeof(hdr));
+            copyIn((tail + sizeof(hdr)) % RING_SIZE, rec.message.data(), hdr.length);
+            tail = (tail + hdr.size) % RING_SIZE;
+            used += hdr.size;
+        }
+
+        uint64_t read(uint64_t afterSeq, std::vector<LogRec>& out, int maxCount) {
+            std::lock_guard<std::mutex> lck(mtx);
+            // Newest first to find where to start, then oldest first into out
+            std::vector<size_t> positions;
+            for (size_t pos = head, left = used; left > 0;) {
+                Header hdr;
+                copyOut(pos, &hdr, sizeof(hdr));
+                if (hdr.seq > afterSeq) { positions.push_back(pos); }
+                pos = (pos + hdr.size) % RING_SIZE;
+                left -= hdr.size;
+            }
+            size_t first = positions.size() > (size_t)maxCount ? positions.size() - maxCount : 0;
+            uint64_t last = afterSeq;
+            for (size_t i = first; i < positions.size(); i++) {
+                Header hdr;
+                copyOut(positions[i], &hdr, sizeof(hdr));
+                LogRec rec;
+                rec.ts = hdr.ts;
+                rec.typ = (Type)hdr.type;
+                rec.seq = hdr.seq;
+                rec.message.resize(hdr.length);
+                copyOut((positions[i] + sizeof(hdr)) % RING_SIZE, rec.message.data(), hdr.length);
+                out.push_back(std::move(rec));
+                last = hdr.seq;
+            }
+            return last;
+        }
 
-            if (performAdhocFileLogging == -1) {
-                FILE *f = fopen(adhocLogFileName,"rt");
-                if (f) {
-                    fclose(f);
-                    performAdhocFileLogging = 1;
+        std::mutex mtx;
+
+    private:
+        struct Header {
+            uint32_t size;      // whole record, 8 byte aligned
+            uint32_t length;    // message bytes
+            int64_t ts;
+            uint64_t seq;
+            int32_t type;
+            uint32_t reserved;
+        };
+
+        void copyIn(size_t pos, const void* data, size_t len) {
+            size_t first = std::min(len, RING_SIZE - pos);
+            memcpy(&buf[pos], data, first);
+            memcpy(&buf[0], (const uint8_t*)data + first, len - first);
+        }
+
+        void copyOut(size_t pos, void* data, size_t len) {
+            size_t first = std::min(len, RING_SIZE - pos);
+            memcpy(data, &buf[pos], first);
+            memcpy((uint8_t*)data + first, &buf[0], len - first);
+        }
+
+        static constexpr size_t RING_SIZE = 256 * 1024;
+        static constexpr size_t MAX_MESSAGE = 4096;
+        uint8_t buf[RING_SIZE];
+        size_t head = 0;
+        size_t tail = 0;
+        size_t used = 0;
+    };
+
+    // Messages of one thread on their way to the flusher, single producer, single consumer
+    struct ThreadQueue {
+        static constexpr uint64_t CAPACITY = 1024;
+        LogRec slots[CAPACITY];
+        std::atomic<uint64_t> head{ 0 };
+        std::atomic<uint64_t> tail{ 0 };
+        std::atomic<bool> closed{ false };      // thread is gone, free once drained
+    };
+
+    class LogBackend {
+    public:
+        void push(LogRec&& rec) {
+            if (!ensureRunning()) {
+                writeNow(rec);
+                return;
+            }
+            ThreadQueue* q = localQueue();
+            if (!q) {
+                writeNow(rec);
+                return;
+            }
+            uint64_t tail = q->tail.load(std::memory_order_relaxed);
+            while (tail - q->head.load(std::memory_order_acquire) >= ThreadQueue::CAPACITY) {
+                // Errors wait for the flusher, anything else is counted and dropped
+                if (rec.typ != TYPE_ERROR) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                if (state.load(std::memory_order_acquire) != RUNNING) {
+                    writeNow(rec);
+                    return;
+                }
+                wake();
+                std::this_thread::yield();
+            }
+            rec.seq = nextSeq.fetch_add(1, std::memory_order_relaxed);
+            bool urgent = rec.typ == TYPE_ERROR || tail - q->head.load(std::memory_order_relaxed) >= ThreadQueue::CAPACITY / 2;
+            q->slots[tail % ThreadQueue::CAPACITY] = std::move(rec);
+            q->tail.store(tail + 1, std::memory_order_release);
+            if (urgent) { wake(); }
+        }
+
+        void flush() {
+            if (state.load(std::memory_order_acquire) != RUNNING) { return; }
+            std::unique_lock<std::mutex> lck(wakeMtx);
+            // A pass already running may have missed what was logged just now
+            uint64_t target = passesStarted + 1;
+            wakeFlag = true;
+            wakeCnd.notify_one();
+            doneCnd.wait(lck, [&] { return passesDone >= target || stopFlag; });
+        }
+
+        uint64_t getDropped() {
+            return dropped.load(std::memory_order_relaxed);
+        }
+
+        LogRing ring;
+
+        static void shutdown();
+        static void afterFork();
+
+    private:
+        enum { STOPPED, RUNNING, SHUTDOWN };
+
+        // Writes synchronously once the flusher is gone, at exit
+        void writeNow(LogRec& rec) {
+            std::lock_guard<std::mutex> lck(outMtx);
+            FILE* adhocFile = openAdhocFile();
+            emit(rec, adhocFile);
+            fflush(stdout);
+            fflush(stderr);
+            if (adhocFile) { fclose(adhocFile); }
+        }
+
+        bool ensureRunning() {
+            int s = state.load(std::memory_order_acquire);
+            if (s != STOPPED) { return s == RUNNING; }
+            std::lock_guard<std::mutex> lck(startMtx);
+            if (state.load(std::memory_order_relaxed) == STOPPED) {
+                stopFlag = false;
+                flusher = new std::thread(&LogBackend::worker, this);
+                if (!hooksInstalled) {
+                    atexit(&LogBackend::shutdown);
+#ifndef _WIN32
+                    pthread_atfork(NULL, NULL, &LogBackend::afterFork);
+#endif
+                    hooksInstalled = true;
+                }
+                state.store(RUNNING, std::memory_order_release);
+            }
+            return state.load(std::memory_order_relaxed) == RUNNING;
+        }
+
+        // NULL once this thread's queue was handed to the flusher for deletion, logging from thread_local or
+        // static destructors that run after that point
+        ThreadQueue* localQueue() {
+            thread_local bool gone = false;
+            struct Holder {
+                ThreadQueue* q = NULL;
+                ~Holder() {
+                    gone = true;
+                    if (q) { q->closed.store(true, std::memory_order_release); }
+                    q = NULL;
+                }
+            };
+            if (gone) { return NULL; }
+            thread_local Holder holder;
+            if (!holder.q) {
+                holder.q = new ThreadQueue;
+                std::lock_guard<std::mutex> lck(queuesMtx);
+                queues.push_back(holder.q);
+            }
+            return holder.q;
+        }
+
+        void wake() {
+            // One wakeup per pass however many threads ask
+            if (wakePending.exchange(true, std::memory_order_acq_rel)) { return; }
+            {
+                std::lock_guard<std::mutex> lck(wakeMtx);
+                wakeFlag = true;
+            }
+            wakeCnd.notify_one();
+        }
+
+        void worker() {
+            std::vector<LogRec> batch;
+            while (true) {
+                uint64_t pass;
+                bool stop;
+                {
+                    std::unique_lock<std::mutex> lck(wakeMtx);
+                    wakeCnd.wait_for(lck, FLUSH_INTERVAL, [this] { return wakeFlag || stopFlag; });
+                    wakeFlag = false;
+                    wakePending.store(false, std::memory_order_release);
+                    pass = ++passesStarted;
+                    stop = stopFlag;
+                }
+
+                drain(batch);
+                write(batch);
+                batch.clear();
+
+                {
+                    std::lock_guard<std::mutex> lck(wakeMtx);
+                    passesDone = pass;
+                }
+                doneCnd.notify_all();
+                if (stop) { return; }
+            }
+        }
+
+        void drain(std::vector<LogRec>& batch) {
+            std::lock_guard<std::mutex> lck(queuesMtx);
+            for (auto it = queues.begin(); it != queues.end();) {
+                ThreadQueue* q = *it;
+                bool closed = q->closed.load(std::memory_order_acquire);
+                uint64_t head = q->head.load(std::memory_order_relaxed);
+                uint64_t tail = q->tail.load(std::memory_order_acquire);
+                for (; head != tail; head++) {
+                    batch.push_back(std::move(q->slots[head % ThreadQueue::CAPACITY]));
+                }
+                q->head.store(head, std::memory_order_release);
+                if (closed) {
+                    delete q;
+                    it = queues.erase(it);
                 }
                 else {
-                    performAdhocFileLogging = 0;
+                    it++;
                 }
             }
-            if (performAdhocFileLogging == 1) {
-                FILE *f = fopen(adhocLogFileName,"at");
-                fprintf(f, "[%02d/%02d/%02d %02d:%02d:%02d.%03d] [%s" "] %s\n",
-                    nowc->tm_mday, nowc->tm_mon + 1, nowc->tm_year + 1900, nowc->tm_hour, nowc->tm_min, nowc->tm_sec, (int)(msec % 1000), TYPE_STR[type], out.c_str());
-                fflush(f);
-                fclose(f);
+            // Each thread's messages are in order already, this interleaves them
+            std::sort(batch.begin(), batch.end(), [](const LogRec& a, const LogRec& b) { return a.seq < b.seq; });
+        }
+
+        void write(std::vector<LogRec>& batch) {
+            int64_t now = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now()).time_since_epoch().count();
+            std::lock_guard<std::mutex> lck(outMtx);
+            FILE* adhocFile = batch.empty() ? NULL : openAdhocFile();
+
+            uint64_t lost = dropped.load(std::memory_order_relaxed);
+            if (lost != reportedDropped) {
+                LogRec rec{ now, TYPE_WARNING, format("{} log messages dropped, logging thread queue full", lost - reportedDropped) };
+                emit(rec, adhocFile);
+                reportedDropped = lost;
+            }
+
+            for (auto& rec : batch) {
+                // The same message over and over is counted instead of written
+                if (hasLast && rec.typ == last.typ && rec.message == last.message) {
+                    if (repeats++ == 0) { repeatSince = rec.ts; }
+                    continue;
+                }
+                writeRepeats(rec.ts, adhocFile);
+                emit(rec, adhocFile);
+                last.typ = rec.typ;
+                last.message = rec.message;
+                hasLast = true;
+            }
+            if (repeats && now - repeatSince >= 1000) { writeRepeats(now, adhocFile); }
+            writeRateSummary(now / 1000, adhocFile);
+
+            if (!batch.empty()) {
+                fflush(stdout);
+                fflush(stderr);
+            }
+            if (adhocFile) { fclose(adhocFile); }
+        }
+
+        void writeRepeats(int64_t ts, FILE* adhocFile) {
+            if (!repeats) { return; }
+            LogRec rec{ ts, last.typ, format("Last message repeated {} times", repeats) };
+            repeats = 0;
+            emit(rec, adhocFile);
+        }
+
+        // Debug and info lines past the per second limit only go to memory
+        void writeRateSummary(int64_t second, FILE* adhocFile) {
+            if (second == rateSecond) { return; }
+            if (rateSuppressed) {
+                LogRec rec{ rateSecond * 1000 + 999, TYPE_WARNING, format("{} log lines over {} per second not printed", rateSuppressed, MAX_LINES_PER_SECOND) };
+                writeEntry(rec, adhocFile);
+            }
+            rateSecond = second;
+            rateLines = 0;
+            rateSuppressed = 0;
+        }
+
+        void emit(LogRec& rec, FILE* adhocFile) {
+            if (!rec.message.empty() && rec.message.back() == 0) { rec.message.pop_back(); }    // terminator formatString copies
+            rec.seq = ++ringSeq;
+            ring.push(rec);
+            writeRateSummary(rec.ts / 1000, adhocFile);
+            if (rec.typ >= TYPE_WARNING || rateLines++ < MAX_LINES_PER_SECOND) {
+                writeEntry(rec, adhocFile);
+            }
+            else {
+                rateSuppressed++;
             }
             if (memoryLogEnabled) {
-                logRecords.emplace_back(LogRec{msec, type, out});
+                logRecords.push_back(rec);
             }
         }
+
+        static constexpr std::chrono::milliseconds FLUSH_INTERVAL{ 20 };
+        static constexpr int MAX_LINES_PER_SECOND = 1000;
+
+        std::atomic<int> state{ STOPPED };
+        std::mutex startMtx;
+        std::thread* flusher = NULL;
+        bool hooksInstalled = false;
+
+        std::mutex queuesMtx;
+        std::vector<ThreadQueue*> queues;
+        std::atomic<uint64_t> nextSeq{ 1 };
+        std::atomic<uint64_t> dropped{ 0 };
+
+        std::mutex wakeMtx;
+        std::condition_variable wakeCnd;
+        std::condition_variable doneCnd;
+        bool wakeFlag = false;
+        std::atomic<bool> wakePending{ false };
+        bool stopFlag = false;
+        uint64_t passesStarted = 0;
+        uint64_t passesDone = 0;
+
+        // Flusher only, or outMtx held
+        uint64_t reportedDropped = 0;
+        uint64_t ringSeq = 0;
+        LogRec last;
+        bool hasLast = false;
+        int repeats = 0;
+        int64_t repeatSince = 0;
+        int64_t rateSecond = 0;
+        int rateLines = 0;
+        int rateSuppressed = 0;
+    };
+
+    // Never destroyed, threads may still log during static destruction
+    static LogBackend& backend() {
+        static LogBackend* instance = new LogBackend;
+        return *instance;
+    }
+
+    void LogBackend::shutdown() {
+        LogBackend& b = backend();
+        {
+            std::lock_guard<std::mutex> lck(b.startMtx);
+            if (b.state.load() != RUNNING) { return; }
+            b.state.store(SHUTDOWN, std::memory_order_release);
+        }
+        {
+            std::lock_guard<std::mutex> lck(b.wakeMtx);
+            b.stopFlag = true;
+        }
+        b.wakeCnd.notify_one();
+        b.flusher->join();
+        delete b.flusher;
+        b.flusher = NULL;
+    }
+
+    // Only the forking thread exists in the child, its locks may have been held by threads that are gone
+    void LogBackend::afterFork() {
+        LogBackend& b = backend();
+        new (&outMtx) std::mutex;
+        new (&b.ring.mtx) std::mutex;
+        new (&b.startMtx) std::mutex;
+        new (&b.queuesMtx) std::mutex;
+        new (&b.wakeMtx) std::mutex;
+        new (&b.wakeCnd) std::condition_variable;
+        new (&b.doneCnd) std::condition_variable;
+        b.flusher = NULL;  // belongs to the parent
+        b.wakeFlag = false;
+        b.wakePending = false;
+        b.passesStarted = b.passesDone = 0;
+        if (b.state.load() == RUNNING) { b.state.store(STOPPED); }
+        // What the parent had queued is the parent's to write
+        for (auto q : b.queues) {
+            q->head.store(q->tail.load());
+        }
+    }
+
+    void __log__(Type type, const char* fmt, const std::vector<std::string>& args) {
+        LogRec rec;
+        rec.message = formatString(fmt, args);
+        if (!rec.message.empty() && rec.message.back() == 0) { rec.message.pop_back(); }    // terminator formatString copies
+        rec.typ = type;
+        rec.ts = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now()).time_since_epoch().count();
+        backend().push(std::move(rec));
+    }
+
+    void flush() {
+        backend().flush();
+    }
+
+    uint64_t getRecent(uint64_t afterSeq, std::vector<LogRec>& out, int maxCount) {
+        return backend().ring.read(afterSeq, out, maxCount);
+    }
+
+    uint64_t getDroppedCount() {
+        return backend().getDropped();
     }
 
     std::string __toString__(bool value) {
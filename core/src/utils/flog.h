@@ -21,6 +21,7 @@ namespace flog {
         int64_t ts;
         Type typ;
         std::string message;
+        uint64_t seq = 0;
     };
 
     extern std::mutex outMtx;
@@ -29,6 +30,20 @@ namespace flog {
     void setMemoryLogEnabled(bool enabled);
     bool isMemoryLogEnabled();
 
+    // Console output of every level goes to stderr, for tools that write their results to stdout
+    void setConsoleToStderr(bool enabled);
+
+    // Log calls only queue the message, a background thread writes it out. Waits until everything
+    // logged so far by any thread is written.
+    void flush();
+
+    // Entries of the in-memory ring after seq, oldest first, at most maxCount of the newest. Returns the
+    // seq to pass next time.
+    uint64_t getRecent(uint64_t afterSeq, std::vector<LogRec>& out, int maxCount = 1000);
+
+    // Messages lost because the queue of the logging thread was full
+    uint64_t getDroppedCount();
+
 
     // IO functions
     void __log__(Type type, const char* fmt, const std::vector<std::string>& args);
@@ -0,0 +1,81 @@
+#include "mapped_file.h"
+#include <utils/flog.h>
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+    LARGE_INTEGER fsize;
+    if (!GetFileSizeEx(file, &fsize) || !fsize.QuadPart) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    ptr = (const uint8_t*)view;
+    length = fsize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !st.st_size) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        flog::error("[MappedFile] Could not map {}", path);
+        return false;
+    }
+    ptr = (const uint8_t*)view;
+    length = st.st_size;
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!ptr) { return; }
+#ifdef _WIN32
+    UnmapViewOfFile(ptr);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    mappingHandle = NULL;
+    fileHandle = NULL;
+#else
+    munmap((void*)ptr, length);
+#endif
+    ptr = NULL;
+    length = 0;
+}
+
+void MappedFile::adviseSequential() {
+#ifndef _WIN32
+    if (ptr) { madvise((void*)ptr, length, MADV_SEQUENTIAL); }
+#endif
+}
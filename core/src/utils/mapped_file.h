@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+
+// Read-only memory mapping of a whole file. Pages are read by the OS on first access, so opening is
+// instant regardless of the file size and any offset can be reached without seeking.
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() { return ptr != NULL; }
+
+    const uint8_t* data() { return ptr; }
+    uint64_t size() { return length; }
+
+    // Hint that the file is about to be read front to back
+    void adviseSequential();
+
+private:
+    const uint8_t* ptr = NULL;
+    uint64_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = NULL;
+    void* mappingHandle = NULL;
+#endif
+};
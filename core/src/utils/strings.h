@@ -173,5 +173,27 @@ namespace percentile {
         return kthSmallest(data, 0, n-1, (int)k);
     }
 
+    // Same on a copy in scratch, which keeps its capacity from call to call
+    template<typename T>
+    T percentile_sampling(const T* arr, int n, double p, std::vector<T>& scratch) {
+        if (n == 0) {
+            return 0;
+        }
+        int targetPoints = 100;
+        if (n > 2 * targetPoints) {
+            float step = (n - 1) / (float)targetPoints;
+            scratch.resize(targetPoints);
+            for(int z=0; z<targetPoints; z++) {
+                scratch[z] = arr[(int)std::floor(step * z)];
+            }
+        }
+        else {
+            scratch.assign(arr, arr + n);
+        }
+        n = scratch.size();
+        double k = (n - 1) * p;
+        return kthSmallest(scratch.data(), 0, n-1, (int)k);
+    }
+
 
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <dsp/buffer/buffer.h>
 #include <dsp/stream.h>
 #include <map>
+#include <utils/flog.h>
 
 namespace wav {
     const char* WAVE_FILE_TYPE          = "WAVE";
@@ -12,6 +13,22 @@ namespace wav {
     const uint32_t FORMAT_HEADER_LEN    = 16;
     const uint16_t SAMPLE_TYPE_PCM      = 1;
 
+    // RIFF and RF64 share one layout. A plain WAV keeps the ds64 chunk as JUNK so it can become RF64 on close.
+    const size_t RIFF_HEADER_SIZE       = 80;
+    const uint32_t DS64_SIZE            = 28;
+
+    // Wave64 chunk GUIDs
+    const uint8_t W64_RIFF_GUID[16]     = { 'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
+    const uint8_t W64_WAVE_GUID[16]     = { 'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+    const uint8_t W64_FMT_GUID[16]      = { 'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+    const uint8_t W64_DATA_GUID[16]     = { 'd', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+    const size_t W64_CHUNK_HEADER_SIZE  = 24;
+    const size_t W64_HEADER_SIZE        = 104;
+
+    // Default write-behind pool, enough for audio. Baseband recordings set a bigger one.
+    const size_t DEFAULT_BLOCK_SIZE     = 256 * 1024;
+    const int DEFAULT_BLOCK_COUNT       = 4;
+
     std::map<SampleType, int> SAMP_BITS = {
         { SAMP_TYPE_UINT8, 8 },
         { SAMP_TYPE_INT16, 16 },
@@ -29,6 +46,7 @@ namespace wav {
         _samplerate = samplerate;
         _format = format;
         _type = type;
+        file.setBuffering(DEFAULT_BLOCK_SIZE, DEFAULT_BLOCK_COUNT);
     }
 
     Writer::~Writer() { close(); }
@@ -36,7 +54,7 @@ namespace wav {
     bool Writer::open(std::string path) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Close previous file
-        if (rw.isOpen()) { close(); }
+        if (file.isOpen()) { close(); }
 
         // Reset work values
         samplesWritten = 0;
@@ -68,35 +86,44 @@ namespace wav {
             break;
         }
 
-        // Open file
-        if (!rw.open(path, WAVE_FILE_TYPE)) { return false; }
+        // Open file and write a placeholder header, the sizes get filled in on close
+        if (!file.open(path)) { return false; }
+        auto header = buildHeader(_format, 0);
+        file.write(header.data(), header.size());
 
-        // Write format chunk
-        rw.beginChunk(FORMAT_MARKER);
-        rw.write((uint8_t*)&hdr, sizeof(FormatHeader));
-        rw.endChunk();
-
-        // Begin data chunk
-        rw.beginChunk(DATA_MARKER);
-        
         return true;
     }
 
     bool Writer::isOpen() {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        return rw.isOpen();
+        return file.isOpen();
     }
 
     void Writer::close() {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do nothing if the file is not open
-        if (!rw.isOpen()) { return; }
+        if (!file.isOpen()) { return; }
 
-        // Finish data chunk
-        rw.endChunk();
+        // Pad the data chunk, RIFF chunks are word aligned and Wave64 chunks 8 byte aligned
+        Format format = _format;
+        size_t headerSize = (format == FORMAT_W64) ? W64_HEADER_SIZE : RIFF_HEADER_SIZE;
+        uint64_t dataBytes = file.getSize() - headerSize;
+        uint64_t padding = (format == FORMAT_W64) ? ((8 - (dataBytes & 7)) & 7) : (dataBytes & 1);
+        if (padding) {
+            uint8_t zeros[8] = { 0 };
+            file.writeAll(zeros, padding);
+        }
 
-        // Close the file
-        rw.close();
+        // Past 4 GB a plain WAV can't hold its sizes, turn its reserved chunk into ds64
+        if (format == FORMAT_WAV && dataBytes + padding + RIFF_HEADER_SIZE - 8 > 0xFFFFFFFF) {
+            flog::warn("WAV recording went past 4 GB, saving it as RF64");
+            format = FORMAT_RF64;
+        }
+
+        // Fill in the sizes and close the file
+        auto header = buildHeader(format, dataBytes);
+        file.patch(0, header.data(), header.size());
+        file.close();
 
         // Free buffers
         if (bufU8) {
@@ -116,7 +143,7 @@ namespace wav {
     void Writer::setChannels(int channels) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (file.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
 
         // Validate channel count
         if (channels < 1) { throw std::runtime_error("Channel count must be greater or equal to 1"); }
@@ -126,7 +153,7 @@ namespace wav {
     void Writer::setSamplerate(uint64_t samplerate) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (file.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
 
         // Validate samplerate
         if (!samplerate) { throw std::runtime_error("Samplerate must be non-zero"); }
@@ -136,48 +163,158 @@ namespace wav {
     void Writer::setFormat(Format format) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (file.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
         _format = format;
     }
 
     void Writer::setSampleType(SampleType type) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
         // Do not allow settings to change while open
-        if (rw.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        if (file.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
         _type = type;
     }
 
+    void Writer::setBuffering(size_t blockSize, int blockCount) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (file.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        file.setBuffering(blockSize, blockCount);
+    }
+
+    void Writer::setDirectIO(bool enabled) {
+        std::lock_guard<std::recursive_mutex> lck(mtx);
+        // Do not allow settings to change while open
+        if (file.isOpen()) { throw std::runtime_error("Cannot change parameters while file is open"); }
+        file.setDirectIO(enabled);
+    }
+
+    std::vector<uint8_t> Writer::buildHeader(Format format, uint64_t dataBytes) {
+        std::vector<uint8_t> header;
+        auto append = [&](const void* data, size_t len) {
+            header.insert(header.end(), (const uint8_t*)data, (const uint8_t*)data + len);
+        };
+        auto append32 = [&](uint32_t val) { append(&val, 4); };
+        auto append64 = [&](uint64_t val) { append(&val, 8); };
+
+        if (format == FORMAT_W64) {
+            uint64_t padded = (dataBytes + 7) & ~7ULL;
+            append(W64_RIFF_GUID, 16);
+            append64(W64_HEADER_SIZE + padded);
+            append(W64_WAVE_GUID, 16);
+            append(W64_FMT_GUID, 16);
+            append64(W64_CHUNK_HEADER_SIZE + sizeof(FormatHeader));
+            append(&hdr, sizeof(FormatHeader));
+            append(W64_DATA_GUID, 16);
+            append64(W64_CHUNK_HEADER_SIZE + dataBytes);
+            return header;
+        }
+
+        uint64_t riffSize = RIFF_HEADER_SIZE - 8 + dataBytes + (dataBytes & 1);
+        bool rf64 = (format == FORMAT_RF64);
+        append(rf64 ? "RF64" : "RIFF", 4);
+        append32(rf64 ? 0xFFFFFFFF : (uint32_t)riffSize);
+        append(WAVE_FILE_TYPE, 4);
+
+        // ds64, or the same space reserved as JUNK
+        append(rf64 ? "ds64" : "JUNK", 4);
+        append32(DS64_SIZE);
+        append64(rf64 ? riffSize : 0);
+        append64(rf64 ? dataBytes : 0);
+        append64(rf64 && bytesPerSamp ? dataBytes / bytesPerSamp : 0);
+        append32(0);
+
+        append(FORMAT_MARKER, 4);
+        append32(FORMAT_HEADER_LEN);
+        append(&hdr, sizeof(FormatHeader));
+
+        append(DATA_MARKER, 4);
+        append32(rf64 ? 0xFFFFFFFF : (uint32_t)dataBytes);
+        return header;
+    }
+
     void Writer::write(float* samples, int count) {
         std::lock_guard<std::recursive_mutex> lck(mtx);
-        if (!rw.isOpen()) { return; }
-        
-        // Select different writer function depending on the chose depth
+        if (!file.isOpen()) { return; }
+
+        // The conversion buffers hold one stream buffer, longer writes go in pieces
+        while (count > STREAM_BUFFER_SIZE) {
+            writeChunk(samples, STREAM_BUFFER_SIZE);
+            samples += STREAM_BUFFER_SIZE * _channels;
+            count -= STREAM_BUFFER_SIZE;
+        }
+        writeChunk(samples, count);
+    }
+
+    void Writer::writeChunk(float* samples, int count) {
+        // Select different writer function depending on the chose depth. The file writer only copies,
+        // the disk is written from its own thread.
         int tcount = count * _channels;
-        int tbytes = count * bytesPerSamp;
+        size_t tbytes = (size_t)count * bytesPerSamp;
+        bool accepted = false;
         switch (_type) {
         case SAMP_TYPE_UINT8:
             // Volk doesn't support unsigned ints yet :/
             for (int i = 0; i < tcount; i++) {
                 bufU8[i] = (samples[i] * 127.0f) + 128.0f;
             }
-            rw.write(bufU8, tbytes);
+            accepted = file.write(bufU8, tbytes);
             break;
         case SAMP_TYPE_INT16:
             volk_32f_s32f_convert_16i(bufI16, samples, 32767.0f, tcount);
-            rw.write((uint8_t*)bufI16, tbytes);
+            accepted = file.write(bufI16, tbytes);
             break;
         case SAMP_TYPE_INT32:
             volk_32f_s32f_convert_32i(bufI32, samples, 2147483647.0f, tcount);
-            rw.write((uint8_t*)bufI32, tbytes);
+            accepted = file.write(bufI32, tbytes);
             break;
         case SAMP_TYPE_FLOAT32:
-            rw.write((uint8_t*)samples, tbytes);
+            accepted = file.write(samples, tbytes);
             break;
         default:
             break;
         }
 
-        // Increment sample counter
-        samplesWritten += count;
+        // Increment sample counter, dropped samples are counted by the file writer
+        if (accepted) { samplesWritten += count; }
+    }
+
+    bool Reader::map() {
+        if (!valid || fmt.channelCount != 2) { return false; }
+        bool supported = (fmt.codec == CODEC_FLOAT && fmt.bitDepth == 32) ||
+                         (fmt.codec == CODEC_PCM && (fmt.bitDepth == 8 || fmt.bitDepth == 16 || fmt.bitDepth == 32));
+        if (!supported) { return false; }
+        if (!mapped.isOpen() && !mapped.open(path)) { return false; }
+        if (dataOffset + dataSize > mapped.size()) {
+            mapped.close();
+            return false;
+        }
+        mapped.adviseSequential();
+        return true;
+    }
+
+    int Reader::readComplex(dsp::complex_t* out, uint64_t first, int count) {
+        uint64_t total = getSampleCount();
+        if (!mapped.isOpen() || first >= total) { return 0; }
+        count = std::min<uint64_t>(count, total - first);
+        int values = count * 2;
+
+        const uint8_t* src = mapped.data() + dataOffset + first * fmt.channelCount * (fmt.bitDepth / 8);
+        float* dst = (float*)out;
+        if (fmt.codec == CODEC_FLOAT) {
+            memcpy(dst, src, values * sizeof(float));
+        }
+        else if (fmt.bitDepth == 16) {
+            volk_16i_s32f_convert_32f(dst, (const int16_t*)src, 32768.0f, values);
+        }
+        else if (fmt.bitDepth == 32) {
+            volk_32i_s32f_convert_32f(dst, (const int32_t*)src, 2147483648.0f, values);
+        }
+        else {
+            // WAV 8 bit samples are unsigned
+            for (int i = 0; i < values; i++) {
+                dst[i] = ((float)src[i] - 128.0f) / 128.0f;
+            }
+        }
+        return count;
     }
 }
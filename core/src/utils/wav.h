@@ -3,7 +3,10 @@
 #include <fstream>
 #include <stdint.h>
 #include <mutex>
-#include "riff.h"
+#include <vector>
+#include <algorithm>
+#include "async_file_writer.h"
+#include "mapped_file.h"
 #include "dsp/types.h"
 #include <string.h>
 #ifndef _WIN32
@@ -24,8 +27,9 @@ namespace wav {
     #pragma pack(pop)
 
     enum Format {
-        FORMAT_WAV,
-        FORMAT_RF64
+        FORMAT_WAV,     // switches to RF64 on close if it went past 4 GB
+        FORMAT_RF64,
+        FORMAT_W64
     };
 
     enum SampleType {
@@ -54,20 +58,39 @@ namespace wav {
         void setFormat(Format format);
         void setSampleType(SampleType type);
 
+        // Write-behind buffer pool and direct I/O for the next open(), see AsyncFileWriter
+        void setBuffering(size_t blockSize, int blockCount);
+        void setDirectIO(bool enabled);
+        // Wait for the disk instead of dropping when the pool is full, needed to save a whole buffer at once
+        void setBlocking(bool enabled) { file.setBlocking(enabled); }
+
         size_t getSamplesWritten() { return samplesWritten; }
 
+        // Samples dropped because the disk fell behind, and how many writes they were dropped in
+        uint64_t getDroppedSamples() { return bytesPerSamp ? file.getDroppedBytes() / bytesPerSamp : 0; }
+        uint64_t getOverruns() { return file.getOverruns(); }
+
+        // Share of the buffer pool waiting for the disk, now and at most since open()
+        float getBufferUsage() { return (float)file.getQueuedBlocks() / (float)file.getBlockCount(); }
+        float getPeakBufferUsage() { return (float)file.getPeakQueuedBlocks() / (float)file.getBlockCount(); }
+
+        bool hasError() { return file.hasError(); }
+
         void write(float* samples, int count);
 
     private:
+        std::vector<uint8_t> buildHeader(Format format, uint64_t dataBytes);
+        void writeChunk(float* samples, int count);
+
         std::recursive_mutex mtx;
         FormatHeader hdr;
-        riff::Writer rw;
+        AsyncFileWriter file;
 
         int _channels;
         uint64_t _samplerate;
         Format _format;
         SampleType _type;
-        size_t bytesPerSamp;
+        size_t bytesPerSamp = 0;
 
         uint8_t* bufU8 = NULL;
         int16_t* bufI16 = NULL;
@@ -123,82 +146,195 @@ namespace wav {
 
         Reader(std::string path) {
             error = "";
+            this->path = path;
             file = std::ifstream(path.c_str(), std::ios::binary);
             if (!file.is_open()) {
                 error = "cannot open file";
+                return;
             }
-            file.read((char*)&hdr, sizeof(WavHeader_t));
-            valid = false;
-            error = "signature mismatch";
-            if (memcmp(hdr.signature, "RIFF", 4) != 0) { return; }
-            if (memcmp(hdr.fileType, "WAVE", 4) != 0) { return; }
+            file.seekg(0, std::ios::end);
+            fileSize = file.tellg();
+            file.seekg(0);
+            valid = parse();
+            if (!valid) { return; }
             error = "";
-            valid = true;
+
+            // Recordings cut short never got their sizes written, play up to the end of the file
+            if (!dataSize || dataOffset + dataSize > fileSize) { dataSize = fileSize - dataOffset; }
+            file.seekg(dataOffset);
         }
 
         uint16_t getBitDepth() {
-            return hdr.bitDepth;
+            return fmt.bitDepth;
         }
 
         uint16_t getChannelCount() {
-            return hdr.channelCount;
+            return fmt.channelCount;
         }
 
         uint32_t getSampleRate() {
-            return hdr.sampleRate;
+            return fmt.sampleRate;
+        }
+
+        uint16_t getCodec() {
+            return fmt.codec;
+        }
+
+        Format getFormat() {
+            return format;
+        }
+
+        // Where the samples start in the file and how many bytes of them there are
+        uint64_t getDataOffset() {
+            return dataOffset;
+        }
+
+        uint64_t getDataSize() {
+            return dataSize;
         }
 
         bool isValid() {
             return valid;
         }
 
+        // Reads size bytes of samples, wrapping around to the first sample at the end of the data
         void readSamples(void* data, size_t size) {
             char* _data = (char*)data;
-            file.read(_data, size);
-            int read = file.gcount();
+            size_t read = readSamples2(_data, size);
             if (read < size) {
-                file.clear();
-                file.seekg(sizeof(WavHeader_t));
-                file.read(&_data[read], size - read);
+                rewind();
+                readSamples2(&_data[read], size - read);
             }
             bytesRead += size;
         }
 
         size_t readSamples2(void* data, size_t size) {
-            char* _data = (char*)data;
-            file.read(_data, size);
-            int read = file.gcount();
+            uint64_t pos = file.tellg();
+            if (!file.good() || pos < dataOffset || pos >= dataOffset + dataSize) {
+                file.clear();
+                return 0;
+            }
+            size = std::min<uint64_t>(size, dataOffset + dataSize - pos);
+            file.read((char*)data, size);
+            size_t read = file.gcount();
+            if (read < size) { file.clear(); }
             return read;
         }
 
         void rewind() {
-            file.seekg(sizeof(WavHeader_t));
+            file.clear();
+            file.seekg(dataOffset);
         }
 
         void close() {
             file.close();
+            mapped.close();
         }
 
+        // Maps the file for readComplex(). Only 8 bit unsigned, 16 and 32 bit integer and 32 bit float
+        // IQ (two channel) files can be read this way.
+        bool map();
+
+        // Number of IQ samples in the data chunk
+        uint64_t getSampleCount() {
+            int frameSize = fmt.channelCount * (fmt.bitDepth / 8);
+            return frameSize ? dataSize / frameSize : 0;
+        }
+
+        // Converts count IQ samples starting at sample index first straight from the mapping into out.
+        // Returns how many were available, less than count at the end of the data.
+        int readComplex(dsp::complex_t* out, uint64_t first, int count);
+
     private:
-        struct WavHeader_t {
-            char signature[4];           // "RIFF"
-            uint32_t fileSize;           // data bytes + sizeof(WavHeader_t) - 8
-            char fileType[4];            // "WAVE"
-            char formatMarker[4];        // "fmt "
-            uint32_t formatHeaderLength; // Always 16
-            uint16_t sampleType;         // PCM (1)
-            uint16_t channelCount;
-            uint32_t sampleRate;
-            uint32_t bytesPerSecond;
-            uint16_t bytesPerSample;
-            uint16_t bitDepth;
-            char dataMarker[4]; // "data"
-            uint32_t dataSize;
-        };
+        bool parse() {
+            char riffId[4];
+            uint32_t riffSize;
+            char form[4];
+            file.read(riffId, 4);
+            file.read((char*)&riffSize, 4);
+            file.read(form, 4);
+            error = "signature mismatch";
+            if (!file.good()) { return false; }
+
+            if (!memcmp(riffId, "riff", 4)) {
+                format = FORMAT_W64;
+                return parseW64();
+            }
+            if (memcmp(form, "WAVE", 4)) { return false; }
+            if (!memcmp(riffId, "RF64", 4)) {
+                format = FORMAT_RF64;
+            }
+            else if (memcmp(riffId, "RIFF", 4)) {
+                return false;
+            }
+
+            // Walk the chunks up to the samples
+            error = "no data chunk";
+            uint64_t ds64DataSize = 0;
+            bool haveFmt = false;
+            while (true) {
+                char id[4];
+                uint32_t size;
+                file.read(id, 4);
+                file.read((char*)&size, 4);
+                if (!file.good()) { return false; }
+                uint64_t next = (uint64_t)file.tellg() + size + (size & 1);
+
+                if (!memcmp(id, "ds64", 4)) {
+                    uint64_t riffSize64;
+                    file.read((char*)&riffSize64, 8);
+                    file.read((char*)&ds64DataSize, 8);
+                }
+                else if (!memcmp(id, "fmt ", 4)) {
+                    file.read((char*)&fmt, sizeof(FormatHeader));
+                    haveFmt = true;
+                }
+                else if (!memcmp(id, "data", 4)) {
+                    dataOffset = file.tellg();
+                    dataSize = (format == FORMAT_RF64 && size == 0xFFFFFFFF) ? ds64DataSize : size;
+                    if (!haveFmt) { error = "no format chunk"; }
+                    return haveFmt;
+                }
+                file.seekg(next);
+            }
+        }
+
+        bool parseW64() {
+            // Chunk ids are GUIDs starting with the usual four letters, sizes are 64 bit and include the header
+            error = "no data chunk";
+            uint64_t pos = 40;
+            bool haveFmt = false;
+            while (true) {
+                char id[16];
+                uint64_t size;
+                file.seekg(pos);
+                file.read(id, 16);
+                file.read((char*)&size, 8);
+                if (!file.good() || size < 24) { return false; }
+
+                if (!memcmp(id, "fmt ", 4)) {
+                    file.read((char*)&fmt, sizeof(FormatHeader));
+                    haveFmt = true;
+                }
+                else if (!memcmp(id, "data", 4)) {
+                    dataOffset = pos + 24;
+                    dataSize = size - 24;
+                    if (!haveFmt) { error = "no format chunk"; }
+                    return haveFmt;
+                }
+                pos += (size + 7) & ~7ULL;
+            }
+        }
 
         bool valid = false;
+        std::string path;
+        MappedFile mapped;
         std::ifstream file;
+        uint64_t fileSize = 0;
         size_t bytesRead = 0;
-        WavHeader_t hdr;
+        Format format = FORMAT_WAV;
+        FormatHeader fmt = {};
+        uint64_t dataOffset = 0;
+        uint64_t dataSize = 0;
     };
 }
@@ -0,0 +1,108 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+// Persistent threads for splitting a loop into chunks. The calling thread runs chunks too and
+// returns once every chunk is done, so the pool costs nothing between loops.
+class WorkerPool {
+public:
+    WorkerPool(int workerCount) {
+        for (int i = 0; i < workerCount; i++) {
+            workers.emplace_back(&WorkerPool::workerLoop, this);
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopping = true;
+        }
+        jobCV.notify_all();
+        for (auto& w : workers) {
+            if (w.joinable()) { w.join(); }
+        }
+    }
+
+    // Calls fn(begin, end) on consecutive ranges covering [0, count), one range per thread
+    void parallelFor(int count, const std::function<void(int, int)>& fn) {
+        std::lock_guard<std::mutex> runLck(runMtx);
+        int chunks = std::min<int>(workers.size() + 1, count);
+        if (chunks <= 1) {
+            if (count > 0) { fn(0, count); }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            job = &fn;
+            jobCount = count;
+            jobChunks = chunks;
+            nextChunk = 0;
+            pendingChunks = chunks;
+            generation++;
+        }
+        jobCV.notify_all();
+
+        runChunks();
+
+        std::unique_lock<std::mutex> lck(mtx);
+        doneCV.wait(lck, [this] { return pendingChunks == 0; });
+        job = NULL;
+    }
+
+    inline int getWorkerCount() { return workers.size(); }
+
+private:
+    void runChunks() {
+        while (true) {
+            int begin, end;
+            const std::function<void(int, int)>* fn;
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                if (!job || nextChunk >= jobChunks) { return; }
+                int chunk = nextChunk++;
+                begin = (int)((long long)jobCount * chunk / jobChunks);
+                end = (int)((long long)jobCount * (chunk + 1) / jobChunks);
+                fn = job;
+            }
+
+            (*fn)(begin, end);
+
+            std::lock_guard<std::mutex> lck(mtx);
+            if (--pendingChunks == 0) { doneCV.notify_all(); }
+        }
+    }
+
+    void workerLoop() {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                jobCV.wait(lck, [&] { return generation != seen || stopping; });
+                if (stopping) { return; }
+                seen = generation;
+            }
+            runChunks();
+        }
+    }
+
+    std::vector<std::thread> workers;
+
+    // Serializes callers, one loop runs at a time
+    std::mutex runMtx;
+
+    std::mutex mtx;
+    std::condition_variable jobCV;
+    std::condition_variable doneCV;
+    const std::function<void(int, int)>* job = NULL;
+    int jobCount = 0;
+    int jobChunks = 0;
+    int nextChunk = 0;
+    int pendingChunks = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
@@ -11,6 +11,7 @@
 #include <dsp/taps/high_pass.h>
 #include <dsp/block.h>
 #include <fftw3.h>
+#include <utils/arrays.h>
 #include "common.h"
 
 #define CTCSS_SENSITIVITY 17
@@ -40,7 +41,10 @@ namespace dsp {
                 in_data[i] = 0.0;
             }
             fftw_out = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * nr);
-            p = fftwf_plan_dft_r2c_1d(nSamp, in_data, fftw_out, FFTW_ESTIMATE);
+            {
+                std::lock_guard<std::mutex> lck(arrays::fftwPlannerMutex());
+                p = fftwf_plan_dft_r2c_1d(nSamp, in_data, fftw_out, FFTW_ESTIMATE);
+            }
             squelchFrequency = squelchFreq;
             base_type::init(in);
         }
@@ -2,6 +2,7 @@
 #include <dsp/processor.h>
 #include <utils/flog.h>
 #include <fftw3.h>
+#include <utils/arrays.h>
 #include "dab_phase_sym.h"
 
 namespace dab {
@@ -157,7 +158,10 @@ namespace dab {
             memcpy(conjRef, DAB_PHASE_SYM_CONJ, 2048 * sizeof(dsp::complex_t));
 
             // Plan the FFT computation
-            plan = fftwf_plan_dft_1d(2048, (fftwf_complex*)corrIn, (fftwf_complex*)corrOut, FFTW_FORWARD, FFTW_ESTIMATE);
+            {
+                std::lock_guard<std::mutex> lck(dsp::arrays::fftwPlannerMutex());
+                plan = fftwf_plan_dft_1d(2048, (fftwf_complex*)corrIn, (fftwf_complex*)corrOut, FFTW_FORWARD, FFTW_ESTIMATE);
+            }
 
             // Compute the correlation AGC configuration
             this->agcRate = agcRate;
@@ -0,0 +1,236 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+#include <json.hpp>
+
+// Runs the decodes of every band and mode on one pool with a fixed thread budget, instead of each band
+// starting its own threads at the slot boundary. Jobs run by priority then earliest deadline, a job that
+// is still queued when the next period of its band arrives is replaced, and one whose deadline passed
+// before it could start is dropped. The threads of the budget are shared between the jobs running.
+class DecodeScheduler {
+public:
+    struct Job {
+        std::string band;       // stats key, one job per band is queued at most
+        int priority = 0;       // higher runs first
+        int deadlineMillis = 15000;     // from submission, results after that are late
+
+        // Does the decode with the given number of threads, returns the number of results
+        std::function<int(int threads)> run;
+
+        // Always called once, from a worker or from submit()/cancel() for jobs that never ran
+        std::function<void(bool decoded, int results, int decodeMillis)> done;
+    };
+
+    struct BandStats {
+        int64_t submitted = 0;
+        int64_t decoded = 0;
+        int64_t late = 0;
+        int64_t expired = 0;        // deadline passed while queued
+        int64_t superseded = 0;     // replaced by the next period while queued
+        int lastQueueMillis = 0;
+        int lastDecodeMillis = 0;
+        int maxDecodeMillis = 0;
+        double avgDecodeMillis = 0.0;
+        int lastThreads = 0;
+        int lastResults = 0;
+    };
+
+    // Most decoder threads one job can use, the decoder splits the band in at most this many parts
+    static constexpr int MAX_THREADS_PER_JOB = 6;
+
+    DecodeScheduler() {}
+    ~DecodeScheduler() { stop(); }
+
+    void start(int threadBudget) {
+        std::lock_guard<std::mutex> lck(mtx);
+        if (!workers.empty()) { return; }
+        budget = std::max<int>(1, threadBudget);
+        stopping = false;
+        int count = std::max<int>(1, std::thread::hardware_concurrency());
+        for (int i = 0; i < count; i++) {
+            workers.emplace_back(&DecodeScheduler::worker, this);
+        }
+    }
+
+    // Waits for the running decodes, queued jobs are dropped
+    void stop() {
+        std::deque<QueuedJob> dropped;
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopping = true;
+            dropped.swap(queue);
+        }
+        cv.notify_all();
+        for (auto& w : workers) { w.join(); }
+        workers.clear();
+        for (auto& q : dropped) { q.job.done(false, 0, 0); }
+    }
+
+    // At most this many decoder threads run at once, whatever the number of bands
+    void setThreadBudget(int threads) {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            budget = std::max<int>(1, threads);
+        }
+        cv.notify_all();
+    }
+
+    int getThreadBudget() { return budget; }
+
+    void submit(Job job) {
+        std::vector<Job> replaced;
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            auto& st = stats[job.band];
+            st.submitted++;
+            for (auto it = queue.begin(); it != queue.end();) {
+                if (it->job.band == job.band) {
+                    st.superseded++;
+                    replaced.push_back(std::move(it->job));
+                    it = queue.erase(it);
+                }
+                else {
+                    it++;
+                }
+            }
+            auto now = Clock::now();
+            auto deadline = now + std::chrono::milliseconds(job.deadlineMillis);
+            queue.push_back({ std::move(job), now, deadline });
+        }
+        cv.notify_one();
+        for (auto& j : replaced) { j.done(false, 0, 0); }
+    }
+
+    // Drops the queued jobs of a band and waits for its running one, before the band goes away
+    void cancel(const std::string& band) {
+        std::vector<Job> dropped;
+        {
+            std::unique_lock<std::mutex> lck(mtx);
+            for (auto it = queue.begin(); it != queue.end();) {
+                if (it->job.band == band) {
+                    dropped.push_back(std::move(it->job));
+                    it = queue.erase(it);
+                }
+                else {
+                    it++;
+                }
+            }
+            doneCV.wait(lck, [&] { return std::find(runningBands.begin(), runningBands.end(), band) == runningBands.end(); });
+            stats.erase(band);
+        }
+        for (auto& j : dropped) { j.done(false, 0, 0); }
+    }
+
+    BandStats getStats(const std::string& band) {
+        std::lock_guard<std::mutex> lck(mtx);
+        auto it = stats.find(band);
+        return (it != stats.end()) ? it->second : BandStats();
+    }
+
+    std::string getStatsJson() {
+        std::lock_guard<std::mutex> lck(mtx);
+        nlohmann::json j;
+        j["threadBudget"] = budget.load();
+        j["threadsInUse"] = threadsInUse;
+        j["running"] = runningBands.size();
+        j["queued"] = queue.size();
+        j["bands"] = nlohmann::json::object();
+        for (auto& [band, st] : stats) {
+            auto& b = j["bands"][band];
+            b["submitted"] = st.submitted;
+            b["decoded"] = st.decoded;
+            b["late"] = st.late;
+            b["expired"] = st.expired;
+            b["superseded"] = st.superseded;
+            b["lastQueueMillis"] = st.lastQueueMillis;
+            b["lastDecodeMillis"] = st.lastDecodeMillis;
+            b["maxDecodeMillis"] = st.maxDecodeMillis;
+            b["avgDecodeMillis"] = st.avgDecodeMillis;
+            b["lastThreads"] = st.lastThreads;
+            b["lastResults"] = st.lastResults;
+        }
+        return j.dump();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct QueuedJob {
+        Job job;
+        Clock::time_point submitted;
+        Clock::time_point deadline;
+    };
+
+    void worker() {
+        std::unique_lock<std::mutex> lck(mtx);
+        while (true) {
+            cv.wait(lck, [&] { return stopping || (!queue.empty() && threadsInUse < budget); });
+            if (stopping) { return; }
+
+            // Highest priority first, then the earliest deadline
+            auto best = std::min_element(queue.begin(), queue.end(), [](const QueuedJob& a, const QueuedJob& b) {
+                if (a.job.priority != b.job.priority) { return a.job.priority > b.job.priority; }
+                return a.deadline < b.deadline;
+            });
+            QueuedJob q = std::move(*best);
+            queue.erase(best);
+            auto& st = stats[q.job.band];
+            auto now = Clock::now();
+            if (now > q.deadline) {
+                st.expired++;
+                lck.unlock();
+                q.job.done(false, 0, 0);
+                lck.lock();
+                continue;
+            }
+
+            // Share what is left of the budget with the jobs still waiting
+            int share = (budget - threadsInUse) / (int)(queue.size() + 1);
+            int threads = std::clamp<int>(share, 1, MAX_THREADS_PER_JOB);
+            threadsInUse += threads;
+            runningBands.push_back(q.job.band);
+            st.lastQueueMillis = (int)std::chrono::duration_cast<std::chrono::milliseconds>(now - q.submitted).count();
+            lck.unlock();
+
+            int results = q.job.run(threads);
+            auto end = Clock::now();
+            int decodeMillis = (int)std::chrono::duration_cast<std::chrono::milliseconds>(end - now).count();
+            q.job.done(true, results, decodeMillis);
+
+            lck.lock();
+            threadsInUse -= threads;
+            runningBands.erase(std::find(runningBands.begin(), runningBands.end(), q.job.band));
+            auto& st2 = stats[q.job.band];
+            st2.decoded++;
+            if (end > q.deadline) { st2.late++; }
+            st2.lastDecodeMillis = decodeMillis;
+            st2.maxDecodeMillis = std::max<int>(st2.maxDecodeMillis, decodeMillis);
+            st2.avgDecodeMillis = (st2.decoded == 1) ? decodeMillis : st2.avgDecodeMillis * 0.9 + decodeMillis * 0.1;
+            st2.lastThreads = threads;
+            st2.lastResults = results;
+            doneCV.notify_all();
+            cv.notify_all();
+        }
+    }
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable doneCV;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    std::atomic<int> budget = 1;
+    int threadsInUse = 0;
+    std::deque<QueuedJob> queue;
+    std::vector<std::string> runningBands;
+    std::map<std::string, BandStats> stats;
+};
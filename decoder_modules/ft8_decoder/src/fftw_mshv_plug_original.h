@@ -7,6 +7,7 @@
 #include <memory>
 #include <ctm.h>
 #include <utils/flog.h>
+#include <utils/arrays.h>
 
 struct FFT_PLAN_IMPL {
     FFT_PLAN_IMPL() = default;
@@ -58,7 +59,10 @@ FFT_PLAN Fftplug_allocate_plan_c2c(PlanStorage &s, int nfft, bool forward, Alloc
     p.outputC = true;
     p.nfft = nfft;
     auto t1 = currentTimeMillis();
-    p.plan = fftwf_plan_dft_1d(nfft, nullptr, nullptr, forward ? FFTW_FORWARD: FFTW_BACKWARD, FFTW_ESTIMATE_PATIENT);
+    {
+        std::lock_guard<std::mutex> plck(dsp::arrays::fftwPlannerMutex());
+        p.plan = fftwf_plan_dft_1d(nfft, nullptr, nullptr, forward ? FFTW_FORWARD: FFTW_BACKWARD, FFTW_ESTIMATE_PATIENT);
+    }
     t1 = currentTimeMillis() - t1;
     planAllocTime += t1;
     return FFT_PLAN {ix};
@@ -73,7 +77,10 @@ FFT_PLAN Fftplug_allocate_plan_r2c(PlanStorage &s, int nfft,  Allocs &allocs) {
     p.outputC = true;
     p.nfft = nfft;
     auto t1 = currentTimeMillis();
-    p.plan = fftwf_plan_dft_r2c_1d(nfft, nullptr, nullptr, FFTW_ESTIMATE_PATIENT);
+    {
+        std::lock_guard<std::mutex> plck(dsp::arrays::fftwPlannerMutex());
+        p.plan = fftwf_plan_dft_r2c_1d(nfft, nullptr, nullptr, FFTW_ESTIMATE_PATIENT);
+    }
     t1 = currentTimeMillis() - t1;
     planAllocTime += t1;
     return FFT_PLAN {ix};
@@ -82,7 +89,10 @@ FFT_PLAN Fftplug_allocate_plan_r2c(PlanStorage &s, int nfft,  Allocs &allocs) {
 
 inline void Fftplug_free_plan(PlanStorage &s, FFT_PLAN plan) {
     std::lock_guard g(s.plansLock);
-    fftwf_destroy_plan(s.allPlans[plan.handle].plan);
+    {
+        std::lock_guard<std::mutex> plck(dsp::arrays::fftwPlannerMutex());
+        fftwf_destroy_plan(s.allPlans[plan.handle].plan);
+    }
     s.freePlan(plan.handle);
 }
 
@@ -56,34 +56,27 @@ DecoderFt4::DecoderFt4(int id, std::shared_ptr<F2a> f2a) : f2a(f2a)
 DecoderFt4::~DecoderFt4() {
     delete TGenFt4;
 }
-static double s_nftx4 = 1200.0;
 void DecoderFt4::SetStTxFreq(double f)
 {
     s_nftx4 = f;
 }
-static bool f_multi_answer_mod4 = false;
 void DecoderFt4::SetStMultiAnswerMod(bool f)
 {
     f_multi_answer_mod4 = f;
 }
-static int s_decoder_deep4 = 1;
 void DecoderFt4::SetStDecoderDeep(int d)
 {
     s_decoder_deep4 = d;
     //qDebug()<<"s_decoder_deep="<<s_decoder_deep;
 }
-static bool s_lapon4 = false;// only in mshv
 void DecoderFt4::SetStApDecode(bool f)
 {
     s_lapon4 = f;
 }
-static int s_nQSOProgress4 = 0;
 void DecoderFt4::SetStQSOProgress(int i)
 {
     s_nQSOProgress4 = i;
 }
-static QString s_time4 = "0.0";
-static int s_mousebutton4 = 0;
 //static bool s_fopen4 = false;
 void DecoderFt4::SetStDecode(QString time,int mousebutton)
 {
@@ -91,17 +84,13 @@ void DecoderFt4::SetStDecode(QString time,int mousebutton)
     s_mousebutton4 = mousebutton;//mousebutton Left=1, Right=3 fullfile=0 rtd=2
     //s_fopen4 = ffopen;
 }
-static QString s_MyCall4 = "NOT__EXIST";
 //static QString s_MyBaseCall4 = "NOT__EXIST";
-static int s_id_cont_ft4_28 = 0;
-static int s_ty_cont_ft4_28 = 0;
 void DecoderFt4::SetStWords(QString s1,QString,int cq3,int ty4)
 {
     s_MyCall4 = s1;
     s_id_cont_ft4_28 = cq3;
     s_ty_cont_ft4_28 = ty4;
 }
-static QString s_HisCall4 = "NOCALL";
 void DecoderFt4::SetStHisCall(QString c)
 {
     s_HisCall4 = c;
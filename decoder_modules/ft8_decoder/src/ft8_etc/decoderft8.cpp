@@ -96,52 +96,40 @@ DecoderFt8::DecoderFt8(int id, std::shared_ptr<F2a> f2a) : f2a(f2a)
 DecoderFt8::~DecoderFt8() {
     delete TGenFt8;
 }
-static bool f_multi_answer_mod8 = false;
 void DecoderFt8::SetStMultiAnswerMod(bool f)
 {
     f_multi_answer_mod8 = f;
 }
 //static QString s_MyCall8 = "NOT__EXIST";
-static QString s_MyBaseCall8 = "NOT__EXIST";
-static int s_id_cont_ft8_28 = 0;
-static int s_ty_cont_ft8_28 = 0;
 void DecoderFt8::SetStWords(QString,QString s2,int cq3,int ty4)
 {
     s_MyBaseCall8 = s2;
     s_id_cont_ft8_28 = cq3;
     s_ty_cont_ft8_28 = ty4;
 }
-static QString s_HisCall8 = "NOCALL";
 void DecoderFt8::SetStHisCall(QString c)
 {
     s_HisCall8 = c;
 }
-static QString s_time8 = "0.0";
-static int s_mousebutton8 = 0;
-static bool s_fopen8 = false;
 void DecoderFt8::SetStDecode(QString time,int mousebutton,bool ffopen)
 {
     s_time8 = time;
     s_mousebutton8 = mousebutton;//mousebutton Left=1, Right=3 fullfile=0 rtd=2
     s_fopen8 = ffopen;//2.66 for ap7 s_fopen8
 }
-static int s_decoder_deep8 = 1;
 void DecoderFt8::SetStDecoderDeep(int d)
 {
     s_decoder_deep8 = d;
     //qDebug()<<"s_decoder_deep="<<s_decoder_deep;
 }
-static bool s_lapon8 = false;
 void DecoderFt8::SetStApDecode(bool f)
 {
     s_lapon8 = f;
 }
-static int s_nQSOProgress8 = 0;
 void DecoderFt8::SetStQSOProgress(int i)
 {
     s_nQSOProgress8 = i;
 }
-static double s_nftx8 = 1200.0;
 void DecoderFt8::SetStTxFreq(double f)
 {
     s_nftx8 = f;
@@ -2335,7 +2323,6 @@ void DecoderFt8::SetNewP(bool f)
 {
     f_new_p = f;
 }
-static bool s_3intFt8_d_ = true;//2.51 default
 void DecoderFt8::Decode3intFt(bool f)//2.39 remm
 {
     s_3intFt8_d_ = f;
@@ -3233,6 +3220,12 @@ void DecoderFt8::ft8_decode(double *dd,int c_dd,double f0a,double f0b,double fqs
 }
 
 void DecoderFt8::EmitDecodedTextFt(QStringList lst) {
+    if (decodeResultCallback) {
+        decodeResultCallback(FtDecodeResult::fromList(11, lst));
+    }
+    if (!resultsCallback && !decodeResultOutputFun && !noisy_ft8) {
+        return;
+    }
     char buf[1000] ="";
     snprintf(buf+strlen(buf), sizeof buf - strlen(buf), "FT8_OUT\t%lld\t%02d", currentTimeMillis(), outCount++);
     for(int i=0; i<lst.count(); i++) {
@@ -294,7 +294,7 @@ void DecoderMs::SetPerodTime(int i)
 }
 void DecoderMs::Decode3intFt(bool f)//2.39 remm
 {
-    DecFt8_0->Decode3intFt(f);//2.39 remm
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->Decode3intFt(f);//2.39 remm
 }
 void DecoderMs::SetMAMCalls(QStringList ls)
 {
@@ -303,8 +303,8 @@ void DecoderMs::SetMAMCalls(QStringList ls)
 void DecoderMs::SetTxFreq(double f)
 {
     s_nftx = f;
-    DecFt8_0->SetStTxFreq(f);
-    DecFt4_0->SetStTxFreq(f);
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->SetStTxFreq(f);
+    for (DecoderFt4 *dec : {DecFt4_0, DecFt4_1, DecFt4_2, DecFt4_3, DecFt4_4, DecFt4_5}) dec->SetStTxFreq(f);
     DecQ65->SetTxFreq(f);
 }
 void DecoderMs::SetDecAftEMEDelay(bool f)
@@ -319,8 +319,8 @@ void DecoderMs::SetQSOProgress(int i)
     {
         s_nQSOProgress = i+1; //MSHV +1  CQ LZ2HV 237 for +AP
     }
-    DecFt8_0->SetStQSOProgress(s_nQSOProgress);//2.51 i=error
-    DecFt4_0->SetStQSOProgress(s_nQSOProgress);//2.51 i=error
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->SetStQSOProgress(s_nQSOProgress);//2.51 i=error
+    for (DecoderFt4 *dec : {DecFt4_0, DecFt4_1, DecFt4_2, DecFt4_3, DecFt4_4, DecFt4_5}) dec->SetStQSOProgress(s_nQSOProgress);//2.51 i=error
     DecQ65->SetStQSOProgress(s_nQSOProgress);//2.51 i=error
     //qDebug()<<"i="<<i<<"QSOProgress="<<s_nQSOProgress;
 
@@ -342,8 +342,8 @@ void DecoderMs::SetQSOProgress(int i)
 }
 void DecoderMs::SetMultiAnswerMod(bool f)
 {
-    DecFt8_0->SetStMultiAnswerMod(f);
-    DecFt4_0->SetStMultiAnswerMod(f); //qDebug()<<"f_multi_answer_mod="<<f;
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->SetStMultiAnswerMod(f);
+    for (DecoderFt4 *dec : {DecFt4_0, DecFt4_1, DecFt4_2, DecFt4_3, DecFt4_4, DecFt4_5}) dec->SetStMultiAnswerMod(f); //qDebug()<<"f_multi_answer_mod="<<f;
     DecQ65->SetStMultiAnswerMod(f);
 }
 void DecoderMs::SetThrLevel(int i)//0=1 1=th/2 2=all
@@ -357,16 +357,16 @@ void DecoderMs::SetThrLevel(int i)//0=1 1=th/2 2=all
 void DecoderMs::SetApDecode(bool f)
 {
     s_lapon = f;//Ap decoding ?
-    DecFt8_0->SetStApDecode(f);
-    DecFt4_0->SetStApDecode(f);// only in mshv
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->SetStApDecode(f);
+    for (DecoderFt4 *dec : {DecFt4_0, DecFt4_1, DecFt4_2, DecFt4_3, DecFt4_4, DecFt4_5}) dec->SetStApDecode(f);// only in mshv
     DecQ65->SetStApDecode(f);// only in mshv
     //qDebug()<<"ft8 s_lapon="<<s_lapon;
 }
 void DecoderMs::SetDecoderDeep(int d)
 {
     s_decoder_deep = d;
-    DecFt8_0->SetStDecoderDeep(d);
-    DecFt4_0->SetStDecoderDeep(d);
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->SetStDecoderDeep(d);
+    for (DecoderFt4 *dec : {DecFt4_0, DecFt4_1, DecFt4_2, DecFt4_3, DecFt4_4, DecFt4_5}) dec->SetStDecoderDeep(d);
     DecQ65->SetStDecoderDeep(d);  //qDebug()<<"s_decoder_deep="<<s_decoder_deep;
 }
 void DecoderMs::SetSingleDecQ65(bool f)
@@ -603,8 +603,8 @@ void DecoderMs::SetWords(QStringList lst,int cont_cq,int cont_type)
     //"PRO DIGI Contest"			12  5		12 CQ PDC 	 4			7 = CQ PDC
     //"CQ WW VHF Contest"			13	2		13 CQ TEST	 1			3 = CQ TEST
 
-    DecFt8_0->SetStWords(s_MyCall,s_MyBaseCall,cont_cq,cont_type);
-    DecFt4_0->SetStWords(s_MyCall,s_MyBaseCall,cont_cq,cont_type);
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->SetStWords(s_MyCall,s_MyBaseCall,cont_cq,cont_type);
+    for (DecoderFt4 *dec : {DecFt4_0, DecFt4_1, DecFt4_2, DecFt4_3, DecFt4_4, DecFt4_5}) dec->SetStWords(s_MyCall,s_MyBaseCall,cont_cq,cont_type);
     DecQ65->SetStWords(s_MyCall,s_MyBaseCall,cont_cq,cont_type);
     //qDebug()<<"CQ="<<cont_cq<<"type="<<cont_type;
 }
@@ -626,7 +626,6 @@ void DecoderMs::SetZap(bool f)
 }
 void DecoderMs::setMode(int ident)
 {
-    static int prev_mod = 2;
     s_mod = ident;
     if (s_mod == 14 || s_mod == 15 || s_mod == 16 || s_mod == 17) allq65 = true;
     else allq65 = false;
@@ -1992,7 +1991,6 @@ void DecoderMs::CalcZapDat()
         s_zap_dat[j]=(double)s_zap_dat[j]-ave;
 }
 //#include <QTime>
-static bool have_dec0_ = false;
 void DecoderMs::StrtDecode() {
     if (s_f_rtd || s_mod == 11 || s_mod == 13 || allq65) // ft8 ft4 q65
         usleep(20000);                                   // 1.30 important time>10ms 20000us=20ms slab PC pri auto decode da zabavi malko pri postoqnno decodirane hv
@@ -2301,13 +2299,6 @@ void DecoderMs::CreateStartTimerthr()
     is_thrTime = true;
 //    thrTime->start(); //qDebug()<<"CreateTimer++++++";
 }
-static bool have_dec1_ = false;
-static bool have_dec2_ = false;
-static bool have_dec3_ = false;
-static bool have_dec4_ = false;
-static bool have_dec5_ = false;
-static bool have_decALL3_ = false;
-static bool thr_only_one_color = true;
 void DecoderMs::ResetDupThr()
 {
     //static bool have_decALL3_ = false; <- no use
@@ -2357,12 +2348,6 @@ void DecoderMs::SetBackColorQ65()
 {
     SetBackColor();
 }
-static bool end_dec0_ = true;
-static bool end_dec1_ = true;
-static bool end_dec2_ = true;
-static bool end_dec3_ = true;
-static bool end_dec4_ = true;
-static bool end_dec5_ = true;
 bool DecoderMs::IsWorking() {
     if (!end_dec0_ || !end_dec1_ || !end_dec2_ || !end_dec3_ || !end_dec4_ || !end_dec5_ || thred_busy) return true;
     return false;
@@ -2385,8 +2370,6 @@ void DecoderMs::TryEndThr()
         thred_busy = false;
     //qDebug()<<"Multy Thread False thred_busy";
 }
-static double _f00_ = 200;
-static double _f01_ = 700;
 void DecoderMs::StrtDec0()
 {
     usleep(17000); //qDebug()<<"0";
@@ -2395,7 +2378,6 @@ void DecoderMs::StrtDec0()
     end_dec0_ = true;
     TryEndThr();
 }
-static double _f02_ = 1200;
 //#define CORFT8 60.0
 //#define CORFT4 100.0
 void DecoderMs::StrtDec1()
@@ -2406,7 +2388,6 @@ void DecoderMs::StrtDec1()
     end_dec1_ = true;
     TryEndThr();
 }
-static double _f03_ = 1700;
 void DecoderMs::StrtDec2()
 {
     usleep(19000); //qDebug()<<"2";
@@ -2415,7 +2396,6 @@ void DecoderMs::StrtDec2()
     end_dec2_ = true;
     TryEndThr();
 }
-static double _f04_ = 2200;
 void DecoderMs::StrtDec3()
 {
     usleep(20000); //qDebug()<<"3";
@@ -2424,7 +2404,6 @@ void DecoderMs::StrtDec3()
     end_dec3_ = true;
     TryEndThr();
 }
-static double _f05_ = 2700;
 void DecoderMs::StrtDec4()
 {
     usleep(21000); //qDebug()<<"4";
@@ -2433,7 +2412,6 @@ void DecoderMs::StrtDec4()
     end_dec4_ = true;
     TryEndThr();
 }
-static double _f06_ = 3200;
 void DecoderMs::StrtDec5()
 {
     usleep(22000); //qDebug()<<"5";
@@ -2707,8 +2685,8 @@ void DecoderMs::SetDecode(short *raw,int count_q,QString time, int t_istart,int
     s_in_istart = (double)t_istart;
     s_time = time;
     s_mousebutton = mousebutton; //mousebutton Left=1, Right=3 fullfile=0 rtd=2 ft8=4,5,6
-    DecFt8_0->SetStDecode(time,mousebutton,s_fopen);//2.66 for ap7 s_fopen8
-    DecFt4_0->SetStDecode(time,mousebutton);
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->SetStDecode(time,mousebutton,s_fopen);//2.66 for ap7 s_fopen8
+    for (DecoderFt4 *dec : {DecFt4_0, DecFt4_1, DecFt4_2, DecFt4_3, DecFt4_4, DecFt4_5}) dec->SetStDecode(time,mousebutton);
     DecQ65->SetStDecode(time,mousebutton);
 
     s_f_rtd = f_rtd;
@@ -2910,3 +2888,7 @@ void DecoderMs::SetResultsCallback(std::function<void(const char *)> fun) {
     DecFt4_4->SetResultsCallback(fun);
     DecFt4_5->SetResultsCallback(fun);
 }
+void DecoderMs::SetDecodeResultCallback(FtDecodeResultCallback fun) {
+    for (DecoderFt8 *dec : {DecFt8_0, DecFt8_1, DecFt8_2, DecFt8_3, DecFt8_4, DecFt8_5}) dec->SetDecodeResultCallback(fun);
+    for (DecoderFt4 *dec : {DecFt4_0, DecFt4_1, DecFt4_2, DecFt4_3, DecFt4_4, DecFt4_5}) dec->SetDecodeResultCallback(fun);
+}
@@ -32,6 +32,36 @@
 //#include <QObject> //2.53
 #define ALL_MSG_SNR 120 //2.63 from 100 to 120
 #define MAXDEC 120
+
+// One decoded FT8/FT4 message, the fields of an FT8_OUT/FT4_OUT line without going through text
+struct FtDecodeResult {
+    int mode = 11;          // 11=FT8 13=FT4
+    std::string time;       // period label passed to SetDecode
+    int snr = 0;            // dB
+    double dt = 0.0;        // time offset, seconds
+    int df = 0;             // offset from the TX frequency, Hz
+    std::string message;    // hashed calls resolved by the decoder are appended after a '|'
+    std::string apType;
+    double quality = 0.0;   // 0.0-1.0
+    int frequency = 0;      // audio frequency, Hz
+
+    static FtDecodeResult fromList(int mode, QStringList &lst) {
+        FtDecodeResult r;
+        r.mode = mode;
+        if (lst.count() < 8) { return r; }
+        r.time = *lst[0].str;
+        r.snr = atoi(lst[1].str->c_str());
+        r.dt = atof(lst[2].str->c_str());
+        r.df = atoi(lst[3].str->c_str());
+        r.message = *lst[4].str;
+        r.apType = *lst[5].str;
+        r.quality = atof(lst[6].str->c_str());
+        r.frequency = atoi(lst[7].str->c_str());
+        return r;
+    }
+};
+typedef std::function<void(const FtDecodeResult &)> FtDecodeResultCallback;
+
 class DecoderFt8
 {
     int outCount = 0;
@@ -53,6 +83,9 @@ public:
     void SetResultsCallback(std::function<void(const char *)> fun) {
         this->resultsCallback = fun;
     }
+    void SetDecodeResultCallback(FtDecodeResultCallback fun) {
+        this->decodeResultCallback = fun;
+    }
 
 
 //signals:
@@ -64,6 +97,22 @@ public:
 private:
     int decid;
     std::function<void(const char *)> resultsCallback;
+    FtDecodeResultCallback decodeResultCallback;
+
+    // Settings from the SetSt* calls, per instance so that several DecoderMs can decode at once
+    bool f_multi_answer_mod8 = false;
+    QString s_MyBaseCall8 = "NOT__EXIST";
+    int s_id_cont_ft8_28 = 0;
+    int s_ty_cont_ft8_28 = 0;
+    QString s_HisCall8 = "NOCALL";
+    QString s_time8 = "0.0";
+    int s_mousebutton8 = 0;
+    bool s_fopen8 = false;
+    int s_decoder_deep8 = 1;
+    bool s_lapon8 = false;
+    int s_nQSOProgress8 = 0;
+    double s_nftx8 = 1200.0;
+    bool s_3intFt8_d_ = true;
 
     std::shared_ptr<F2a> f2a;
     PomAll pomAll;
@@ -174,10 +223,19 @@ public:
     void SetResultsCallback(std::function<void(const char *)> fun) {
         this->resultsCallback = fun;
     }
+    void SetDecodeResultCallback(FtDecodeResultCallback fun) {
+        this->decodeResultCallback = fun;
+    }
 
 
     //signals:
     void EmitDecodedTextFt(QStringList lst) {
+        if (decodeResultCallback) {
+            decodeResultCallback(FtDecodeResult::fromList(13, lst));
+        }
+        if (!resultsCallback && !decodeResultOutputFun && !noisy_ft8) {
+            return;
+        }
         char buf[1000] ="";
         snprintf(buf+strlen(buf), sizeof(buf)-strlen(buf), "FT4_OUT\t%lld\t%02d", currentTimeMillis(), outCount++);
         for(int i=0; i<lst.count(); i++) {
@@ -198,6 +256,20 @@ public:
 
 private:
     int decid;
+
+    // Settings from the SetSt* calls, per instance so that several DecoderMs can decode at once
+    double s_nftx4 = 1200.0;
+    bool f_multi_answer_mod4 = false;
+    int s_decoder_deep4 = 1;
+    bool s_lapon4 = false;
+    int s_nQSOProgress4 = 0;
+    QString s_time4 = "0.0";
+    int s_mousebutton4 = 0;
+    QString s_MyCall4 = "NOT__EXIST";
+    int s_id_cont_ft4_28 = 0;
+    int s_ty_cont_ft4_28 = 0;
+    QString s_HisCall4 = "NOCALL";
+
     std::shared_ptr<F2a> f2a;
     PomAll pomAll;
     PomFt pomFt;
@@ -263,6 +335,7 @@ private:
     int aphis_fd_ft4[28];
 
     std::function<void(const char *)> resultsCallback;
+    FtDecodeResultCallback decodeResultCallback;
 };
 
 //#include <QObject>
@@ -327,6 +400,7 @@ public:
     void SetShOpt(bool f);
     void SetSwlOpt(bool f);
     void SetResultsCallback(std::function<void(const char *)> fun);
+    void SetDecodeResultCallback(FtDecodeResultCallback fun);
     //void SetMyGridMsk144ContM(QString,bool);//for " R " in msg 1.31
     //void SetMsk144RxEqual(int);
     ///  JT56ABC  ////////////////////////
@@ -394,6 +468,31 @@ private:
     std::shared_ptr<F2a> f2a;
     PomAll pomAll;
     //PomFt pomFt;
+
+    // Per decode thread state, members so that several instances can decode at the same time
+    bool have_dec0_ = false;
+    bool have_dec1_ = false;
+    bool have_dec2_ = false;
+    bool have_dec3_ = false;
+    bool have_dec4_ = false;
+    bool have_dec5_ = false;
+    bool have_decALL3_ = false;
+    bool thr_only_one_color = true;
+    std::atomic<bool> end_dec0_ = true;
+    std::atomic<bool> end_dec1_ = true;
+    std::atomic<bool> end_dec2_ = true;
+    std::atomic<bool> end_dec3_ = true;
+    std::atomic<bool> end_dec4_ = true;
+    std::atomic<bool> end_dec5_ = true;
+    double _f00_ = 200;
+    double _f01_ = 700;
+    double _f02_ = 1200;
+    double _f03_ = 1700;
+    double _f04_ = 2200;
+    double _f05_ = 2700;
+    double _f06_ = 3200;
+    int prev_mod = 2;
+
     void EndRtdPeriod();
     bool s_fopen;
     int rtd_dupe_cou;
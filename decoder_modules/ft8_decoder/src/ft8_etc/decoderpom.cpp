@@ -5,6 +5,7 @@
 //#include "decoderms.h"
 #include "decoderpom.h"
 #include <fstream>
+#include <atomic>
 //#include <QRegExp>
 //#include <unistd.h>
 #include <regex>
@@ -35,19 +36,19 @@
 //static int cplu = 0;
 #define SLPAMIN  2000 //2000 importent SLPAMIN > SLPASTEP
 #define SLPASTEP 1000 //1000 importent SLPAMIN > SLPASTEP
-static bool _block_th_all_ = false;        //need to be static for all
-static int _wait_t_ = SLPAMIN - SLPASTEP;  //need to be static for all
+static std::atomic<bool> _block_th_all_ = false;        //need to be static for all, atomic as several decoders run at once
+static std::atomic<int> _wait_t_ = SLPAMIN - SLPASTEP;  //need to be static for all
 static int setup_c2c_d2c_(bool &wait,FFT_PLAN &p,std::complex<float> *a,int nfft,int isign,int iform,float *d = 0)
 {
     // debugPrintf("setup_c2c_d2c_ begin isign %d iform %d sizeof(p)=%d, &p=%p", isign, iform, sizeof(p), &p);
-    if (_block_th_all_ || !wait)
+    if (!wait || _block_th_all_.exchange(true))
     {
         // debugPrintf("setup_c2c_d2c_ ret: %d %d ", _block_th_all_, wait);
         _wait_t_ += SLPASTEP;
         wait = true; //retr++; qDebug()<<"retry---->"<<retr<<_wait_t_;
         return _wait_t_;
     }
-    _block_th_all_ = true; //if (cplu == 0) qDebug()<<"----------------------"; cplu++; qDebug()<<"PLANS="<<cplu<<nfft;
+    //if (cplu == 0) qDebug()<<"----------------------"; cplu++; qDebug()<<"PLANS="<<cplu<<nfft;
 
     //unsigned int flag = FFTW_ESTIMATE_PATIENT;
 //    unsigned int flag = FFTW_ESTIMATE;
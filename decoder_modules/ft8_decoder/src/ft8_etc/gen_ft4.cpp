@@ -13,8 +13,9 @@
 
 #include "gen_ft4.h"
 //#include <QtGui>
+#include <mutex>
 
-static bool inicialize_pulse_ft4_trx = false;
+static std::once_flag inicialize_pulse_ft4_trx;//decoders are built from several threads at once
 static double pulse_ft4_tx[7000];          //    !576*4*3=6912
 
 GenFt4::GenFt4(bool f_dec_gen)//f_dec_gen = dec=true gen=false
@@ -23,7 +24,7 @@ GenFt4::GenFt4(bool f_dec_gen)//f_dec_gen = dec=true gen=false
     genPomFt.initGenPomFt();//first_ft4_enc_174_91 = true;
     twopi=8.0*atan(1.0);   
 
-    if (inicialize_pulse_ft4_trx) return;
+    std::call_once(inicialize_pulse_ft4_trx, [] {
     /*int nsps=4*512;//=2048 48000hz
     //! Compute the frequency-smoothing pulse
     for (int i= 0; i < 3*nsps; ++i)//6144
@@ -33,8 +34,8 @@ GenFt4::GenFt4(bool f_dec_gen)//f_dec_gen = dec=true gen=false
     }*/
     //nsps=4*576;//=2304 48000hz
     //nsps*1.5=3456.0
-    gen_pulse_gfsk_(pulse_ft4_tx,3456.0,1.0,2304);
-    inicialize_pulse_ft4_trx = true;
+        gen_pulse_gfsk_(pulse_ft4_tx,3456.0,1.0,2304);
+    });
 }
 GenFt4::~GenFt4()
 {}
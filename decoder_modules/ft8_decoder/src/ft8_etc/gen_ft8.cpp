@@ -13,8 +13,9 @@
 
 #include "gen_ft8.h"
 //#include <QtGui>
+#include <mutex>
 
-static bool inicialize_pulse_ft8_trx = false;
+static std::once_flag inicialize_pulse_ft8_trx;//decoders are built from several threads at once
 static double pulse_ft8_tx[23060];          //    !1920*4*3=23040
 
 GenFt8::GenFt8(bool f_dec_gen)//f_dec_gen = dec=true gen=false
@@ -23,7 +24,7 @@ GenFt8::GenFt8(bool f_dec_gen)//f_dec_gen = dec=true gen=false
     genPomFt.initGenPomFt();//first_ft8_enc_174_91 = true;
     twopi=8.0*atan(1.0);   
 
-    if (inicialize_pulse_ft8_trx) return;
+    std::call_once(inicialize_pulse_ft8_trx, [] {
     /*int nsps=4*1920;//48000hz=7680
     //! Compute the frequency-smoothing pulse
     for (int i= 0; i < 3*nsps; ++i)//=23040
@@ -31,8 +32,8 @@ GenFt8::GenFt8(bool f_dec_gen)//f_dec_gen = dec=true gen=false
         double tt=(i-1.5*nsps)/(double)nsps;
         pulse_ft8_tx[i]=gfsk_pulse(2.0,tt);//tx=2.0
     }*/
-    gen_pulse_gfsk_(pulse_ft8_tx,11520.0,2.0,7680);
-    inicialize_pulse_ft8_trx = true;
+        gen_pulse_gfsk_(pulse_ft8_tx,11520.0,2.0,7680);
+    });
 }
 GenFt8::~GenFt8()
 {}
@@ -16,11 +16,14 @@
 #include "mshv_support.h"
 #include "pack_unpack_msg77.h"
 #include "config_str_exc.h"
+#include <mutex>
 // #include "../../../config_str_exc.h"
 
 //static const QString c_77_04(){return " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ/";}//for the future [-Wclazy-non-pod-global-static]
 
 //// static decoders array ////////////////////////
+// Shared by every decoder and generator in the process, the lock lets several of them run at once
+static std::mutex hash_arrays_lock;
 static bool inicialize_static_arrays = false;
 #define MAXHASHD 600+4+5//decoders +4=+my +his + r1 +r2  +5=mam slots
 static int ihash10d[MAXHASHD+5];            //+5=for any case
@@ -54,6 +57,7 @@ void PackUnpackMsg77::initPackUnpack77(bool f_dec_gen)//f_dec_gen -> dec=true ge
 
     //qDebug()<<f_dec_gen;
     sf_dec_gen = f_dec_gen;
+    std::lock_guard<std::mutex> lck(hash_arrays_lock);
     if (inicialize_static_arrays) return;
 
     for (int i = 0; i<MAXHASHD; ++i)
@@ -77,6 +81,7 @@ void PackUnpackMsg77::hash10(int n10,QString &c13)
 {
     c13="<0:"+std::to_string(n10)+">";
     if(n10<0 || n10>1023) return;//2.47 not from here
+    std::lock_guard<std::mutex> lck(hash_arrays_lock);
     if (sf_dec_gen)
     {
         for (int i = 0; i < MAXHASHD; ++i)
@@ -115,6 +120,7 @@ void PackUnpackMsg77::hash12(int n12,QString &c13)
 //    c13="<...>";//c++   ==.EQ. !=.NE. >.GT. <.LT. >=.GE. <=.LE.
     c13="<1:"+std::to_string(n12)+">";
     if(n12<0 || n12>4095) return;//2.47 not from here
+    std::lock_guard<std::mutex> lck(hash_arrays_lock);
     if (sf_dec_gen)
     {
         for (int i = 0; i < MAXHASHD; ++i)
@@ -151,6 +157,7 @@ void PackUnpackMsg77::hash12(int n12,QString &c13)
 void PackUnpackMsg77::hash22(int n22,QString &c13)
 {
     c13="<2:"+std::to_string(n22)+">";
+    std::lock_guard<std::mutex> lck(hash_arrays_lock);
     if (sf_dec_gen)
     {
         for (int i = 0; i < MAXHASHD; ++i)
@@ -1064,6 +1071,7 @@ int PackUnpackMsg77::ihashcall(QString c0,int m)
 void PackUnpackMsg77::save_hash_call_mam(QStringList ls)
 {
     if (!sf_dec_gen) return;// only decoders	for any case
+    std::lock_guard<std::mutex> lck(hash_arrays_lock);
     int f_pos = 4;
     for (int i = 0; i < ls.count(); ++i)
     {
@@ -1098,6 +1106,7 @@ void PackUnpackMsg77::save_hash_call_my_his_r1_r2(QString call,int pos)
     n10=ihashcall(c13,10);
     n12=ihashcall(c13,12);
     n22=ihashcall(c13,22);
+    std::lock_guard<std::mutex> lck(hash_arrays_lock);
     if(n10>=0 && n10<=1023) ihash10d[pos]=n10;//2.47
     if(n12>=0 && n12<=4095) ihash12d[pos]=n12;//2.47
     ihash22d[pos]=n22;
@@ -1108,6 +1117,7 @@ void PackUnpackMsg77::save_hash_call(QString c13,int &n10,int &n12,int &n22)
 {
     //qDebug()<<"-> inportent c13+pouses <-   "<<c13<<sf_dec_gen;
     if (c13.at(0)==' ' || c13.mid(0,5)=="<...>") return;
+    std::lock_guard<std::mutex> lck(hash_arrays_lock);
     if (sf_dec_gen)
     {
         n10=ihashcall(c13,10);
@@ -19,9 +19,11 @@
 #include <unordered_map>
 #include <unordered_set>
 #include "ft8_decoder.h"
+#include "decode_scheduler.h"
 #include "../../radio/src/demodulators/usb.h"
 #include <utils/kmeans.h>
 #include <utils/cty.h>
+#include <http_debug_server.h>
 #include "module_interface.h"
 #include "ft8_etc/gen_ft8.h"
 
@@ -158,8 +160,6 @@ struct CallHashCache {
     }
 };
 
-bool removeFiles = true;
-
 struct DecodedResult {
     DecodedMode mode;
     long long decodeEndTimestamp;
@@ -281,6 +281,10 @@ static std::pair<int,int> calculateVFOCenterOffset(const std::vector<int> &frequ
 
 
 class FT8DecoderModule;
+
+// One pool decodes the blocks of every band and mode, so slot boundaries don't oversubscribe the CPU
+static DecodeScheduler decodeScheduler;
+
 static std::vector<int> ft8Frequencies = { 1840000, 3573000, 5357000, 7074000, 10136000, 14074000, 18100000, 21074000, 24915000, 28074000, 50323000, 144174000, 222065000, 432065000  };
 
 struct SingleDecoder {
@@ -345,6 +349,9 @@ struct SingleDecoder {
 
     void startBlockProcessing(const std::shared_ptr<std::vector<dsp::stereo_t>>& block, int blockNumber, int originalOffset);
 
+    // Scheduler key, one per module instance and mode
+    std::string getBandName();
+
     virtual std::pair<int,int> calculateVFOCenterOffsetForMode(double centerFrequency, double ifBandwidth) = 0;
 
 };
@@ -753,8 +760,8 @@ public:
         if (config.conf[name].find("secondsToKeepResults") != config.conf[name].end()) {
             secondsToKeepResults = config.conf[name]["secondsToKeepResults"];
         }
-        if (config.conf[name].find("nthreads") != config.conf[name].end()) {
-            nthreads = config.conf[name]["nthreads"];
+        if (config.conf[name].contains("priorityDecode")) {
+            priorityDecode = config.conf[name]["priorityDecode"].get<bool>();
         }
         if (config.conf[name].contains("processingEnabledFT8")) {
             ft8decoder.processingEnabled = config.conf[name]["processingEnabledFT8"].get<bool>();
@@ -788,9 +795,6 @@ public:
     }
 
     void drawDebugMenu(ImGuiContext *gctx) {
-        ImGui::LeftLabel("Remove FT8 WAVs");
-        ImGui::FillWidth();
-        ImGui::Checkbox("##keep_ft8_wavs", &removeFiles);
         ImGui::Text("ft8en %d onfreq %d", allDecoders[0]->mod->enabled, allDecoders[0]->onTheFrequency);
     }
 
@@ -849,12 +853,24 @@ public:
         //
         // FT8
         //
+        ImGui::LeftLabel("Decode threads");
         ImGui::FillWidth();
-        if (ImGui::SliderInt("##ft8_threads", &_this->nthreads, 1, 6, "%d threads decode", 0)) {
+        int decodeThreads = decodeScheduler.getThreadBudget();
+        if (ImGui::SliderInt("##ft8_decode_threads", &decodeThreads, 1, std::max<int>(1, std::thread::hardware_concurrency()), "%d (all bands)", 0)) {
+            decodeScheduler.setThreadBudget(decodeThreads);
             config.acquire();
-            config.conf[_this->name]["nthreads"] = _this->nthreads;
+            config.conf["decodeThreads"] = decodeThreads;
             config.release(true);
         }
+        ImGui::LeftLabel("Priority decode");
+        if (ImGui::Checkbox(CONCAT("##_priority_decode_", _this->name), &_this->priorityDecode)) {
+            config.acquire();
+            config.conf[_this->name]["priorityDecode"] = _this->priorityDecode;
+            config.release(true);
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Decode this band first, for the one with a QSO in progress");
+        }
 
         auto ft8processing = _this->ft8decoder.blockProcessorsRunning.load();
         if (ft8processing) {
@@ -972,7 +988,7 @@ public:
     char allTxtPath[1024];
     std::string allTxtPathError;
     int secondsToKeepResults = 120;
-    int nthreads = 1;
+    bool priorityDecode = false;
 
     std::string  lastLocation;
     LatLng _myPos = LatLng::invalid();
@@ -1168,170 +1184,144 @@ void SingleDecoder::handleData(int rd, dsp::stereo_t* inputData) {
         handleIFData(reader);
     }
 }
+
+std::string SingleDecoder::getBandName() {
+    return mod->name + "/" + getModeString();
+}
+
 void SingleDecoder::startBlockProcessing(const std::shared_ptr<std::vector<dsp::stereo_t>>& block, int blockNumber, int originalOffset) {
-    std::thread processor([=]() {
-        SetThreadName(getModeString()+"_startBlockProcessing");
-        std::time_t bst = (std::time_t)(blockNumber * getBlockDuration());
-//        flog::info("Start processing block ({}), size={}, block time: {}", this->getModeString(), (int64_t)block->size(), std::asctime(std::gmtime(&bst)));
-        blockProcessorsRunning.fetch_add(1);
-        auto started = currentTimeMillis();
-        std::unique_ptr<int, std::function<void(int*)>> myPtr(new int, [&](int* p) {
-            delete p;
-            auto prev = blockProcessorsRunning.fetch_add(-1);
-//            flog::info("blockProcessorsRunning ({}) released after {} msec, prev={}", getModeString(), (int64_t)(currentTimeMillis() - started), prev);
-        });
-        int count = 0;
-        long long time0 = 0;
-        auto poss = mod->getMyPos();
-        auto handler = [&](int mode, std::vector<std::string> result, std::atomic<const char *> &progress) {
-            progress ="in-handler";
-            if (result.size() == 2 && result[0] == "ERROR") {
-                strcpy(decodeError, result[1].c_str());
-            } else if (result.size() == 1 && result[0] == "DECODE_EOF") {
-                //
-            } else {
-                strcpy(decodeError , "");
-                if (time0 == 0) {
-                    time0 = currentTimeMillis();
-                }
-                auto message = result[4];
-                auto pipe = message.find('|');
-                std::string callsigns;
-                std::string callsign;
-                if (pipe != std::string::npos) {
-                    progress = "pipe1";
-                    callsigns = message.substr(pipe + 1);
-                    message = message.substr(0, pipe);
-                    std::vector<std::string> callsignsV;
-                    progress = "pipe2";
-                    splitStringV(callsigns, ";", callsignsV);
-                    progress = "pipe3";
-                    if (callsignsV.size() > 1) {
-                        progress = "pipe4";
-                        callsign = callsignsV[1];
-                        callHashCacheMutex.lock();
-                        progress = "pipe5";
-                        callHashCache.addCall(callsignsV[0], bst * 1000);
-                        callHashCache.addCall(callsignsV[1], bst * 1000);
-                        callHashCacheMutex.unlock();
-                        progress = "pipe6";
-                    }
-                    if (!callsign.empty() && callsign[0] == '<') {
-                        progress = "pipe7";
-                        callHashCacheMutex.lock();
-                        auto ncallsign = callHashCache.findCall(callsign, bst * 1000);
-                        progress = "pipe8";
+    // Outlives this call, the decode runs later on a scheduler thread
+    struct DecodeState {
+        std::atomic_int count = 0;
+        std::atomic<long long> time0 = 0;
+        LatLng poss = LatLng::invalid();
+    };
+    auto state = std::make_shared<DecodeState>();
+    state->poss = mod->getMyPos();
+    std::time_t bst = (std::time_t)(blockNumber * getBlockDuration());
+//    flog::info("Start processing block ({}), size={}, block time: {}", this->getModeString(), (int64_t)block->size(), std::asctime(std::gmtime(&bst)));
+    auto handler = [this, state, bst, blockNumber](const FtDecodeResult &result) {
+        long long unset = 0;
+        state->time0.compare_exchange_strong(unset, currentTimeMillis());
+        auto message = result.message;
+        auto pipe = message.find('|');
+        std::string callsigns;
+        std::string callsign;
+        if (pipe != std::string::npos) {
+            callsigns = message.substr(pipe + 1);
+            message = message.substr(0, pipe);
+            std::vector<std::string> callsignsV;
+            splitStringV(callsigns, ";", callsignsV);
+            if (callsignsV.size() > 1) {
+                callsign = callsignsV[1];
+                callHashCacheMutex.lock();
+                callHashCache.addCall(callsignsV[0], bst * 1000);
+                callHashCache.addCall(callsignsV[1], bst * 1000);
+                callHashCacheMutex.unlock();
+            }
+            if (!callsign.empty() && callsign[0] == '<') {
+                callHashCacheMutex.lock();
+                auto ncallsign = callHashCache.findCall(callsign, bst * 1000);
 //                        flog::info("Found call: {} -> {}", callsign, ncallsign);
-                        callsign = ncallsign;
-                        callHashCacheMutex.unlock();
-                        progress = "pipe9";
-                    }
-                }
-                else {
-                    progress = "pre-extract";
-                    callsign = extractCallsignFromFT8(message);
-                    progress = "post-extract";
-                }
-                count++;
-                if (callsign.empty() || callsign.find('<') != std::string::npos) { // ignore <..> callsigns
-                    return;
-                }
-                double distance = 0;
-                CTY::Callsign cs;
-                if (callsign.empty()) {
-                    callsign = "?? " + message;
-                }
-                else {
-                    progress = "pre-find";
-                    cs = globalCty.findCallsign(callsign);
-                    progress = "post-find";
-                    if (poss.isValid()) {
-                        auto bd = bearingDistance(poss, cs.ll);
-                        distance = bd.distance;
-                    }
-                }
-                progress = "pre-mkdecoded-result";
-                auto frequencyInBand = atoi(result[3].c_str());
-
-                if (message.find(callsign) == std::string::npos) {
-                    // inject callsign into message
-                    std::string newmsg;
-                    std::vector<std::string> splitMessage;
-                    splitStringV(message, " ", splitMessage);
-                    for(auto &s : splitMessage) {
-                        if (s[0] == '<' && s[s.size()-1] == '>') {
-                            s = callsign;   // inject
-                        }
-                        newmsg += s + " ";
-                    }
-                    if (newmsg.size() > 0) {
-                        newmsg.resize(newmsg.size() - 1);
-                    }
-                    message = newmsg;
-                }
-                DecodedResult decodedResult(getModeDM(), (long long)(blockNumber * getBlockDuration() * 1000 + getBlockDuration()), frequencyInBand, callsign, message);
-                decodedResult.distance = (int)distance;
-                auto strength = atof(result[1].c_str());
-                strength = (strength + 24) / (24 + 24);
-                if (strength < 0.0) strength = 0.0;
-                if (strength > 1.0) strength = 1.0;
-                decodedResult.strength = strength;
-                decodedResult.strengthRaw = atof(result[1].c_str());
-                decodedResult.intensity = 0;
-
-                time_t blocktimeUnix = blockNumber * getBlockDuration();
-                tm* ltm = std::gmtime(&blocktimeUnix);
-
-                char buf[100];
-                snprintf(buf, sizeof buf, "%02d%02d%02d_%02d%02d%02d", ltm->tm_year % 100, ltm->tm_mon + 1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min, ltm->tm_sec);
-                decodedResult.decodedBlock = buf;
-                snprintf(buf, sizeof buf,  "%0.3f", (previousCenterOffset - USB_BANDWIDTH) / 1000000.0);
-                decodedResult.frequencyBand = buf;
-
-                // (random() % 100) / 100.0;
-                if (!cs.dxccname.empty()) {
-                    decodedResult.qth = cs.dxccname;
-                }
-                progress = "pre-add-result";
-                mod->addDecodedResult(decodedResult);
-                progress = "post-add-result";
+                callsign = ncallsign;
+                callHashCacheMutex.unlock();
             }
+        }
+        else {
+            callsign = extractCallsignFromFT8(message);
+        }
+        state->count++;
+        if (callsign.empty() || callsign.find('<') != std::string::npos) { // ignore <..> callsigns
             return;
-        };
-        std::atomic<const char *> progress;
-        progress = "Starting";
-        std::thread t0([&]() {
-            SetThreadName(getModeString()+"_callDecode");
-            auto start = currentTimeMillis();
-            dsp::ft8::decodeFT8(mod->nthreads, getModeString(), VFO_SAMPLE_RATE, block->data(), block->size(), handler, progress, removeFiles);
-            auto end = currentTimeMillis();
-            if (noisy_ft8) {
-                flog::info("FT8 decoding ({}) took {} ms", this->getModeString(), (int64_t) (end - start));
+        }
+        double distance = 0;
+        CTY::Callsign cs;
+        if (callsign.empty()) {
+            callsign = "?? " + message;
+        }
+        else {
+            cs = globalCty.findCallsign(callsign);
+            if (state->poss.isValid()) {
+                auto bd = bearingDistance(state->poss, cs.ll);
+                distance = bd.distance;
             }
-            lastDecodeCount = (int)count;
-            lastDecodeTime = (int)(end - start);
-            if (time0 == 0) {
-                lastDecodeTime0 = 0;
-            } else {
-                lastDecodeTime0 = (int)(time0 - start);
+        }
+        auto frequencyInBand = result.frequency;
+
+        if (message.find(callsign) == std::string::npos) {
+            // inject callsign into message
+            std::string newmsg;
+            std::vector<std::string> splitMessage;
+            splitStringV(message, " ", splitMessage);
+            for(auto &s : splitMessage) {
+                if (s[0] == '<' && s[s.size()-1] == '>') {
+                    s = callsign;   // inject
+                }
+                newmsg += s + " ";
             }
-        });
+            if (newmsg.size() > 0) {
+                newmsg.resize(newmsg.size() - 1);
+            }
+            message = newmsg;
+        }
+        DecodedResult decodedResult(getModeDM(), (long long)(blockNumber * getBlockDuration() * 1000 + getBlockDuration()), frequencyInBand, callsign, message);
+        decodedResult.distance = (int)distance;
+        double strength = result.snr;
+        strength = (strength + 24) / (24 + 24);
+        if (strength < 0.0) strength = 0.0;
+        if (strength > 1.0) strength = 1.0;
+        decodedResult.strength = strength;
+        decodedResult.strengthRaw = result.snr;
+        decodedResult.intensity = 0;
+
+        time_t blocktimeUnix = blockNumber * getBlockDuration();
+        tm* ltm = std::gmtime(&blocktimeUnix);
+
+        char buf[100];
+        snprintf(buf, sizeof buf, "%02d%02d%02d_%02d%02d%02d", ltm->tm_year % 100, ltm->tm_mon + 1, ltm->tm_mday, ltm->tm_hour, ltm->tm_min, ltm->tm_sec);
+        decodedResult.decodedBlock = buf;
+        snprintf(buf, sizeof buf,  "%0.3f", (previousCenterOffset - USB_BANDWIDTH) / 1000000.0);
+        decodedResult.frequencyBand = buf;
+
+        // (random() % 100) / 100.0;
+        if (!cs.dxccname.empty()) {
+            decodedResult.qth = cs.dxccname;
+        }
+        mod->addDecodedResult(decodedResult);
+        return;
+    };
 
-        auto future = std::async(std::launch::async, &std::thread::join, &t0);
-        int count0=0;
-        while(true) {
-            if (future.wait_for(std::chrono::seconds(1)) == std::future_status::timeout) {
-//                flog::info("outside progress({}: decoding ({}) : {}", count0, this->getModeString(), progress.load());
-                count0++;
+    DecodeScheduler::Job job;
+    job.band = getBandName();
+    job.priority = mod->priorityDecode ? 1 : 0;
+    // The block is submitted at the end of its slot, results are still useful until the end of the next one
+    job.deadlineMillis = (int)(getBlockDuration() * 1000);
+    job.run = [this, state, block, handler](int threads) {
+        if (dsp::ft8::decodeBlock(threads, getModeString(), VFO_SAMPLE_RATE, *block, handler)) {
+            strcpy(decodeError, "");
+        } else {
+            snprintf(decodeError, sizeof(decodeError), "cannot decode %s block", getModeString().c_str());
+        }
+        return (int)state->count;
+    };
+    job.done = [this, state](bool decoded, int results, int decodeMillis) {
+        if (decoded) {
+            if (noisy_ft8) {
+                flog::info("FT8 decoding ({}) took {} ms", this->getModeString(), decodeMillis);
+            }
+            auto start = currentTimeMillis() - decodeMillis;
+            lastDecodeCount = results;
+            lastDecodeTime = decodeMillis;
+            if (state->time0 == 0) {
+                lastDecodeTime0 = 0;
             } else {
-                break;
+                lastDecodeTime0 = (int)(state->time0 - start);
             }
         }
-
-//        flog::info("blockProcessorsRunning ({}) gracefully completed {}", getModeString(), blockNumber);
-
-    });
-    processor.detach();
+        blockProcessorsRunning.fetch_add(-1);
+    };
+    blockProcessorsRunning.fetch_add(1);
+    decodeScheduler.submit(std::move(job));
 }
 
 void SingleDecoder::init(const std::string &name) {
@@ -1394,6 +1384,7 @@ void SingleDecoder::destroy() {
     gui::mainWindow.onPlayStateChange.unbindHandler(&onPlayStateChange);
     ifChain.out->stopReader();
     running = false;
+    decodeScheduler.cancel(getBandName());
 }
 
 
@@ -1405,6 +1396,18 @@ MOD_EXPORT void _INIT_() {
     config.enableAutoSave();
     mshv_init();
 
+    config.acquire();
+    int decodeThreads = config.conf.contains("decodeThreads") ? config.conf["decodeThreads"].get<int>() : (int)std::thread::hardware_concurrency();
+    config.release();
+    decodeScheduler.start(decodeThreads);
+    httpdebug::procfs::registerEndpoint("/ft8_decoder/scheduler",
+        []() -> std::string { return decodeScheduler.getStatsJson(); },
+        nullptr,
+        httpdebug::procfs::Type::String);
+    httpdebug::procfs::registerEndpoint("/ft8_decoder/decode_threads",
+        []() -> std::string { return std::to_string(decodeScheduler.getThreadBudget()); },
+        [](const std::string& val) { decodeScheduler.setThreadBudget(std::atoi(val.c_str())); },
+        httpdebug::procfs::Type::Int);
 }
 
 MOD_EXPORT ModuleManager::Instance* _CREATE_INSTANCE_(std::string name) {
@@ -1416,6 +1419,9 @@ MOD_EXPORT void _DELETE_INSTANCE_(void* instance) {
 }
 
 MOD_EXPORT void _END_() {
+    httpdebug::procfs::unregister("/ft8_decoder/scheduler");
+    httpdebug::procfs::unregister("/ft8_decoder/decode_threads");
+    decodeScheduler.stop();
     config.disableAutoSave();
     config.save();
 }
@@ -1429,27 +1435,18 @@ void SingleDecoder::handleIFData(const std::vector<dsp::stereo_t>& data) {
             flog::info("handleIFdata new block ({}) : {} ", getModeString(), blockNumber);
         }
         if (fullBlock) {
-            bool shouldStartProcessing = true;
+            // Always submitted, the scheduler replaces the previous block of this band if it didn't start yet
             std::shared_ptr<std::vector<dsp::stereo_t>> processingBlock;
             processingBlock = fullBlock;
-            int currentlyRunning = blockProcessorsRunning.load();
-            if (currentlyRunning > 0) {
-                shouldStartProcessing = false;
-                flog::info("blockProcessorsRunning ({}) not starting: {}", getModeString(), currentlyRunning);
-
-            }
-            if (shouldStartProcessing) {
-                // no processing is done.
-                if (processingBlock->size() / VFO_SAMPLE_RATE > getBlockDuration()+1 || processingBlock->size() / VFO_SAMPLE_RATE <= getBlockDuration()-2) {
-                    flog::info("Block size ({}) is not matching: {}, curtime={}",
-                               getModeString(),
-                               (int64_t)(processingBlock->size() / VFO_SAMPLE_RATE),
-                               (int64_t)curtime);
-                    processingBlock.reset(); // clear for new one
-                } else {
-                    // block size is ok.
-                    startBlockProcessing(processingBlock, prevBlockNumber, vfoOffset + gui::waterfall.getCenterFrequency());
-                }
+            if (processingBlock->size() / VFO_SAMPLE_RATE > getBlockDuration()+1 || processingBlock->size() / VFO_SAMPLE_RATE <= getBlockDuration()-2) {
+                flog::info("Block size ({}) is not matching: {}, curtime={}",
+                           getModeString(),
+                           (int64_t)(processingBlock->size() / VFO_SAMPLE_RATE),
+                           (int64_t)curtime);
+                processingBlock.reset(); // clear for new one
+            } else {
+                // block size is ok.
+                startBlockProcessing(processingBlock, prevBlockNumber, vfoOffset + gui::waterfall.getCenterFrequency());
             }
             fullBlock.reset();
         }
@@ -1462,25 +1459,3 @@ void SingleDecoder::handleIFData(const std::vector<dsp::stereo_t>& data) {
     fullBlock->insert(std::end(*fullBlock), std::begin(data), std::end(data));
     //        flog::info("{} Got {} samples: {}", blockNumber, data.size(), data[0].l);
 }
-
-
-#ifdef NEW_BUILTIN_MODE
-
-extern void doDecode(const char *mode, const char *path, int threads, std::function<void(int mode, std::vector<std::string> result)> callback);
-namespace dsp {
-    namespace ft8 {
-        void invokeDecoder(int nthreads, const std::string &mode, const std::string &wavPath, const std::string &outPath,
-                           const std::string &errPath,
-                           std::function<void(int mode, std::vector<std::string> result, std::atomic<const char *> &progress)> callback1,
-                           std::atomic<const char *> &progress)
-        {
-            ::doDecode(mode.c_str(), wavPath.c_str(), nthreads, [&](int mode2, std::vector<std::string> result) {
-                callback1(mode2, result, progress);
-            });
-        }
-
-    }
-}
-
-
-#endif
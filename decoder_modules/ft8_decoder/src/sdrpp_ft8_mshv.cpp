@@ -29,6 +29,8 @@
 
 #include <utils/usleep.h>
 #include <utils/strings.h>
+#include <utils/flog.h>
+#include "ft8_decoder.h"
 
 namespace ft8 {
 
@@ -37,46 +39,47 @@ namespace ft8 {
         DMS_FT4 = 13
     } DecoderMSMode;
 
-
-    // input stereo samples, nsamples (number of pairs of float)
-    inline void decodeFT8(int threads, const char *mode, int sampleRate, dsp::stereo_t* samples, long long nsamples, std::function<void(const char*)> callback) {
-        //
-        //
-        //
-        mshv_init();
-
-//        four2a_d2c_cnt = 0;
-
+    // Converts to the 12 kHz int16 mono the decoder takes. With normalize, blocks louder than full scale are scaled
+    // down rather than wrapped around in int16, as the float WAV files used to be.
+    static std::vector<short> toDecoderInput(int sampleRate, const dsp::stereo_t* samples, long long nsamples, bool normalize) {
         std::vector<dsp::stereo_t> resampledV;
-
         if (sampleRate != 12000) {
             long long int outSize = 3 * (nsamples * 12000) / sampleRate;
             resampledV.resize(outSize);
             dsp::multirate::RationalResampler<dsp::stereo_t> res;
             res.init(nullptr, sampleRate, 12000);
-            nsamples = res.process(nsamples, samples, resampledV.data());
+            nsamples = res.process(nsamples, (dsp::stereo_t*)samples, resampledV.data());
             samples = resampledV.data();
-            printf("Resampled, samples size=2 * %zu\n", resampledV.size()/2);
         }
 
+        float scale = 16383.52f;
+        if (normalize) {
+            float max = 0.0f;
+            for (long long i = 0; i < nsamples; i++) {
+                max = std::max<float>(max, std::max<float>(fabsf(samples[i].l), fabsf(samples[i].r)));
+            }
+            if (max > 1.0f) {
+                scale /= max;
+            }
+        }
 
-
-        std::vector<short> converted;
-        converted.reserve(nsamples);
-        for (int q = 0; q < nsamples; q++) {
-            converted.emplace_back(samples[q].l * 16383.52);
+        std::vector<short> converted(nsamples);
+        for (long long q = 0; q < nsamples; q++) {
+            converted[q] = (short)(samples[q].l * scale);
         }
+        return converted;
+    }
 
-        //    auto core = std::make_shared<MsCore>();
-        //    core->ResampleAndFilter(converted.data(), converted.size());
+    // A decoder of its own for each call, nothing is shared with other calls but the callsign hash table
+    static std::shared_ptr<DecoderMs> makeDecoder(int threads, const char *mode) {
+        mshv_init();
         auto dms = std::make_shared<DecoderMs>();
         if (std::string("ft8") == mode) {
             dms->setMode(DMS_FT8);
         } else if (std::string("ft4") == mode) {
             dms->setMode(DMS_FT4);
         } else {
-            fprintf(stderr, "ERROR: invalid mode is specified. Valid modes: ft8, ft4\n");
-            exit(1);
+            return nullptr;
         }
         {
             QStringList ql;
@@ -93,15 +96,48 @@ namespace ft8 {
             ql << "";
             dms->SetCalsHash(ql);
         }
-        dms->SetResultsCallback(callback);
         dms->SetDecoderDeep(3);
         dms->SetThrLevel(threads);
+        return dms;
+    }
 
+    static void runDecoder(const std::shared_ptr<DecoderMs> &dms, std::vector<short> &converted) {
         dms->SetDecode(converted.data(), converted.size(), "120000", 0, 4, false, true, false);
         while (dms->IsWorking()) {
-            usleep(100000);
+            usleep(10000);
         }
-        return;
+    }
+
+    // input stereo samples, nsamples (number of pairs of float)
+    inline void decodeFT8(int threads, const char *mode, int sampleRate, dsp::stereo_t* samples, long long nsamples, std::function<void(const char*)> callback) {
+        auto converted = toDecoderInput(sampleRate, samples, nsamples, false);
+        auto dms = makeDecoder(threads, mode);
+        if (!dms) {
+            fprintf(stderr, "ERROR: invalid mode is specified. Valid modes: ft8, ft4\n");
+            exit(1);
+        }
+        dms->SetResultsCallback(callback);
+        runDecoder(dms, converted);
+    }
+
+}
+
+namespace dsp::ft8 {
+
+    bool decodeBlock(int nthreads, const std::string& mode, int sampleRate, const std::vector<dsp::stereo_t>& samples,
+                     const FtDecodeResultCallback& callback) {
+        auto dms = ::ft8::makeDecoder(nthreads, mode.c_str());
+        if (!dms) {
+            flog::error("FT8 decoder: unknown mode {}", mode);
+            return false;
+        }
+        auto converted = ::ft8::toDecoderInput(sampleRate, samples.data(), samples.size(), true);
+        if (converted.size() < 512) {
+            return false;
+        }
+        dms->SetDecodeResultCallback(callback);
+        ::ft8::runDecoder(dms, converted);
+        return true;
     }
 
 }
@@ -17,6 +17,7 @@
 #include <utils/optionlist.h>
 #include <cmath>
 #include <fftw3.h>
+#include <utils/arrays.h>
 #include <algorithm>
 #include "radio_interface.h"
 #include "demod.h"
@@ -267,7 +268,11 @@ public:
             // For bucket averaging: compute FFT, then average into buckets
             float* fftIn = (float*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
             fftwf_complex* fftOut = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * fftSize);
-            auto plan = fftwf_plan_dft_1d(fftSize, (fftwf_complex*)fftIn, fftOut, FFTW_FORWARD, FFTW_ESTIMATE);
+            fftwf_plan plan;
+            {
+                std::lock_guard<std::mutex> lck(dsp::arrays::fftwPlannerMutex());
+                plan = fftwf_plan_dft_1d(fftSize, (fftwf_complex*)fftIn, fftOut, FFTW_FORWARD, FFTW_ESTIMATE);
+            }
             
             for (int i = 0; i < fftSize; i++) {
                 fftIn[2*i] = snap[i].re * window[i];
@@ -303,7 +308,10 @@ public:
             json += ", \"max_bin\": " + std::to_string(maxPower);
             json += "}";
             
-            fftwf_destroy_plan(plan);
+            {
+                std::lock_guard<std::mutex> lck(dsp::arrays::fftwPlannerMutex());
+                fftwf_destroy_plan(plan);
+            }
             fftwf_free(fftIn);
             fftwf_free(fftOut);
             
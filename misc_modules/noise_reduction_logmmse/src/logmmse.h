@@ -85,6 +85,7 @@ namespace dsp {
                 int nFFT;
                 Arg<FFTPlan> forwardPlan;
                 Arg<FFTPlan> reversePlan;
+                ArrayArena arena;       // per frame temporaries, see logmmse_all
                 float aa = 0.98;
                 float mu = 0.98;
                 float ksi_min;
@@ -132,16 +133,17 @@ namespace dsp {
                     diff = muleach(diff, diff);
                     dev_history.emplace_back(diff);
 
-                    devs = addeach(devs, diff);
+                    addeach_(devs, diff);
 
                     while (dev_history.size() > noise_history_len()) {
-                        devs = subeach(devs, dev_history.front());
+                        volk_32f_x2_subtract_32f(devs->data(), devs->data(), dev_history.front()->data(), nFFT);
                         dev_history.pop_front();
                     }
 
                 }
 
                 BackgroundNoiseCaltulator backgroundNoiseCaltulator;
+                std::vector<float> devFrame;
 
 
 #define ADD_STEP_STATS()          ctm2 = currentTimeNanos(); muSum[statIndex++] += ctm2-ctm; ctm = ctm2
@@ -166,7 +168,8 @@ namespace dsp {
 
                             // recalculate noise floor
                             if (generation > 0) {
-                                std::vector<float> lower(nFFT, 0);
+                                auto tnm = npzeros(nFFT);
+                                auto lower = tnm->data();
                                 ALLOC_AND_CHECK(x, sz, "update_noise_mu2 point 1.5")
                                 const int nlower = 12;
                                 int ix = 0;
@@ -185,7 +188,6 @@ namespace dsp {
                                     lower[w] *= lower[w];
                                 }
                                 ALLOC_AND_CHECK(x, sz, "update_noise_mu2 point 3")
-                                auto tnm = std::make_shared<std::vector<float>>(lower);
                                 auto tnoise_mu2 = npmavg(tnm, 6);
                                 auto tmindb = *std::min_element(tnoise_mu2->begin(), tnoise_mu2->end());
                                 auto tmaxdb = *std::max_element(tnoise_mu2->begin(), tnoise_mu2->end());
@@ -216,7 +218,7 @@ namespace dsp {
                             generation++;
                         } else {
 
-                            auto noise_mu2_copy = *noise_mu2;
+                            auto noise_mu2_copy = clone(noise_mu2);
 
                             auto noiseAvg = mul(sums, 1 / (float)nframes);
 
@@ -235,20 +237,20 @@ namespace dsp {
                             }
                             memset(noise_mu2->data(), 0, nFFT*sizeof(noise_mu2->at(0)));
                             ADD_STEP_STATS();
-                            std::vector<float> devs(devSquareD, devSquareD +nFFT);
-                            float detectedNoise = backgroundNoiseCaltulator.addFrame(devs);
+                            devFrame.assign(devSquareD, devSquareD + nFFT);
+                            float detectedNoise = backgroundNoiseCaltulator.addFrame(devFrame);
                             ADD_STEP_STATS();
                             auto acceptible_stdev = detectedNoise;
                             auto nmu2 = noise_mu2->data();
                             auto navg =  noiseAvg->data();
                             for(int q=0; q < nFFT; q++) {
-                                if (devs[q] < acceptible_stdev) {
+                                if (devFrame[q] < acceptible_stdev) {
                                     nmu2[q] = navg[q] * navg[q];
                                 }
                             }
 
                             if (!linearInterpolateHoles(nmu2, nFFT)) {
-                                *noise_mu2 = noise_mu2_copy;
+                                std::copy(noise_mu2_copy->begin(), noise_mu2_copy->end(), noise_mu2->begin());
                             }
 
                             ADD_STEP_STATS();
@@ -339,6 +341,8 @@ namespace dsp {
             }
 
             static ComplexArray logmmse_all(const ComplexArray &x, int Srate, float eta, SavedParamsC *params) {
+                // Temporaries are recycled from frame to frame instead of going to the heap
+                ArenaScope arenaScope(params->arena);
                 int sz = x->size();
                 ALLOC_AND_CHECK(x, sz, "logmmse_all point -2.1")
                 static long long muSum[30] = {0,}, muCount = 0; auto ctm = currentTimeNanos();long long ctm2; auto statIndex = 0;
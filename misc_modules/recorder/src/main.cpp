@@ -8,7 +8,10 @@
 #include <dsp/audio/volume.h>
 #include <dsp/convert/stereo_to_mono.h>
 #include <thread>
+#include <atomic>
 #include <ctime>
+#include <cmath>
+#include <inttypes.h>
 #include <gui/gui.h>
 #include <filesystem>
 #include <signal_path/signal_path.h>
@@ -28,6 +31,10 @@
 
 #define SILENCE_LVL 10e-6
 
+// Write-behind pool for baseband, sized to ride out this much disk stall
+#define BASEBAND_BUFFER_SECONDS 2.0
+#define BASEBAND_BLOCK_SIZE     (4 * 1024 * 1024)
+
 SDRPP_MOD_INFO{
     /* Name:            */ "recorder",
     /* Description:     */ "Recorder module for SDR++",
@@ -47,7 +54,8 @@ public:
 
         // Define option lists
         containers.define("WAV", wav::FORMAT_WAV);
-        // containers.define("RF64", wav::FORMAT_RF64); // Disabled for now
+        containers.define("RF64", wav::FORMAT_RF64);
+        containers.define("W64", wav::FORMAT_W64);
         sampleTypes.define(wav::SAMP_TYPE_UINT8, "Uint8", wav::SAMP_TYPE_UINT8);
         sampleTypes.define(wav::SAMP_TYPE_INT16, "Int16", wav::SAMP_TYPE_INT16);
         sampleTypes.define(wav::SAMP_TYPE_INT32, "Int32", wav::SAMP_TYPE_INT32);
@@ -84,6 +92,9 @@ public:
         if (config.conf[name].contains("ignoreSilence")) {
             ignoreSilence = config.conf[name]["ignoreSilence"];
         }
+        if (config.conf[name].contains("directIO")) {
+            directIO = config.conf[name]["directIO"];
+        }
         if (config.conf[name].contains("nameTemplate")) {
             std::string _nameTemplate = config.conf[name]["nameTemplate"];
             if (_nameTemplate.length() > sizeof(nameTemplate)-1) {
@@ -111,6 +122,7 @@ public:
     }
 
     ~RecorderModule() {
+        if (historyThread.joinable()) { historyThread.join(); }
         std::lock_guard<std::recursive_mutex> lck(recMtx);
         core::modComManager.unregisterInterface(name);
         gui::menu.removeEntry(name);
@@ -169,10 +181,20 @@ public:
         writer.setChannels((recMode == RECORDER_MODE_AUDIO && !stereo) ? 1 : 2);
         writer.setSampleType(sampleTypes[sampleTypeId]);
         writer.setSamplerate(samplerate);
+        if (recMode == RECORDER_MODE_BASEBAND) {
+            double bytesPerSecond = (double)samplerate * 2.0 * sampleTypeBytes(sampleTypes[sampleTypeId]);
+            int blocks = std::clamp<int>(ceil(bytesPerSecond * BASEBAND_BUFFER_SECONDS / BASEBAND_BLOCK_SIZE), 8, 128);
+            writer.setBuffering(BASEBAND_BLOCK_SIZE, blocks);
+            writer.setDirectIO(directIO);
+        }
+        else {
+            writer.setBuffering(256 * 1024, 4);
+            writer.setDirectIO(false);
+        }
 
         // Open file
         std::string vfoName = (recMode == RECORDER_MODE_AUDIO) ? selectedStreamName : "";
-        std::string extension = ".wav";
+        std::string extension = (containers[containerId] == wav::FORMAT_W64) ? ".w64" : ".wav";
         std::string expandedPath = expandString(folderSelect.path + "/" + genFileName(nameTemplate, recMode, vfoName) + extension);
         if (!writer.open(expandedPath)) {
             flog::error("Failed to open file for recording: {0}", expandedPath);
@@ -227,7 +249,67 @@ public:
         recording = false;
     }
 
+    // Saves the IQ history between the given number of seconds ago to a baseband file in the background
+    bool saveHistory(double fromSecondsAgo, double toSecondsAgo) {
+        auto history = sigpath::iqFrontEnd.getHistory();
+        if (!history) {
+            flog::error("Recorder: IQ history is disabled, nothing to save");
+            return false;
+        }
+        if (savingHistory) { return false; }
+        if (historyThread.joinable()) { historyThread.join(); }
+
+        uint64_t from = history->positionSecondsAgo(fromSecondsAgo);
+        uint64_t to = history->positionSecondsAgo(toSecondsAgo);
+        if (to <= from) { return false; }
+        double sampleRate = history->getSampleRate();
+
+        // Named after the time of the first sample, like a recording started then
+        std::string extension = (containers[containerId] == wav::FORMAT_W64) ? ".w64" : ".wav";
+        time_t startTime = time(0) - (time_t)(history->getWritePosition() - from) / (time_t)sampleRate;
+        std::string path = expandString(folderSelect.path + "/" + genFileName(nameTemplate, RECORDER_MODE_BASEBAND, "", startTime) + extension);
+
+        savingHistory = true;
+        historyProgress = 0.0f;
+        historyThread = std::thread(&RecorderModule::historyWorker, this, history, from, to, sampleRate, path);
+        return true;
+    }
+
 private:
+    void historyWorker(dsp::buffer::IQHistory* history, uint64_t from, uint64_t to, double sampleRate, std::string path) {
+        wav::Writer w(2, sampleRate, containers[containerId], sampleTypes[sampleTypeId]);
+        w.setBuffering(BASEBAND_BLOCK_SIZE, 8);
+        w.setBlocking(true);
+        if (!w.open(path)) {
+            flog::error("Failed to open file for saving the IQ history: {0}", path);
+            savingHistory = false;
+            return;
+        }
+
+        // The oldest samples keep being overwritten while saving, skip ahead if the disk is that slow
+        std::vector<dsp::complex_t> buf(STREAM_BUFFER_SIZE);
+        uint64_t pos = from;
+        uint64_t lost = 0;
+        while (pos < to) {
+            int count = history->read(pos, buf.data(), std::min<uint64_t>(buf.size(), to - pos));
+            if (!count) {
+                uint64_t oldest = history->getOldestPosition();
+                if (oldest <= pos || oldest >= to) { break; }
+                lost += oldest - pos;
+                pos = oldest;
+                continue;
+            }
+            w.write((float*)buf.data(), count);
+            pos += count;
+            historyProgress = (float)(pos - from) / (float)(to - from);
+        }
+        w.close();
+
+        if (lost) { flog::warn("IQ history saved to {0}, {1} samples were overwritten before they could be saved", path, lost); }
+        else { flog::info("IQ history saved to {0}", path); }
+        savingHistory = false;
+    }
+
     static void menuHandler(void* ctx) {
         RecorderModule* _this = (RecorderModule*)ctx;
         float menuWidth = ImGui::GetContentRegionAvail().x;
@@ -285,6 +367,16 @@ private:
             config.release(true);
         }
 
+#ifdef __linux__
+        if (_this->recMode == RECORDER_MODE_BASEBAND) {
+            if (ImGui::Checkbox(CONCAT("Direct I/O##_recorder_direct_io_", _this->name), &_this->directIO)) {
+                config.acquire();
+                config.conf[_this->name]["directIO"] = _this->directIO;
+                config.release(true);
+            }
+        }
+#endif
+
         if (_this->recording) { style::endDisabled(); }
 
         // Show additional audio options
@@ -329,6 +421,34 @@ private:
             }
         }
 
+        // Save what already went by from the IQ history
+        auto history = sigpath::iqFrontEnd.getHistory();
+        if (history && _this->recMode == RECORDER_MODE_BASEBAND) {
+            if (_this->savingHistory) {
+                ImGui::ProgressBar(_this->historyProgress, ImVec2(menuWidth, 0), "Saving history...");
+            }
+            else {
+                ImGui::LeftLabel("Last seconds");
+                ImGui::FillWidth();
+                ImGui::InputInt(CONCAT("##_recorder_history_seconds_", _this->name), &_this->historySeconds, 5, 30);
+                _this->historySeconds = std::clamp<int>(_this->historySeconds, 1, std::max<int>(1, history->getCapacitySeconds()));
+                if (ImGui::Button(CONCAT("Save history##_recorder_save_history_", _this->name), ImVec2(menuWidth, 0))) {
+                    _this->saveHistory(_this->historySeconds, 0.0);
+                }
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("%.0f s of IQ history available", history->getAvailableSeconds());
+                }
+            }
+        }
+        if (history && _this->recMode == RECORDER_MODE_AUDIO && !_this->selectedStreamName.empty()) {
+            float shift = sigpath::iqFrontEnd.getVFOTimeShift(_this->selectedStreamName);
+            ImGui::LeftLabel("Time shift");
+            ImGui::FillWidth();
+            if (ImGui::SliderFloat(CONCAT("##_recorder_time_shift_", _this->name), &shift, 0.0f, history->getCapacitySeconds(), shift > 0.0f ? "%.1f s behind" : "Live")) {
+                sigpath::iqFrontEnd.setVFOTimeShift(_this->selectedStreamName, shift);
+            }
+        }
+
         // Record button
         bool canRecord = _this->folderSelect.pathIsValid();
         if (_this->recMode == RECORDER_MODE_AUDIO) { canRecord &= !_this->selectedStreamName.empty(); }
@@ -352,6 +472,17 @@ private:
             else {
                 ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Recording %02d:%02d:%02d", dtm->tm_hour, dtm->tm_min, dtm->tm_sec);
             }
+
+            // Disk buffer and what the disk could not keep up with
+            char bufText[64];
+            snprintf(bufText, sizeof(bufText), "Buffer %.0f%% (peak %.0f%%)", _this->writer.getBufferUsage() * 100.0f, _this->writer.getPeakBufferUsage() * 100.0f);
+            ImGui::ProgressBar(_this->writer.getBufferUsage(), ImVec2(menuWidth, 0), bufText);
+            if (_this->writer.getOverruns()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Dropped %" PRIu64 " samples in %" PRIu64 " overruns", _this->writer.getDroppedSamples(), _this->writer.getOverruns());
+            }
+            if (_this->writer.hasError()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Disk write error");
+            }
         }
     }
 
@@ -455,9 +586,9 @@ private:
         { RADIO_IFACE_MODE_RAW, "RAW" }
     };
 
-    std::string genFileName(std::string templ, int recMode, std::string name) {
+    std::string genFileName(std::string templ, int recMode, std::string name, time_t when = 0) {
         // Get data
-        time_t now = time(0);
+        time_t now = when ? when : time(0);
         tm* ltm = localtime(&now);
         char buf[1024];
         double freq = gui::waterfall.getCenterFrequency();
@@ -523,6 +654,17 @@ private:
         return std::regex_replace(input, std::regex("//"), "/");
     }
 
+    static int sampleTypeBytes(wav::SampleType type) {
+        switch (type) {
+        case wav::SAMP_TYPE_UINT8:
+            return 1;
+        case wav::SAMP_TYPE_INT16:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
     static void complexHandler(dsp::complex_t* data, int count, void* ctx) {
         RecorderModule* _this = (RecorderModule*)ctx;
         _this->writer.write((float*)data, count);
@@ -567,8 +709,18 @@ private:
             if (recording) { stop(); }
             return "{\"status\":\"stopped\"}";
         }
+        if (cmd == "save_history") {
+            double seconds = args.empty() ? 10.0 : std::atof(args.c_str());
+            return saveHistory(seconds, 0.0) ? "{\"status\":\"saving\"}" : "{\"status\":\"failed\"}";
+        }
         if (cmd == "status") {
-            return "{\"recording\":" + std::string(recording ? "true" : "false") + "}";
+            std::string status = "{\"recording\":" + std::string(recording ? "true" : "false");
+            if (recording) {
+                status += ",\"samples\":" + std::to_string(writer.getSamplesWritten());
+                status += ",\"droppedSamples\":" + std::to_string(writer.getDroppedSamples());
+                status += ",\"overruns\":" + std::to_string(writer.getOverruns());
+            }
+            return status + "}";
         }
         return "{}";
     }
@@ -591,6 +743,10 @@ private:
         else if (code == RECORDER_IFACE_CMD_STOP) {
             if (_this->recording) { _this->stop(); }
         }
+        else if (code == RECORDER_IFACE_CMD_SAVE_HISTORY) {
+            double* _in = (double*)in;
+            _this->saveHistory(_in[0], _in[1]);
+        }
     }
 
     std::string name;
@@ -609,6 +765,7 @@ private:
     std::string selectedStreamName = "";
     float audioVolume = 1.0f;
     bool ignoreSilence = false;
+    bool directIO = false;
     dsp::stereo_t audioLvl = { -100.0f, -100.0f };
 
     bool recording = false;
@@ -632,6 +789,12 @@ private:
 
     uint64_t samplerate = 48000;
 
+    // Saving the IQ history
+    std::thread historyThread;
+    std::atomic<bool> savingHistory = false;
+    std::atomic<float> historyProgress = 0.0f;
+    int historySeconds = 30;
+
     EventHandler<std::string> onStreamRegisteredHandler;
     EventHandler<std::string> onStreamUnregisterHandler;
 
@@ -0,0 +1,87 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// Level and noise floor of every channel of a scan range, all evaluated from the same FFT frame instead
+// of tuning to each channel in turn. The noise floor of each channel follows its level while it is quiet,
+// quickly down and slowly up, so a channel is active when it is above both the level and its own floor.
+class ChannelScanner {
+public:
+    // Noise floor tracking, per frame
+    static constexpr float NOISE_ATTACK = 0.3f;
+    static constexpr float NOISE_DECAY = 0.01f;
+
+    void configure(double startFreq, double stopFreq, double interval) {
+        _startFreq = startFreq;
+        _interval = std::max<double>(interval, 1.0);
+        int count = std::max<int>(1, (int)floor((stopFreq - startFreq) / _interval + 1e-6) + 1);
+        channels.assign(count, Channel());
+    }
+
+    int getChannelCount() { return channels.size(); }
+
+    double getFrequency(int ch) { return _startFreq + ch * _interval; }
+
+    // Nearest channel, clamped to the range
+    int getChannel(double freq) {
+        return std::clamp<int>((int)round((freq - _startFreq) / _interval), 0, channels.size() - 1);
+    }
+
+    // Updates every channel whose whole width is inside the frame. first and last are set to the visible
+    // channels, returns false when none is.
+    bool update(const float* data, int dataWidth, double wfStart, double wfWidth, double channelWidth, double passband, float level, float minSNR, int& first, int& last) {
+        double wfEnd = wfStart + wfWidth;
+        first = std::max<int>(0, (int)ceil((wfStart + channelWidth / 2.0 - _startFreq) / _interval - 1e-6));
+        last = std::min<int>(channels.size() - 1, (int)floor((wfEnd - channelWidth / 2.0 - _startFreq) / _interval + 1e-6));
+        if (dataWidth <= 0 || first > last) { return false; }
+
+        double binsPerHz = (double)dataWidth / wfWidth;
+        for (int ch = first; ch <= last; ch++) {
+            double freq = getFrequency(ch);
+            int lowId = std::clamp<int>((freq - passband / 2.0 - wfStart) * binsPerHz, 0, dataWidth - 1);
+            int highId = std::clamp<int>((freq + passband / 2.0 - wfStart) * binsPerHz, 0, dataWidth - 1);
+            float max = *std::max_element(&data[lowId], &data[highId] + 1);
+
+            Channel& c = channels[ch];
+            c.level = max;
+            if (std::isnan(c.noise)) { c.noise = max; }
+            c.active = (max >= level) && (max - c.noise >= minSNR);
+            if (!c.active) {
+                c.noise += (max - c.noise) * ((max < c.noise) ? NOISE_ATTACK : NOISE_DECAY);
+            }
+        }
+        return true;
+    }
+
+    bool isActive(int ch) { return channels[ch].active; }
+    float getLevel(int ch) { return channels[ch].level; }
+    float getNoiseFloor(int ch) { return channels[ch].noise; }
+
+    // First active channel after from in the given direction, within first..last. Wraps around inside
+    // that span when wrap is set. Returns -1 when there is none.
+    int findActive(int from, bool up, int first, int last, bool wrap) {
+        int span = last - first + 1;
+        if (span <= 0) { return -1; }
+        for (int i = 1; i <= span; i++) {
+            int ch = up ? from + i : from - i;
+            if (ch < first || ch > last) {
+                if (!wrap) { return -1; }
+                ch = first + (((ch - first) % span) + span) % span;
+            }
+            if (channels[ch].active) { return ch; }
+        }
+        return -1;
+    }
+
+private:
+    struct Channel {
+        float level = -INFINITY;
+        float noise = NAN;
+        bool active = false;
+    };
+
+    double _startFreq = 0.0;
+    double _interval = 1.0;
+    std::vector<Channel> channels;
+};
@@ -4,6 +4,7 @@
 #include <gui/style.h>
 #include <signal_path/signal_path.h>
 #include <chrono>
+#include "channel_scanner.h"
 
 SDRPP_MOD_INFO{
     /* Name:            */ "scanner",
@@ -75,8 +76,19 @@ private:
         if (ImGui::InputInt("##linger_time_scanner", &_this->lingerTime, 100, 1000)) {
             _this->lingerTime = std::clamp<int>(_this->lingerTime, 100, 10000.0);
         }
+        ImGui::LeftLabel("Whole band at once");
+        ImGui::Checkbox("##fast_scan_scanner", &_this->fastScan);
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Check every visible channel on each FFT frame, only retune when the range is wider than the view");
+        }
         if (_this->running) { ImGui::EndDisabled(); }
 
+        if (_this->fastScan) {
+            ImGui::LeftLabel("Min SNR (dB)");
+            ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
+            ImGui::SliderFloat("##scanner_min_snr", &_this->minSNR, 0.0, 40.0, "%.0f");
+        }
+
         ImGui::LeftLabel("Level");
         ImGui::SetNextItemWidth(menuWidth - ImGui::GetCursorPosX());
         ImGui::SliderFloat("##scanner_level", &_this->level, -150.0, 0.0);
@@ -106,12 +118,18 @@ private:
             ImGui::Text("Status: Idle");
         }
         else {
-            if (ImGui::Button("Stop##scanner_start", ImVec2(menuWidth, 0))) {
+            if (ImGui::Button("Stop##scanner_stop", ImVec2(menuWidth, 0))) {
                 _this->stop();
             }
+            if (_this->fastScan) {
+                ImGui::Text("%d channels, cycle %d ms", _this->channelScanner.getChannelCount(), (int)_this->lastCycleMillis);
+            }
             if (_this->receiving) {
                 ImGui::TextColored(ImVec4(0, 1, 0, 1), "Status: Receiving");
             }
+            else if (_this->tuning && _this->fastScan) {
+                ImGui::TextColored(ImVec4(0, 1, 1, 1), "Status: Tuning to next segment");
+            }
             else if (_this->tuning) {
                 ImGui::TextColored(ImVec4(0, 1, 1, 1), "Status: Tuning");
             }
@@ -124,6 +142,12 @@ private:
     void start() {
         if (running) { return; }
         current = startFreq;
+        if (fastScan) {
+            channelScanner.configure(startFreq, stopFreq, interval);
+            lastFFTFrame = 0;
+            lastCycleTime = std::chrono::high_resolution_clock::now();
+            tuning = false;
+        }
         running = true;
         workerThread = std::thread(&ScannerModule::worker, this);
     }
@@ -137,9 +161,9 @@ private:
     }
 
     void worker() {
-        // 10Hz scan loop
+        // 10Hz scan loop, or once per FFT frame when scanning the whole band at once
         while (running) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            std::this_thread::sleep_for(std::chrono::milliseconds(fastScan ? 10 : 100));
             {
                 std::lock_guard<std::mutex> lck(scanMtx);
                 auto now = std::chrono::high_resolution_clock::now();
@@ -149,6 +173,10 @@ private:
                     running = false;
                     return;
                 }
+                if (fastScan) {
+                    fastScanFrame(now);
+                    continue;
+                }
                 tuner::normalTuning(gui::waterfall.selectedVFO, current);
 
                 // Check if we are waiting for a tune
@@ -229,6 +257,76 @@ private:
         }
     }
 
+    void fastScanFrame(std::chrono::time_point<std::chrono::high_resolution_clock> now) {
+        // Each FFT frame is looked at once
+        uint64_t frame = gui::waterfall.getFFTFrameCount();
+        if (frame == lastFFTFrame) { return; }
+        lastFFTFrame = frame;
+
+        if (tuning) {
+            if ((std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTuneTime)).count() <= tuningTime) { return; }
+            tuning = false;
+        }
+
+        int dataWidth = 0;
+        float* data = gui::waterfall.acquireLatestFFT(dataWidth);
+        if (!data) { return; }
+        double wfCenter = gui::waterfall.getViewOffset() + gui::waterfall.getCenterFrequency();
+        double wfWidth = gui::waterfall.getViewBandwidth();
+        double wfStart = wfCenter - (wfWidth / 2.0);
+        double vfoWidth = sigpath::vfoManager.getBandwidth(gui::waterfall.selectedVFO);
+        int first, last;
+        bool visible = channelScanner.update(data, dataWidth, wfStart, wfWidth, vfoWidth, vfoWidth * (passbandRatio * 0.01), level, minSNR, first, last);
+        gui::waterfall.releaseLatestFFT();
+
+        int count = channelScanner.getChannelCount();
+        bool wholeRange = visible && first == 0 && last == count - 1;
+        int cur = channelScanner.getChannel(current);
+        if (wholeRange || (visible && (scanUp ? last == count - 1 : first == 0))) {
+            lastCycleMillis = std::chrono::duration<double, std::milli>(now - lastCycleTime).count();
+            lastCycleTime = now;
+        }
+
+        if (receiving) {
+            if (visible && cur >= first && cur <= last && channelScanner.isActive(cur)) {
+                lastSignalTime = now;
+                return;
+            }
+            if ((std::chrono::duration_cast<std::chrono::milliseconds>(now - lastSignalTime)).count() <= lingerTime) { return; }
+            receiving = false;
+        }
+
+        // Next active channel of the visible part, in scan direction first
+        if (visible) {
+            int ch = channelScanner.findActive(cur, scanUp, first, last, wholeRange);
+            if (ch < 0 && !reverseLock) { ch = channelScanner.findActive(cur, !scanUp, first, last, wholeRange); }
+            reverseLock = false;
+            if (ch >= 0) {
+                current = channelScanner.getFrequency(ch);
+                receiving = true;
+                lastSignalTime = now;
+                tuner::normalTuning(gui::waterfall.selectedVFO, current);
+                return;
+            }
+        }
+
+        // Everything is visible and quiet, no need to touch the hardware
+        if (wholeRange) { return; }
+
+        // Move the view to the next part of the range, starting at its edge in scan direction
+        int next = cur;
+        if (visible) {
+            if (scanUp) { next = (last + 1 < count) ? last + 1 : 0; }
+            else { next = (first > 0) ? first - 1 : count - 1; }
+        }
+        current = channelScanner.getFrequency(next);
+        double center = scanUp ? current + (wfWidth / 2.0) - vfoWidth : current - (wfWidth / 2.0) + vfoWidth;
+        tuner::centerTuning(gui::waterfall.selectedVFO, center);
+        tuner::normalTuning(gui::waterfall.selectedVFO, current);
+        lastTuneTime = now;
+        tuning = true;
+    }
+
     bool findSignal(bool scanDir, double& bottomLimit, double& topLimit, double wfStart, double wfEnd, double wfWidth, double vfoWidth, float* data, int dataWidth) {
         bool found = false;
         double freq = current;
@@ -284,6 +382,12 @@ private:
     bool tuning = false;
     bool scanUp = true;
     bool reverseLock = false;
+    bool fastScan = false;
+    float minSNR = 10.0f;
+    ChannelScanner channelScanner;
+    uint64_t lastFFTFrame = 0;
+    double lastCycleMillis = 0.0;
+    std::chrono::time_point<std::chrono::high_resolution_clock> lastCycleTime;
     std::chrono::time_point<std::chrono::high_resolution_clock> lastSignalTime;
     std::chrono::time_point<std::chrono::high_resolution_clock> lastTuneTime;
     std::thread workerThread;
@@ -5,4 +5,12 @@
 
 struct FileSourceInterface {
     virtual void openPath(const std::string &path) = 0;
-};
\ No newline at end of file
+
+    // Playback speed as a multiple of real time, 0 to play as fast as the DSP chain takes samples
+    virtual void setPlaybackSpeed(double speed) = 0;
+
+    // Position in the open file, applied by the worker on its next block
+    virtual void seekSeconds(double seconds) = 0;
+    virtual double getPositionSeconds() = 0;
+    virtual double getDurationSeconds() = 0;
+};
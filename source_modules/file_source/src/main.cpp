@@ -12,11 +12,14 @@
 #include <gui/tuner.h>
 #include <time.h>
 #include "gui/smgui.h"
+#include <gui/style.h>
 #include "utils/usleep.h"
 #include "utils/optionlist.h"
 #include "utils/wstr.h"
 #include <algorithm>
 #include <stdexcept>
+#include <atomic>
+#include <chrono>
 #include "utils/wstr.h"
 #include "server.h"
 #include "file_source.h"
@@ -36,15 +39,30 @@ ConfigManager config;
 
 class FileSourceModule : public ModuleManager::Instance, public FileSourceInterface {
 public:
-    FileSourceModule(std::string name) : fileSelect("", { "Wav IQ Files (*.wav)", "*.wav", "All Files", "*" }) {
+    FileSourceModule(std::string name) : fileSelect("", { "Wav IQ Files (*.wav *.w64)", "*.wav *.w64", "All Files", "*" }) {
         this->name = name;
         isServer = core::args["server"].b() ? 1 : 0;
 
         //        if (core::args["server"].b()) { return; }
 
+        speeds.define("1x", 1.0);
+        speeds.define("2x", 2.0);
+        speeds.define("4x", 4.0);
+        speeds.define("8x", 8.0);
+        speeds.define("16x", 16.0);
+        speeds.define("Max", 0.0);
+        speedId = speeds.valueId(1.0);
+
         config.acquire();
         fileSelect.setPath(config.conf["path"], true);
+        if (config.conf.contains("speed") && speeds.keyExists(config.conf["speed"])) {
+            speedId = speeds.keyId(config.conf["speed"]);
+        }
+        if (config.conf.contains("loop")) {
+            loop = config.conf["loop"];
+        }
         config.release();
+        speed = speeds.value(speedId);
 
         handler.ctx = this;
         handler.selectHandler = menuSelected;
@@ -96,8 +114,8 @@ public:
 
         // Iterate over the directory entries
         for (const auto& entry : std::filesystem::directory_iterator(wstr::str2wstr(directoryPath))) {
-            // Check if the entry is a file and has a .wav extension
-            if (entry.is_regular_file() && entry.path().extension() == ".wav") {
+            // Check if the entry is a file and has a .wav or .w64 extension
+            if (entry.is_regular_file() && (entry.path().extension() == ".wav" || entry.path().extension() == ".w64")) {
                 wavFiles.push_back(entry.path().string());
             }
         }
@@ -198,11 +216,47 @@ public:
             resp["filename"] = path;
             return resp.dump();
         }
+        if (cmd == "seek") {
+            seekSeconds(std::atof(args.c_str()));
+            json resp;
+            resp["position"] = getPositionSeconds();
+            return resp.dump();
+        }
+        if (cmd == "set_speed") {
+            setPlaybackSpeed(std::atof(args.c_str()));
+            json resp;
+            resp["speed"] = speed.load();
+            return resp.dump();
+        }
+        if (cmd == "get_position") {
+            json resp;
+            resp["position"] = getPositionSeconds();
+            resp["duration"] = getDurationSeconds();
+            return resp.dump();
+        }
         json err;
         err["error"] = "unknown command: " + cmd;
         return err.dump();
     }
 
+    void setPlaybackSpeed(double speed) override {
+        this->speed = std::max<double>(speed, 0.0);
+        if (speeds.valueExists(this->speed)) { speedId = speeds.valueId(this->speed); }
+    }
+
+    void seekSeconds(double seconds) override {
+        seekRequest = std::max<int64_t>(0, (int64_t)(seconds * sampleRate));
+        if (!running) { playPos = std::min<uint64_t>(seekRequest.exchange(-1), sampleCount); }
+    }
+
+    double getPositionSeconds() override {
+        return (double)playPos / std::max<double>(sampleRate, 1.0);
+    }
+
+    double getDurationSeconds() override {
+        return (double)sampleCount / std::max<double>(sampleRate, 1.0);
+    }
+
 #ifndef BUILD_TESTS
 private:
 #endif
@@ -233,7 +287,8 @@ private:
         if (_this->running) { return; }
         if (_this->reader == NULL) { return; }
         _this->running = true;
-        _this->workerThread = _this->float32Mode ? std::thread(floatWorker, _this) : std::thread(worker, _this);
+        _this->stopRequested = false;
+        _this->workerThread = std::thread(worker, _this);
         flog::info("FileSourceModule '{0}': Start!", _this->name);
     }
 
@@ -241,11 +296,13 @@ private:
         FileSourceModule* _this = (FileSourceModule*)ctx;
         if (!_this->running) { return; }
         if (_this->reader == NULL) { return; }
+        _this->stopRequested = true;
         _this->stream.stopWriter();
         _this->workerThread.join();
         _this->stream.clearWriteStop();
         _this->running = false;
-        _this->reader->rewind();
+        _this->playPos = 0;
+        _this->seekRequest = -1;
         flog::info("FileSourceModule '{0}': Stop!", _this->name);
     }
 
@@ -296,10 +353,6 @@ private:
             if (!_this->fileSelect.pathIsValid() || (cfgPath != _this->fileSelect.path && !cfgPath.empty())) {
                 _this->fileSelect.setPath(cfgPath, true);
                 if (_this->fileSelect.pathIsValid()) {
-                    if (_this->reader != NULL) {
-                        _this->reader->close();
-                        delete _this->reader;
-                    }
                     try {
                         _this->openPathFromFileSelect();
                     }
@@ -312,10 +365,6 @@ private:
 
         if (_this->fileSelect.render("##file_source_" + _this->name)) {
             if (_this->fileSelect.pathIsValid()) {
-                if (_this->reader != NULL) {
-                    _this->reader->close();
-                    delete _this->reader;
-                }
                 try {
                     _this->openPathFromFileSelect();
                 }
@@ -342,7 +391,33 @@ private:
             char streamTime[64];
             strftime(streamTime, sizeof(streamTime), "%Y-%m-%d %H:%M:%S", tmm);
             ImGui::Text("Stream pos: %s", streamTime);
-            ImGui::Checkbox("Float32 Mode##_file_source", &_this->float32Mode);
+
+            // Seek slider, shows position and length as hh:mm:ss
+            if (_this->reader) {
+                float pos = _this->getPositionSeconds();
+                float duration = _this->getDurationSeconds();
+                char posText[64];
+                int p = pos, d = duration;
+                snprintf(posText, sizeof(posText), "%02d:%02d:%02d / %02d:%02d:%02d", p / 3600, (p / 60) % 60, p % 60, d / 3600, (d / 60) % 60, d % 60);
+                ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x);
+                if (ImGui::SliderFloat(CONCAT("##_file_source_pos_", _this->name), &pos, 0.0f, duration, posText)) {
+                    _this->seekSeconds(pos);
+                }
+            }
+
+            ImGui::LeftLabel("Speed");
+            ImGui::FillWidth();
+            if (ImGui::Combo(CONCAT("##_file_source_speed_", _this->name), &_this->speedId, _this->speeds.txt)) {
+                _this->speed = _this->speeds.value(_this->speedId);
+                config.acquire();
+                config.conf["speed"] = _this->speeds.key(_this->speedId);
+                config.release(true);
+            }
+            if (ImGui::Checkbox(CONCAT("Loop##_file_source_loop_", _this->name), &_this->loop)) {
+                config.acquire();
+                config.conf["loop"] = _this->loop;
+                config.release(true);
+            }
         }
     }
 
@@ -354,9 +429,20 @@ private:
     }
 
 
-    void openPath(const std::string& path) {
+    void openPath(const std::string& path) override {
         try {
             lastError = "";
+            bool wasRunning = running;
+            if (reader) {
+                stop(this);
+                reader->close();
+                delete reader;
+                reader = NULL;
+            }
+            sampleCount = 0;
+            playPos = 0;
+            seekRequest = -1;
+
             reader = new wav::Reader(path);
             sampleRate = reader->getSampleRate();
             if (reader->getSampleRate() == 0) {
@@ -365,6 +451,13 @@ private:
                 reader = NULL;
                 throw std::runtime_error("Sample rate may not be zero");
             }
+            if (!reader->map()) {
+                reader->close();
+                delete reader;
+                reader = NULL;
+                throw std::runtime_error("Unsupported file, expected 2 channel 8/16/32 bit integer or float32 IQ");
+            }
+            sampleCount = reader->getSampleCount();
             core::setInputSampleRate(sampleRate);
             std::string filename = getFileName(path);
             double newFrequency = getFrequency(filename);
@@ -377,6 +470,7 @@ private:
                 server::sendCenterFrequency(centerFreq);
             }
             flog::info("FileSourceModule: Opened file: {0} @ {1} Hz", path, (int)sampleRate);
+            if (wasRunning) { start(this); }
             if (fineTune) {
                 // restore the fine tune. When working with file source and restarting the app, the fine tune is lost
             }
@@ -397,53 +491,58 @@ private:
         FileSourceModule* _this = (FileSourceModule*)ctx;
         double sampleRate = std::max(_this->reader->getSampleRate(), (uint32_t)1);
         int blockSize = std::min((int)(sampleRate / 200.0f), (int)STREAM_BUFFER_SIZE);
-        int16_t* inBuf = new int16_t[blockSize * 2];
-
-        long long samplesRead = 0;
-        sigpath::iqFrontEnd.setCurrentStreamTime(_this->streamStartTime);
-        auto serverMode = core::args["server"].b();
-
-        auto ctm = currentTimeMillis();
-        while (true) {
-            _this->reader->readSamples(inBuf, blockSize * 2 * sizeof(int16_t));
-            volk_16i_s32f_convert_32f((float*)_this->stream.writeBuf, inBuf, 32768.0f, blockSize * 2);
-            if (!_this->stream.swap(blockSize)) { break; };
-
-            samplesRead += blockSize;
-            if (_this->streamStartTime != 0) {
-                long long currentTime = _this->streamStartTime + samplesRead * 1000 / sampleRate;
-                sigpath::iqFrontEnd.setCurrentStreamTime(currentTime);
-            }
-            if (serverMode) {
-                auto blockLength = (1000 * blockSize) / sampleRate;
-                ctm += blockLength;
-                auto now = currentTimeMillis();
-                auto delay = ctm - now;
-                if (delay > 0) {
-                    usleep(delay * 1000);
+        uint64_t sampleCount = _this->sampleCount;
+
+        // Pacing clock, restarted whenever the position or the speed changes
+        auto paceStart = std::chrono::steady_clock::now();
+        uint64_t paceStartPos = _this->playPos;
+        double paceSpeed = _this->speed;
+
+        while (!_this->stopRequested) {
+            uint64_t pos = _this->playPos;
+            int64_t seekTo = _this->seekRequest.exchange(-1);
+            if (seekTo >= 0) { pos = std::min<uint64_t>(seekTo, sampleCount); }
+            if (pos >= sampleCount) {
+                if (!_this->loop) {
+                    // Hold at the end until a seek or a stop
+                    _this->playPos = pos;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    paceStartPos = UINT64_MAX;
+                    continue;
                 }
+                pos = 0;
+            }
+            double speed = _this->speed;
+            if (seekTo >= 0 || pos < paceStartPos || speed != paceSpeed) {
+                paceStart = std::chrono::steady_clock::now();
+                paceStartPos = pos;
+                paceSpeed = speed;
             }
-        }
-
-        delete[] inBuf;
-    }
-
-    static void floatWorker(void* ctx) {
-        FileSourceModule* _this = (FileSourceModule*)ctx;
-        double sampleRate = std::max(_this->reader->getSampleRate(), (uint32_t)1);
-        int blockSize = std::min((int)(sampleRate / 200.0f), (int)STREAM_BUFFER_SIZE);
-        long long samplesRead = 0;
-        sigpath::iqFrontEnd.setCurrentStreamTime(_this->streamStartTime);
 
-        while (true) {
-            _this->reader->readSamples(_this->stream.writeBuf, blockSize * sizeof(dsp::complex_t));
-            if (!_this->stream.swap(blockSize)) { break; };
+            // Convert straight from the mapped file into the stream buffer
+            int count = _this->reader->readComplex(_this->stream.writeBuf, pos, blockSize);
+            if (!_this->stream.swap(count)) { break; };
+            pos += count;
+            _this->playPos = pos;
 
-            samplesRead += blockSize;
+            // Stream time follows the file position, whatever the speed
             if (_this->streamStartTime != 0) {
-                long long currentTime = _this->streamStartTime + samplesRead * 1000 / sampleRate;
+                long long currentTime = _this->streamStartTime + (long long)(pos * 1000 / sampleRate);
                 sigpath::iqFrontEnd.setCurrentStreamTime(currentTime);
             }
+
+            if (speed > 0) {
+                double due = (double)(pos - paceStartPos) / (sampleRate * speed);
+                double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - paceStart).count();
+                if (due > elapsed) {
+                    std::this_thread::sleep_for(std::chrono::duration<double>(due - elapsed));
+                }
+                else if (elapsed - due > 0.1) {
+                    // Fell behind, carry on from here rather than bursting to catch up
+                    paceStart = std::chrono::steady_clock::now();
+                    paceStartPos = pos;
+                }
+            }
         }
     }
 
@@ -460,7 +559,8 @@ private:
         // like baseband_14235774Hz_12-19-14_10-07-2022.wav
 
         if (filename.substr(0, 8) != "baseband") return 0;
-        if (".wav" != filename.substr(filename.size() - 4, 4)) return 0;
+        std::string extension = filename.substr(filename.size() - 4, 4);
+        if (extension != ".wav" && extension != ".w64") return 0;
         auto pos = filename.find("Hz");
         if (pos == std::string::npos) return 0;
         std::string dateTimeStre = filename.substr(pos + 3, 19);
@@ -510,7 +610,16 @@ private:
     double centerFreq = 100000000;
     bool centerFreqSet = false;
 
-    bool float32Mode = false;
+    OptionList<std::string, double> speeds;
+    int speedId = 0;
+    std::atomic<double> speed = 1.0;
+    bool loop = true;
+
+    // Playback position in samples, owned by the worker while running
+    uint64_t sampleCount = 0;
+    std::atomic<uint64_t> playPos = 0;
+    std::atomic<int64_t> seekRequest = -1;
+    std::atomic<bool> stopRequested = false;
 };
 
 int FileSourceModule::isServer;
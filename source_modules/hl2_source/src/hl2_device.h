@@ -1,6 +1,7 @@
 #pragma once
 #include "protocol1_discovery.h"
 #include "discovered.h"
+#include "hl2_frame_parser.h"
 #include "plugin_main.h"
 #include "utils/stream_tracker.h"
 #include "utils/wav.h"
@@ -12,6 +13,7 @@
 #ifdef __linux__
 #include <unistd.h>
 #include <sys/prctl.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #endif
@@ -42,26 +44,6 @@ struct HL2Device {
     DISCOVERED _discovered;
     DISCOVERED* discovered;
 
-    enum {
-        SYNC_0 = 0,
-        SYNC_1,
-        SYNC_2,
-        CONTROL_0,
-        CONTROL_1,
-        CONTROL_2,
-        CONTROL_3,
-        CONTROL_4,
-        LEFT_SAMPLE_HI,
-        LEFT_SAMPLE_MID,
-        LEFT_SAMPLE_LOW,
-        RIGHT_SAMPLE_HI,
-        RIGHT_SAMPLE_MID,
-        RIGHT_SAMPLE_LOW,
-        MIC_SAMPLE_HI,
-        MIC_SAMPLE_LOW,
-        SKIP
-    };
-
     ControlData deviceControl[50] = { 0 }; // multiple hardware registers here.
     int deviceControlDirty[50] = { 0 }; // deviceControlDirty stuff
 
@@ -90,19 +72,15 @@ struct HL2Device {
     long long sendStartTime = 0;     // millis of first send packet
     long long sendStartSequence = 0; // send_sequence at a time of a start
     //
-    int state = SYNC_0;
     unsigned char control_in[5] = { 0x00, 0x00, 0x00, 0x00, 0x00 };
 
     int receivers = 1; // limit of receivers here
 
-    int nreceiver; // state machine
-    int left_sample;
-    int right_sample;
-    short mic_sample;
-    double left_sample_double;
-    double right_sample_double;
-    int nsamples;
-    int iq_samples;
+    // Packets per receive call where the platform can batch them, at 384 kS/s one arrives every 0.16 ms
+    static constexpr int RECEIVE_BATCH = 16;
+    static constexpr int RECEIVE_BUFFER_SIZE = 2048;
+    dsp::complex_t rxSamples[hl2::MAX_FRAME_SAMPLES];
+    long long badFrames = 0;
 
     bool adc_overload;
     bool overflow;
@@ -135,13 +113,15 @@ struct HL2Device {
 
     int rx_sample_rate = 384000;
 
-    const std::function<void(int, double, double)> handler;
+    // Called from the receive thread with the samples of one USB frame and the frequency they were taken at
+    typedef std::function<void(int frequency, const dsp::complex_t* samples, int count)> SampleHandler;
+    const SampleHandler handler;
 
     int pttHangTime = 6;
     int bufferLatency = 0x15; // as in linhpsdr
     wav::ComplexDumper hl2txdump;
 
-    HL2Device(DISCOVERED _discovered, const std::function<void(int, double, double)>& handler) : _discovered(_discovered), handler(handler), sendTracker("hl2 tx"), hl2txdump(0, hl2txdumpName()) {
+    HL2Device(DISCOVERED _discovered, const SampleHandler& handler) : _discovered(_discovered), handler(handler), sendTracker("hl2 tx"), hl2txdump(0, hl2txdumpName()) {
         discovered = &this->_discovered;
         setADCGain(0);
         setFrequency(7000000);
@@ -558,8 +538,8 @@ struct HL2Device {
     };
 
     // from receiver to PC
-    void add_iq_samples(int receiverNo, int frequency, double i_sample, double q_sample) {
-        handler(frequency, i_sample, q_sample);
+    void add_iq_samples(int frequency, const dsp::complex_t* samples, int count) {
+        handler(frequency, samples, count);
     }
 
 
@@ -654,109 +634,16 @@ struct HL2Device {
     }
 
 
+    // One 512 byte USB frame: control bytes, then the samples of the first receiver
     void process_ozy_input_buffer(unsigned char* buffer) {
-        int i;
-        // sync 0, 1, 2
-        // control 0, 1, 2, 3, 4
-        // iq_samples = (512 - 8) / ((receivers * 6) + 2);   // how samples are packed
-        // iq_samples * (0, 1, 2,    00 11 22   , 3 4)
-        for (i = 0; i < 512; i++) {
-            process_ozy_byte(buffer[i] & 0xFF);
-        }
-    }
-
-    // receive
-    void process_ozy_byte(int b) {
-        switch (state) {
-        case SYNC_0:
-            if (b == SYNC) {
-                state++;
-            }
-            break;
-        case SYNC_1:
-            if (b == SYNC) {
-                state++;
-            }
-            break;
-        case SYNC_2:
-            if (b == SYNC) {
-                state++;
-            }
-            break;
-        case CONTROL_0:
-            control_in[0] = b;
-            state++;
-            break;
-        case CONTROL_1:
-            control_in[1] = b;
-            state++;
-            break;
-        case CONTROL_2:
-            control_in[2] = b;
-            state++;
-            break;
-        case CONTROL_3:
-            control_in[3] = b;
-            state++;
-            break;
-        case CONTROL_4:
-            control_in[4] = b;
-            process_control_bytes();
-            nreceiver = 0;
-            iq_samples = (512 - 8) / ((receivers * 6) + 2);   // how samples are packed
-            nsamples = 0;
-            state++;
-            break;
-        case LEFT_SAMPLE_HI:
-            left_sample = (int)((signed char)b << 16);
-            state++;
-            break;
-        case LEFT_SAMPLE_MID:
-            left_sample |= (int)((((unsigned char)b) << 8) & 0xFF00);
-            state++;
-            break;
-        case LEFT_SAMPLE_LOW:
-            left_sample |= (int)((unsigned char)b & 0xFF);
-            left_sample_double = (double)left_sample / 8388607.0; // 24 bit sample 2^23-1
-            state++;
-            break;
-        case RIGHT_SAMPLE_HI:
-            right_sample = (int)((signed char)b << 16);
-            state++;
-            break;
-        case RIGHT_SAMPLE_MID:
-            right_sample |= (int)((((unsigned char)b) << 8) & 0xFF00);
-            state++;
-            break;
-        case RIGHT_SAMPLE_LOW: {
-            right_sample |= (int)((unsigned char)b & 0xFF);
-            right_sample_double = (double)right_sample / 8388607.0; // 24 bit sample 2^23-1
-            add_iq_samples(nreceiver, frequencyFromSamples, left_sample_double, right_sample_double);
-            nreceiver++;
-            if (nreceiver == receivers) {
-                state++;
-            }
-            else {
-                state = LEFT_SAMPLE_HI;
-            }
-            break;
-        }
-        case MIC_SAMPLE_HI:
-            mic_sample = (short)(b << 8);
-            state++;
-            break;
-        case MIC_SAMPLE_LOW:
-            mic_sample |= (short)(b & 0xFF);
-            nsamples++;
-            if (nsamples == iq_samples) {
-                state = SYNC_0;
-            }
-            else {
-                nreceiver = 0;
-                state = LEFT_SAMPLE_HI;
-            }
-            break;
+        if (!hl2::frameSynced(buffer)) {
+            if (badFrames++ == 0) { flog::warn("HL2: USB frame without sync bytes, dropped"); }
+            return;
         }
+        memcpy(control_in, hl2::frameControl(buffer), sizeof(control_in));
+        process_control_bytes();
+        int count = hl2::unpackFrame(buffer, receivers, 0, rxSamples);
+        add_iq_samples(frequencyFromSamples, rxSamples, count);
     }
 
 
@@ -813,8 +700,6 @@ struct HL2Device {
         int i;
         unsigned char buffer[64];
 
-        state = SYNC_0;
-
 #ifdef USBOZY
         if (radio->discovered->device != DEVICE_OZY) {
 #endif
@@ -923,8 +808,9 @@ struct HL2Device {
                 auto neededData = (passed * getRxSampleRate()) / 1000;
                 auto toAdd = neededData - transmitModeProducedIQData;
                 if (toAdd > 0) {
-                    for (long long q = 0; q < toAdd; q++) {
-                        add_iq_samples(0, frequencyFromSamples, 0, 0);
+                    dsp::complex_t silence[hl2::MAX_FRAME_SAMPLES] = {};
+                    for (long long q = 0; q < toAdd; q += hl2::MAX_FRAME_SAMPLES) {
+                        add_iq_samples(frequencyFromSamples, silence, std::min<long long>(hl2::MAX_FRAME_SAMPLES, toAdd - q));
                     }
                     transmitModeProducedIQData = neededData;
                 }
@@ -937,6 +823,53 @@ struct HL2Device {
     }
 
 
+    void process_metis_packet(unsigned char* buffer, int bytes_read) {
+        int ep;
+        if (bytes_read >= hl2::METIS_HEADER_SIZE && buffer[0] == 0xEF && buffer[1] == 0xFE) {
+            switch (buffer[2]) {
+            case 1:
+                // get the end point
+                ep = buffer[3] & 0xFF;
+
+                // get the sequence number
+                //                        sequence = ((buffer[4] & 0xFF) << 24) + ((buffer[5] & 0xFF) << 16) + ((buffer[6] & 0xFF) << 8) + (buffer[7] & 0xFF);
+
+                switch (ep) {
+                case 6: // EP6
+                    if (bytes_read < hl2::METIS_PACKET_SIZE) {
+                        fprintf(stderr, "short EP6 packet length=%d\n", bytes_read);
+                        break;
+                    }
+                    // process the data
+                    process_ozy_input_buffer(&buffer[hl2::METIS_HEADER_SIZE]);
+                    process_ozy_input_buffer(&buffer[hl2::METIS_HEADER_SIZE + hl2::USB_FRAME_SIZE]);
+                    //                                            full_tx_buffer(radio->transmitter);
+                    break;
+                default:
+                    fprintf(stderr, "unexpected EP %d length=%d\n", ep, bytes_read);
+                    break;
+                }
+                break;
+            case 2: // response to a discovery packet
+                fprintf(stderr, "unexepected discovery response when not in discovery mode\n");
+                break;
+            case 28: // HL2 proxy extension protocol
+                ep = buffer[3] & 0xFF;
+                switch(ep) {
+                case 6: // same EP as usually
+                    process_hl2_control_bytes(buffer+8);
+                }
+                break;
+            default:
+                fprintf(stderr, "unexpected packet type: 0x%02X\n", buffer[2]);
+                break;
+            }
+        }
+        else {
+            fprintf(stderr, "received bad header bytes on data port %02X,%02X\n", buffer[0], buffer[1]);
+        }
+    }
+
     void start_protocol1_thread() {
 
         data_socket = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -1015,35 +948,39 @@ struct HL2Device {
 //            }
 //        });
         receiveThread = std::make_shared<std::thread>([&] {
+            std::vector<unsigned char> buffers(RECEIVE_BATCH * RECEIVE_BUFFER_SIZE);
+            int lengths[RECEIVE_BATCH];
+#ifdef __linux__
+            struct mmsghdr msgs[RECEIVE_BATCH];
+            struct iovec iovecs[RECEIVE_BATCH];
+            memset(msgs, 0, sizeof(msgs));
+            for (int i = 0; i < RECEIVE_BATCH; i++) {
+                iovecs[i].iov_base = &buffers[i * RECEIVE_BUFFER_SIZE];
+                iovecs[i].iov_len = RECEIVE_BUFFER_SIZE;
+                msgs[i].msg_hdr.msg_iov = &iovecs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+#else
             struct sockaddr_in addr;
             socklen_t length;
-            unsigned char buffer[2048];
-            int bytes_read;
-            int ep;
-            long sequence;
+#endif
 
             SetThreadName("hl2_receive_thread");
 
             fprintf(stderr, "hl2: protocol1: receive_thread started\n");
 
-            length = sizeof(addr);
-            auto ctm = currentTimeNanos();
-            std::string logg;
             while (running) {
-                auto pctm = currentTimeNanos();
-                if ((pctm - ctm) / 1000 > 500) {
-                    logg += "?" + std::to_string((pctm - ctm) / 1000) + " ";
-                }
-                bytes_read = recvfrom(data_socket, (char*)buffer, sizeof(buffer), 0, (struct sockaddr*)&addr, &length);
-                auto rcv = currentTimeNanos();
+                // Waits for the first packet, then takes whatever else already arrived
+#ifdef __linux__
+                int received = recvmmsg(data_socket, msgs, RECEIVE_BATCH, MSG_WAITFORONE, NULL);
+                for (int i = 0; i < received; i++) { lengths[i] = msgs[i].msg_len; }
+#else
+                length = sizeof(addr);
+                lengths[0] = recvfrom(data_socket, (char*)buffers.data(), RECEIVE_BUFFER_SIZE, 0, (struct sockaddr*)&addr, &length);
+                int received = lengths[0] < 0 ? -1 : 1;
+#endif
                 lastReceiveTime = currentTimeMillis();
-                logg += std::to_string((rcv - pctm) / 1000) + " ";
-                ctm = rcv;
-                if (logg.size() > 100) {
-                    //                    flog::info("hl2 recv timings: {0}", logg);
-                    logg = "";
-                }
-                if (bytes_read < 0) {
+                if (received < 0) {
                     bool timeout = false;
 #ifdef WIN32
                     DWORD err = WSAGetLastError();
@@ -1063,45 +1000,8 @@ struct HL2Device {
                     continue;
                 }
 
-
-                if (buffer[0] == 0xEF && buffer[1] == 0xFE) {
-                    switch (buffer[2]) {
-                    case 1:
-                        // get the end point
-                        ep = buffer[3] & 0xFF;
-
-                        // get the sequence number
-                        //                        sequence = ((buffer[4] & 0xFF) << 24) + ((buffer[5] & 0xFF) << 16) + ((buffer[6] & 0xFF) << 8) + (buffer[7] & 0xFF);
-
-                        switch (ep) {
-                        case 6: // EP6
-                            // process the data
-                            process_ozy_input_buffer(&buffer[8]);
-                            process_ozy_input_buffer(&buffer[520]);
-                            //                                            full_tx_buffer(radio->transmitter);
-                            break;
-                        default:
-                            fprintf(stderr, "unexpected EP %d length=%d\n", ep, bytes_read);
-                            break;
-                        }
-                        break;
-                    case 2: // response to a discovery packet
-                        fprintf(stderr, "unexepected discovery response when not in discovery mode\n");
-                        break;
-                    case 28: // HL2 proxy extension protocol
-                        ep = buffer[3] & 0xFF;
-                        switch(ep) {
-                        case 6: // same EP as usually
-                            process_hl2_control_bytes(buffer+8);
-                        }
-                        break;
-                    default:
-                        fprintf(stderr, "unexpected packet type: 0x%02X\n", buffer[2]);
-                        break;
-                    }
-                }
-                else {
-                    fprintf(stderr, "received bad header bytes on data port %02X,%02X\n", buffer[0], buffer[1]);
+                for (int i = 0; i < received; i++) {
+                    process_metis_packet(&buffers[i * RECEIVE_BUFFER_SIZE], lengths[i]);
                 }
             }
 
@@ -0,0 +1,51 @@
+#pragma once
+#include <dsp/types.h>
+#include <volk/volk.h>
+#include <stdint.h>
+
+// Protocol 1 receive data from the Hermes Lite 2. Each 1032 byte Metis packet on EP6 carries two 512 byte
+// USB frames: 3 sync bytes, 5 control bytes, then as many samples as fit, each one 6 bytes per receiver
+// (24 bit big endian I, then Q) followed by 2 mic bytes. A frame always holds whole samples, so frames are
+// unpacked as blocks rather than pushed byte by byte through a state machine.
+namespace hl2 {
+    static constexpr int METIS_HEADER_SIZE = 8;
+    static constexpr int USB_FRAME_SIZE = 512;
+    static constexpr int METIS_PACKET_SIZE = METIS_HEADER_SIZE + 2 * USB_FRAME_SIZE;
+    static constexpr int USB_FRAME_HEADER_SIZE = 8;
+    static constexpr int MAX_FRAME_SAMPLES = (USB_FRAME_SIZE - USB_FRAME_HEADER_SIZE) / 8;   // 63 with one receiver
+    static constexpr uint8_t FRAME_SYNC = 0x7F;
+
+    inline int frameSamples(int receivers) {
+        return (USB_FRAME_SIZE - USB_FRAME_HEADER_SIZE) / (receivers * 6 + 2);
+    }
+
+    inline bool frameSynced(const uint8_t* frame) {
+        return frame[0] == FRAME_SYNC && frame[1] == FRAME_SYNC && frame[2] == FRAME_SYNC;
+    }
+
+    // Control bytes C0..C4 of a frame
+    inline const uint8_t* frameControl(const uint8_t* frame) {
+        return &frame[3];
+    }
+
+    // Sign extended 24 bit big endian word
+    inline int32_t word24(const uint8_t* p) {
+        return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8)) >> 8;
+    }
+
+    // Unpacks the samples of receiver rx from one USB frame into out, with re = Q and im = I as the source
+    // stream expects. The words are widened in a plain loop the compiler vectorizes, then scaled by volk in
+    // one go. Returns the number of samples, at most MAX_FRAME_SAMPLES.
+    inline int unpackFrame(const uint8_t* frame, int receivers, int rx, dsp::complex_t* out) {
+        int32_t raw[2 * MAX_FRAME_SAMPLES];
+        int count = frameSamples(receivers);
+        int stride = receivers * 6 + 2;
+        const uint8_t* p = &frame[USB_FRAME_HEADER_SIZE + rx * 6];
+        for (int n = 0; n < count; n++) {
+            raw[2 * n] = word24(&p[n * stride + 3]);
+            raw[2 * n + 1] = word24(&p[n * stride]);
+        }
+        volk_32i_s32f_convert_32f((float*)out, raw, 8388607.0f, 2 * count);    // 24 bit full scale, 2^23-1
+        return count;
+    }
+}
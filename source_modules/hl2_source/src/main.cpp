@@ -287,8 +287,8 @@ private:
     bool fastScan = true;
     char staticIp[20] = { 0 };
 
-    void incomingSample(double i, double q) {
-        incomingBuffer.emplace_back(dsp::complex_t{ (float)q, (float)i });
+    void incomingSamples(const dsp::complex_t* samples, int count) {
+        incomingBuffer.insert(incomingBuffer.end(), samples, samples + count);
         if (incomingBuffer.size() >= 512 - 8) {
             flushIncomingSamples();
         }
@@ -314,19 +314,7 @@ private:
         _this->device.reset();
         for (int i = 0; i < devices; i++) {
             if (_this->selectedIP == discoveredToIp(discovered[i])) {
-                _this->device = std::make_shared<HL2Device>(discovered[i], [=](int currentFrequency, double i, double q) {
-                    static auto lastCtm = currentTimeMillis();
-                    static auto totalCount = 0LL;
-                    totalCount++;
-                    if (totalCount % 10000 == 0) {
-                        if (lastCtm < currentTimeMillis() - 1000) {
-                            static auto lastLastTotalCount = 0LL;
-                            auto nowCtm = currentTimeMillis();
-                            //                            std::cout << "HL2: Speed: IQ pairs/sec: ~ " << (totalCount - lastLastTotalCount) * 1000 / (nowCtm - lastCtm) << std::endl;
-                            lastLastTotalCount = totalCount;
-                            lastCtm = nowCtm;
-                        }
-                    }
+                _this->device = std::make_shared<HL2Device>(discovered[i], [=](int currentFrequency, const dsp::complex_t* samples, int count) {
                     if (_this->lastReportedFrequency != currentFrequency) {
                         _this->lastReportedFrequency = currentFrequency;
                         if (_this->serverMode) {
@@ -334,7 +322,7 @@ private:
                             server::setInputCenterFrequencyCallback(currentFrequency);  // notify server next samples are for different frequency
                         }
                     }
-                    _this->incomingSample(i, q);
+                    _this->incomingSamples(samples, count);
                 });
             }
         }
@@ -38,6 +38,8 @@ public:
         compressionTypeList.define("No compression", server::CT_NONE);
         compressionTypeList.define("Legacy ZSTD compression", server::CT_LEGACY);
         compressionTypeList.define("Lossy compression", server::CT_LOSSY);
+        compressionTypeList.define("Streaming ZSTD", server::CT_ZSTD_STREAM);
+        compressionTypeList.define("Streaming ZSTD + dictionary", server::CT_ZSTD_STREAM_DICT);
         compressionTypeId = compressionTypeList.valueId(server::CT_NONE);
 
         sampleTypeList.define("Int8", dsp::compression::PCM_TYPE_I8);
@@ -311,6 +313,10 @@ private:
                 config.conf["servers"][_this->devConfName]["compressionType"] = _this->compressionTypeList.value(_this->compressionTypeId);
                 config.release(true);
             }
+            auto compressionType = _this->compressionTypeList.value(_this->compressionTypeId);
+            if ((compressionType == server::CT_ZSTD_STREAM || compressionType == server::CT_ZSTD_STREAM_DICT) && _this->client->serverCompressionRatio > 0) {
+                ImGui::Text("Compression: %.2fx, %.1f ms/s on server", _this->client->serverCompressionRatio, _this->client->serverCompressMillisPerSecond);
+            }
             if (_this->compressionTypeList.value(_this->compressionTypeId) == server::CT_LOSSY) {
                 if (_this->client->transmitterSupported != -1) { // means sdr++ brown version
                     ImGui::LeftLabel("Loss factor");
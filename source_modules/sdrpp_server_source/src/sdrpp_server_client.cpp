@@ -289,6 +289,7 @@ namespace server {
         std::string diffId = "";
         SmGui::DrawListElem diffValue;
         bool syncRequired = false;
+        if (uiResyncRequest.exchange(false)) { getUI(); }
         {
             std::lock_guard<std::mutex> lck(dlMtx);
             dl.draw(diffId, diffValue, syncRequired);
@@ -351,7 +352,20 @@ namespace server {
 
     void Client::setCompressionType(CompressionType type) {
         if (!isOpen()) { return; }
-        s_cmd_data[0] = type == CompressionType::CT_LEGACY ? 1 : 0;
+        switch (type) {
+        case CompressionType::CT_LEGACY:
+            s_cmd_data[0] = BASEBAND_COMPRESSION_LEGACY;
+            break;
+        case CompressionType::CT_ZSTD_STREAM:
+            s_cmd_data[0] = BASEBAND_COMPRESSION_ZSTD_STREAM;
+            break;
+        case CompressionType::CT_ZSTD_STREAM_DICT:
+            s_cmd_data[0] = BASEBAND_COMPRESSION_ZSTD_STREAM_DICT;
+            break;
+        default:
+            s_cmd_data[0] = BASEBAND_COMPRESSION_NONE;
+            break;
+        }
         sendCommand(COMMAND_SET_COMPRESSION, 1);
         s_cmd_data[0] = type == CompressionType::CT_LOSSY ? 1 : 0;
         sendCommand(COMMAND_SET_FFTZSTD_COMPRESSION, 1);
@@ -469,6 +483,19 @@ namespace server {
                     // unsolicited UI
                     std::lock_guard lck(dlMtx);
                     dl.load(r_cmd_data, r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
+                } else if (r_cmd_hdr->cmd == COMMAND_GET_UI_DELTA) {
+                    // Deltas that don't fit the list we have are dropped until the full list asked for arrives
+                    int res;
+                    {
+                        std::lock_guard lck(dlMtx);
+                        res = dl.loadDelta(r_cmd_data, r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader), uiSeq);
+                        if (res >= 0 && (((SmGui::DeltaHeader*)r_cmd_data)->flags & SmGui::DELTA_FLAG_FULL)) { uiResyncPending = false; }
+                    }
+                    if (res < 0 && !uiResyncPending) {
+                        flog::warn("UI delta does not apply ({0}), asking for the full UI", res);
+                        uiResyncPending = true;
+                        uiResyncRequest = true;
+                    }
                 } else if (r_cmd_hdr->cmd == COMMAND_SECURE_CHALLENGE) {
                     secureChallengeReceived = currentTimeMillis();
                     challenge.resize(256 / 8);
@@ -507,6 +534,10 @@ namespace server {
                         rt->txPrebufferMillis = &txPrebufferMsec;
                         sigpath::transmitter = rt;
                     }
+                } else if (r_cmd_hdr->cmd == COMMAND_SET_ZSTD_DICTIONARY) {
+                    int nbytes = r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader);
+                    streamDecoder.setDictionary(r_cmd_data, nbytes);
+                    flog::info("Received a {} byte zstd dictionary", nbytes);
                 } else if (r_cmd_hdr->cmd == COMMAND_SET_TRANSMITTER_NOT_SUPPORTED) {
                     transmitterSupported = 0;
                     if (sigpath::transmitter) {
@@ -567,6 +598,23 @@ namespace server {
                 };
                 updateStreamTime(this);
             }
+            else if (r_pkt_hdr->type == PACKET_TYPE_BASEBAND_ZSTD_STREAM) {
+                fftDecompressor.setEnabled(false);
+                StreamMetadata* sm = (StreamMetadata*)r_pkt_data;
+                int dataSize = r_pkt_hdr->size - sizeof(PacketHeader);
+                if (dataSize < (int)sizeof(StreamMetadata) || sm->size < (int)sizeof(StreamMetadata) || sm->size > dataSize) {
+                    flog::error("Invalid zstd stream packet");
+                    continue;
+                }
+                serverCompressionRatio = sm->compressionRatio;
+                serverCompressMillisPerSecond = sm->compressMillisPerSecond;
+                bool frameStart = sm->streamFlags & STREAM_FLAG_FRAME_START;
+                int outCount = streamDecoder.decompress(&r_pkt_data[sm->size], dataSize - sm->size, decompIn.writeBuf, STREAM_BUFFER_SIZE*sizeof(dsp::complex_t)+8, frameStart);
+                if (outCount > 0) {
+                    if (!decompIn.swap(outCount)) { break; }
+                }
+                updateStreamTime(this);
+            }
             else if (r_pkt_hdr->type == PACKET_TYPE_ERROR) {
                 flog::error("SDR++ Server Error: {0}", rbuffer[sizeof(PacketHeader)]);
             }
@@ -580,7 +628,9 @@ namespace server {
     int Client::getUI() {
         if (!isOpen()) { return -1; }
 //        auto waiter = awaitCommandAck(COMMAND_GET_UI);
-        sendCommand(COMMAND_GET_UI, 0);
+        // Servers that know about deltas switch to them, older ones ignore the version and send full lists
+        *(int32_t*)s_cmd_data = SmGui::DELTA_VERSION;
+        sendCommand(COMMAND_GET_UI, sizeof(int32_t));
 //        if (waiter->await(PROTOCOL_TIMEOUT_MS)) {
 //            std::lock_guard lck(dlMtx);
 //            dl.load(r_cmd_data, r_pkt_hdr->size - sizeof(PacketHeader) - sizeof(CommandHeader));
@@ -14,6 +14,7 @@
 #include <dsp/buffer/prebuffer.h>
 #include <zstd.h>
 #include "dsp/compression/experimental_fft_decompressor.h"
+#include "dsp/compression/zstd_stream.h"
 #include <chrono>
 
 #define PROTOCOL_TIMEOUT_MS             10000
@@ -23,7 +24,9 @@ namespace server {
     enum CompressionType {
         CT_NONE,
         CT_LEGACY,
-        CT_LOSSY
+        CT_LOSSY,
+        CT_ZSTD_STREAM,
+        CT_ZSTD_STREAM_DICT
     };
 
 
@@ -132,6 +135,16 @@ namespace server {
             }
         }
 
+        // Asks the server to shift offset Hz from the center to baseband before resampling
+        void setDDCOffset(double offset) {
+            if (ddcOffset != offset) {
+                ddcOffset = offset;
+                *((double*)&s_cmd_data[0]) = offset;
+                sendCommand(COMMAND_SET_DDC_OFFSET, sizeof(double));
+                prebufferer.clear();
+            }
+        }
+
         void setMaskedFrequencies(std::vector<int32_t> offsets) {
             if (maskedFrequencies != offsets) {
                 maskedFrequencies = offsets;
@@ -156,6 +169,10 @@ namespace server {
         int transmitterSupported = -1; // unknown
         int txPrebufferMsec = 0;
 
+        // As reported by the server in the zstd stream metadata
+        float serverCompressionRatio = 0;
+        float serverCompressMillisPerSecond = 0;
+
     private:
         void worker();
 
@@ -197,13 +214,18 @@ namespace server {
 
         SmGui::DrawList dl;
         std::mutex dlMtx;
+        uint32_t uiSeq = 0;                 // of the list in dl when the server sends deltas
+        bool uiResyncPending = false;
+        std::atomic<bool> uiResyncRequest = false;   // sent from showMenu(), sbuffer belongs to the UI thread
 
         ZSTD_DCtx* dctx;
+        dsp::compression::ZstdStreamDecoder streamDecoder;
 
         std::thread workerThread;
 
         double currentSampleRate = 1000000.0;
         double requestedSampleRate = 0;
+        double ddcOffset = 0;
     };
 
     std::shared_ptr<Client> connect(std::string host, uint16_t port, dsp::stream<dsp::complex_t>* out);
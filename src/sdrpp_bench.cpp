@@ -0,0 +1,319 @@
+#include <dsp/bench/speed_tester.h>
+#include <dsp/filter/fir.h>
+#include <dsp/taps/windowed_sinc.h>
+#include <dsp/multirate/power_decimator.h>
+#include <dsp/multirate/rational_resampler.h>
+#include <dsp/channel/rx_vfo.h>
+#include <dsp/channel/frequency_xlator.h>
+#include <dsp/demod/broadcast_fm.h>
+#include <dsp/demod/quadrature.h>
+#include <dsp/loop/agc.h>
+#include <dsp/routing/splitter.h>
+#include <dsp/buffer/reshaper.h>
+#include <dsp/sink/null_sink.h>
+#include <command_args.h>
+#include <utils/flog.h>
+#include <json.hpp>
+#include <fstream>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+// Headless throughput benchmark of the core DSP blocks. Every case runs one block between the two threads of
+// a SpeedTester, with buffers of 10 ms at the nominal sample rate of the case. Results go to a JSON file,
+// and when a baseline from an earlier run is given, cases that got slower than the threshold are flagged
+// and the exit code is 1.
+
+using nlohmann::json;
+
+struct BenchResult {
+    double inRate = 0;
+    double outRate = 0;
+};
+
+struct BenchCase {
+    std::string name;       // family/parameters, what runs are compared by
+    std::string family;
+    double sampleRate;      // nominal input rate
+    std::function<BenchResult(int durationMs, int bufferSize)> run;
+};
+
+template <class I, class O>
+static BenchResult measure(dsp::stream<I>* in, dsp::stream<O>* out, int durationMs, int bufferSize) {
+    dsp::bench::SpeedTester<I, O> tester(in, out);
+    BenchResult res;
+    res.inRate = tester.benchmark(durationMs, bufferSize);
+    res.outRate = tester.getOutputRate();
+    return res;
+}
+
+static std::string rateName(double rate) {
+    char buf[32];
+    if (rate >= 1e6) { snprintf(buf, sizeof(buf), "%gM", rate / 1e6); }
+    else { snprintf(buf, sizeof(buf), "%gk", rate / 1e3); }
+    return buf;
+}
+
+static std::vector<BenchCase> makeCases() {
+    std::vector<BenchCase> cases;
+    auto add = [&cases](const std::string& family, const std::string& params, double sampleRate, std::function<BenchResult(int, int)> run) {
+        cases.push_back({ family + "/" + params + "/" + rateName(sampleRate), family, sampleRate, run });
+    };
+
+    for (double rate : { 48000.0, 250000.0, 2400000.0 }) {
+        for (int tapCount : { 32, 128, 512, 2048 }) {
+            add("fir", "taps=" + std::to_string(tapCount), rate, [tapCount](int durationMs, int bufferSize) {
+                dsp::stream<dsp::complex_t> in;
+                auto taps = dsp::taps::windowedSinc<float>(tapCount, 0.05, 1.0, dsp::window::nuttall);
+                dsp::filter::FIR<dsp::complex_t, float> fir(&in, taps);
+                fir.start();
+                auto res = measure(&in, &fir.out, durationMs, bufferSize);
+                fir.stop();
+                dsp::taps::free(taps);
+                return res;
+            });
+        }
+    }
+
+    for (double rate : { 2400000.0, 10000000.0 }) {
+        for (int ratio : { 2, 8, 64 }) {
+            add("power_decimator", "ratio=" + std::to_string(ratio), rate, [ratio](int durationMs, int bufferSize) {
+                dsp::stream<dsp::complex_t> in;
+                dsp::multirate::PowerDecimator<dsp::complex_t> decim(&in, ratio);
+                decim.start();
+                auto res = measure(&in, &decim.out, durationMs, bufferSize);
+                decim.stop();
+                return res;
+            });
+        }
+    }
+
+    const std::pair<double, double> resamplings[] = { { 48000.0, 44100.0 }, { 250000.0, 48000.0 }, { 2400000.0, 48000.0 }, { 10000000.0, 250000.0 } };
+    for (auto [inRate, outRate] : resamplings) {
+        add("rational_resampler", "out=" + rateName(outRate), inRate, [inRate = inRate, outRate = outRate](int durationMs, int bufferSize) {
+            dsp::stream<dsp::complex_t> in;
+            dsp::multirate::RationalResampler<dsp::complex_t> resamp(&in, inRate, outRate);
+            resamp.start();
+            auto res = measure(&in, &resamp.out, durationMs, bufferSize);
+            resamp.stop();
+            return res;
+        });
+    }
+
+    const std::tuple<double, double, double> vfos[] = { { 2400000.0, 48000.0, 12500.0 }, { 10000000.0, 48000.0, 12500.0 }, { 10000000.0, 250000.0, 200000.0 } };
+    for (auto [inRate, outRate, bandwidth] : vfos) {
+        add("rx_vfo", "out=" + rateName(outRate), inRate, [inRate = inRate, outRate = outRate, bandwidth = bandwidth](int durationMs, int bufferSize) {
+            dsp::stream<dsp::complex_t> in;
+            dsp::channel::RxVFO vfo(&in, inRate, outRate, bandwidth, inRate / 8);
+            vfo.start();
+            auto res = measure(&in, &vfo.out, durationMs, bufferSize);
+            vfo.stop();
+            return res;
+        });
+    }
+
+    for (bool stereo : { false, true }) {
+        add("broadcast_fm", stereo ? "stereo" : "mono", 250000.0, [stereo](int durationMs, int bufferSize) {
+            dsp::stream<dsp::complex_t> in;
+            dsp::demod::BroadcastFM demod(&in, 75000.0, 250000.0, stereo);
+            demod.start();
+            auto res = measure(&in, &demod.out, durationMs, bufferSize);
+            demod.stop();
+            return res;
+        });
+    }
+
+    add("agc", "real", 48000.0, [](int durationMs, int bufferSize) {
+        dsp::stream<float> in;
+        dsp::loop::AGC<float> agc(&in, 1.0, 50.0 / 48000.0, 5.0 / 48000.0, 10e6, 10.0);
+        agc.start();
+        auto res = measure(&in, &agc.out, durationMs, bufferSize);
+        agc.stop();
+        return res;
+    });
+    add("agc", "complex", 250000.0, [](int durationMs, int bufferSize) {
+        dsp::stream<dsp::complex_t> in;
+        dsp::loop::AGC<dsp::complex_t> agc(&in, 1.0, 50.0 / 250000.0, 5.0 / 250000.0, 10e6, 10.0);
+        agc.start();
+        auto res = measure(&in, &agc.out, durationMs, bufferSize);
+        agc.stop();
+        return res;
+    });
+
+    for (double rate : { 2400000.0, 10000000.0 }) {
+        add("frequency_xlator", "offset=rate/8", rate, [rate](int durationMs, int bufferSize) {
+            dsp::stream<dsp::complex_t> in;
+            dsp::channel::FrequencyXlator xlator(&in, rate / 8, rate);
+            xlator.start();
+            auto res = measure(&in, &xlator.out, durationMs, bufferSize);
+            xlator.stop();
+            return res;
+        });
+    }
+
+    for (double rate : { 48000.0, 250000.0 }) {
+        add("quadrature", "deviation=5k", rate, [rate](int durationMs, int bufferSize) {
+            dsp::stream<dsp::complex_t> in;
+            dsp::demod::Quadrature demod(&in, 5000.0, rate);
+            demod.start();
+            auto res = measure(&in, &demod.out, durationMs, bufferSize);
+            demod.stop();
+            return res;
+        });
+    }
+
+    for (bool shared : { false, true }) {
+        for (int outputs : { 1, 4 }) {
+            add("splitter", std::string(shared ? "shared" : "copy") + ",outputs=" + std::to_string(outputs), 10000000.0, [shared, outputs](int durationMs, int bufferSize) {
+                // The tester reads the first output, null sinks drain the others
+                dsp::stream<dsp::complex_t> in;
+                std::vector<dsp::stream<dsp::complex_t>> outs(outputs);
+                std::vector<dsp::sink::Null<dsp::complex_t>> sinks(outputs);
+                dsp::routing::Splitter<dsp::complex_t> split(&in);
+                split.setSharedFanout(shared);
+                for (int i = 0; i < outputs; i++) { split.bindStream(&outs[i]); }
+                for (int i = 1; i < outputs; i++) {
+                    sinks[i].init(&outs[i]);
+                    sinks[i].start();
+                }
+                split.start();
+                auto res = measure(&in, &outs[0], durationMs, bufferSize);
+                split.stop();
+                for (int i = 1; i < outputs; i++) { sinks[i].stop(); }
+                return res;
+            });
+        }
+    }
+
+    // Reshaping for an FFT of 8192 bins at 20 frames per second and with full overlap
+    for (int skip : { 0, 2400000 / 20 - 8192 }) {
+        add("reshaper", "keep=8192,skip=" + std::to_string(skip), 2400000.0, [skip](int durationMs, int bufferSize) {
+            dsp::stream<dsp::complex_t> in;
+            dsp::buffer::Reshaper<dsp::complex_t> reshape(&in, 8192, skip);
+            reshape.start();
+            auto res = measure(&in, &reshape.out, durationMs, bufferSize);
+            reshape.stop();
+            return res;
+        });
+    }
+
+    return cases;
+}
+
+static bool loadJson(const std::string& path, json& out) {
+    std::ifstream file(path);
+    if (!file.is_open()) { return false; }
+    try {
+        file >> out;
+    }
+    catch (const std::exception& e) {
+        flog::error("Could not parse '{}': {}", path, e.what());
+        return false;
+    }
+    return out.contains("results") && out["results"].is_array();
+}
+
+int main(int argc, char* argv[]) {
+    CommandArgsParser args;
+    args.define('h', "help", "Show help");
+    args.define('l', "list", "List the benchmark cases and exit");
+    args.define('f', "filter", "Only run the cases whose name contains this", std::string(""));
+    args.define('d', "duration", "Milliseconds per run of a case", 500);
+    args.define('n', "runs", "Runs per case, the best one counts", 3);
+    args.define('q', "quick", "Short single runs, for a smoke test");
+    args.define('o', "output", "JSON file the results are written to", std::string("sdrpp_bench.json"));
+    args.define('b', "baseline", "JSON file of an earlier run to compare against", std::string(""));
+    args.define('t', "threshold", "Slowdown against the baseline that counts as a regression", 0.15);
+    if (args.parse(argc, argv) < 0) { return 2; }
+    if (args["help"].b()) {
+        args.showHelp();
+        return 0;
+    }
+
+    std::string filter = args["filter"].s();
+    std::vector<BenchCase> cases;
+    for (auto& c : makeCases()) {
+        if (filter.empty() || c.name.find(filter) != std::string::npos) { cases.push_back(c); }
+    }
+    if (args["list"].b()) {
+        for (auto& c : cases) { printf("%s\n", c.name.c_str()); }
+        return 0;
+    }
+
+    json baseline;
+    std::string baselinePath = args["baseline"].s();
+    if (!baselinePath.empty() && !loadJson(baselinePath, baseline)) {
+        flog::error("Could not read the baseline '{}'", baselinePath);
+        return 2;
+    }
+
+    bool quick = args["quick"].b();
+    int durationMs = quick ? 100 : std::max<int>(args["duration"].i(), 10);
+    int runs = quick ? 1 : std::max<int>(args["runs"].i(), 1);
+    double threshold = args["threshold"].f();
+
+    json results = json::array();
+    for (auto& c : cases) {
+        int bufferSize = std::clamp<int>(c.sampleRate / 100, 480, STREAM_BUFFER_SIZE / 4);
+        BenchResult best;
+        for (int r = 0; r < runs; r++) {
+            BenchResult res = c.run(durationMs, bufferSize);
+            if (res.inRate > best.inRate) { best = res; }
+        }
+        json entry;
+        entry["name"] = c.name;
+        entry["family"] = c.family;
+        entry["sampleRate"] = c.sampleRate;
+        entry["bufferSize"] = bufferSize;
+        entry["samplesPerSec"] = best.inRate;
+        entry["outputSamplesPerSec"] = best.outRate;
+        entry["realtime"] = best.inRate / c.sampleRate;
+        results.push_back(entry);
+        flog::info("{}: {} MS/s, {} x real time", c.name, best.inRate / 1e6, best.inRate / c.sampleRate);
+    }
+
+    // Compare by name, cases missing on either side are left out
+    int regressions = 0;
+    if (!baselinePath.empty()) {
+        std::map<std::string, double> before;
+        for (auto& entry : baseline["results"]) { before[entry["name"]] = entry["samplesPerSec"]; }
+        for (auto& entry : results) {
+            auto it = before.find(entry["name"]);
+            if (it == before.end() || it->second <= 0) { continue; }
+            double ratio = (double)entry["samplesPerSec"] / it->second;
+            entry["baselineSamplesPerSec"] = it->second;
+            entry["ratio"] = ratio;
+            entry["regression"] = ratio < 1.0 - threshold;
+            if (ratio < 1.0 - threshold) {
+                flog::warn("Regression {}: {} MS/s, was {} MS/s ({}%)", (std::string)entry["name"], (double)entry["samplesPerSec"] / 1e6, it->second / 1e6, (ratio - 1.0) * 100.0);
+                regressions++;
+            }
+        }
+        flog::info("{} of {} cases slower than the baseline by more than {}%", regressions, (int)results.size(), threshold * 100.0);
+    }
+
+    json out;
+    out["tool"] = "sdrpp_bench";
+    out["version"] = 1;
+    out["durationMs"] = durationMs;
+    out["runs"] = runs;
+    out["threads"] = std::thread::hardware_concurrency();
+    if (!baselinePath.empty()) {
+        out["baseline"] = baselinePath;
+        out["regressions"] = regressions;
+    }
+    out["results"] = results;
+    std::string outputPath = args["output"].s();
+    std::ofstream file(outputPath);
+    if (!file.is_open()) {
+        flog::error("Could not write '{}'", outputPath);
+        return 2;
+    }
+    file << out.dump(4);
+    file.close();
+    flog::info("Results written to '{}'", outputPath);
+    flog::flush();
+
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,601 @@
+#include <dsp/channel/rx_vfo.h>
+#include <dsp/demod/ssb.h>
+#include <dsp/demod/broadcast_fm.h>
+#include <utils/wav.h>
+#include <utils/flog.h>
+#include <command_args.h>
+#include <json.hpp>
+#include "../decoder_modules/ft8_decoder/src/ft8_decoder.h"
+#include "../decoder_modules/pager_decoder/src/pocsag/dsp.h"
+#include "../decoder_modules/pager_decoder/src/pocsag/pocsag.h"
+#include "../decoder_modules/radio/src/rds_demod.h"
+#include "../decoder_modules/radio/src/rds.h"
+#include <filesystem>
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+
+// Headless batch decoding of baseband recordings. Every pair of a file and a VFO is a job: the channel of the
+// VFO is cut out of the mapped file with an RxVFO and fed to the decoder as fast as the CPU allows, with no
+// pacing and no signal path. Jobs run on a pool of threads, FT8/FT4 periods are decoded on the same pool as
+// they are completed. Results are written to stdout as JSON lines, the log goes to stderr.
+
+using nlohmann::json;
+
+// IQ samples read from the file per step of a job
+static const int CHUNK_SIZE = 65536;
+
+struct Recording {
+    std::string path;
+    double centerFrequency = 0;
+    double sampleRate = 0;
+    uint64_t sampleCount = 0;
+    int64_t startMillis = 0;    // wall clock time of the first sample, 0 if unknown
+};
+
+struct VFOSpec {
+    std::string decoder;
+    double frequency;
+};
+
+// Runs the channel jobs and the FT8/FT4 decodes they hand in. Queued decodes go before new jobs so that
+// finished periods don't pile up, and a job that gets too far ahead of the decodes runs some itself.
+class JobQueue {
+public:
+    JobQueue(int threads) : threadCount(threads) {}
+
+    void addJob(std::function<void()> job) {
+        std::lock_guard<std::mutex> lck(mtx);
+        jobs.push_back(std::move(job));
+    }
+
+    void addDecode(std::function<void()> decode) {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            decodes.push_back(std::move(decode));
+        }
+        cv.notify_one();
+    }
+
+    // Called by jobs between chunks
+    void helpIfBehind() {
+        while (true) {
+            std::function<void()> decode;
+            {
+                std::lock_guard<std::mutex> lck(mtx);
+                if ((int)decodes.size() <= threadCount) { return; }
+                decode = std::move(decodes.front());
+                decodes.pop_front();
+            }
+            decode();
+        }
+    }
+
+    // Returns once every job and every decode is done
+    void run() {
+        std::vector<std::thread> workers;
+        for (int i = 1; i < threadCount; i++) { workers.emplace_back(&JobQueue::workerLoop, this); }
+        workerLoop();
+        for (auto& w : workers) { w.join(); }
+    }
+
+private:
+    void workerLoop() {
+        std::unique_lock<std::mutex> lck(mtx);
+        while (true) {
+            cv.wait(lck, [this] { return !decodes.empty() || !jobs.empty() || !active; });
+            std::function<void()> task;
+            if (!decodes.empty()) {
+                task = std::move(decodes.front());
+                decodes.pop_front();
+            }
+            else if (!jobs.empty()) {
+                task = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            else {
+                // Nothing queued and nothing running that could queue more
+                cv.notify_all();
+                return;
+            }
+            active++;
+            lck.unlock();
+            task();
+            lck.lock();
+            active--;
+            if (!active) { cv.notify_all(); }
+        }
+    }
+
+    int threadCount;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::function<void()>> jobs;
+    std::deque<std::function<void()>> decodes;
+    int active = 0;
+};
+
+// One JSON line per result, whole lines only
+class ResultWriter {
+public:
+    void write(const json& result) {
+        std::string line = result.dump() + "\n";
+        std::lock_guard<std::mutex> lck(mtx);
+        fwrite(line.data(), 1, line.size(), stdout);
+        fflush(stdout);
+        count++;
+    }
+
+    int getCount() {
+        std::lock_guard<std::mutex> lck(mtx);
+        return count;
+    }
+
+private:
+    std::mutex mtx;
+    int count = 0;
+};
+
+// Fields every result has, time is from the start of the file in seconds
+static json makeResult(const Recording& rec, const VFOSpec& vfo, double time) {
+    json result;
+    result["file"] = rec.path;
+    result["decoder"] = vfo.decoder;
+    result["vfo"] = vfo.frequency;
+    result["time"] = time;
+    if (rec.startMillis) { result["timestamp"] = rec.startMillis + (int64_t)(time * 1000.0); }
+    return result;
+}
+
+class BatchDecoder {
+public:
+    BatchDecoder(const Recording& rec, const VFOSpec& vfo, ResultWriter& writer) : rec(rec), vfo(vfo), writer(writer) {}
+    virtual ~BatchDecoder() {}
+
+    virtual double getSampleRate() = 0;
+    virtual double getBandwidth() = 0;
+
+    // Where the channel is centered relative to the VFO frequency
+    virtual double getCenterOffset() { return 0; }
+
+    // Channel samples, time is the offset of the first one from the start of the file in seconds
+    virtual void process(dsp::complex_t* data, int count, double time) = 0;
+
+    virtual void finish() {}
+
+protected:
+    json makeResult(double time) { return ::makeResult(rec, vfo, time); }
+
+    const Recording& rec;
+    const VFOSpec& vfo;
+    ResultWriter& writer;
+};
+
+// USB audio of the dial frequency, cut into periods on the UTC grid like the module does. Periods that
+// don't cover at least all but two seconds of their slot are left out.
+class FT8BatchDecoder : public BatchDecoder {
+public:
+    static constexpr int SAMPLE_RATE = 24000;
+    static constexpr int BANDWIDTH = 3000;
+
+    FT8BatchDecoder(const Recording& rec, const VFOSpec& vfo, ResultWriter& writer, JobQueue& queue)
+        : BatchDecoder(rec, vfo, writer), queue(queue) {
+        period = (vfo.decoder == "ft4") ? 7.5 : 15.0;
+        demod.init(NULL, dsp::demod::SSB<dsp::stereo_t>::Mode::USB, BANDWIDTH, SAMPLE_RATE, 0.0, 0.0);
+        audio.resize(CHUNK_SIZE);
+    }
+
+    double getSampleRate() { return SAMPLE_RATE; }
+    double getBandwidth() { return BANDWIDTH; }
+    double getCenterOffset() { return BANDWIDTH / 2; }
+
+    void process(dsp::complex_t* data, int count, double time) {
+        demod.process(count, data, audio.data());
+        double startSec = rec.startMillis / 1000.0;
+        int done = 0;
+        while (done < count) {
+            double t = startSec + time + (double)done / SAMPLE_RATE;
+            int64_t number = (int64_t)floor(t / period);
+            if (number != blockNumber) {
+                submit();
+                blockNumber = number;
+                blockTime = time + (double)done / SAMPLE_RATE;
+                block = std::make_shared<std::vector<dsp::stereo_t>>();
+                block->reserve((int)((period + 1) * SAMPLE_RATE));
+            }
+            // Up to the end of this period
+            double periodEnd = (number + 1) * period;
+            int left = std::max<int>(1, (int)ceil((periodEnd - t) * SAMPLE_RATE));
+            int n = std::min<int>(count - done, left);
+            block->insert(block->end(), audio.begin() + done, audio.begin() + done + n);
+            done += n;
+        }
+    }
+
+    void finish() { submit(); }
+
+private:
+    void submit() {
+        if (!block) { return; }
+        double seconds = (double)block->size() / SAMPLE_RATE;
+        if (seconds > period - 2) {
+            // Runs after this decoder is gone, the recording, the VFO and the writer live until the end
+            auto decodeBlock = block;
+            double time = blockTime;
+            const Recording& rec = this->rec;
+            const VFOSpec& vfo = this->vfo;
+            ResultWriter& writer = this->writer;
+            queue.addDecode([decodeBlock, time, &rec, &vfo, &writer]() {
+                dsp::ft8::decodeBlock(1, vfo.decoder, SAMPLE_RATE, *decodeBlock, [time, &rec, &vfo, &writer](const FtDecodeResult& res) {
+                    // Calls resolved from the hash table come after a '|'
+                    std::string message = res.message.substr(0, res.message.find('|'));
+                    json result = ::makeResult(rec, vfo, time);
+                    result["frequency"] = vfo.frequency + res.frequency;
+                    result["audioFrequency"] = res.frequency;
+                    result["snr"] = res.snr;
+                    result["dt"] = res.dt;
+                    result["message"] = message;
+                    writer.write(result);
+                });
+            });
+        }
+        block.reset();
+    }
+
+    JobQueue& queue;
+    double period;
+    dsp::demod::SSB<dsp::stereo_t> demod;
+    std::vector<dsp::stereo_t> audio;
+    std::shared_ptr<std::vector<dsp::stereo_t>> block;
+    int64_t blockNumber = -1;
+    double blockTime = 0;
+};
+
+// Same channel and demodulator as the pager module
+class POCSAGBatchDecoder : public BatchDecoder {
+public:
+    static constexpr int BAUDRATE = 2400;
+    static constexpr int SAMPLE_RATE = BAUDRATE * 10;
+
+    POCSAGBatchDecoder(const Recording& rec, const VFOSpec& vfo, ResultWriter& writer) : BatchDecoder(rec, vfo, writer) {
+        dsp.init(NULL, SAMPLE_RATE, BAUDRATE);
+        soft.resize(CHUNK_SIZE);
+        bits.resize(CHUNK_SIZE);
+        decoder.onMessage.bind([this](pocsag::Address addr, pocsag::MessageType type, const std::string& msg) {
+            json result = makeResult(currentTime);
+            result["address"] = addr;
+            result["type"] = (type == pocsag::MESSAGE_TYPE_ALPHANUMERIC) ? "alphanumeric" : "numeric";
+            result["message"] = msg;
+            this->writer.write(result);
+        });
+    }
+
+    double getSampleRate() { return SAMPLE_RATE; }
+    double getBandwidth() { return 12500; }
+
+    void process(dsp::complex_t* data, int count, double time) {
+        currentTime = time;
+        int n = dsp.process(count, data, soft.data(), bits.data());
+        decoder.process(bits.data(), n);
+    }
+
+private:
+    POCSAGDSP dsp;
+    pocsag::Decoder decoder;
+    std::vector<float> soft;
+    std::vector<uint8_t> bits;
+    double currentTime = 0;
+};
+
+// Mono broadcast FM demodulator with the RDS output of the radio module's WFM mode. A result is written
+// whenever the PI code, the program service name or the radio text changes.
+class RDSBatchDecoder : public BatchDecoder {
+public:
+    static constexpr int SAMPLE_RATE = 250000;
+
+    RDSBatchDecoder(const Recording& rec, const VFOSpec& vfo, ResultWriter& writer) : BatchDecoder(rec, vfo, writer) {
+        demod.init(NULL, 75000, SAMPLE_RATE, false, false, true);
+        rdsDemod.init(NULL, false);
+        audio.resize(CHUNK_SIZE);
+        rdsSamples.resize(CHUNK_SIZE);
+        soft.resize(CHUNK_SIZE);
+        bits.resize(CHUNK_SIZE);
+    }
+
+    double getSampleRate() { return SAMPLE_RATE; }
+    double getBandwidth() { return 150000; }
+
+    void process(dsp::complex_t* data, int count, double time) {
+        int rdsCount = 0;
+        demod.process(count, data, audio.data(), rdsCount, rdsSamples.data());
+        int n = rdsDemod.process(rdsCount, rdsSamples.data(), soft.data(), bits.data());
+        decoder.process(bits.data(), n);
+
+        if (decoder.piCodeValid()) {
+            char pi[8];
+            snprintf(pi, sizeof(pi), "0x%04X", decoder.getPICode());
+            report(time, "pi", pi, lastPI);
+        }
+        if (decoder.PSNameValid()) { report(time, "ps", decoder.getPSName(), lastPS); }
+        if (decoder.radioTextValid()) { report(time, "rt", decoder.getRadioText(), lastRT); }
+    }
+
+private:
+    void report(double time, const char* field, const std::string& value, std::string& last) {
+        if (value == last) { return; }
+        last = value;
+        json result = makeResult(time);
+        result["field"] = field;
+        result["value"] = value;
+        writer.write(result);
+    }
+
+    dsp::demod::BroadcastFM demod;
+    RDSDemod rdsDemod;
+    rds::Decoder decoder;
+    std::vector<dsp::stereo_t> audio;
+    std::vector<dsp::complex_t> rdsSamples;
+    std::vector<float> soft;
+    std::vector<uint8_t> bits;
+    std::string lastPI, lastPS, lastRT;
+};
+
+static const char* DECODER_NAMES[] = { "ft8", "ft4", "pocsag", "rds" };
+
+// Decoders of the GUI that this tool is built without
+static const char* UNSUPPORTED_DECODER_NAMES[] = { "tetra", "dmr" };
+
+// Standard FT8 dial frequencies, the same as the FT8 module's. A ft8 VFO without a frequency stands for those
+// the recording covers.
+static const double FT8_FREQUENCIES[] = { 1840000, 3573000, 5357000, 7074000, 10136000, 14074000, 18100000, 21074000, 24915000, 28074000, 50323000, 144174000, 222065000, 432065000 };
+
+static std::unique_ptr<BatchDecoder> makeDecoder(const Recording& rec, const VFOSpec& vfo, ResultWriter& writer, JobQueue& queue) {
+    if (vfo.decoder == "ft8" || vfo.decoder == "ft4") { return std::make_unique<FT8BatchDecoder>(rec, vfo, writer, queue); }
+    if (vfo.decoder == "pocsag") { return std::make_unique<POCSAGBatchDecoder>(rec, vfo, writer); }
+    if (vfo.decoder == "rds") { return std::make_unique<RDSBatchDecoder>(rec, vfo, writer); }
+    return nullptr;
+}
+
+// Same naming as the recorder, like baseband_14235774Hz_12-19-14_10-07-2022.wav
+static double frequencyFromName(const std::string& name) {
+    auto pos = name.find("Hz");
+    if (pos == std::string::npos) { return 0; }
+    auto begin = pos;
+    while (begin > 0 && isdigit(name[begin - 1])) { begin--; }
+    if (begin == pos) { return 0; }
+    return std::atof(name.substr(begin, pos - begin).c_str());
+}
+
+static int64_t startFromName(const std::string& name) {
+    auto pos = name.find("Hz_");
+    if (name.rfind("baseband", 0) || pos == std::string::npos) { return 0; }
+    std::tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(name.c_str() + pos + 3, "%d-%d-%d_%d-%d-%d", &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &tm.tm_mday, &tm.tm_mon, &tm.tm_year) != 6) { return 0; }
+    tm.tm_mon--;
+    tm.tm_year -= 1900;
+    tm.tm_isdst = -1;
+    std::time_t t = std::mktime(&tm);
+    return (t < 0) ? 0 : (int64_t)t * 1000;
+}
+
+static bool openRecording(const std::string& path, double center, Recording& rec) {
+    wav::Reader reader(path);
+    if (!reader.isValid()) {
+        flog::error("Could not open '{}': {}", path, reader.error);
+        return false;
+    }
+    std::string name = std::filesystem::path(path).filename().string();
+    rec.path = path;
+    rec.sampleRate = reader.getSampleRate();
+    rec.sampleCount = reader.getSampleCount();
+    rec.centerFrequency = center ? center : frequencyFromName(name);
+    rec.startMillis = startFromName(name);
+    reader.close();
+    if (!rec.centerFrequency) {
+        flog::error("No center frequency in the name of '{}', give it with --center", path);
+        return false;
+    }
+    return true;
+}
+
+static std::vector<std::string> splitList(const std::string& str) {
+    std::vector<std::string> out;
+    size_t begin = 0;
+    while (begin <= str.size()) {
+        size_t end = str.find(',', begin);
+        if (end == std::string::npos) { end = str.size(); }
+        if (end > begin) { out.push_back(str.substr(begin, end - begin)); }
+        begin = end + 1;
+    }
+    return out;
+}
+
+// Files as given, directories for the recordings in them
+static std::vector<std::string> listInputs(const std::string& list) {
+    std::vector<std::string> paths;
+    for (auto& input : splitList(list)) {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(input, ec)) {
+            paths.push_back(input);
+            continue;
+        }
+        std::vector<std::string> inDir;
+        for (auto& entry : std::filesystem::directory_iterator(input, ec)) {
+            std::string ext = entry.path().extension().string();
+            if (entry.is_regular_file() && (ext == ".wav" || ext == ".w64")) { inDir.push_back(entry.path().string()); }
+        }
+        std::sort(inDir.begin(), inDir.end());
+        paths.insert(paths.end(), inDir.begin(), inDir.end());
+    }
+    return paths;
+}
+
+static bool parseVFOs(const std::string& list, std::vector<VFOSpec>& vfos) {
+    for (auto& item : splitList(list)) {
+        auto colon = item.find(':');
+        VFOSpec vfo;
+        vfo.decoder = item.substr(0, colon);
+        if (std::find(std::begin(UNSUPPORTED_DECODER_NAMES), std::end(UNSUPPORTED_DECODER_NAMES), vfo.decoder) != std::end(UNSUPPORTED_DECODER_NAMES)) {
+            flog::error("The {} decoder is not built into sdrpp_decode, only ft8, ft4, pocsag and rds are", vfo.decoder);
+            return false;
+        }
+        if (std::find(std::begin(DECODER_NAMES), std::end(DECODER_NAMES), vfo.decoder) == std::end(DECODER_NAMES)) {
+            flog::error("Unknown decoder '{}'", vfo.decoder);
+            return false;
+        }
+        if (colon == std::string::npos) {
+            if (vfo.decoder != "ft8") {
+                flog::error("VFO '{}' is not decoder:frequency", item);
+                return false;
+            }
+            vfo.frequency = 0;
+            vfos.push_back(vfo);
+            continue;
+        }
+        try {
+            vfo.frequency = std::stod(item.substr(colon + 1));
+        }
+        catch (const std::exception&) {
+            flog::error("Invalid frequency in '{}'", item);
+            return false;
+        }
+        vfos.push_back(vfo);
+    }
+    if (vfos.empty()) {
+        flog::error("No VFOs given, use --vfo");
+        return false;
+    }
+    return true;
+}
+
+static bool isCovered(const Recording& rec, const VFOSpec& vfo, BatchDecoder& decoder) {
+    double offset = vfo.frequency + decoder.getCenterOffset() - rec.centerFrequency;
+    return fabs(offset) + decoder.getBandwidth() / 2 <= rec.sampleRate / 2 && decoder.getSampleRate() <= rec.sampleRate;
+}
+
+// A ft8 VFO without a frequency turns into one per standard FT8 frequency in the recording
+static std::vector<VFOSpec> expandVFOs(const Recording& rec, const std::vector<VFOSpec>& vfos, ResultWriter& writer, JobQueue& queue) {
+    std::vector<VFOSpec> out;
+    for (auto& vfo : vfos) {
+        if (vfo.frequency) {
+            out.push_back(vfo);
+            continue;
+        }
+        int found = 0;
+        for (double freq : FT8_FREQUENCIES) {
+            VFOSpec dial = { vfo.decoder, freq };
+            if (isCovered(rec, dial, *makeDecoder(rec, dial, writer, queue))) {
+                out.push_back(dial);
+                found++;
+            }
+        }
+        if (!found) { flog::warn("No standard FT8 frequency is covered by '{}'", rec.path); }
+    }
+    return out;
+}
+
+static bool runJob(const Recording& rec, const VFOSpec& vfo, ResultWriter& writer, JobQueue& queue) {
+    auto decoder = makeDecoder(rec, vfo, writer, queue);
+    double outRate = decoder->getSampleRate();
+    double offset = vfo.frequency + decoder->getCenterOffset() - rec.centerFrequency;
+    if (!isCovered(rec, vfo, *decoder)) {
+        flog::warn("{} VFO at {} Hz is not covered by '{}'", vfo.decoder, vfo.frequency, rec.path);
+        return false;
+    }
+
+    wav::Reader reader(rec.path);
+    if (!reader.isValid() || !reader.map()) {
+        flog::error("Could not map '{}'", rec.path);
+        return false;
+    }
+
+    dsp::channel::RxVFO channel;
+    channel.init(NULL, rec.sampleRate, outRate, decoder->getBandwidth(), offset);
+    std::vector<dsp::complex_t> buf(CHUNK_SIZE);
+    uint64_t channelSamples = 0;
+    for (uint64_t pos = 0; pos < rec.sampleCount;) {
+        int count = reader.readComplex(buf.data(), pos, CHUNK_SIZE);
+        if (count <= 0) { break; }
+        pos += count;
+        int outCount = channel.process(count, buf.data(), buf.data());
+        decoder->process(buf.data(), outCount, (double)channelSamples / outRate);
+        channelSamples += outCount;
+        queue.helpIfBehind();
+    }
+    decoder->finish();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    CommandArgsParser args;
+    args.define('h', "help", "Show help");
+    args.define('i', "input", "Baseband files or directories of them, comma separated", std::string(""));
+    args.define('v', "vfo", "VFOs as decoder:frequency in Hz, comma separated. Decoders: ft8, ft4, pocsag, rds (TETRA and DMR are not built in). A bare ft8 decodes every standard FT8 frequency in the recording", std::string(""));
+    args.define('c', "center", "Center frequency of the files in Hz, taken from the file names if 0", 0.0);
+    args.define('j', "threads", "Worker threads, 0 for one per core", 0);
+    if (args.parse(argc, argv) < 0) { return 2; }
+    if (args["help"].b()) {
+        args.showHelp();
+        printf("\nTETRA and DMR decoding is not built into sdrpp_decode, use their modules in SDR++ for those.\n");
+        return 0;
+    }
+    flog::setConsoleToStderr(true);
+
+    std::vector<VFOSpec> vfos;
+    if (!parseVFOs(args["vfo"].s(), vfos)) { return 2; }
+    auto paths = listInputs(args["input"].s());
+    if (paths.empty()) {
+        flog::error("No input files given, use --input");
+        return 2;
+    }
+
+    // Failed files are reported and left out, the others still run
+    std::vector<Recording> recordings;
+    for (auto& path : paths) {
+        Recording rec;
+        if (openRecording(path, args["center"].d(), rec)) { recordings.push_back(rec); }
+    }
+
+    int threads = args["threads"].i();
+    if (threads <= 0) { threads = std::max<int>(1, std::thread::hardware_concurrency()); }
+
+    // Not thread safe the first time
+    mshv_init();
+
+    ResultWriter writer;
+    JobQueue queue(threads);
+    std::atomic<int> failedJobs = 0;
+    double seconds = 0;
+    // The decodes keep references to the VFOs until the end
+    std::deque<std::vector<VFOSpec>> recordingVFOs;
+    int jobCount = 0;
+    for (auto& rec : recordings) {
+        seconds += rec.sampleCount / rec.sampleRate;
+        recordingVFOs.push_back(expandVFOs(rec, vfos, writer, queue));
+        if (recordingVFOs.back().empty()) { failedJobs++; }
+        jobCount += recordingVFOs.back().size();
+        for (auto& vfo : recordingVFOs.back()) {
+            queue.addJob([&rec, &vfo, &writer, &queue, &failedJobs]() {
+                if (!runJob(rec, vfo, writer, queue)) { failedJobs++; }
+            });
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    queue.run();
+    double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    flog::info("Decoded {} files ({} s), {} VFOs in all, in {} s on {} threads, {} results",
+               (int)recordings.size(), seconds, jobCount, elapsed, threads, writer.getCount());
+    flog::flush();
+
+    return (recordings.size() < paths.size() || failedJobs) ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include "../core/src/utils/arrays.h"
+#include "../core/src/utils/flog.h"
+#include "../misc_modules/noise_reduction_logmmse/src/logmmse.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Checks that the noise reduction frame loop and the plan level FFT stop allocating once warmed up,
+// using the array allocation counter, and that the in-place helpers match their allocating versions.
+
+static const int NR_SAMPLE_RATE = 48000;
+static const int NR_FRAME_SAMPLES = 4800;
+static const int NR_WARMUP_FRAMES = 20;
+static const int NR_BENCH_FRAMES = 500;
+
+using namespace dsp::arrays;
+
+static ComplexArray noiseBlock(int count) {
+    auto block = npzeros_c(count);
+    for (auto& s : *block) {
+        s.re = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
+        s.im = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
+    }
+    return block;
+}
+
+static bool sameArrays(const FloatArray& a, const FloatArray& b) {
+    if (a->size() != b->size()) { return false; }
+    for (int i = 0; i < a->size(); i++) {
+        if (fabsf((*a)[i] - (*b)[i]) > 1e-5f * std::max<float>(1.0f, fabsf((*a)[i]))) { return false; }
+    }
+    return true;
+}
+
+static void checkInPlaceHelpers() {
+    auto v = npzeros(1000);
+    auto w = npzeros(1000);
+    for (int i = 0; i < 1000; i++) {
+        (*v)[i] = (float)rand() / (float)RAND_MAX;
+        (*w)[i] = 0.5f + (float)rand() / (float)RAND_MAX;
+    }
+
+    struct Case {
+        const char* name;
+        FloatArray expected;
+        std::function<void(const FloatArray&)> inPlace;
+    };
+    Case cases[] = {
+        { "mul_", mul(v, 3.0f), [](const FloatArray& x) { mul_(x, 3.0f); } },
+        { "add_", add(v, 3.0f), [](const FloatArray& x) { add_(x, 3.0f); } },
+        { "addeach_", addeach(v, w), [&](const FloatArray& x) { addeach_(x, w); } },
+        { "muleach_", muleach(v, w), [&](const FloatArray& x) { muleach_(x, w); } },
+        { "diveach_", diveach(v, w), [&](const FloatArray& x) { diveach_(x, w); } },
+        { "npexp_", npexp(v), [](const FloatArray& x) { npexp_(x); } },
+    };
+    for (auto& c : cases) {
+        auto x = clone(v);
+        c.inPlace(x);
+        if (!sameArrays(x, c.expected)) {
+            flog::error("{} differs from its allocating version", c.name);
+            sdrpp::test::failed = true;
+        }
+    }
+
+    auto m = npminimum(v, w);
+    if (m->size() != v->size() || (*m)[0] != std::min<float>((*v)[0], (*w)[0])) {
+        flog::error("npminimum of two arrays returned {} items", (int)m->size());
+        sdrpp::test::failed = true;
+    }
+}
+
+static void setup_arrays_alloc() {
+    checkInPlaceHelpers();
+
+    // Plan level FFT on its own input
+    auto plan = allocateFFTWPlan(false, 8192);
+    uint64_t before = getArrayAllocationCount();
+    for (int i = 0; i < 100; i++) { plan->execute(); }
+    for (int i = 0; i < 100; i++) { plan->npfftfft(plan->getInput()); }
+    if (getArrayAllocationCount() != before) {
+        flog::error("FFT execution allocated {} arrays", getArrayAllocationCount() - before);
+        sdrpp::test::failed = true;
+    }
+
+    // Noise reduction, one logmmse_all call per frame like the IF noise reduction block
+    dsp::logmmse::LogMMSE::SavedParamsC params;
+    auto input = noiseBlock(NR_FRAME_SAMPLES * 14);
+    dsp::logmmse::LogMMSE::logmmse_sample(input, NR_SAMPLE_RATE, 0.15f, &params, 12);
+
+    std::vector<ComplexArray> frames;
+    for (int i = 0; i < 8; i++) { frames.push_back(noiseBlock(NR_FRAME_SAMPLES)); }
+    for (int i = 0; i < NR_WARMUP_FRAMES; i++) {
+        dsp::logmmse::LogMMSE::logmmse_all(frames[i % frames.size()], NR_SAMPLE_RATE, 0.15f, &params);
+    }
+
+    // The noise history keeps growing for a while, only count after it has filled up
+    for (int i = 0; params.noise_history.size() < params.noise_history_len(); i++) {
+        dsp::logmmse::LogMMSE::logmmse_all(frames[i % frames.size()], NR_SAMPLE_RATE, 0.15f, &params);
+    }
+
+    before = getArrayAllocationCount();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < NR_BENCH_FRAMES; i++) {
+        dsp::logmmse::LogMMSE::logmmse_all(frames[i % frames.size()], NR_SAMPLE_RATE, 0.15f, &params);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    uint64_t allocs = getArrayAllocationCount() - before;
+
+    flog::info("logmmse: {} us/frame, {} array allocations over {} frames", elapsed * 1e6 / NR_BENCH_FRAMES, allocs, NR_BENCH_FRAMES);
+    if (allocs != 0) {
+        flog::error("logmmse allocated arrays in steady state");
+        sdrpp::test::failed = true;
+    }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(arrays_alloc, ::setup_arrays_alloc);
@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../core/src/utils/wav.h"
+#include "../core/src/utils/async_file_writer.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Recorder backend: WAV, RF64 and Wave64 files written through the write-behind pool must read back
+// sample exact, the DSP side write() must not wait on the disk, and a full pool must drop whole writes.
+// In blocking mode a single write larger than the whole pool must land on disk complete.
+
+static const int REC_BLOCK_SAMPLES = 16384;
+static const int REC_BLOCKS = 400;     // 50 MB of float32 IQ
+
+static bool recordAndCheck(wav::Format format, const char* path) {
+    std::vector<dsp::complex_t> block(REC_BLOCK_SAMPLES);
+    wav::Writer writer(2, 1000000, format, wav::SAMP_TYPE_FLOAT32);
+    writer.setBuffering(4 * 1024 * 1024, 32);
+    if (!writer.open(path)) {
+        flog::error("Could not open {}", path);
+        return false;
+    }
+
+    double maxWriteMs = 0;
+    for (int b = 0; b < REC_BLOCKS; b++) {
+        for (int i = 0; i < REC_BLOCK_SAMPLES; i++) {
+            block[i] = { (float)b, (float)i };
+        }
+        auto start = std::chrono::steady_clock::now();
+        writer.write((float*)block.data(), REC_BLOCK_SAMPLES);
+        maxWriteMs = std::max<double>(maxWriteMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    uint64_t dropped = writer.getDroppedSamples();
+    writer.close();
+    flog::info("async_recorder: format {}: longest write() {} ms, {} samples dropped", (int)format, maxWriteMs, dropped);
+
+    // Read back, every sample that was not dropped must be there in order
+    wav::Reader reader(path);
+    if (!reader.isValid() || reader.getFormat() != format) {
+        flog::error("Could not read back format {}: {}", (int)format, reader.error);
+        return false;
+    }
+    if (reader.getSampleRate() != 1000000 || reader.getChannelCount() != 2 || reader.getBitDepth() != 32) {
+        flog::error("Format {} read back with the wrong parameters", (int)format);
+        return false;
+    }
+    uint64_t expected = (uint64_t)REC_BLOCKS * REC_BLOCK_SAMPLES - dropped;
+    if (reader.getDataSize() != expected * sizeof(dsp::complex_t)) {
+        flog::error("Format {} has {} data bytes, expected {}", (int)format, reader.getDataSize(), expected * sizeof(dsp::complex_t));
+        return false;
+    }
+    int lastBlock = -1;
+    while (reader.readSamples2(block.data(), REC_BLOCK_SAMPLES * sizeof(dsp::complex_t)) == REC_BLOCK_SAMPLES * sizeof(dsp::complex_t)) {
+        int b = block[0].re;
+        if (b <= lastBlock || block[REC_BLOCK_SAMPLES - 1].re != b || block[REC_BLOCK_SAMPLES - 1].im != REC_BLOCK_SAMPLES - 1) {
+            flog::error("Format {} has corrupt samples after block {}", (int)format, lastBlock);
+            return false;
+        }
+        lastBlock = b;
+    }
+    reader.close();
+    remove(path);
+    return true;
+}
+
+// One write() of a buffer many times the pool, like saving a recorded QSO in one go
+static bool bigBlockingWrite(const char* path) {
+    const int samples = 200000;
+    std::vector<dsp::complex_t> buf(samples);
+    for (int i = 0; i < samples; i++) { buf[i] = { (float)i, -(float)i }; }
+    wav::Writer writer(2, 48000, wav::FORMAT_WAV, wav::SAMP_TYPE_FLOAT32);
+    writer.setBuffering(AsyncFileWriter::ALIGNMENT, 2);
+    writer.setBlocking(true);
+    if (!writer.open(path)) {
+        flog::error("Could not open {}", path);
+        return false;
+    }
+    writer.write((float*)buf.data(), samples);
+    writer.close();
+
+    wav::Reader reader(path);
+    bool ok = reader.isValid() && reader.getDataSize() == samples * sizeof(dsp::complex_t);
+    std::vector<dsp::complex_t> back(samples);
+    ok = ok && reader.readSamples2(back.data(), samples * sizeof(dsp::complex_t)) == samples * sizeof(dsp::complex_t);
+    for (int i = 0; ok && i < samples; i++) { ok = back[i].re == (float)i && back[i].im == -(float)i; }
+    if (!ok) { flog::error("Write larger than the pool did not read back complete"); }
+    reader.close();
+    remove(path);
+    return ok;
+}
+
+static void setup_async_recorder() {
+    if (!recordAndCheck(wav::FORMAT_WAV, "async_recorder_test.wav")) { sdrpp::test::failed = true; }
+    if (!recordAndCheck(wav::FORMAT_RF64, "async_recorder_test_rf64.wav")) { sdrpp::test::failed = true; }
+    if (!recordAndCheck(wav::FORMAT_W64, "async_recorder_test.w64")) { sdrpp::test::failed = true; }
+
+    if (!bigBlockingWrite("async_recorder_test_big.wav")) { sdrpp::test::failed = true; }
+
+    // A write bigger than the free pool is dropped whole and counted, one that fills it exactly is taken
+    AsyncFileWriter file;
+    file.setBuffering(AsyncFileWriter::ALIGNMENT, 2);
+    if (file.open("async_recorder_test.bin")) {
+        std::vector<uint8_t> big(AsyncFileWriter::ALIGNMENT * 3);
+        if (file.write(big.data(), big.size()) || file.getOverruns() != 1 || file.getSize() != 0) {
+            flog::error("Oversized write was not dropped as an overrun");
+            sdrpp::test::failed = true;
+        }
+        if (!file.write(big.data(), AsyncFileWriter::ALIGNMENT * 2) || file.getSize() != AsyncFileWriter::ALIGNMENT * 2) {
+            flog::error("Write filling the pool exactly was refused");
+            sdrpp::test::failed = true;
+        }
+        file.close();
+        remove("async_recorder_test.bin");
+    }
+    else {
+        sdrpp::test::failed = true;
+    }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(async_recorder, ::setup_async_recorder);
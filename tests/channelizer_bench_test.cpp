@@ -0,0 +1,198 @@
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include <memory>
+#include "../core/src/dsp/channel/rx_vfo.h"
+#include "../core/src/dsp/channel/pfb_channelizer.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Checks that a tone comes out of a channelized VFO at the same frequency and level, and at the same rate, as
+// out of a VFO fed at the full rate, and that a VFO sticks to its channel past the boundary with the next one.
+// Then compares the per-VFO cost of the full rate RxVFO path against VFOs fed by the shared channelizer.
+// Blocks are driven synchronously through their process() functions so that only DSP time is measured.
+
+static const double BENCH_SAMPLERATE = 10e6;
+static const double BENCH_VFO_SAMPLERATE = 25000.0;
+static const double BENCH_VFO_BANDWIDTH = 12500.0;
+static const int BENCH_BLOCK_SIZE = 100000;
+static const int BENCH_BLOCK_COUNT = 50; // 0.5s of signal
+
+static const double TONE_SAMPLERATE = 2.4e6;
+static const double TONE_VFO_OFFSET = 338000.0; // Odd channel, off its center
+static const double TONE_OFFSET = 3000.0; // From the VFO center
+static const float TONE_AMPLITUDE = 0.5f;
+static const int TONE_BLOCK_SIZE = 24000;
+static const int TONE_BLOCK_COUNT = 20;
+static const int TONE_SETTLE = 500; // Output samples skipped while the filters fill up
+
+struct ToneStats {
+    double frequency = 0.0;
+    double level = 0.0;
+    int samples = 0;
+};
+
+// Average frequency and RMS level of the VFO output after the filters settled
+static ToneStats measureTone(const std::vector<dsp::complex_t>& out) {
+    ToneStats stats;
+    stats.samples = out.size();
+    dsp::complex_t acc = { 0.0f, 0.0f };
+    double power = 0.0;
+    for (int i = TONE_SETTLE + 1; i < (int)out.size(); i++) {
+        acc += out[i - 1].conj() * out[i];
+        power += (out[i].re * out[i].re) + (out[i].im * out[i].im);
+    }
+    int n = (int)out.size() - TONE_SETTLE - 1;
+    stats.frequency = acc.phase() * BENCH_VFO_SAMPLERATE / (2.0 * FL_M_PI);
+    stats.level = sqrt(power / (double)n);
+    return stats;
+}
+
+static bool checkTone() {
+    // Tone with a little noise so that the channel filter has something to reject
+    std::vector<std::vector<dsp::complex_t>> input(TONE_BLOCK_COUNT, std::vector<dsp::complex_t>(TONE_BLOCK_SIZE));
+    double phase = 0.0;
+    double phaseInc = 2.0 * FL_M_PI * (TONE_VFO_OFFSET + TONE_OFFSET) / TONE_SAMPLERATE;
+    for (auto& block : input) {
+        for (auto& s : block) {
+            s.re = TONE_AMPLITUDE * cos(phase) + 0.01f * ((2.0f * (float)rand() / (float)RAND_MAX) - 1.0f);
+            s.im = TONE_AMPLITUDE * sin(phase) + 0.01f * ((2.0f * (float)rand() / (float)RAND_MAX) - 1.0f);
+            phase = fmod(phase + phaseInc, 2.0 * FL_M_PI);
+        }
+    }
+
+    dsp::stream<dsp::complex_t> dummy;
+    std::vector<dsp::complex_t> directOut;
+    dsp::channel::RxVFO direct(&dummy, TONE_SAMPLERATE, BENCH_VFO_SAMPLERATE, BENCH_VFO_BANDWIDTH, TONE_VFO_OFFSET);
+    for (auto& block : input) {
+        int count = direct.process(TONE_BLOCK_SIZE, block.data(), direct.out.writeBuf);
+        directOut.insert(directOut.end(), direct.out.writeBuf, direct.out.writeBuf + count);
+    }
+
+    std::vector<dsp::complex_t> chanOut;
+    dsp::channel::PFBChannelizer channelizer(&dummy, TONE_SAMPLERATE);
+    double residual;
+    int channel = channelizer.findChannel(TONE_VFO_OFFSET, BENCH_VFO_BANDWIDTH, BENCH_VFO_SAMPLERATE, residual);
+    if (channel < 0) {
+        flog::error("VFO at {} does not fit the channel grid", TONE_VFO_OFFSET);
+        return false;
+    }
+    dsp::stream<dsp::complex_t> chanStream;
+    channelizer.bindChannel(channel, &chanStream);
+    dsp::channel::RxVFO chanVFO(&dummy, channelizer.getChannelSamplerate(), BENCH_VFO_SAMPLERATE, BENCH_VFO_BANDWIDTH, residual);
+    for (auto& block : input) {
+        int count = channelizer.process(TONE_BLOCK_SIZE, block.data());
+        int outCount = chanVFO.process(count, chanStream.writeBuf, chanVFO.out.writeBuf);
+        chanOut.insert(chanOut.end(), chanVFO.out.writeBuf, chanVFO.out.writeBuf + outCount);
+    }
+
+    bool ok = true;
+    ToneStats d = measureTone(directOut);
+    ToneStats c = measureTone(chanOut);
+    flog::info("Tone: direct {} Hz at {}, {} samples, channelized {} Hz at {}, {} samples",
+               d.frequency, d.level, d.samples, c.frequency, c.level, c.samples);
+    if (fabs(d.frequency - TONE_OFFSET) > 1.0 || fabs(c.frequency - TONE_OFFSET) > 1.0) {
+        flog::error("Tone frequency is off, expected {} Hz", TONE_OFFSET);
+        ok = false;
+    }
+    if (fabs(c.level - d.level) > 0.03 * d.level || fabs(d.level - TONE_AMPLITUDE) > 0.03 * TONE_AMPLITUDE) {
+        flog::error("Tone level differs between the direct and channelized paths");
+        ok = false;
+    }
+    double expectedSamples = (double)TONE_BLOCK_SIZE * TONE_BLOCK_COUNT * BENCH_VFO_SAMPLERATE / TONE_SAMPLERATE;
+    if (fabs(c.samples - d.samples) > 16 || fabs(d.samples - expectedSamples) > 16) {
+        flog::error("Output sample count differs between the direct and channelized paths");
+        ok = false;
+    }
+
+    // Just past the boundary with the next channel, the VFO still fits the one it is on
+    double spacing = channelizer.getChannelSpacing();
+    double pastBoundary = ((double)channel + 0.5) * spacing + 1000.0;
+    if (!channelizer.fitsChannel(channel, pastBoundary, BENCH_VFO_BANDWIDTH, BENCH_VFO_SAMPLERATE, residual) || fabs(residual - (0.5 * spacing + 1000.0)) > 1e-6) {
+        flog::error("VFO just past the channel boundary doesn't fit its channel anymore");
+        ok = false;
+    }
+    if (channelizer.findChannel(pastBoundary, BENCH_VFO_BANDWIDTH, BENCH_VFO_SAMPLERATE, residual) != channel + 1) {
+        flog::error("VFO just past the channel boundary isn't closest to the next channel");
+        ok = false;
+    }
+    return ok;
+}
+
+static double benchDirect(const std::vector<dsp::complex_t>& input, int vfoCount) {
+    dsp::stream<dsp::complex_t> dummy;
+    std::vector<std::unique_ptr<dsp::channel::RxVFO>> vfos;
+    for (int i = 0; i < vfoCount; i++) {
+        double offset = -4e6 + (8e6 * (double)i / (double)std::max<int>(vfoCount, 1)) + 3000.0;
+        vfos.emplace_back(std::make_unique<dsp::channel::RxVFO>(&dummy, BENCH_SAMPLERATE, BENCH_VFO_SAMPLERATE, BENCH_VFO_BANDWIDTH, offset));
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int b = 0; b < BENCH_BLOCK_COUNT; b++) {
+        for (auto& vfo : vfos) {
+            vfo->process(BENCH_BLOCK_SIZE, input.data(), vfo->out.writeBuf);
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static double benchChannelized(const std::vector<dsp::complex_t>& input, int vfoCount) {
+    dsp::stream<dsp::complex_t> dummy;
+    dsp::channel::PFBChannelizer channelizer(&dummy, BENCH_SAMPLERATE);
+    std::vector<std::unique_ptr<dsp::stream<dsp::complex_t>>> chanStreams;
+    std::vector<std::unique_ptr<dsp::channel::RxVFO>> vfos;
+    for (int i = 0; i < vfoCount; i++) {
+        double offset = -4e6 + (8e6 * (double)i / (double)std::max<int>(vfoCount, 1)) + 3000.0;
+        double residual;
+        int channel = channelizer.findChannel(offset, BENCH_VFO_BANDWIDTH, BENCH_VFO_SAMPLERATE, residual);
+        if (channel < 0) {
+            flog::error("VFO at {} does not fit the channel grid", offset);
+            sdrpp::test::failed = true;
+            return 0;
+        }
+        chanStreams.emplace_back(std::make_unique<dsp::stream<dsp::complex_t>>());
+        channelizer.bindChannel(channel, chanStreams.back().get());
+        vfos.emplace_back(std::make_unique<dsp::channel::RxVFO>(&dummy, channelizer.getChannelSamplerate(), BENCH_VFO_SAMPLERATE, BENCH_VFO_BANDWIDTH, residual));
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int b = 0; b < BENCH_BLOCK_COUNT; b++) {
+        int count = channelizer.process(BENCH_BLOCK_SIZE, input.data());
+        for (int i = 0; i < vfoCount; i++) {
+            vfos[i]->process(count, chanStreams[i]->writeBuf, vfos[i]->out.writeBuf);
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static void setup_bench_channelizer() {
+    if (!checkTone()) { sdrpp::test::failed = true; }
+
+    std::vector<dsp::complex_t> input(BENCH_BLOCK_SIZE);
+    for (auto& s : input) {
+        s.re = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
+        s.im = (2.0f * (float)rand() / (float)RAND_MAX) - 1.0f;
+    }
+
+    double signalTime = (double)BENCH_BLOCK_SIZE * BENCH_BLOCK_COUNT / BENCH_SAMPLERATE;
+    double chanBase = benchChannelized(input, 0);
+    flog::info("Channelizer alone: {} % of one core at {} MS/s", 100.0 * chanBase / signalTime, BENCH_SAMPLERATE / 1e6);
+
+    for (int vfoCount : { 1, 8, 32 }) {
+        double direct = benchDirect(input, vfoCount);
+        double chan = benchChannelized(input, vfoCount);
+        flog::info("{} VFOs: direct {} % core ({} % per VFO), channelized {} % core ({} % marginal per VFO)",
+                   vfoCount,
+                   100.0 * direct / signalTime, 100.0 * direct / signalTime / vfoCount,
+                   100.0 * chan / signalTime, 100.0 * (chan - chanBase) / signalTime / vfoCount);
+    }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(bench_channelizer, ::setup_bench_channelizer);
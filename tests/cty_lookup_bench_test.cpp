@@ -0,0 +1,107 @@
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include "../core/src/utils/cty.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Replays a day of FT8 decodes through the CTY lookup: the index and its cache must give the same entity
+// as the scan over every prefix, and the replay rate is compared with the scan.
+
+static const int DISTINCT_CALLS = 20000;
+static const int DAY_LOOKUPS = 8 * 5760 * 10;     // 8 bands, every 15 s slot, 10 decodes each
+static const int SCAN_CHECKS = 3000;
+
+static bool sameCallsign(const utils::CTY::Callsign& a, const utils::CTY::Callsign& b) {
+    return a.exact == b.exact && a.value == b.value && a.dxccname == b.dxccname && a.continent == b.continent
+           && a.ll.lat == b.ll.lat && a.ll.lon == b.ll.lon;
+}
+
+// Callsigns built on the prefixes of the loaded files, plus a few exact ones and some junk
+static std::vector<std::string> makeCallsigns(const utils::CTY& cty, std::mt19937& rng) {
+    std::vector<std::string> prefixes;
+    std::vector<std::string> exact;
+    for (auto& d : cty.dxcc) {
+        for (auto& p : d.prefixes) {
+            (p.exact ? exact : prefixes).push_back(p.value);
+        }
+    }
+
+    std::vector<std::string> calls;
+    while (calls.size() < DISTINCT_CALLS) {
+        int kind = rng() % 20;
+        if (kind == 0 && !exact.empty()) {
+            calls.push_back(exact[rng() % exact.size()]);
+            continue;
+        }
+        if (kind == 1) {
+            calls.push_back("Q" + std::to_string(rng() % 1000));
+            continue;
+        }
+        std::string call = prefixes[rng() % prefixes.size()];
+        if (!isdigit(call.back())) { call += (char)('0' + rng() % 10); }
+        int suffix = 1 + rng() % 3;
+        for (int i = 0; i < suffix; i++) { call += (char)('A' + rng() % 26); }
+        calls.push_back(call);
+    }
+    return calls;
+}
+
+static void setup_cty_lookup_bench() {
+    if (utils::globalCty.dxcc.empty()) { utils::loadAllCty(); }
+    const utils::CTY& cty = utils::globalCty;
+    if (cty.dxcc.empty()) {
+        flog::error("No CTY data loaded");
+        sdrpp::test::failed = true;
+        sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+        return;
+    }
+
+    std::mt19937 rng(1234);
+    auto calls = makeCallsigns(cty, rng);
+
+    // Busy stations show up again and again through the day
+    std::vector<int> day(DAY_LOOKUPS);
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+    for (auto& idx : day) { idx = (int)(DISTINCT_CALLS * pow(uni(rng), 3.0)); }
+
+    // Same answers as the scan
+    int mismatches = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<utils::CTY::Callsign> scanned(SCAN_CHECKS);
+    for (int i = 0; i < SCAN_CHECKS; i++) { scanned[i] = cty.findCallsignScan(calls[i]); }
+    double scanSec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < SCAN_CHECKS; i++) {
+            if (!sameCallsign(cty.findCallsign(calls[i]), scanned[i])) {
+                if (mismatches++ < 10) { flog::error("{}: index gives '{}' instead of '{}'", calls[i], cty.findCallsign(calls[i]).dxccname, scanned[i].dxccname); }
+            }
+        }
+    }
+    if (mismatches) {
+        flog::error("{} lookups differ from the scan", mismatches);
+        sdrpp::test::failed = true;
+    }
+
+    start = std::chrono::high_resolution_clock::now();
+    int found = 0;
+    for (int idx : day) {
+        if (!cty.findCallsign(calls[idx]).dxccname.empty()) { found++; }
+    }
+    double daySec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    double scanRate = SCAN_CHECKS / scanSec;
+    double dayRate = DAY_LOOKUPS / daySec;
+    flog::info("cty_lookup: {} DXCC entities, scan {} lookups/s, indexed day replay {} lookups/s ({}x), {} of {} found",
+               (int)cty.dxcc.size(), scanRate, dayRate, dayRate / scanRate, found, DAY_LOOKUPS);
+    flog::info("cty_lookup: a day of decodes takes {} ms instead of {} ms", daySec * 1000.0, DAY_LOOKUPS / scanRate * 1000.0);
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(cty_lookup_bench, ::setup_cty_lookup_bench);
@@ -0,0 +1,107 @@
+#include <vector>
+#include <memory>
+#include "../core/src/dsp/chain.h"
+#include "../core/src/dsp/profiler.h"
+#include "../core/src/utils/flog.h"
+#include "../core/src/json.hpp"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Pipeline profiler on a three block chain: every block sees every sample while enabled, nothing is
+// counted while disabled, and the snapshot links each block output to the next block input.
+
+static const int PROFILER_CHAIN_LENGTH = 3;
+static const int PROFILER_BLOCK_SIZE = 1024;
+static const int PROFILER_BUFFERS = 200;
+
+namespace {
+    class AddOne : public dsp::Processor<float, float> {
+        using base_type = dsp::Processor<float, float>;
+    public:
+        inline int process(int count, const float* in, float* out) {
+            for (int i = 0; i < count; i++) { out[i] = in[i] + 1.0f; }
+            return count;
+        }
+
+        DEFAULT_PROC_RUN
+    };
+}
+
+static bool pump(dsp::stream<float>& in, dsp::stream<float>* out, int buffers) {
+    for (int b = 0; b < buffers; b++) {
+        for (int i = 0; i < PROFILER_BLOCK_SIZE; i++) { in.writeBuf[i] = (float)i; }
+        if (!in.swap(PROFILER_BLOCK_SIZE)) { return false; }
+        int count = out->read();
+        if (count != PROFILER_BLOCK_SIZE || out->readBuf[0] != (float)PROFILER_CHAIN_LENGTH) { return false; }
+        out->flush();
+    }
+    return true;
+}
+
+static void setup_dsp_profiler() {
+    bool ok = true;
+    dsp::stream<float> in;
+    dsp::chain<float> chain(&in);
+    std::vector<std::unique_ptr<AddOne>> blocks;
+    for (int i = 0; i < PROFILER_CHAIN_LENGTH; i++) {
+        blocks.emplace_back(std::make_unique<AddOne>());
+        blocks.back()->init(NULL);
+        chain.addBlock(blocks.back().get(), true);
+    }
+    chain.start();
+
+    dsp::profiler::setEnabled(true);
+    if (!pump(in, chain.out, PROFILER_BUFFERS)) {
+        flog::error("Chain output wrong while profiling");
+        ok = false;
+    }
+    auto snap = dsp::profiler::getSnapshot();
+    const uint64_t expected = (uint64_t)PROFILER_BUFFERS * PROFILER_BLOCK_SIZE;
+    for (int i = 0; i < PROFILER_CHAIN_LENGTH; i++) {
+        auto it = std::find_if(snap.blocks.begin(), snap.blocks.end(), [&](const dsp::profiler::BlockStats& b) { return b.id == blocks[i].get(); });
+        if (it == snap.blocks.end()) {
+            flog::error("Block {} missing from the snapshot", i);
+            ok = false;
+            continue;
+        }
+        if (it->samplesIn != expected || it->samplesOut != expected) {
+            flog::error("Block {} saw {} samples in, {} out, expected {}", i, (int64_t)it->samplesIn, (int64_t)it->samplesOut, (int64_t)expected);
+            ok = false;
+        }
+        if (it->inputs.size() != 1 || it->outputs.size() != 1 || it->outputs[0] != &blocks[i]->out) {
+            flog::error("Block {} streams not linked", i);
+            ok = false;
+        }
+        else if (i > 0 && it->inputs[0] != &blocks[i - 1]->out) {
+            flog::error("Block {} input is not the output of block {}", i, i - 1);
+            ok = false;
+        }
+        flog::info("{}: {} runs, {} s in run(), {} s waiting to read, {} s waiting to write", it->type, (int64_t)it->runs, it->runTime, it->readWait, it->writeWait);
+    }
+
+    // Nothing is counted while disabled
+    dsp::profiler::setEnabled(false);
+    pump(in, chain.out, PROFILER_BUFFERS);
+    auto idle = dsp::profiler::getSnapshot();
+    for (auto& s : idle.streams) {
+        if (s.id == &blocks[0]->out && s.samplesWritten != expected) {
+            flog::error("Stream counted {} samples while disabled", (int64_t)(s.samplesWritten - expected));
+            ok = false;
+        }
+    }
+
+    auto json = nlohmann::json::parse(dsp::profiler::toJson(idle), nullptr, false);
+    if (json.is_discarded() || json["blocks"].size() < PROFILER_CHAIN_LENGTH || json["enabled"] != false) {
+        flog::error("Bad JSON snapshot");
+        ok = false;
+    }
+
+    chain.stop();
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(dsp_profiler, ::setup_dsp_profiler);
@@ -0,0 +1,147 @@
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "../core/src/dsp/chain.h"
+#include "../core/src/dsp/executor.h"
+#include "../core/src/dsp/sink.h"
+#include "../core/src/dsp/bench/speed_tester.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Runs a 20 block chain once with a thread per block and once fused onto the worker pool, checks both
+// produce the same samples and reports throughput, context switches and per-block CPU time. Also checks that
+// a block run by the pool can stop another block of its group.
+
+static const int BENCH_CHAIN_LENGTH = 20;
+static const int BENCH_BLOCK_SIZE = 1024;
+static const int BENCH_DURATION_MS = 2000;
+
+namespace {
+    class AddOne : public dsp::Processor<float, float> {
+        using base_type = dsp::Processor<float, float>;
+    public:
+        inline int process(int count, const float* in, float* out) {
+            for (int i = 0; i < count; i++) { out[i] = in[i] + 1.0f; }
+            return count;
+        }
+
+        DEFAULT_PROC_RUN
+    };
+
+    // Stops another block from inside its own run(), once
+    class StopOther : public dsp::Sink<float> {
+        using base_type = dsp::Sink<float>;
+    public:
+        int run() {
+            int count = base_type::_in->read();
+            if (count < 0) { return -1; }
+            base_type::_in->flush();
+            if (!stopped) {
+                other->stop();
+                stopped = true;
+            }
+            return count;
+        }
+
+        dsp::block* other = NULL;
+        std::atomic<bool> stopped = false;
+    };
+}
+
+static long voluntaryContextSwitches() {
+#ifndef _WIN32
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw;
+#else
+    return 0;
+#endif
+}
+
+static void benchExecutor(bool pooled) {
+    dsp::stream<float> in;
+    dsp::chain<float> chain(&in);
+    dsp::ExecGroup group;
+    std::vector<std::unique_ptr<AddOne>> blocks;
+    for (int i = 0; i < BENCH_CHAIN_LENGTH; i++) {
+        blocks.emplace_back(std::make_unique<AddOne>());
+        blocks.back()->init(NULL);
+        chain.addBlock(blocks.back().get(), true);
+    }
+    if (pooled) { chain.setScheduler(&group); }
+    chain.start();
+
+    // Every block must have run exactly once on each buffer
+    for (int i = 0; i < BENCH_BLOCK_SIZE; i++) { in.writeBuf[i] = (float)i; }
+    in.swap(BENCH_BLOCK_SIZE);
+    int count = chain.out->read();
+    if (count != BENCH_BLOCK_SIZE || chain.out->readBuf[10] != 10.0f + BENCH_CHAIN_LENGTH) {
+        flog::error("Executor: chain output is wrong ({} samples, got {})", count, chain.out->readBuf[10]);
+        sdrpp::test::failed = true;
+    }
+    chain.out->flush();
+
+    dsp::bench::SpeedTester<float, float> tester(&in, chain.out);
+    long ctxSw = voluntaryContextSwitches();
+    double rate = tester.benchmark(BENCH_DURATION_MS, BENCH_BLOCK_SIZE);
+    ctxSw = voluntaryContextSwitches() - ctxSw;
+    chain.stop();
+
+    double cpu = 0;
+    for (auto& b : blocks) { cpu += b->getCPUTime(); }
+    double seconds = (double)BENCH_DURATION_MS / 1000.0;
+    flog::info("{} blocks, {}: {} MS/s, {} context switches/s, {} us CPU per block per run",
+               BENCH_CHAIN_LENGTH, pooled ? "worker pool" : "thread per block", rate / 1e6, (double)ctxSw / seconds,
+               1e6 * cpu / (double)(BENCH_CHAIN_LENGTH * blocks[0]->getRunCount()));
+}
+
+static void stopFromRun() {
+    // Declared so that the group goes last
+    struct Blocks {
+        dsp::ExecGroup group;
+        dsp::stream<float> in;
+        dsp::stream<float> otherIn;
+        StopOther stopper;
+        AddOne other;
+    };
+    auto b = std::make_unique<Blocks>();
+    b->stopper.init(&b->in);
+    b->other.init(&b->otherIn);
+    b->stopper.other = &b->other;
+    b->stopper.setScheduler(&b->group);
+    b->other.setScheduler(&b->group);
+    b->other.start();
+    b->stopper.start();
+
+    b->in.writeBuf[0] = 0.0f;
+    b->in.swap(1);
+    auto start = std::chrono::steady_clock::now();
+    while (!b->stopper.stopped && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!b->stopper.stopped || b->group.getBlockCount() != 1) {
+        flog::error("Executor: stopping a block from a pooled run() is stuck");
+        sdrpp::test::failed = true;
+        // The pool thread never comes back, leave everything it uses alive
+        b.release();
+        return;
+    }
+    b->stopper.stop();
+}
+
+static void setup_bench_executor() {
+    benchExecutor(false);
+    benchExecutor(true);
+    stopFromRun();
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(bench_executor, ::setup_bench_executor);
@@ -0,0 +1,240 @@
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "../core/src/dsp/compression/experimental_fft_compressor.h"
+#include "../core/src/dsp/sink/handler_sink.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// EFFT compressor on synthetic IQ at server sample rates: the preallocated pipeline must give the spectra of the
+// one it replaced, list of arrays and all, and both are timed against real time, with and without the worker.
+
+static const int EFFT_BENCH_SLICES = 60;
+
+using namespace dsp::arrays;
+
+// The per-slice pipeline before buffers were preallocated, trimmed to what ends up in the output
+struct LegacyEFFT {
+    int sampleRate, fftSize, largeTick;
+    float hzTick;
+    int signalWidth = 300;
+    double lossRate = 1.0;
+    float prevAllowance = 0;
+    const int minRecents = 10;
+    Arg<FFTPlan> fftPlan;
+    std::shared_ptr<std::vector<dsp::complex_t>> inArray;
+    std::vector<float> fftWindow;
+    std::vector<ComplexArray> cleanFreqDomain;
+    std::vector<FloatArray> cleanMagnitudes;
+    std::vector<FloatArray> windowedMagnitudes;
+
+    LegacyEFFT(int sampleRate) : sampleRate(sampleRate) {
+        fftSize = sampleRate * 50 / 1000;
+        fftSize = pow(2, floor(log2(fftSize)));
+        fftPlan = allocateFFTWPlan(false, fftSize);
+        inArray = std::make_shared<std::vector<dsp::complex_t>>(fftSize);
+        fftWindow.resize(fftSize);
+        for (int i = 0; i < fftSize; i++) { fftWindow[i] = dsp::compression::blackmanWindowElement(i+5, fftSize+10); }
+        hzTick = ((float) sampleRate) / fftSize;
+        largeTick = (int)(signalWidth / hzTick) * 10;
+    }
+
+    void filterSignal(FloatArray windowedMags, FloatArray clearMags, dsp::complex_t *unfiltered) {
+        auto mvar = movingVariance(windowedMags, 16);
+        auto newAllowance = lossRate * percentile::percentile_sampling(*clone(mvar), .15);
+        auto allowance = newAllowance * 0.1 + prevAllowance * 0.9;
+        prevAllowance = allowance;
+        auto cma = centeredSma(windowedMags, largeTick);
+        for (int i = 0; i < fftSize; i++) {
+            if (mvar->at(i) > allowance) { cma->at(i) = 0; }
+        }
+        dsp::math::linearInterpolateHoles(cma->data(), cma->size());
+        cma = centeredSma(cma, largeTick);
+        auto cmax = centeredSma(cma, 5*largeTick);
+        auto diff = subeach(cma, cmax);
+        for (int i = 0; i < fftSize; i++) { diff->at(i) = fabs(diff->at(i)); }
+        auto cmaxAllow = percentile::percentile_sampling(*clone(diff), .15);
+        for (int i = 0; i < fftSize; i++) {
+            if (diff->at(i) > cmaxAllow) { cma->at(i) = 0; }
+        }
+        dsp::math::linearInterpolateHoles(cma->data(), cma->size());
+        cma = centeredSma(cma, largeTick);
+        auto mask = npzeros(fftSize);
+        for (int i = 0; i < fftSize; i++) {
+            if (clearMags->at(i) > cma->at(i) + allowance) { mask->at(i) = 1; }
+        }
+        mask = centeredSma(mask, signalWidth / 8);
+        for (int i = 0; i < fftSize; i++) {
+            if (mask->at(i) == 0) { unfiltered[i] = {0, 0}; }
+        }
+    }
+
+    int process(const dsp::complex_t* samples, dsp::complex_t* writeBuf) {
+        inArray->assign(samples, samples + fftSize);
+        auto out = fftPlan->npfftfft(inArray);
+        swapfft(out);
+        cleanFreqDomain.emplace_back(clone(out));
+        auto spectrumOut = npzeros(fftSize);
+        volk_32fc_s32f_power_spectrum_32f(spectrumOut->data(), (const lv_32fc_t *) out->data(), fftSize, fftSize);
+        cleanMagnitudes.emplace_back(spectrumOut);
+        volk_32fc_32f_multiply_32fc((lv_32fc_t*)inArray->data(), (lv_32fc_t*)inArray->data(), fftWindow.data(), fftSize);
+        out = fftPlan->npfftfft(inArray);
+        swapfft(out);
+        auto windowedSpectrumOut = npzeros(fftSize);
+        volk_32fc_s32f_power_spectrum_32f(windowedSpectrumOut->data(), (const lv_32fc_t *) out->data(), fftSize, fftSize);
+        windowedMagnitudes.emplace_back(windowedSpectrumOut);
+        if (cleanFreqDomain.size() < minRecents) { return 0; }
+
+        std::copy(cleanFreqDomain[0]->begin(), cleanFreqDomain[0]->end(), writeBuf);
+        auto windowedSpectrum = npzeros(fftSize);
+        for (int r = 0; r < windowedMagnitudes.size(); r++) { windowedSpectrum = addeach(windowedSpectrum, windowedMagnitudes[r]); }
+        windowedSpectrum = div(windowedSpectrum, windowedMagnitudes.size());
+        auto clearSpectrum = npzeros(fftSize);
+        for (int r = 0; r < cleanMagnitudes.size(); r++) { clearSpectrum = addeach(clearSpectrum, cleanMagnitudes[r]); }
+        clearSpectrum = div(clearSpectrum, cleanMagnitudes.size());
+        filterSignal(windowedSpectrum, clearSpectrum, writeBuf);
+        for (int i = 0; i < fftSize; i++) {
+            if (writeBuf[i].re == 0 && writeBuf[i].im == 0) { continue; }
+            auto amp = writeBuf[i].amplitude();
+            auto namp = sqrt(sqrt(amp));
+            writeBuf[i] *= (namp / amp);
+        }
+        cleanFreqDomain.erase(cleanFreqDomain.begin() + 0);
+        if (cleanMagnitudes.size() > minRecents * 2) {
+            cleanMagnitudes.erase(cleanMagnitudes.begin() + 0);
+            windowedMagnitudes.erase(windowedMagnitudes.begin() + 0);
+        }
+        return fftSize;
+    }
+};
+
+// Noise with a few carriers, one of them drifting so the noise floor estimate has something to do
+static std::vector<dsp::complex_t> makeIQ(int sampleRate, size_t count) {
+    std::vector<dsp::complex_t> samples(count);
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+    double phases[4] = { 0, 0, 0, 0 };
+    for (size_t i = 0; i < count; i++) {
+        float re = noise(rng), im = noise(rng);
+        for (int c = 0; c < 4; c++) {
+            double f = sampleRate * (-0.3 + 0.17 * c) + (c == 3 ? 2000.0 * i / sampleRate : 0.0);
+            phases[c] += 2.0 * M_PI * f / sampleRate;
+            float amp = 0.05f / (c + 1);
+            re += amp * cos(phases[c]);
+            im += amp * sin(phases[c]);
+        }
+        samples[i] = { re, im };
+    }
+    return samples;
+}
+
+// Through the block, slices counted at the output
+static double runStream(int sampleRate, bool worker, const std::vector<dsp::complex_t>& samples, int& outSlices) {
+    dsp::stream<dsp::complex_t> in;
+    dsp::compression::ExperimentalFFTCompressor comp;
+    comp.init(&in);
+    comp.setSampleRate(sampleRate);
+    comp.setEnabled(true);
+    comp.setWorkerThread(worker);
+    std::atomic<int> bins = 0;
+    dsp::sink::Handler<dsp::complex_t> sink;
+    sink.init(&comp.out, [](dsp::complex_t* data, int count, void* ctx) { *(std::atomic<int>*)ctx += count; }, &bins);
+    sink.start();
+    comp.start();
+
+    int block = sampleRate / 100;
+    int expected = (samples.size() / comp.fftSize - (comp.minRecents - 1)) * comp.fftSize;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t pos = 0; pos < samples.size(); pos += block) {
+        int count = std::min<size_t>(block, samples.size() - pos);
+        memcpy(in.writeBuf, &samples[pos], count * sizeof(dsp::complex_t));
+        in.swap(count);
+    }
+    while (bins < expected && std::chrono::high_resolution_clock::now() - start < std::chrono::seconds(60)) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    outSlices = bins / comp.fftSize;
+
+    comp.stop();
+    sink.stop();
+    return elapsed;
+}
+
+static bool benchRate(int sampleRate) {
+    bool ok = true;
+    LegacyEFFT legacy(sampleRate);
+    int fftSize = legacy.fftSize;
+    auto samples = makeIQ(sampleRate, (size_t)fftSize * EFFT_BENCH_SLICES);
+    double seconds = (double)samples.size() / sampleRate;
+
+    std::vector<dsp::complex_t> legacyOut((size_t)fftSize * EFFT_BENCH_SLICES);
+    auto start = std::chrono::high_resolution_clock::now();
+    int legacySlices = 0;
+    for (int s = 0; s < EFFT_BENCH_SLICES; s++) {
+        if (legacy.process(&samples[(size_t)s * fftSize], &legacyOut[(size_t)legacySlices * fftSize])) { legacySlices++; }
+    }
+    double legacySec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    dsp::compression::ExperimentalFFTCompressor comp;
+    comp.setSampleRate(sampleRate);
+    std::vector<dsp::complex_t> newOut((size_t)fftSize * EFFT_BENCH_SLICES);
+    int newSlices = 0;
+    uint64_t allocations = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int s = 0; s < EFFT_BENCH_SLICES; s++) {
+        if (s == comp.minRecents) { allocations = getArrayAllocationCount(); }
+        if (comp.processSlice(&samples[(size_t)s * fftSize], &newOut[(size_t)newSlices * fftSize])) { newSlices++; }
+    }
+    double newSec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    allocations = getArrayAllocationCount() - allocations;
+
+    if (legacySlices != newSlices) {
+        flog::error("{} S/s: {} slices out instead of {}", sampleRate, newSlices, legacySlices);
+        ok = false;
+    }
+    int maskDiff = 0, valueDiff = 0;
+    for (size_t i = 0; i < (size_t)newSlices * fftSize; i++) {
+        bool legacyZero = legacyOut[i].re == 0 && legacyOut[i].im == 0;
+        bool newZero = newOut[i].re == 0 && newOut[i].im == 0;
+        if (legacyZero != newZero) { maskDiff++; }
+        else if (fabsf(legacyOut[i].re - newOut[i].re) > 1e-5f || fabsf(legacyOut[i].im - newOut[i].im) > 1e-5f) { valueDiff++; }
+    }
+    if (maskDiff || valueDiff) {
+        flog::error("{} S/s: {} bins zeroed differently, {} values differ", sampleRate, maskDiff, valueDiff);
+        ok = false;
+    }
+    if (allocations) {
+        flog::error("{} S/s: {} arrays allocated while processing slices", sampleRate, (int64_t)allocations);
+        ok = false;
+    }
+
+    int syncSlices, workerSlices;
+    double syncSec = runStream(sampleRate, false, samples, syncSlices);
+    double workerSec = runStream(sampleRate, true, samples, workerSlices);
+    if (syncSlices != newSlices || workerSlices != newSlices) {
+        flog::error("{} S/s: streams gave {} and {} slices instead of {}", sampleRate, syncSlices, workerSlices, newSlices);
+        ok = false;
+    }
+
+    flog::info("experimental_fft_compressor: {} S/s, fft {}, legacy {} x real time, preallocated {} x ({}x faster), stream {} x, with worker {} x",
+               sampleRate, fftSize, seconds / legacySec, seconds / newSec, legacySec / newSec, seconds / syncSec, seconds / workerSec);
+    return ok;
+}
+
+static void setup_experimental_fft_compressor_bench() {
+    bool ok = benchRate(2000000);
+    ok &= benchRate(6000000);
+    ok &= benchRate(10000000);
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(experimental_fft_compressor_bench, ::setup_experimental_fft_compressor_bench);
@@ -0,0 +1,68 @@
+#include <chrono>
+#include <thread>
+#include "../core/src/utils/arrays.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Measures plan allocation latency with the plan cache and the execution time of estimated vs measured
+// plans, using the per-size FFT statistics.
+
+static const int BENCH_FFT_COUNT = 2000;
+static const int BENCH_MEASURE_WAIT_MS = 30000;
+
+static double timeAllocation(int size, bool backward) {
+    auto start = std::chrono::high_resolution_clock::now();
+    auto plan = dsp::arrays::allocateFFTWPlan(backward, size);
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static dsp::arrays::FFTStats statsFor(int size) {
+    for (auto& st : dsp::arrays::getFFTStats()) {
+        if (st.size == size && !st.backward) { return st; }
+    }
+    return dsp::arrays::FFTStats{ size, false, false, 0, 0 };
+}
+
+// Average time per FFT over a run of BENCH_FFT_COUNT transforms, in microseconds
+static double timeExecution(int size) {
+    auto plan = dsp::arrays::allocateFFTWPlan(false, size);
+    auto in = plan->getInput();
+    for (int i = 0; i < size; i++) { (*in)[i] = { (float)rand() / (float)RAND_MAX, 0.0f }; }
+    auto before = statsFor(size);
+    for (int i = 0; i < BENCH_FFT_COUNT; i++) { plan->npfftfft(in); }
+    auto after = statsFor(size);
+    return (double)(after.totalNs - before.totalNs) / (double)(after.count - before.count) / 1e3;
+}
+
+static void setup_bench_fft_plan() {
+    // No wisdom file so that every size gets measured from scratch
+    dsp::arrays::initFFTPlanCache("", dsp::arrays::FFT_PLAN_MEASURE);
+
+    for (int size = 1024; size <= 65536; size *= 4) {
+        double firstAlloc = timeAllocation(size, false);
+        double estimated = timeExecution(size);
+        double cachedAlloc = timeAllocation(size, false);
+
+        // Wait for the background planner to swap in the measured plan
+        auto start = std::chrono::steady_clock::now();
+        while (!statsFor(size).measured) {
+            if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(BENCH_MEASURE_WAIT_MS)) {
+                flog::error("FFT {}: no measured plan after {} ms", size, BENCH_MEASURE_WAIT_MS);
+                sdrpp::test::failed = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        double measured = timeExecution(size);
+
+        flog::info("FFT {}: first plan {} ms, cached plan {} ms, estimated {} us/FFT, measured {} us/FFT ({}x)",
+                   size, firstAlloc * 1e3, cachedAlloc * 1e3, estimated, measured, estimated / measured);
+    }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(bench_fft_plan, ::setup_bench_fft_plan);
@@ -0,0 +1,117 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Asynchronous flog: a log call from a hot thread only queues the message, the ring behind /log gets every
+// message in order once flushed, a message repeated over and over comes out once with a count, and a thread
+// can still log from its thread_local destructors after its queue is gone.
+
+static const int FLOG_THREADS = 8;
+static const int FLOG_MESSAGES = 20000;
+
+static std::vector<flog::LogRec> recentSince(uint64_t& cursor, const std::string& prefix) {
+    std::vector<flog::LogRec> all, matching;
+    cursor = flog::getRecent(cursor, all, 100000);
+    for (auto& rec : all) {
+        if (rec.message.compare(0, prefix.size(), prefix) == 0) { matching.push_back(rec); }
+    }
+    return matching;
+}
+
+namespace {
+    // Constructed before the thread's log queue, so destroyed after it
+    struct LateLogger {
+        ~LateLogger() {
+            // Past a flush pass, the queue is deleted by then
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            flog::info("flog_async from a thread_local destructor");
+        }
+    };
+}
+
+static void setup_flog_async() {
+    bool ok = true;
+    flog::flush();
+    std::vector<flog::LogRec> newest;
+    uint64_t cursor = flog::getRecent(0, newest, 1);
+
+    // Everything from one thread, in order
+    for (int i = 0; i < 100; i++) { flog::info("flog_async order {}", i); }
+    flog::flush();
+    auto ordered = recentSince(cursor, "flog_async order");
+    bool inOrder = ordered.size() == 100;
+    for (int i = 0; inOrder && i < 100; i++) { inOrder = ordered[i].message == "flog_async order " + std::to_string(i); }
+    if (!inOrder) {
+        flog::error("Ring has {} of 100 messages, or not in order", (int)ordered.size());
+        ok = false;
+    }
+
+    // Repeats are counted
+    for (int i = 0; i < 500; i++) { flog::warn("flog_async repeated"); }
+    flog::info("flog_async after repeats");
+    flog::flush();
+    auto repeated = recentSince(cursor, "");
+    int copies = 0;
+    bool counted = false;
+    for (auto& rec : repeated) {
+        if (rec.message == "flog_async repeated") { copies++; }
+        if (rec.message == "Last message repeated 499 times") { counted = true; }
+    }
+    if (copies != 1 || !counted) {
+        flog::error("Repeated message written {} times, count {}", copies, counted ? "written" : "missing");
+        ok = false;
+    }
+
+    // Logging from a thread that is exiting
+    std::thread exiting([]() {
+        thread_local LateLogger late;
+        (void)&late;
+        flog::info("flog_async exiting thread");
+    });
+    exiting.join();
+    flog::flush();
+    if (recentSince(cursor, "flog_async from a thread_local destructor").size() != 1) {
+        flog::error("Message logged after the thread queue was closed is missing");
+        ok = false;
+    }
+
+    // Hot threads, time spent in the log call itself
+    uint64_t droppedBefore = flog::getDroppedCount();
+    std::vector<std::thread> threads;
+    std::vector<double> callNs(FLOG_THREADS);
+    for (int t = 0; t < FLOG_THREADS; t++) {
+        threads.emplace_back([t, &callNs]() {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < FLOG_MESSAGES; i++) { flog::debug("flog_async thread {} message {}", t, i); }
+            callNs[t] = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / FLOG_MESSAGES;
+        });
+    }
+    for (auto& th : threads) { th.join(); }
+    auto start = std::chrono::high_resolution_clock::now();
+    flog::flush();
+    double flushMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    double worstNs = 0;
+    for (double ns : callNs) { worstNs = std::max(worstNs, ns); }
+    uint64_t dropped = flog::getDroppedCount() - droppedBefore;
+    auto hot = recentSince(cursor, "flog_async thread");
+    if (hot.empty() && dropped < (uint64_t)FLOG_THREADS * FLOG_MESSAGES) {
+        flog::error("Nothing from the hot threads in the ring");
+        ok = false;
+    }
+    // Past the console rate limit window the flood used up
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    flog::info("flog_async: {} threads x {} messages, worst {} ns per call, flushed in {} ms, {} dropped",
+               FLOG_THREADS, FLOG_MESSAGES, worstNs, flushMs, (int64_t)dropped);
+
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(flog_async, ::setup_flog_async);
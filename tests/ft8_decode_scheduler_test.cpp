@@ -0,0 +1,175 @@
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+#include "../decoder_modules/ft8_decoder/src/decode_scheduler.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// FT8 decode scheduler: jobs must start by priority then deadline, never use more threads than the budget,
+// and a queued job must be replaced by the next period of its band or dropped once its deadline passed.
+
+struct SchedulerTrace {
+    std::mutex mtx;
+    std::vector<std::string> started;
+    std::vector<std::string> skipped;
+    int threads = 0;
+    int maxThreads = 0;
+};
+
+static DecodeScheduler::Job traceJob(SchedulerTrace& trace, std::string band, int priority, int deadlineMillis, int runMillis) {
+    DecodeScheduler::Job job;
+    job.band = band;
+    job.priority = priority;
+    job.deadlineMillis = deadlineMillis;
+    job.run = [&trace, band, runMillis](int threads) {
+        {
+            std::lock_guard<std::mutex> lck(trace.mtx);
+            trace.started.push_back(band);
+            trace.threads += threads;
+            trace.maxThreads = std::max<int>(trace.maxThreads, trace.threads);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(runMillis));
+        std::lock_guard<std::mutex> lck(trace.mtx);
+        trace.threads -= threads;
+        return 1;
+    };
+    job.done = [&trace, band](bool decoded, int results, int decodeMillis) {
+        if (decoded) { return; }
+        std::lock_guard<std::mutex> lck(trace.mtx);
+        trace.skipped.push_back(band);
+    };
+    return job;
+}
+
+static void waitIdle(DecodeScheduler& sched) {
+    for (int i = 0; i < 500; i++) {
+        std::string json = sched.getStatsJson();
+        if (json.find("\"queued\":0") != std::string::npos && json.find("\"running\":0") != std::string::npos) { return; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+static bool checkOrdering() {
+    DecodeScheduler sched;
+    SchedulerTrace trace;
+    sched.start(1);
+
+    // Keep the single thread busy while the others queue up
+    sched.submit(traceJob(trace, "busy", 0, 15000, 100));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    sched.submit(traceJob(trace, "late", 0, 15000, 1));
+    sched.submit(traceJob(trace, "early", 0, 7500, 1));
+    sched.submit(traceJob(trace, "qso", 1, 15000, 1));
+    waitIdle(sched);
+    sched.stop();
+
+    std::vector<std::string> expected = { "busy", "qso", "early", "late" };
+    if (trace.started != expected) {
+        flog::error("Jobs ran in the wrong order");
+        for (auto& s : trace.started) { flog::error("  {}", s); }
+        return false;
+    }
+    return true;
+}
+
+static bool checkBudget() {
+    DecodeScheduler sched;
+    SchedulerTrace trace;
+    sched.start(4);
+    for (int i = 0; i < 8; i++) {
+        sched.submit(traceJob(trace, "band" + std::to_string(i), 0, 15000, 30));
+    }
+    waitIdle(sched);
+    sched.stop();
+
+    bool ok = true;
+    if (trace.started.size() != 8) {
+        flog::error("{} of 8 jobs ran", (int)trace.started.size());
+        ok = false;
+    }
+    if (trace.maxThreads > 4) {
+        flog::error("{} threads in use with a budget of 4", trace.maxThreads);
+        ok = false;
+    }
+    flog::info("ft8_decode_scheduler: at most {} threads in use for a budget of 4", trace.maxThreads);
+    return ok;
+}
+
+static bool checkSupersedeAndExpiry() {
+    DecodeScheduler sched;
+    SchedulerTrace trace;
+    sched.start(1);
+
+    sched.submit(traceJob(trace, "busy", 0, 15000, 100));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    sched.submit(traceJob(trace, "20m", 0, 15000, 1));
+    sched.submit(traceJob(trace, "20m", 0, 15000, 1));
+    sched.submit(traceJob(trace, "40m", 0, 10, 1));
+    waitIdle(sched);
+    sched.stop();
+
+    bool ok = true;
+    auto st20 = sched.getStats("20m");
+    auto st40 = sched.getStats("40m");
+    if (st20.submitted != 2 || st20.superseded != 1 || st20.decoded != 1) {
+        flog::error("20m: {} submitted, {} superseded, {} decoded", st20.submitted, st20.superseded, st20.decoded);
+        ok = false;
+    }
+    if (st40.expired != 1 || st40.decoded != 0) {
+        flog::error("40m: {} expired, {} decoded", st40.expired, st40.decoded);
+        ok = false;
+    }
+    if (trace.skipped.size() != 2) {
+        flog::error("{} jobs reported as skipped instead of 2", (int)trace.skipped.size());
+        ok = false;
+    }
+    return ok;
+}
+
+static bool checkCancel() {
+    DecodeScheduler sched;
+    SchedulerTrace trace;
+    sched.start(1);
+
+    sched.submit(traceJob(trace, "busy", 0, 15000, 50));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    sched.submit(traceJob(trace, "gone", 0, 15000, 1));
+
+    // The queued job never runs, and cancel() returns once the running job of its band is done
+    sched.cancel("gone");
+    sched.cancel("busy");
+    bool ok = true;
+    {
+        std::lock_guard<std::mutex> lck(trace.mtx);
+        if (trace.threads != 0) {
+            flog::error("cancel() returned while the band was still decoding");
+            ok = false;
+        }
+        if (trace.skipped != std::vector<std::string>{ "gone" }) {
+            flog::error("Cancelled job was not reported as skipped");
+            ok = false;
+        }
+    }
+    sched.stop();
+    if (trace.started.size() != 1) {
+        flog::error("Cancelled job ran");
+        ok = false;
+    }
+    return ok;
+}
+
+static void setup_ft8_decode_scheduler() {
+    if (!checkOrdering()) { sdrpp::test::failed = true; }
+    if (!checkBudget()) { sdrpp::test::failed = true; }
+    if (!checkSupersedeAndExpiry()) { sdrpp::test::failed = true; }
+    if (!checkCancel()) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(ft8_decode_scheduler, ::setup_ft8_decode_scheduler);
@@ -0,0 +1,179 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "../source_modules/hl2_source/src/hl2_frame_parser.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// HL2 receive path on synthetic Metis packets: the block parser must give the same samples as the per-byte
+// state machine it replaced, and both are timed against the 384 kS/s packet rate of the radio.
+
+static const int HL2_BENCH_PACKETS = 20000;
+static const double HL2_RATE = 384000.0;
+
+// EP6 packets with a tone on receiver 0 and a frequency ack now and then in the control bytes
+static std::vector<uint8_t> makeMetisPackets(int count, int receivers) {
+    std::vector<uint8_t> packets(count * hl2::METIS_PACKET_SIZE);
+    int perFrame = hl2::frameSamples(receivers);
+    int stride = receivers * 6 + 2;
+    int64_t n = 0;
+    for (int p = 0; p < count; p++) {
+        uint8_t* pkt = &packets[p * hl2::METIS_PACKET_SIZE];
+        pkt[0] = 0xEF; pkt[1] = 0xFE; pkt[2] = 0x01; pkt[3] = 0x06;
+        for (int f = 0; f < 2; f++) {
+            uint8_t* frame = &pkt[hl2::METIS_HEADER_SIZE + f * hl2::USB_FRAME_SIZE];
+            frame[0] = frame[1] = frame[2] = hl2::FRAME_SYNC;
+            frame[3] = (p % 7 == 0) ? 0x80 | (2 << 1) : 0x00;
+            frame[4] = 0x00; frame[5] = 0x6B; frame[6] = 0xCF; frame[7] = 0xC0 + (p & 0x0F);
+            for (int s = 0; s < perFrame; s++, n++) {
+                for (int rx = 0; rx < receivers; rx++) {
+                    int32_t iv = (int32_t)(8388607.0 * 0.7 * cos(2.0 * M_PI * 0.013 * n + rx));
+                    int32_t qv = (int32_t)(8388607.0 * 0.7 * sin(2.0 * M_PI * 0.013 * n + rx));
+                    uint8_t* w = &frame[hl2::USB_FRAME_HEADER_SIZE + s * stride + rx * 6];
+                    w[0] = iv >> 16; w[1] = iv >> 8; w[2] = iv;
+                    w[3] = qv >> 16; w[4] = qv >> 8; w[5] = qv;
+                }
+            }
+        }
+    }
+    return packets;
+}
+
+// The per-byte state machine hl2_device.h used before, with the per-sample handler of the source module
+struct ByteParser {
+    enum { SYNC_0, SYNC_1, SYNC_2, CONTROL_0, CONTROL_1, CONTROL_2, CONTROL_3, CONTROL_4,
+           LEFT_SAMPLE_HI, LEFT_SAMPLE_MID, LEFT_SAMPLE_LOW, RIGHT_SAMPLE_HI, RIGHT_SAMPLE_MID, RIGHT_SAMPLE_LOW,
+           MIC_SAMPLE_HI, MIC_SAMPLE_LOW };
+    int state = SYNC_0;
+    int receivers = 1;
+    unsigned char control_in[5];
+    int nreceiver, left_sample, right_sample, nsamples, iq_samples;
+    double left_sample_double, right_sample_double;
+    int controlFrames = 0;
+    std::function<void(int, double, double)> handler;
+
+    void process(const uint8_t* buffer) {
+        for (int i = 0; i < 512; i++) { processByte(buffer[i] & 0xFF); }
+    }
+
+    void processByte(int b) {
+        switch (state) {
+        case SYNC_0: case SYNC_1: case SYNC_2:
+            if (b == hl2::FRAME_SYNC) { state++; }
+            break;
+        case CONTROL_0: case CONTROL_1: case CONTROL_2: case CONTROL_3:
+            control_in[state - CONTROL_0] = b;
+            state++;
+            break;
+        case CONTROL_4:
+            control_in[4] = b;
+            controlFrames++;
+            nreceiver = 0;
+            iq_samples = (512 - 8) / ((receivers * 6) + 2);
+            nsamples = 0;
+            state++;
+            break;
+        case LEFT_SAMPLE_HI: left_sample = (int)((signed char)b << 16); state++; break;
+        case LEFT_SAMPLE_MID: left_sample |= (int)((((unsigned char)b) << 8) & 0xFF00); state++; break;
+        case LEFT_SAMPLE_LOW:
+            left_sample |= (int)((unsigned char)b & 0xFF);
+            left_sample_double = (double)left_sample / 8388607.0;
+            state++;
+            break;
+        case RIGHT_SAMPLE_HI: right_sample = (int)((signed char)b << 16); state++; break;
+        case RIGHT_SAMPLE_MID: right_sample |= (int)((((unsigned char)b) << 8) & 0xFF00); state++; break;
+        case RIGHT_SAMPLE_LOW:
+            right_sample |= (int)((unsigned char)b & 0xFF);
+            right_sample_double = (double)right_sample / 8388607.0;
+            if (nreceiver == 0) { handler(0, left_sample_double, right_sample_double); }
+            nreceiver++;
+            state = (nreceiver == receivers) ? MIC_SAMPLE_HI : LEFT_SAMPLE_HI;
+            break;
+        case MIC_SAMPLE_HI: state++; break;
+        case MIC_SAMPLE_LOW:
+            nsamples++;
+            if (nsamples == iq_samples) { state = SYNC_0; }
+            else {
+                nreceiver = 0;
+                state = LEFT_SAMPLE_HI;
+            }
+            break;
+        }
+    }
+};
+
+static bool benchReceivers(int receivers) {
+    auto packets = makeMetisPackets(HL2_BENCH_PACKETS, receivers);
+    int64_t expected = (int64_t)HL2_BENCH_PACKETS * 2 * hl2::frameSamples(receivers);
+
+    // Per byte, per sample
+    std::vector<dsp::complex_t> byteOut;
+    byteOut.reserve(expected);
+    ByteParser bp;
+    bp.receivers = receivers;
+    bp.handler = [&byteOut](int freq, double i, double q) { byteOut.emplace_back(dsp::complex_t{ (float)q, (float)i }); };
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int p = 0; p < HL2_BENCH_PACKETS; p++) {
+        bp.process(&packets[p * hl2::METIS_PACKET_SIZE + hl2::METIS_HEADER_SIZE]);
+        bp.process(&packets[p * hl2::METIS_PACKET_SIZE + hl2::METIS_HEADER_SIZE + hl2::USB_FRAME_SIZE]);
+    }
+    double byteSec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // Per frame, per block
+    std::vector<dsp::complex_t> blockOut;
+    blockOut.reserve(expected);
+    std::function<void(int, const dsp::complex_t*, int)> handler = [&blockOut](int freq, const dsp::complex_t* samples, int count) {
+        blockOut.insert(blockOut.end(), samples, samples + count);
+    };
+    dsp::complex_t frameSamples[hl2::MAX_FRAME_SAMPLES];
+    unsigned char control[5];
+    int controlFrames = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for (int p = 0; p < HL2_BENCH_PACKETS; p++) {
+        for (int f = 0; f < 2; f++) {
+            const uint8_t* frame = &packets[p * hl2::METIS_PACKET_SIZE + hl2::METIS_HEADER_SIZE + f * hl2::USB_FRAME_SIZE];
+            if (!hl2::frameSynced(frame)) { continue; }
+            memcpy(control, hl2::frameControl(frame), sizeof(control));
+            controlFrames++;
+            int count = hl2::unpackFrame(frame, receivers, 0, frameSamples);
+            handler(0, frameSamples, count);
+        }
+    }
+    double blockSec = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    bool ok = true;
+    if (byteOut.size() != expected || blockOut.size() != expected || bp.controlFrames != controlFrames) {
+        flog::error("{} receivers: {} and {} samples instead of {}", receivers, (int64_t)byteOut.size(), (int64_t)blockOut.size(), expected);
+        ok = false;
+    }
+    else {
+        int mismatches = 0;
+        for (int64_t n = 0; n < expected; n++) {
+            if (fabsf(byteOut[n].re - blockOut[n].re) > 1e-6f || fabsf(byteOut[n].im - blockOut[n].im) > 1e-6f) { mismatches++; }
+        }
+        if (mismatches) {
+            flog::error("{} receivers: {} samples differ from the byte parser", receivers, mismatches);
+            ok = false;
+        }
+    }
+
+    double streamSec = expected / HL2_RATE;
+    flog::info("hl2_frame_parser: {} receivers, byte parser {} x real time, block parser {} x real time ({}x faster)",
+               receivers, streamSec / byteSec, streamSec / blockSec, byteSec / blockSec);
+    return ok;
+}
+
+static void setup_hl2_frame_parser_bench() {
+    bool ok = benchReceivers(1);
+    ok &= benchReceivers(2);
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(hl2_frame_parser_bench, ::setup_hl2_frame_parser_bench);
@@ -0,0 +1,114 @@
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include "../core/src/dsp/buffer/iq_history.h"
+#include "../core/src/dsp/sink/handler_sink.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Time-shift history: samples must come back exactly by absolute position until they are overwritten,
+// int16 storage must stay within its quantization, and a player must run exactly its delay behind.
+
+static const double HIST_SAMPLE_RATE = 100000.0;
+static const int HIST_BLOCK = 1000;
+
+static dsp::complex_t histSample(uint64_t i, bool int16) {
+    if (int16) { return { (float)(i % 1000) / 1000.0f, -(float)(i % 777) / 777.0f }; }
+    return { (float)i, -(float)i };
+}
+
+static void feed(dsp::stream<dsp::complex_t>& in, uint64_t& next, int blocks, bool int16) {
+    for (int b = 0; b < blocks; b++) {
+        for (int i = 0; i < HIST_BLOCK; i++) { in.writeBuf[i] = histSample(next + i, int16); }
+        in.swap(HIST_BLOCK);
+        next += HIST_BLOCK;
+    }
+}
+
+static bool checkStorage(bool int16) {
+    dsp::stream<dsp::complex_t> in;
+    dsp::buffer::IQHistory history(&in, HIST_SAMPLE_RATE, 1.0, int16);
+    history.start();
+
+    // Two and a half seconds into a one second history
+    uint64_t next = 0;
+    feed(in, next, 250, int16);
+    while (history.getWritePosition() < next) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+
+    bool ok = true;
+    std::vector<dsp::complex_t> buf(5000);
+    if (history.getOldestPosition() != next - 100000 || fabs(history.getAvailableSeconds() - 1.0) > 1e-9) {
+        flog::error("History holds from {} instead of {}", history.getOldestPosition(), next - 100000);
+        ok = false;
+    }
+    if (history.read(next - 100001, buf.data(), 10) != 0 || history.read(next, buf.data(), 10) != 0) {
+        flog::error("History returned samples it can't hold");
+        ok = false;
+    }
+
+    // Reads across the wrap point of the ring and up to the newest sample
+    float tolerance = int16 ? 1.0f / 16384.0f : 0.0f;
+    uint64_t positions[] = { next - 100000, next - 1234, 220500, 200000 - 2500 };
+    for (uint64_t pos : positions) {
+        int count = history.read(pos, buf.data(), buf.size());
+        if (count != (int)std::min<uint64_t>(buf.size(), next - pos)) {
+            flog::error("Read {} samples at {}", count, pos);
+            ok = false;
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            dsp::complex_t e = histSample(pos + i, int16);
+            if (fabsf(buf[i].re - e.re) > tolerance || fabsf(buf[i].im - e.im) > tolerance) {
+                flog::error("Sample {} is {} {}, expected {} {}", pos + i, buf[i].re, buf[i].im, e.re, e.im);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    // The player starts half a second back and stays there
+    if (!int16) {
+        uint64_t writePos = history.getWritePosition();
+        dsp::buffer::IQHistoryPlayer player(&history, 0.5);
+        std::atomic<int64_t> firstSample = -1;
+        std::atomic<int64_t> lastLag = -1;
+        dsp::sink::Handler<dsp::complex_t> sink;
+        struct Ctx { std::atomic<int64_t>* first; std::atomic<int64_t>* lag; dsp::buffer::IQHistory* history; } ctx = { &firstSample, &lastLag, &history };
+        sink.init(&player.out, [](dsp::complex_t* data, int count, void* c) {
+            Ctx* ctx = (Ctx*)c;
+            if (*ctx->first < 0) { *ctx->first = (int64_t)data[0].re; }
+            *ctx->lag = (int64_t)ctx->history->getWritePosition() - (int64_t)data[count - 1].re - 1;
+        }, &ctx);
+        sink.start();
+        player.start();
+        feed(in, next, 200, int16);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        player.stop();
+        sink.stop();
+
+        if (firstSample != (int64_t)(writePos - 50000)) {
+            flog::error("Player started at {}, expected {}", (int64_t)firstSample, writePos - 50000);
+            ok = false;
+        }
+        if (lastLag < 50000) {
+            flog::error("Player got {} samples from live, less than its delay", (int64_t)lastLag);
+            ok = false;
+        }
+    }
+
+    history.stop();
+    flog::info("iq_history: {} storage, {} bytes for 1 s at {} S/s", int16 ? "int16" : "float32", (uint64_t)history.getMemoryBytes(), HIST_SAMPLE_RATE);
+    return ok;
+}
+
+static void setup_iq_history() {
+    if (!checkStorage(false)) { sdrpp::test::failed = true; }
+    if (!checkStorage(true)) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(iq_history, ::setup_iq_history);
@@ -0,0 +1,84 @@
+#include <vector>
+#include "../misc_modules/scanner/src/channel_scanner.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Whole band scanner: every channel of the view is evaluated from one FFT frame, a raised noise floor on
+// part of the band must not count as signals, and only the channels fully in the view are updated.
+
+static const int SCAN_FFT_WIDTH = 2000;
+static const double SCAN_WF_START = 88000000.0;
+static const double SCAN_WF_WIDTH = 2000000.0;   // 1 kHz per bin
+
+static void makeFrame(std::vector<float>& frame, const std::vector<double>& carriers) {
+    for (int i = 0; i < SCAN_FFT_WIDTH; i++) {
+        frame[i] = -100.0f + (float)((i * 7919) % 5);
+        // Raised floor on the top quarter, like a noisy neighbour
+        if (i >= 1500) { frame[i] += 20.0f; }
+    }
+    for (double f : carriers) {
+        int bin = (f - SCAN_WF_START) / (SCAN_WF_WIDTH / SCAN_FFT_WIDTH);
+        frame[bin] = -40.0f;
+    }
+}
+
+static void setup_scanner_channels() {
+    // 88.0 to 92.0 MHz every 100 kHz, only the first 2 MHz are in the view
+    ChannelScanner scanner;
+    scanner.configure(88000000.0, 92000000.0, 100000.0);
+    std::vector<float> frame(SCAN_FFT_WIDTH);
+    int first, last;
+    bool ok = true;
+
+    // Let the noise floors settle on a quiet band
+    makeFrame(frame, {});
+    for (int i = 0; i < 50; i++) {
+        scanner.update(frame.data(), SCAN_FFT_WIDTH, SCAN_WF_START, SCAN_WF_WIDTH, 50000.0, 10000.0, -90.0f, 10.0f, first, last);
+    }
+    if (scanner.getChannelCount() != 41 || first != 1 || last != 19) {
+        flog::error("{} channels, {}..{} visible, expected 41 and 1..19", scanner.getChannelCount(), first, last);
+        ok = false;
+    }
+    for (int ch = first; ch <= last; ch++) {
+        if (scanner.isActive(ch)) {
+            flog::error("Channel {} active on a quiet band, level {} floor {}", ch, scanner.getLevel(ch), scanner.getNoiseFloor(ch));
+            ok = false;
+        }
+    }
+
+    // One frame finds every carrier at once
+    makeFrame(frame, { 88300000.0, 88900000.0, 89700000.0 });
+    scanner.update(frame.data(), SCAN_FFT_WIDTH, SCAN_WF_START, SCAN_WF_WIDTH, 50000.0, 10000.0, -90.0f, 10.0f, first, last);
+    std::vector<int> active;
+    for (int ch = first; ch <= last; ch++) {
+        if (scanner.isActive(ch)) { active.push_back(ch); }
+    }
+    if (active != std::vector<int>{ 3, 9, 17 }) {
+        flog::error("{} active channels after one frame, expected 3, 9 and 17", (int)active.size());
+        ok = false;
+    }
+
+    // Next one in each direction, wrapping within the view
+    if (scanner.findActive(3, true, first, last, false) != 9 || scanner.findActive(3, false, first, last, false) != -1
+        || scanner.findActive(3, false, first, last, true) != 17 || scanner.findActive(17, true, first, last, true) != 3) {
+        flog::error("findActive() picked the wrong channel");
+        ok = false;
+    }
+
+    // Channels outside the view keep their state
+    if (scanner.isActive(30) || !std::isnan(scanner.getNoiseFloor(30))) {
+        flog::error("Channel outside the view was updated");
+        ok = false;
+    }
+
+    flog::info("scanner_channels: {} channels evaluated per frame, floor {} dB on the quiet part and {} dB on the noisy one",
+               last - first + 1, scanner.getNoiseFloor(5), scanner.getNoiseFloor(16));
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(scanner_channels, ::setup_scanner_channels);
@@ -0,0 +1,178 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include "../core/src/server.h"
+#include "../core/src/dsp/compression/pcm_type.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Loopback load test for the multi-client server. Several simulated clients with different settings share
+// one synthetic capture, and one of them never reads its socket. The others must keep getting frames at
+// the capture rate while the stuck one drops them.
+
+static const int FANOUT_PORT = 15259;
+static const double FANOUT_SAMPLE_RATE = 1000000.0;
+static const int FANOUT_BLOCK_SAMPLES = 10000;  // 10 ms
+static const int FANOUT_SECONDS = 4;
+
+using namespace server;
+
+struct SimClient {
+    const char* name;
+    bool reads;
+    net::Conn conn;
+    std::thread reader;
+    std::atomic<int> basebandPackets = 0;
+};
+
+static dsp::stream<dsp::complex_t> fanoutSource;
+
+static void sendTestCommand(net::Conn& conn, Command cmd, const void* data, int len) {
+    std::vector<uint8_t> buf(sizeof(PacketHeader) + sizeof(CommandHeader) + len);
+    PacketHeader* hdr = (PacketHeader*)buf.data();
+    CommandHeader* chdr = (CommandHeader*)&buf[sizeof(PacketHeader)];
+    hdr->type = PACKET_TYPE_COMMAND;
+    hdr->size = buf.size();
+    chdr->cmd = cmd;
+    if (len) { memcpy(&buf[sizeof(PacketHeader) + sizeof(CommandHeader)], data, len); }
+    conn->write(buf.size(), buf.data());
+}
+
+static void sendTestCommand(net::Conn& conn, Command cmd, uint8_t value) {
+    sendTestCommand(conn, cmd, &value, 1);
+}
+
+static void readPackets(SimClient* client) {
+    std::vector<uint8_t> buf(SERVER_MAX_PACKET_SIZE);
+    PacketHeader* hdr = (PacketHeader*)buf.data();
+    while (true) {
+        if (client->conn->read(sizeof(PacketHeader), buf.data()) <= 0) { return; }
+        int goal = hdr->size - sizeof(PacketHeader);
+        if (goal < 0 || goal > (int)(buf.size() - sizeof(PacketHeader))) { return; }
+        if (goal > 0 && client->conn->read(goal, &buf[sizeof(PacketHeader)]) <= 0) { return; }
+        switch (hdr->type) {
+            case PACKET_TYPE_BASEBAND:
+            case PACKET_TYPE_BASEBAND_COMPRESSED:
+            case PACKET_TYPE_BASEBAND_WITH_METADATA:
+            case PACKET_TYPE_BASEBAND_EXPERIMENTAL_FFT:
+                client->basebandPackets++;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static void setup_server_fanout() {
+    server::init();
+    server::setInputSampleRate(FANOUT_SAMPLE_RATE);
+    server::setInput(&fanoutSource);
+    try {
+        server::listen("127.0.0.1", FANOUT_PORT, 8);
+    }
+    catch (std::exception& e) {
+        flog::error("Could not listen on port {}: {}", FANOUT_PORT, e.what());
+        sdrpp::test::failed = true;
+        sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+        return;
+    }
+
+    // Synthetic capture paced at the sample rate
+    std::atomic<bool> feeding = true;
+    std::atomic<int> fedBlocks = 0;
+    std::thread feeder([&] {
+        double phase = 0;
+        auto next = std::chrono::steady_clock::now();
+        while (feeding) {
+            for (int i = 0; i < FANOUT_BLOCK_SAMPLES; i++) {
+                fanoutSource.writeBuf[i] = { (float)cos(phase), (float)sin(phase) };
+                phase = fmod(phase + 0.05, 2.0 * M_PI);
+            }
+            if (!fanoutSource.swap(FANOUT_BLOCK_SAMPLES)) { return; }
+            fedBlocks++;
+            next += std::chrono::milliseconds(10);
+            std::this_thread::sleep_until(next);
+        }
+    });
+
+    SimClient clients[] = {
+        { "raw", true },
+        { "zstd", true },
+        { "lossy fft", true },
+        { "ddc 48k", true },
+        { "stuck f32", false },
+    };
+    int clientCount = sizeof(clients) / sizeof(clients[0]);
+
+    for (auto& c : clients) {
+        c.conn = net::connect("127.0.0.1", FANOUT_PORT);
+        std::string name = c.name;
+        bool fft = (name == "lossy fft");
+        sendTestCommand(c.conn, COMMAND_SET_FFTZSTD_COMPRESSION, fft);
+        sendTestCommand(c.conn, COMMAND_SET_COMPRESSION, name == "zstd");
+        if (name == "stuck f32") {
+            sendTestCommand(c.conn, COMMAND_SET_SAMPLE_TYPE, dsp::compression::PCM_TYPE_F32);
+        }
+        if (name == "ddc 48k") {
+            double offset = 100000.0;
+            int32_t rate = 48000;
+            sendTestCommand(c.conn, COMMAND_SET_DDC_OFFSET, &offset, sizeof(offset));
+            sendTestCommand(c.conn, COMMAND_SET_SAMPLERATE, &rate, sizeof(rate));
+        }
+
+        StartCommandArguments args = {};
+        args.magic = SDRPP_BROWN_MAGIC;
+        args.clientCapsRequested = fft ? 1 : 0;     // metadata
+        sendTestCommand(c.conn, COMMAND_START, &args, sizeof(args));
+
+        if (c.reads) { c.reader = std::thread(readPackets, &c); }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int startBlocks = fedBlocks;
+    std::this_thread::sleep_for(std::chrono::seconds(FANOUT_SECONDS));
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int blocks = fedBlocks - startBlocks;
+
+    auto stats = server::getClientStats();
+    if ((int)stats.size() != clientCount) {
+        flog::error("Server has {} clients, expected {}", (int)stats.size(), clientCount);
+        sdrpp::test::failed = true;
+    }
+
+    for (int i = 0; i < clientCount; i++) {
+        auto& c = clients[i];
+        uint64_t dropped = (i < (int)stats.size()) ? stats[i].droppedFrames : 0;
+        flog::info("server_fanout: {}: {} frames/s received, {} dropped by the server", c.name, c.basebandPackets / elapsed, dropped);
+        if (c.reads && c.basebandPackets < blocks / 4) {
+            flog::error("Client {} only got {} frames for {} captured blocks", c.name, (int)c.basebandPackets, blocks);
+            sdrpp::test::failed = true;
+        }
+        if (!c.reads && dropped == 0) {
+            flog::error("Client {} never reads but the server dropped nothing", c.name);
+            sdrpp::test::failed = true;
+        }
+    }
+    if (clients[0].basebandPackets < blocks * 8 / 10) {
+        flog::error("Uncompressed client fell behind the capture: {} frames for {} blocks", (int)clients[0].basebandPackets, blocks);
+        sdrpp::test::failed = true;
+    }
+
+    // Tear down, the clients first so their readers return
+    for (auto& c : clients) {
+        c.conn->close();
+        if (c.reader.joinable()) { c.reader.join(); }
+    }
+    server::shutdown();
+    feeding = false;
+    fanoutSource.stopWriter();
+    feeder.join();
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(server_fanout, ::setup_server_fanout);
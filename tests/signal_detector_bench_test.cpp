@@ -0,0 +1,124 @@
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <fstream>
+#include "../core/src/core.h"
+#include "../core/src/dsp/detector/signal_detector.h"
+#include "../core/src/dsp/sink/handler_sink.h"
+#include "../core/src/utils/wav.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Signal detector stages on the recording of test_signal_detection: the capture stage on the DSP path must keep
+// up far above real time, and the detection stage must publish a result once two seconds went through it.
+
+static const std::string DETECTOR_FILE_NAME = "baseband_14174296Hz_11-08-47_24-02-2024-contest-ssb-small.wav";
+static const int DETECTOR_BLOCK = 8192;
+
+// The recording when it is there, otherwise noise with a few harmonic combs
+static std::vector<dsp::complex_t> loadDetectorInput(double& sampleRate) {
+    std::string testDir = std::string(core::getRoot()) + "/tests/test_files";
+    if (core::args["test_root"].type == CLI_ARG_TYPE_STRING && !core::args["test_root"].s().empty()) {
+        testDir = core::args["test_root"].s() + "/test_files";
+    }
+    std::vector<dsp::complex_t> samples;
+    std::string path = testDir + "/" + DETECTOR_FILE_NAME;
+    if (std::ifstream(path).good()) {
+        wav::Reader reader(path);
+        if (reader.map()) {
+            sampleRate = reader.getSampleRate();
+            samples.resize(std::min<uint64_t>(reader.getSampleCount(), (uint64_t)(sampleRate * 6)));
+            samples.resize(reader.readComplex(samples.data(), 0, samples.size()));
+            flog::info("signal_detector_bench: {} s of {}", samples.size() / sampleRate, DETECTOR_FILE_NAME);
+            return samples;
+        }
+    }
+
+    flog::warn("signal_detector_bench: {} not found, using a synthetic signal", path);
+    sampleRate = 250000.0;
+    samples.resize(sampleRate * 6);
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    for (size_t i = 0; i < samples.size(); i++) {
+        float re = noise(rng), im = noise(rng);
+        for (int comb = 0; comb < 3; comb++) {
+            for (int h = 0; h < 8; h++) {
+                double f = -80000.0 + comb * 60000.0 + h * 150.0;
+                re += 0.002f * cos(2.0 * M_PI * f * i / sampleRate);
+                im += 0.002f * sin(2.0 * M_PI * f * i / sampleRate);
+            }
+        }
+        samples[i] = { re, im };
+    }
+    return samples;
+}
+
+static double feed(dsp::stream<dsp::complex_t>& in, const std::vector<dsp::complex_t>& samples, dsp::detector::SignalDetector* flushEachRow, double sampleRate) {
+    auto start = std::chrono::high_resolution_clock::now();
+    int rowSamples = sampleRate / 10;
+    for (size_t pos = 0; pos < samples.size(); pos += DETECTOR_BLOCK) {
+        int count = std::min<size_t>(DETECTOR_BLOCK, samples.size() - pos);
+        memcpy(in.writeBuf, &samples[pos], count * sizeof(dsp::complex_t));
+        in.swap(count);
+        if (flushEachRow && (pos / rowSamples) != ((pos + count) / rowSamples)) {
+            // Let the capture stage take the block, then wait for the detection stage
+            while (flushEachRow->getCapturedRows() < (pos + count) / rowSamples) { std::this_thread::sleep_for(std::chrono::microseconds(100)); }
+            flushEachRow->flush();
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static void setup_signal_detector_bench() {
+    double sampleRate;
+    auto samples = loadDetectorInput(sampleRate);
+    double seconds = samples.size() / sampleRate;
+
+    bool ok = true;
+    for (int pass = 0; pass < 2; pass++) {
+        dsp::stream<dsp::complex_t> in;
+        dsp::detector::SignalDetector detector;
+        detector.init(&in);
+        detector.setSampleRate(sampleRate);
+        dsp::sink::Handler<dsp::complex_t> sink;
+        sink.init(&detector.out, [](dsp::complex_t* data, int count, void* ctx) {}, NULL);
+        sink.start();
+        detector.start();
+
+        if (pass == 0) {
+            // Capture stage alone, as fast as it goes, the detection stage drops what it can't take
+            double elapsed = feed(in, samples, NULL, sampleRate);
+            detector.flush();
+            flog::info("signal_detector_bench: capture stage {} x real time, {} rows captured, {} dropped",
+                       seconds / elapsed, (int64_t)detector.getCapturedRows(), (int64_t)detector.getDroppedRows());
+        }
+        else {
+            // Every row through the detection stage
+            double elapsed = feed(in, samples, &detector, sampleRate);
+            std::vector<float> result;
+            uint64_t version = 0;
+            if (!detector.getSmoothed(result, version) || result.size() != (size_t)(sampleRate / 10)) {
+                flog::error("Detector published no result after {} s", seconds);
+                ok = false;
+            }
+            if (detector.getDroppedRows()) {
+                flog::error("Detector dropped {} rows while flushed after each one", (int64_t)detector.getDroppedRows());
+                ok = false;
+            }
+            flog::info("signal_detector_bench: detection stage {} ms per row ({} x real time), aggregation {} ms",
+                       elapsed * 1000.0 / detector.getCapturedRows(), seconds / elapsed, detector.getLastDetectMillis());
+        }
+
+        detector.stop();
+        sink.stop();
+    }
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(signal_detector_bench, ::setup_signal_detector_bench);
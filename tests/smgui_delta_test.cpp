@@ -0,0 +1,128 @@
+#include <vector>
+#include <string>
+#include "../core/src/gui/smgui.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Remote UI deltas: a source menu where one slider moved must go out as a few bytes instead of the whole
+// list, apply back to the same list, including a list that only got shorter, and a delta on top of the wrong
+// list must be refused.
+
+// Something like a source menu with a few gain stages and a status line
+static void makeMenu(SmGui::DrawList& dl, int gain, const std::string& status, bool extraRow) {
+    for (int stage = 0; stage < 8; stage++) {
+        dl.pushStep(SmGui::DRAW_STEP_LEFT_LABEL, false);
+        dl.pushString("Gain stage " + std::to_string(stage));
+        dl.pushStep(SmGui::DRAW_STEP_FILL_WIDTH, false);
+        dl.pushStep(SmGui::DRAW_STEP_SLIDER_INT, false);
+        dl.pushString("##source_gain_" + std::to_string(stage));
+        dl.pushInt(stage == 3 ? gain : stage * 5);
+        dl.pushInt(0);
+        dl.pushInt(60);
+        dl.pushInt(SmGui::FMT_STR_INT_DB);
+        dl.pushInt(0);
+        dl.pushStep(SmGui::DRAW_STEP_CHECKBOX, false);
+        dl.pushString("AGC##source_agc_" + std::to_string(stage));
+        dl.pushBool(stage % 2);
+    }
+    if (extraRow) {
+        dl.pushStep(SmGui::DRAW_STEP_CHECKBOX, false);
+        dl.pushString("Bias-T##source_biast");
+        dl.pushBool(true);
+    }
+    dl.pushStep(SmGui::DRAW_STEP_TEXT, false);
+    dl.pushString(status);
+}
+
+static bool sameList(SmGui::DrawList& a, SmGui::DrawList& b) {
+    if (a.elements.size() != b.elements.size()) { return false; }
+    for (int i = 0; i < a.elements.size(); i++) {
+        if (!SmGui::DrawList::sameItem(a.elements[i], b.elements[i])) { return false; }
+    }
+    return true;
+}
+
+static void setup_smgui_delta() {
+    bool ok = true;
+    std::vector<uint8_t> buf;
+
+    // First list goes out whole
+    SmGui::DrawList server1, client;
+    makeMenu(server1, 20, "Running", false);
+    uint32_t seq = 0;
+    int fullSize = server1.storeFull(1, buf);
+    if (client.loadDelta(buf.data(), fullSize, seq) < 0 || seq != 1 || !sameList(server1, client)) {
+        flog::error("Full list did not load");
+        ok = false;
+    }
+
+    // One slider moved
+    SmGui::DrawList server2;
+    makeMenu(server2, 27, "Running", false);
+    int deltaSize = server2.storeDelta(server1, 1, 2, buf);
+    if (((SmGui::DeltaHeader*)buf.data())->changeCount != 1 || client.loadDelta(buf.data(), deltaSize, seq) < 0 || seq != 2 || !sameList(server2, client)) {
+        flog::error("Delta for one slider did not apply");
+        ok = false;
+    }
+    flog::info("smgui_delta: {} elements, full list {} bytes, one slider moved {} bytes", (int)server2.elements.size(), server2.getSize(), deltaSize);
+    if (deltaSize * 10 > server2.getSize()) {
+        flog::error("Delta of {} bytes is not much smaller than the {} byte list", deltaSize, server2.getSize());
+        ok = false;
+    }
+
+    // The list grows by a row and the status changes
+    SmGui::DrawList server3;
+    makeMenu(server3, 27, "Overload", true);
+    deltaSize = server3.storeDelta(server2, 2, 3, buf);
+    if (client.loadDelta(buf.data(), deltaSize, seq) < 0 || seq != 3 || !sameList(server3, client)) {
+        flog::error("Delta for a longer list did not apply");
+        ok = false;
+    }
+
+    // And shrinks back
+    deltaSize = server2.storeDelta(server3, 3, 4, buf);
+    if (client.loadDelta(buf.data(), deltaSize, seq) < 0 || seq != 4 || !sameList(server2, client)) {
+        flog::error("Delta for a shorter list did not apply");
+        ok = false;
+    }
+
+    // Only the last row goes away, no element changed but the delta still has to go out
+    SmGui::DrawList server4;
+    makeMenu(server4, 27, "Running", false);
+    server4.pushStep(SmGui::DRAW_STEP_TEXT, false);
+    server4.pushString("Overload");
+    deltaSize = server4.storeDelta(server2, 4, 5, buf);
+    if (client.loadDelta(buf.data(), deltaSize, seq) < 0 || seq != 5 || !sameList(server4, client)) {
+        flog::error("Delta that adds a last row did not apply");
+        ok = false;
+    }
+    deltaSize = server2.storeDelta(server4, 5, 6, buf);
+    if (((SmGui::DeltaHeader*)buf.data())->changeCount != 0 || client.loadDelta(buf.data(), deltaSize, seq) < 0 || seq != 6 || !sameList(server2, client)) {
+        flog::error("Delta that only drops the last row did not apply");
+        ok = false;
+    }
+
+    // A delta on top of a list the client doesn't have is refused and leaves the list alone
+    deltaSize = server1.storeDelta(server3, 3, 7, buf);
+    if (client.loadDelta(buf.data(), deltaSize, seq) != -2 || seq != 6 || !sameList(server2, client)) {
+        flog::error("Delta with the wrong base was not refused");
+        ok = false;
+    }
+
+    // A change count the packet can't hold is refused before anything is allocated
+    deltaSize = server1.storeDelta(server2, 6, 7, buf);
+    ((SmGui::DeltaHeader*)buf.data())->changeCount = 0xFFFFFFFF;
+    if (client.loadDelta(buf.data(), deltaSize, seq) != -1 || seq != 6 || !sameList(server2, client)) {
+        flog::error("Delta with a bogus change count was not refused");
+        ok = false;
+    }
+
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(smgui_delta, ::setup_smgui_delta);
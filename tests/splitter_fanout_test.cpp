@@ -0,0 +1,168 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../core/src/dsp/routing/splitter.h"
+#include "../core/src/dsp/sink/handler_sink.h"
+#include "../core/src/dsp/executor.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Shared fan-out policies with a reader that stalls: BLOCK delivers every block in order and holds up the
+// writer, DROP_OLDEST keeps the newest blocks, DROP_NEWEST the oldest, each counting what it dropped. On an
+// executor a splitter with a full BLOCK branch must not hold up the other blocks of its group.
+
+static const int FANOUT_BLOCKS = 6;
+static const int FANOUT_DEPTH = 2;
+static const int FANOUT_BLOCK_SIZE = 16;
+
+static void writeBlock(dsp::stream<float>& in, int n) {
+    for (int i = 0; i < FANOUT_BLOCK_SIZE; i++) { in.writeBuf[i] = (float)n; }
+    in.swap(FANOUT_BLOCK_SIZE);
+}
+
+static bool waitFor(const std::function<bool()>& cond) {
+    auto start = std::chrono::steady_clock::now();
+    while (!cond()) {
+        if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5)) { return false; }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Reads what the branch holds, expecting the given block numbers in that order
+static bool readBlocks(dsp::stream<float>& branch, const std::vector<int>& expected, const char* name) {
+    for (int n : expected) {
+        int count = branch.read();
+        bool ok = (count == FANOUT_BLOCK_SIZE && branch.readBuf[0] == (float)n && branch.readBuf[FANOUT_BLOCK_SIZE - 1] == (float)n);
+        float got = (count > 0) ? branch.readBuf[0] : -1.0f;
+        branch.flush();
+        if (!ok) {
+            flog::error("{}: got block {} ({} samples), expected {}", name, got, count, n);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkDropPolicy(dsp::FanoutPolicy policy, const std::vector<int>& expected, const char* name) {
+    dsp::stream<float> in;
+    dsp::stream<float> branch;
+    dsp::routing::Splitter<float> split(&in);
+    split.setSharedFanout(true);
+    split.bindStream(&branch, policy, FANOUT_DEPTH);
+    split.start();
+
+    // Nobody reads the branch while all blocks go in
+    for (int n = 0; n < FANOUT_BLOCKS; n++) { writeBlock(in, n); }
+    uint64_t expectedDrops = FANOUT_BLOCKS - FANOUT_DEPTH;
+    bool ok = true;
+    if (!waitFor([&] { return split.getDroppedBlocks(&branch) == expectedDrops; })) {
+        flog::error("{}: {} blocks dropped, expected {}", name, split.getDroppedBlocks(&branch), expectedDrops);
+        ok = false;
+    }
+    ok &= readBlocks(branch, expected, name);
+    if (branch.isDataReady()) {
+        flog::error("{}: more blocks than the queue depth delivered", name);
+        ok = false;
+    }
+    split.stop();
+    return ok;
+}
+
+static bool checkBlockPolicy() {
+    dsp::stream<float> in;
+    dsp::stream<float> branch;
+    dsp::routing::Splitter<float> split(&in);
+    split.setSharedFanout(true);
+    split.bindStream(&branch, dsp::FanoutPolicy::BLOCK, FANOUT_DEPTH);
+    split.start();
+
+    std::atomic<int> written = 0;
+    std::thread writer([&] {
+        for (int n = 0; n < FANOUT_BLOCKS; n++) {
+            writeBlock(in, n);
+            written++;
+        }
+    });
+
+    // The queue fills, one block waits in the splitter and one in its input, then the writer is held up
+    bool ok = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    if (written >= FANOUT_BLOCKS) {
+        flog::error("BLOCK: the writer was not held up by a stalled reader");
+        ok = false;
+    }
+    std::vector<int> all;
+    for (int n = 0; n < FANOUT_BLOCKS; n++) { all.push_back(n); }
+    ok &= readBlocks(branch, all, "BLOCK");
+    writer.join();
+    if (split.getDroppedBlocks(&branch) != 0) {
+        flog::error("BLOCK: {} blocks dropped", split.getDroppedBlocks(&branch));
+        ok = false;
+    }
+    split.stop();
+    return ok;
+}
+
+static bool checkPooledBlockPolicy() {
+    // Declared so that the group goes last
+    struct Blocks {
+        dsp::ExecGroup group;
+        dsp::stream<float> in;
+        dsp::stream<float> branch;
+        dsp::stream<float> otherIn;
+        dsp::routing::Splitter<float> split;
+        dsp::sink::Handler<float> other;
+    };
+    auto b = std::make_unique<Blocks>();
+    std::atomic<int> otherSamples = 0;
+    b->split.init(&b->in);
+    b->split.setSharedFanout(true);
+    b->split.bindStream(&b->branch, dsp::FanoutPolicy::BLOCK, 1);
+    b->split.setScheduler(&b->group);
+    b->other.init(&b->otherIn, [](float* data, int count, void* ctx) { *(std::atomic<int>*)ctx += count; }, &otherSamples);
+    b->other.setScheduler(&b->group);
+    b->split.start();
+    b->other.start();
+
+    std::thread writer([&] {
+        for (int n = 0; n < 3; n++) { writeBlock(b->in, n); }
+    });
+
+    // The branch is full and the splitter has the next block, the other block must still run
+    bool ok = true;
+    waitFor([&] { return b->branch.isDataReady(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    writeBlock(b->otherIn, 0);
+    if (!waitFor([&] { return otherSamples == FANOUT_BLOCK_SIZE; })) {
+        flog::error("Pooled BLOCK: a full branch held up the rest of the group");
+        ok = false;
+        // The pool thread is stuck in the splitter, leave everything it uses alive
+        b.release();
+        writer.detach();
+        return ok;
+    }
+    ok &= readBlocks(b->branch, { 0, 1, 2 }, "Pooled BLOCK");
+    writer.join();
+    b->other.stop();
+    b->split.stop();
+    return ok;
+}
+
+static void setup_splitter_fanout() {
+    bool ok = true;
+    ok &= checkDropPolicy(dsp::FanoutPolicy::DROP_OLDEST, { FANOUT_BLOCKS - 2, FANOUT_BLOCKS - 1 }, "DROP_OLDEST");
+    ok &= checkDropPolicy(dsp::FanoutPolicy::DROP_NEWEST, { 0, 1 }, "DROP_NEWEST");
+    ok &= checkBlockPolicy();
+    ok &= checkPooledBlockPolicy();
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(splitter_fanout, ::setup_splitter_fanout);
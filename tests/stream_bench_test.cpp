@@ -0,0 +1,150 @@
+#include <vector>
+#include <memory>
+#include <thread>
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include "../core/src/dsp/processor.h"
+#include "../core/src/dsp/routing/splitter.h"
+#include "../core/src/dsp/bench/speed_tester.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Pushes samples through a chain of 20 pass-through blocks, once with the double buffered streams and
+// once with every hop switched to the lock-free ring. Checks that a numbered sequence comes out of the
+// chain intact and in order, then reports throughput and thread wake-ups.
+
+static const int BENCH_CHAIN_LENGTH = 20;
+static const int BENCH_BLOCK_SIZE = 1024;
+static const int BENCH_RING_DEPTH = 4;
+static const int BENCH_DURATION_MS = 2000;
+static const int CHECK_BLOCKS = 2000;
+
+namespace {
+    class PassThrough : public dsp::Processor<float, float> {
+        using base_type = dsp::Processor<float, float>;
+    public:
+        inline int process(int count, const float* in, float* out) {
+            memcpy(out, in, count * sizeof(float));
+            return count;
+        }
+
+        DEFAULT_PROC_RUN
+    };
+}
+
+static long voluntaryContextSwitches() {
+#ifndef _WIN32
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw;
+#else
+    return 0;
+#endif
+}
+
+// Every sample is its index in the sequence, blocks of varying size
+static bool checkSequence(dsp::stream<float>& in, dsp::stream<float>* out) {
+    const int total = CHECK_BLOCKS * BENCH_BLOCK_SIZE / 2;
+    std::thread writer([&] {
+        int next = 0;
+        for (int b = 0; next < total; b++) {
+            int count = std::min<int>(1 + (b * 37) % BENCH_BLOCK_SIZE, total - next);
+            for (int i = 0; i < count; i++) { in.writeBuf[i] = (float)(next + i); }
+            if (!in.swap(count)) { return; }
+            next += count;
+        }
+    });
+
+    int expected = 0;
+    bool ok = true;
+    while (ok && expected < total) {
+        int count = out->read();
+        if (count <= 0) {
+            flog::error("Chain output ended after {} of {} samples", expected, total);
+            ok = false;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (out->readBuf[i] != (float)expected) {
+                flog::error("Sample {} came out as {}", expected, out->readBuf[i]);
+                ok = false;
+                break;
+            }
+            expected++;
+        }
+        out->flush();
+    }
+    if (!ok) { in.stopWriter(); }
+    writer.join();
+    if (!ok) { in.clearWriteStop(); }
+    return ok;
+}
+
+static void benchChain(bool ring) {
+    dsp::stream<float> in;
+    if (ring) { in.setRingDepth(BENCH_RING_DEPTH, BENCH_BLOCK_SIZE); }
+
+    std::vector<std::unique_ptr<PassThrough>> blocks;
+    dsp::stream<float>* prev = &in;
+    for (int i = 0; i < BENCH_CHAIN_LENGTH; i++) {
+        blocks.emplace_back(std::make_unique<PassThrough>());
+        blocks.back()->init(prev);
+        if (ring) { blocks.back()->out.setRingDepth(BENCH_RING_DEPTH, BENCH_BLOCK_SIZE); }
+        prev = &blocks.back()->out;
+    }
+    for (auto& b : blocks) { b->start(); }
+
+    if (!checkSequence(in, prev)) {
+        flog::error("{} streams: chain output is wrong", ring ? "Ring" : "Double buffered");
+        sdrpp::test::failed = true;
+    }
+
+    dsp::bench::SpeedTester<float, float> tester(&in, prev);
+    long ctxSw = voluntaryContextSwitches();
+    uint64_t wakeups = dsp::buffer::EventCount::wakeups.load();
+    double rate = tester.benchmark(BENCH_DURATION_MS, BENCH_BLOCK_SIZE);
+    ctxSw = voluntaryContextSwitches() - ctxSw;
+    wakeups = dsp::buffer::EventCount::wakeups.load() - wakeups;
+
+    for (auto& b : blocks) { b->stop(); }
+
+    double seconds = (double)BENCH_DURATION_MS / 1000.0;
+    flog::info("{} blocks, {}: {} MS/s, {} context switches/s, {} futex wake-ups/s",
+               BENCH_CHAIN_LENGTH, ring ? "ring streams" : "double buffered streams",
+               rate / 1e6, (double)ctxSw / seconds, (double)wakeups / seconds);
+}
+
+// The ring reader only takes what the writer committed to the ring, it would never see shared blocks
+static void checkSharedFanoutRefused() {
+    dsp::stream<float> in;
+    dsp::stream<float> ringOut;
+    ringOut.setRingDepth(BENCH_RING_DEPTH, BENCH_BLOCK_SIZE);
+    dsp::routing::Splitter<float> split(&in);
+    split.setSharedFanout(true);
+    bool refused = false;
+    try {
+        split.bindStream(&ringOut);
+    }
+    catch (const std::runtime_error&) {
+        refused = true;
+    }
+    if (!refused) {
+        flog::error("A ring stream was bound to a splitter with shared fan-out");
+        sdrpp::test::failed = true;
+    }
+}
+
+static void setup_bench_stream() {
+    benchChain(false);
+    benchChain(true);
+    checkSharedFanoutRefused();
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(bench_stream, ::setup_bench_stream);
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../core/src/gui/widgets/fft_pyramid.h"
+#include "../core/src/utils/worker_pool.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Waterfall zoom from the max pyramid: every pixel must be exactly the max of the raw bins doZoom() gives it,
+// whatever the span, pan and row size. Full redraws split across the worker pool must not start threads.
+
+static const int PYRAMID_ROWS = 64;
+
+static std::vector<float> randomRow(int size) {
+    std::vector<float> row(size);
+    for (auto& v : row) { v = -100.0f + 100.0f * (float)rand() / (float)RAND_MAX; }
+    return row;
+}
+
+static bool checkZoom(int rawSize, int offset, int width, int outSize) {
+    std::vector<float> raw = randomRow(rawSize);
+    FFTPyramid pyramid;
+    pyramid.init(rawSize);
+    std::vector<float> row(std::max<int>(1, pyramid.getRowSize()));
+    pyramid.buildRow(raw.data(), row.data());
+
+    std::vector<float> expected(outSize);
+    std::vector<float> got(outSize);
+    doZoom(offset, width, rawSize, outSize, raw.data(), expected.data());
+    pyramid.zoomRow(raw.data(), row.data(), offset, width, outSize, got.data());
+    for (int i = 0; i < outSize; i++) {
+        if (got[i] != expected[i]) {
+            flog::error("{} bins, offset {}, width {}, {} pixels: pixel {} is {} instead of {}", rawSize, offset, width, outSize, i, got[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Thread count of the process, -1 where it can't be read
+static int threadCount() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("Threads:", 0) == 0) { return std::stoi(line.substr(8)); }
+    }
+    return -1;
+}
+
+static bool checkRedraw() {
+    const int rawSize = 65536;
+    const int outSize = 1000;
+    FFTPyramid pyramid;
+    pyramid.init(rawSize);
+    std::vector<float> raw;
+    std::vector<float> rows(PYRAMID_ROWS * pyramid.getRowSize());
+    for (int i = 0; i < PYRAMID_ROWS; i++) {
+        std::vector<float> r = randomRow(rawSize);
+        raw.insert(raw.end(), r.begin(), r.end());
+        pyramid.buildRow(&raw[i * rawSize], &rows[i * pyramid.getRowSize()]);
+    }
+
+    WorkerPool pool(3);
+    std::vector<float> out(PYRAMID_ROWS * outSize);
+    auto redraw = [&](int offset, int width) {
+        pool.parallelFor(PYRAMID_ROWS, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                pyramid.zoomRow(&raw[i * rawSize], &rows[i * pyramid.getRowSize()], offset, width, outSize, &out[i * outSize]);
+            }
+        });
+    };
+
+    bool ok = true;
+    redraw(0, rawSize);
+    int threads = threadCount();
+    for (int n = 0; n < 50; n++) {
+        int width = 1000 + (n * 1237) % (rawSize - 1000);
+        int offset = (n * 389) % (rawSize - width + 1);
+        redraw(offset, width);
+
+        std::vector<float> expected(outSize);
+        for (int i = 0; i < PYRAMID_ROWS; i++) {
+            doZoom(offset, width, rawSize, outSize, &raw[i * rawSize], expected.data());
+            if (!std::equal(expected.begin(), expected.end(), &out[i * outSize])) {
+                flog::error("Redraw at offset {}, width {}: row {} differs from doZoom", offset, width, i);
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (threads >= 0 && threadCount() != threads) {
+        flog::error("Redraws went from {} to {} threads", threads, threadCount());
+        ok = false;
+    }
+    return ok;
+}
+
+static void setup_waterfall_pyramid() {
+    bool ok = true;
+    for (int rawSize : { 4096, 3000, 131072 }) {
+        for (int outSize : { 1000, 733, 100 }) {
+            // Whole band, zoomed spans of every shape, zoomed past one bin per pixel
+            for (int width : { rawSize, rawSize - 1, rawSize / 2 + 77, 1537, 1000, 999, 300 }) {
+                if (width > rawSize) { continue; }
+                // Panned to both edges and in between, the last one runs past the end of the row
+                for (int offset : { 0, 1, 63, (rawSize - width) / 3, rawSize - width, rawSize - width / 2 }) {
+                    ok &= checkZoom(rawSize, offset, width, outSize);
+                }
+            }
+        }
+    }
+    ok &= checkRedraw();
+    if (!ok) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(waterfall_pyramid, ::setup_waterfall_pyramid);
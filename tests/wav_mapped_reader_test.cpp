@@ -0,0 +1,80 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../core/src/utils/wav.h"
+#include "../core/src/utils/flog.h"
+#include "test_utils.h"
+
+#include "test_runner.h"
+
+// Mapped playback path of the file source: files of every recorder sample type must come back from
+// readComplex() at any position, without going through the stream reader.
+
+static const int MAP_SAMPLES = 1 << 20;
+static const int MAP_READ = 4096;
+
+static dsp::complex_t expectedSample(uint64_t i) {
+    return { 0.9f * (float)sin(i * 0.001), 0.9f * (float)cos(i * 0.0007) };
+}
+
+static bool checkType(wav::SampleType type, float tolerance, const char* path) {
+    std::vector<dsp::complex_t> buf(MAP_READ);
+    wav::Writer writer(2, 48000, wav::FORMAT_WAV, type);
+    if (!writer.open(path)) { return false; }
+    for (uint64_t i = 0; i < MAP_SAMPLES; i += MAP_READ) {
+        for (int j = 0; j < MAP_READ; j++) { buf[j] = expectedSample(i + j); }
+        writer.write((float*)buf.data(), MAP_READ);
+    }
+    writer.close();
+
+    wav::Reader reader(path);
+    if (!reader.map() || reader.getSampleCount() != MAP_SAMPLES) {
+        flog::error("Sample type {} could not be mapped", (int)type);
+        return false;
+    }
+
+    // Random positions, and reads running into the end of the data
+    uint64_t positions[] = { 0, 12345, MAP_SAMPLES / 2 + 7, 777, MAP_SAMPLES - MAP_READ / 2 };
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t pos : positions) {
+        int count = reader.readComplex(buf.data(), pos, MAP_READ);
+        int expectedCount = std::min<uint64_t>(MAP_READ, MAP_SAMPLES - pos);
+        if (count != expectedCount) {
+            flog::error("Sample type {} read {} samples at {}, expected {}", (int)type, count, pos, expectedCount);
+            return false;
+        }
+        for (int j = 0; j < count; j++) {
+            dsp::complex_t e = expectedSample(pos + j);
+            if (fabsf(buf[j].re - e.re) > tolerance || fabsf(buf[j].im - e.im) > tolerance) {
+                flog::error("Sample type {} sample {} is {} {}, expected {} {}", (int)type, pos + j, buf[j].re, buf[j].im, e.re, e.im);
+                return false;
+            }
+        }
+    }
+
+    // Whole file front to back
+    uint64_t total = 0;
+    for (uint64_t pos = 0; pos < MAP_SAMPLES; pos += MAP_READ) { total += reader.readComplex(buf.data(), pos, MAP_READ); }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    flog::info("wav_mapped_reader: sample type {}: {} MS/s", (int)type, total / seconds / 1e6);
+    if (reader.readComplex(buf.data(), MAP_SAMPLES, MAP_READ) != 0) {
+        flog::error("Read past the end of the data");
+        return false;
+    }
+
+    reader.close();
+    remove(path);
+    return true;
+}
+
+static void setup_wav_mapped_reader() {
+    if (!checkType(wav::SAMP_TYPE_FLOAT32, 1e-6f, "wav_mapped_reader_f32.wav")) { sdrpp::test::failed = true; }
+    if (!checkType(wav::SAMP_TYPE_INT16, 2.0f / 32768.0f, "wav_mapped_reader_i16.wav")) { sdrpp::test::failed = true; }
+    if (!checkType(wav::SAMP_TYPE_UINT8, 2.0f / 128.0f, "wav_mapped_reader_u8.wav")) { sdrpp::test::failed = true; }
+
+    // Nothing to render, exit on the first frame
+    sdrpp::test::renderLoopHook.verifyResultsFrames = 1;
+}
+
+REGISTER_TEST(wav_mapped_reader, ::setup_wav_mapped_reader);